@@ -18,7 +18,81 @@
 
 #include "libmseed.h"
 
+#if !defined(LMP_WIN32)
+  #include <pthread.h>
+  #define MSFP_READAHEAD 1
+#endif
+
 static int ms_fread (char *buf, int size, int num, FILE *stream);
+static int msfp_read (MSFileParam *msfp, char *buf, int size);
+static int msfp_eof (MSFileParam *msfp);
+static off_t msfp_tell (MSFileParam *msfp);
+static int msfp_seek (MSFileParam *msfp, off_t offset);
+static int msfp_readahead_start (MSFileParam *msfp, int count, int size);
+static void msfp_readahead_stop (MSFileParam *msfp);
+static int msfp_filter_open (MSFileParam *msfp, flag verbose);
+static int msfp_filter_read (struct MSFilterStream_s *fs, char *buf, int size);
+static void msfp_filter_close (MSFileParam *msfp);
+
+/* Read-ahead configuration, set with MS_READAHEAD(COUNT,SIZE) */
+int readaheadcount = 0;
+int readaheadsize  = 0;
+
+/* Read-ahead used for filtered input when not configured, decoding
+ * is then done by the read-ahead thread */
+#define MSFILTERREADAHEADCOUNT 4
+#define MSFILTERREADAHEADSIZE 262144
+
+/* Registered input filters, added with ms_addinputfilter() */
+#define MSMAXFILTERS 8
+static const MSInputFilter *inputfilters[MSMAXFILTERS];
+static int inputfiltercount = 0;
+
+/* Size of buffer for unfiltered input */
+#define MSFILTERINLEN 65536
+
+/* Input filter state, unfiltered input is read from the file into a
+ * buffer and decoded by the filter on demand. */
+struct MSFilterStream_s
+{
+  const MSInputFilter *filter;
+  void *handle;            /* Decoder handle returned by filter open() */
+  FILE *fp;
+  char *inbuf;             /* Buffer of unfiltered input */
+  int inlen;               /* Length of data in input buffer */
+  int inpos;               /* Offset of next unconsumed byte in input buffer */
+  int ineof;               /* End of unfiltered input reached */
+  int end;                 /* End of filtered data reached */
+  int error;               /* Read or decode error */
+  off_t position;          /* Filtered position of next byte */
+};
+
+#if defined(MSFP_READAHEAD)
+/* Read-ahead state, a ring of buffers filled by a background thread.
+ * Buffers in the ring from head to tail are filled and owned by the
+ * consumer, all others are owned by the filling thread. */
+struct MSReadAhead_s
+{
+  pthread_t thread;
+  pthread_mutex_t lock;
+  pthread_cond_t filled;   /* Signaled when a buffer has been filled */
+  pthread_cond_t emptied;  /* Signaled when a buffer has been consumed */
+  FILE *fp;
+  struct MSFilterStream_s *filter; /* Input filter, read through instead of fp if set */
+  int count;               /* Number of buffers in ring */
+  int size;                /* Size of each buffer */
+  char **buffers;          /* Ring of buffers */
+  int *lengths;            /* Length of data in each buffer */
+  int head;                /* Next buffer to consume */
+  int tail;                /* Next buffer to fill */
+  int filledcount;         /* Number of filled buffers */
+  int consumed;            /* Bytes consumed from head buffer */
+  int eof;                 /* End of file reached by filling thread */
+  int error;               /* Read error in filling thread */
+  int stop;                /* Stop request for filling thread */
+  off_t position;          /* File position of next byte to consume */
+};
+#endif
 
 /* Pack type parameters for the 8 defined types:
  * [type] : [hdrlen] [sizelen] [chksumlen]
@@ -84,7 +158,7 @@ int8_t packtypes[9][3] = {
  *********************************************************************/
 
 /* Initialize the global file reading parameters */
-MSFileParam gMSFileParam = {NULL, "", NULL, 0, 0, 0, 0, 0, 0, 0};
+MSFileParam gMSFileParam = {NULL, "", NULL, 0, 0, 0, 0, 0, 0, 0, NULL, NULL};
 
 /**********************************************************************
  * ms_readmsr:
@@ -126,48 +200,85 @@ ms_readmsr_r (MSFileParam **ppmsfp, MSRecord **ppmsr, const char *msfile,
                           last, skipnotdata, dataflag, NULL, verbose);
 } /* End of ms_readmsr_r() */
 
+/* The file reading buffer for a MSFP is a ring of MSFPRINGLEN bytes
+ * followed by an overhang of MAXRECLEN bytes.  Unprocessed data
+ * starts at readoffset and continues for readlen bytes, wrapping
+ * around the end of the ring.  Records are parsed in place, only the
+ * part of a record that wraps around the end of the ring is copied
+ * into the overhang to make the record contiguous. */
+#define MSFPRINGLEN MAXRECLEN
+
+/* Macro to calculate length of unprocessed buffer */
+#define MSFPBUFLEN(MSFP) (MSFP->readlen)
+
+/* Macro to return current reading position */
+#define MSFPREADPTR(MSFP) (MSFP->rawrec + MSFP->readoffset)
+
 /**********************************************************************
- * ms_shift_msfp:
+ * msfp_consume:
  *
- * A helper routine to shift (remove bytes from the beginning of) the
- * file reading buffer for a MSFP.  The buffer length, reading offset
- * and file position indicators are all updated as necessary.
+ * A helper routine to consume (mark as processed) bytes from the
+ * beginning of the unprocessed data in the file reading buffer for a
+ * MSFP.  The buffer length, reading offset and file position
+ * indicators are all updated as necessary.  No data is moved.
  *
  *********************************************************************/
 static void
-ms_shift_msfp (MSFileParam *msfp, int shift)
+msfp_consume (MSFileParam *msfp, int count)
 {
   if (!msfp)
     return;
 
-  if (shift <= 0 && shift > msfp->readlen)
+  if (count < 0 || count > msfp->readlen)
   {
-    ms_log (2, "ms_shift_msfp(): Cannot shift buffer, shift: %d, readlen: %d, readoffset: %d\n",
-            shift, msfp->readlen, msfp->readoffset);
+    ms_log (2, "msfp_consume(): Cannot consume buffer, count: %d, readlen: %d, readoffset: %d\n",
+            count, msfp->readlen, msfp->readoffset);
     return;
   }
 
-  memmove (msfp->rawrec, msfp->rawrec + shift, msfp->readlen - shift);
-  msfp->readlen -= shift;
+  msfp->readoffset = (msfp->readoffset + count) % MSFPRINGLEN;
+  msfp->readlen -= count;
+  msfp->filepos += count;
 
-  if (shift < msfp->readoffset)
-  {
-    msfp->readoffset -= shift;
-  }
-  else
-  {
-    msfp->filepos += (shift - msfp->readoffset);
+  /* Restart at the beginning of the ring when empty to maximize contiguous reads */
+  if (msfp->readlen == 0)
     msfp->readoffset = 0;
-  }
 
   return;
-} /* End of ms_shift_msfp() */
+} /* End of msfp_consume() */
 
-/* Macro to calculate length of unprocessed buffer */
-#define MSFPBUFLEN(MSFP) (MSFP->readlen - MSFP->readoffset)
+/**********************************************************************
+ * msfp_view:
+ *
+ * A helper routine to make at least want bytes (or all unprocessed
+ * bytes if fewer) contiguous at the reading position of the file
+ * reading buffer for a MSFP.  When the unprocessed data wraps around
+ * the end of the ring the needed bytes from the beginning of the ring
+ * are copied into the overhang.
+ *
+ * Returns the number of contiguous bytes at the reading position.
+ *********************************************************************/
+static int
+msfp_view (MSFileParam *msfp, int want)
+{
+  int contiguous = MSFPRINGLEN - msfp->readoffset;
 
-/* Macro to return current reading position */
-#define MSFPREADPTR(MSFP) (MSFP->rawrec + MSFP->readoffset)
+  if (msfp->readlen <= contiguous)
+    return msfp->readlen;
+
+  if (want > msfp->readlen)
+    want = msfp->readlen;
+
+  if (want > MSFPRINGLEN + MAXRECLEN - msfp->readoffset)
+    want = MSFPRINGLEN + MAXRECLEN - msfp->readoffset;
+
+  if (want <= contiguous)
+    return contiguous;
+
+  memcpy (msfp->rawrec + MSFPRINGLEN, msfp->rawrec, want - contiguous);
+
+  return want;
+} /* End of msfp_view() */
 
 /**********************************************************************
  * ms_readmsr_main:
@@ -202,9 +313,10 @@ ms_shift_msfp (MSFileParam *msfp, int shift)
  *
  * dataflag will be passed directly to msr_unpack().
  *
- * If a Selections list is supplied it will be used to determine when
- * a section of data in a packed file may be skipped, packed files are
- * internal to the IRIS DMC.
+ * If a Selections list is supplied only records matching it are
+ * returned, it will also be used to determine when a section of data
+ * in a packed file may be skipped, packed files are internal to the
+ * IRIS DMC.
  *
  * After reading all the records in a file the controlling program
  * should call it one last time with msfile set to NULL.  This will
@@ -226,6 +338,9 @@ ms_readmsr_main (MSFileParam **ppmsfp, MSRecord **ppmsr, const char *msfile,
   int parseval  = 0;
   int readsize  = 0;
   int readcount = 0;
+  int readpos   = 0;
+  int viewlen   = 0;
+  int want      = MINRECLEN;
   int retcode   = MS_NOERROR;
 
   if (!ppmsr)
@@ -260,6 +375,8 @@ ms_readmsr_main (MSFileParam **ppmsfp, MSRecord **ppmsr, const char *msfile,
     msfp->filepos       = 0;
     msfp->filesize      = 0;
     msfp->recordcount   = 0;
+    msfp->readahead     = NULL;
+    msfp->filter        = NULL;
   }
 
   /* When cleanup is requested */
@@ -267,6 +384,9 @@ ms_readmsr_main (MSFileParam **ppmsfp, MSRecord **ppmsr, const char *msfile,
   {
     msr_free (ppmsr);
 
+    msfp_readahead_stop (msfp);
+    msfp_filter_close (msfp);
+
     if (msfp->fp != NULL)
       fclose (msfp->fp);
 
@@ -286,6 +406,8 @@ ms_readmsr_main (MSFileParam **ppmsfp, MSRecord **ppmsr, const char *msfile,
       gMSFileParam.filepos       = 0;
       gMSFileParam.filesize      = 0;
       gMSFileParam.recordcount   = 0;
+      gMSFileParam.readahead     = NULL;
+      gMSFileParam.filter        = NULL;
     }
     /* Otherwise free the MSFileParam */
     else
@@ -300,7 +422,7 @@ ms_readmsr_main (MSFileParam **ppmsfp, MSRecord **ppmsr, const char *msfile,
   /* Allocate reading buffer */
   if (msfp->rawrec == NULL)
   {
-    if (!(msfp->rawrec = (char *)malloc (MAXRECLEN)))
+    if (!(msfp->rawrec = (char *)malloc (MSFPRINGLEN + MAXRECLEN)))
     {
       ms_log (2, "ms_readmsr_main(): Cannot allocate memory for read buffer\n");
       return MS_GENERROR;
@@ -312,6 +434,9 @@ ms_readmsr_main (MSFileParam **ppmsfp, MSRecord **ppmsr, const char *msfile,
   {
     ms_log (2, "ms_readmsr_main() called with a different file name without being reset\n");
 
+    msfp_readahead_stop (msfp);
+    msfp_filter_close (msfp);
+
     /* Close previous file and reset needed variables */
     if (msfp->fp != NULL)
       fclose (msfp->fp);
@@ -362,15 +487,41 @@ ms_readmsr_main (MSFileParam **ppmsfp, MSRecord **ppmsr, const char *msfile,
         msfp->filesize = sbuf.st_size;
       }
     }
+
+    /* Detect filtered (e.g. compressed) input if any filters are registered */
+    if (inputfiltercount > 0 && msfp_filter_open (msfp, verbose))
+    {
+      if (msfp->fp != stdin)
+        fclose (msfp->fp);
+      msfp->fp = NULL;
+      msr_free (ppmsr);
+
+      return MS_GENERROR;
+    }
+
+    /* Start read-ahead if configured or to decode filtered input on a
+     * separate thread, failure falls back to direct reading */
+    if (readaheadcount > 0 && readaheadsize > 0)
+      msfp_readahead_start (msfp, readaheadcount, readaheadsize);
+    else if (msfp->filter)
+      msfp_readahead_start (msfp, MSFILTERREADAHEADCOUNT, MSFILTERREADAHEADSIZE);
   }
 
   /* Seek to a specified offset if requested */
   if (fpos != NULL && *fpos < 0)
   {
+    /* Filtered input cannot be positioned */
+    if (msfp->filter)
+    {
+      ms_log (2, "Cannot seek in %s input: %s\n", msfp->filter->filter->name, msfile);
+
+      return MS_GENERROR;
+    }
+
     /* Only try to seek in real files, not stdin */
     if (msfp->fp != stdin)
     {
-      if (lmp_fseeko (msfp->fp, *fpos * -1, SEEK_SET))
+      if (msfp_seek (msfp, *fpos * -1))
       {
         ms_log (2, "Cannot seek in file: %s (%s)\n", msfile, strerror (errno));
 
@@ -391,30 +542,24 @@ ms_readmsr_main (MSFileParam **ppmsfp, MSRecord **ppmsr, const char *msfile,
   for (;;)
   {
     /* Read more data into buffer if not at EOF and buffer has less than MINRECLEN
-       * or more data is needed for the current record detected in buffer. */
-    if (!feof (msfp->fp) && (MSFPBUFLEN (msfp) < MINRECLEN || parseval > 0))
+     * or more data is needed for the current record detected in buffer. */
+    if (!msfp_eof (msfp) && (MSFPBUFLEN (msfp) < MINRECLEN || MSFPBUFLEN (msfp) < want) &&
+        MSFPBUFLEN (msfp) < MSFPRINGLEN)
     {
-      /* Reset offsets if no unprocessed data in buffer */
-      if (MSFPBUFLEN (msfp) <= 0)
-      {
-        msfp->readlen    = 0;
-        msfp->readoffset = 0;
-      }
-      /* Otherwise shift existing data to beginning of buffer */
-      else if (msfp->readoffset > 0)
-      {
-        ms_shift_msfp (msfp, msfp->readoffset);
-      }
+      /* Determine read position and size, up to the end of the ring or the unprocessed data */
+      readpos = (msfp->readoffset + msfp->readlen) % MSFPRINGLEN;
 
-      /* Determine read size */
-      readsize = (MAXRECLEN - msfp->readlen);
+      if (readpos >= msfp->readoffset)
+        readsize = MSFPRINGLEN - readpos;
+      else
+        readsize = msfp->readoffset - readpos;
 
       /* Read data into record buffer */
-      readcount = ms_fread (msfp->rawrec + msfp->readlen, 1, readsize, msfp->fp);
+      readcount = msfp_read (msfp, msfp->rawrec + readpos, readsize);
 
       if (readcount != readsize)
       {
-        if (!feof (msfp->fp))
+        if (!msfp_eof (msfp))
         {
           ms_log (2, "Short read of %d bytes starting from %" PRId64 "\n",
                   readsize, msfp->filepos);
@@ -428,11 +573,14 @@ ms_readmsr_main (MSFileParam **ppmsfp, MSRecord **ppmsr, const char *msfile,
 
       /* File position corresponding to start of buffer; not strictly necessary */
       if (msfp->fp != stdin)
-        msfp->filepos = lmp_ftello (msfp->fp) - msfp->readlen;
+        msfp->filepos = msfp_tell (msfp) - msfp->readlen;
     }
 
+    /* Make sure the beginning of the unprocessed data is contiguous */
+    viewlen = msfp_view (msfp, MINRECLEN);
+
     /* Test for packed file signature at the beginning of the file */
-    if (msfp->filepos == 0 && *(MSFPREADPTR (msfp)) == 'P' && MSFPBUFLEN (msfp) >= 48)
+    if (msfp->filepos == 0 && *(MSFPREADPTR (msfp)) == 'P' && viewlen >= 48)
     {
       msfp->packtype = 0;
 
@@ -453,7 +601,7 @@ ms_readmsr_main (MSFileParam **ppmsfp, MSRecord **ppmsr, const char *msfile,
     }
 
     /* Read pack headers, initial and subsequent headers including (ignored) chksum values */
-    if (msfp->packtype && (msfp->packtype < 0 || msfp->filepos == msfp->packhdroffset) && MSFPBUFLEN (msfp) >= 48)
+    if (msfp->packtype && (msfp->packtype < 0 || msfp->filepos == msfp->packhdroffset) && viewlen >= 48)
     {
       char hdrstr[30];
       int64_t datasize;
@@ -481,13 +629,15 @@ ms_readmsr_main (MSFileParam **ppmsfp, MSRecord **ppmsr, const char *msfile,
                 (msfp->filepos + packskipsize), packdatasize,
                 msfp->packhdroffset);
 
-      /* Shift buffer to new reading offset (aligns records in buffer) */
-      ms_shift_msfp (msfp, msfp->readoffset + (packskipsize + packtypes[msfp->packtype][0]));
+      /* Move to new reading offset (aligns records in buffer) */
+      msfp_consume (msfp, packskipsize + packtypes[msfp->packtype][0]);
+      viewlen = msfp_view (msfp, MINRECLEN);
     } /* End of packed header processing */
 
     /* Check for match if selections are supplied and pack header was read, */
     /* only when enough data is in buffer and not reading from stdin pipe */
-    if (selections && msfp->packtype && packdatasize && MSFPBUFLEN (msfp) >= 48 && msfp->fp != stdin)
+    if (selections && msfp->packtype && packdatasize && viewlen >= 48 &&
+        msfp->fp != stdin && !msfp->filter)
     {
       char srcname[100];
 
@@ -504,9 +654,8 @@ ms_readmsr_main (MSFileParam **ppmsfp, MSRecord **ppmsr, const char *msfile,
                     srcname, (msfp->packhdroffset - msfp->filepos), msfp->filepos);
           }
 
-          msfp->readoffset += (msfp->packhdroffset - msfp->filepos);
-          msfp->filepos = msfp->packhdroffset;
-          packdatasize  = 0;
+          msfp_consume (msfp, (int)(msfp->packhdroffset - msfp->filepos));
+          packdatasize = 0;
         }
 
         /* Otherwise seek to next pack header and reset reading position */
@@ -518,7 +667,7 @@ ms_readmsr_main (MSFileParam **ppmsfp, MSRecord **ppmsr, const char *msfile,
                     srcname, (msfp->packhdroffset - msfp->filepos), msfp->filepos);
           }
 
-          if (lmp_fseeko (msfp->fp, msfp->packhdroffset, SEEK_SET))
+          if (msfp_seek (msfp, msfp->packhdroffset))
           {
             ms_log (2, "Cannot seek in file: %s (%s)\n", msfile, strerror (errno));
 
@@ -540,10 +689,11 @@ ms_readmsr_main (MSFileParam **ppmsfp, MSRecord **ppmsr, const char *msfile,
     /* Attempt to parse record from buffer */
     if (MSFPBUFLEN (msfp) >= MINRECLEN)
     {
-      int parselen = MSFPBUFLEN (msfp);
+      /* Parse all contiguous data, at least the amount wanted */
+      int parselen = msfp_view (msfp, want);
 
       /* Limit the parse length to offset of pack header if present in the buffer */
-      if (msfp->packhdroffset && msfp->packhdroffset < (msfp->filepos + MSFPBUFLEN (msfp)))
+      if (msfp->packhdroffset && msfp->packhdroffset < (msfp->filepos + parselen))
         parselen = msfp->packhdroffset - msfp->filepos;
 
       parseval = msr_parse (MSFPREADPTR (msfp), parselen, ppmsr, reclen, dataflag, verbose);
@@ -554,6 +704,18 @@ ms_readmsr_main (MSFileParam **ppmsfp, MSRecord **ppmsr, const char *msfile,
         if (verbose > 1)
           ms_log (1, "Read record length of %d bytes\n", (*ppmsr)->reclen);
 
+        /* A record longer than the remaining data, parsed with a length implied
+         * by the end of the file, is a truncated record */
+        if ((*ppmsr)->reclen > MSFPBUFLEN (msfp))
+        {
+          if (verbose)
+            ms_log (1, "Truncated record at byte offset %" PRId64 ", record length %d: %s\n",
+                    msfp->filepos, (*ppmsr)->reclen, msfile);
+
+          retcode = MS_ENDOFFILE;
+          break;
+        }
+
         /* Test if this is the last record if file size is known (not pipe) */
         if (last && msfp->filesize)
           if ((msfp->filesize - (msfp->filepos + (*ppmsr)->reclen)) < MINRECLEN)
@@ -564,10 +726,18 @@ ms_readmsr_main (MSFileParam **ppmsfp, MSRecord **ppmsr, const char *msfile,
           *fpos = msfp->filepos;
 
         /* Update reading offset, file position and record count */
-        msfp->readoffset += (*ppmsr)->reclen;
-        msfp->filepos += (*ppmsr)->reclen;
+        msfp_consume (msfp, (*ppmsr)->reclen);
         msfp->recordcount++;
 
+        /* Skip records not matching the selections */
+        if (selections && !msr_matchselect (selections, *ppmsr, NULL))
+        {
+          if (last)
+            *last = 0;
+          want = MINRECLEN;
+          continue;
+        }
+
         retcode = MS_NOERROR;
         break;
       }
@@ -587,8 +757,8 @@ ms_readmsr_main (MSFileParam **ppmsfp, MSRecord **ppmsr, const char *msfile,
           }
 
           /* Skip MINRECLEN bytes, update reading offset and file position */
-          msfp->readoffset += MINRECLEN;
-          msfp->filepos += MINRECLEN;
+          msfp_consume (msfp, MINRECLEN);
+          want = MINRECLEN;
         }
         /* Parsing errors */
         else
@@ -597,7 +767,7 @@ ms_readmsr_main (MSFileParam **ppmsfp, MSRecord **ppmsr, const char *msfile,
                   msfp->filepos, msfile);
 
           /* Print common errors and raw details if verbose */
-          ms_parse_raw (MSFPREADPTR (msfp), MSFPBUFLEN (msfp), verbose, -1);
+          ms_parse_raw (MSFPREADPTR (msfp), parselen, verbose, -1);
 
           retcode = parseval;
           break;
@@ -608,14 +778,17 @@ ms_readmsr_main (MSFileParam **ppmsfp, MSRecord **ppmsr, const char *msfile,
         /* Determine implied record length if needed */
         int32_t impreclen = reclen;
 
+        /* Wanted amount of contiguous data for the next parse attempt */
+        want = parselen + parseval;
+
         /* Check for parse hints that are larger than MAXRECLEN */
-        if ((MSFPBUFLEN (msfp) + parseval) > MAXRECLEN)
+        if ((parselen + parseval) > MAXRECLEN)
         {
           if (skipnotdata)
           {
             /* Skip MINRECLEN bytes, update reading offset and file position */
-            msfp->readoffset += MINRECLEN;
-            msfp->filepos += MINRECLEN;
+            msfp_consume (msfp, MINRECLEN);
+            want = MINRECLEN;
           }
           else
           {
@@ -647,8 +820,8 @@ ms_readmsr_main (MSFileParam **ppmsfp, MSRecord **ppmsr, const char *msfile,
           }
         }
 
-        /* End of file check */
-        else if (impreclen <= 0 && feof (msfp->fp))
+        /* End of file check, only when all unprocessed data was parsed */
+        else if (impreclen <= 0 && parselen >= MSFPBUFLEN (msfp) && msfp_eof (msfp))
         {
           impreclen = msfp->filesize - msfp->filepos;
 
@@ -979,6 +1152,546 @@ ms_fread (char *buf, int size, int num, FILE *stream)
   return read;
 } /* End of ms_fread() */
 
+/*********************************************************************
+ * msfp_read:
+ *
+ * Read size bytes into buf from the file associated with a MSFP.
+ * When read-ahead is active the data is copied from the ring of
+ * buffers filled by the background thread, otherwise the file is
+ * read directly or through the input filter.
+ *
+ * Returns the number of bytes read, less than size only on end of
+ * file or error.
+ *********************************************************************/
+static int
+msfp_read (MSFileParam *msfp, char *buf, int size)
+{
+#if defined(MSFP_READAHEAD)
+  struct MSReadAhead_s *ra = msfp->readahead;
+  int total = 0;
+  int copy;
+  int idx;
+
+  if (!ra)
+  {
+    if (msfp->filter)
+      return msfp_filter_read (msfp->filter, buf, size);
+
+    return ms_fread (buf, 1, size, msfp->fp);
+  }
+
+  pthread_mutex_lock (&ra->lock);
+
+  while (total < size)
+  {
+    while (ra->filledcount == 0 && !ra->eof && !ra->error)
+      pthread_cond_wait (&ra->filled, &ra->lock);
+
+    if (ra->filledcount == 0)
+      break;
+
+    idx = ra->head;
+    copy = ra->lengths[idx] - ra->consumed;
+    if (copy > (size - total))
+      copy = size - total;
+
+    /* Head buffer is owned by the consumer, copy without holding the lock */
+    pthread_mutex_unlock (&ra->lock);
+    memcpy (buf + total, ra->buffers[idx] + ra->consumed, copy);
+    pthread_mutex_lock (&ra->lock);
+
+    total += copy;
+    ra->consumed += copy;
+    ra->position += copy;
+
+    /* Return exhausted buffer to the filling thread */
+    if (ra->consumed >= ra->lengths[idx])
+    {
+      ra->head = (ra->head + 1) % ra->count;
+      ra->filledcount--;
+      ra->consumed = 0;
+      pthread_cond_signal (&ra->emptied);
+    }
+  }
+
+  if (total < size && ra->error)
+    ms_log (2, "ms_fread(): Cannot read input file\n");
+
+  pthread_mutex_unlock (&ra->lock);
+
+  return total;
+#else
+  if (msfp->filter)
+    return msfp_filter_read (msfp->filter, buf, size);
+
+  return ms_fread (buf, 1, size, msfp->fp);
+#endif
+} /* End of msfp_read() */
+
+/*********************************************************************
+ * msfp_eof:
+ *
+ * Returns non-zero when all data in the file associated with a MSFP
+ * has been read, otherwise 0.
+ *********************************************************************/
+static int
+msfp_eof (MSFileParam *msfp)
+{
+#if defined(MSFP_READAHEAD)
+  struct MSReadAhead_s *ra = msfp->readahead;
+  int eof;
+
+  if (ra)
+  {
+    pthread_mutex_lock (&ra->lock);
+    eof = (ra->eof && ra->filledcount == 0);
+    pthread_mutex_unlock (&ra->lock);
+
+    return eof;
+  }
+#endif
+
+  if (msfp->filter)
+    return msfp->filter->end;
+
+  return feof (msfp->fp);
+} /* End of msfp_eof() */
+
+/*********************************************************************
+ * msfp_tell:
+ *
+ * Returns the file position of the next byte to be returned by
+ * msfp_read() for the file associated with a MSFP.  For filtered
+ * input this is the position in the filtered data.
+ *********************************************************************/
+static off_t
+msfp_tell (MSFileParam *msfp)
+{
+#if defined(MSFP_READAHEAD)
+  if (msfp->readahead)
+    return msfp->readahead->position;
+#endif
+
+  if (msfp->filter)
+    return msfp->filter->position;
+
+  return lmp_ftello (msfp->fp);
+} /* End of msfp_tell() */
+
+/*********************************************************************
+ * msfp_seek:
+ *
+ * Set the reading position of the file associated with a MSFP.  Any
+ * active read-ahead is stopped and restarted from the new position.
+ *
+ * Returns 0 on success and -1 on error.
+ *********************************************************************/
+static int
+msfp_seek (MSFileParam *msfp, off_t offset)
+{
+  int restart = (msfp->readahead != NULL);
+
+  msfp_readahead_stop (msfp);
+
+  if (lmp_fseeko (msfp->fp, offset, SEEK_SET))
+    return -1;
+
+  if (restart)
+    msfp_readahead_start (msfp, readaheadcount, readaheadsize);
+
+  return 0;
+} /* End of msfp_seek() */
+
+#if defined(MSFP_READAHEAD)
+/*********************************************************************
+ * msfp_readahead_thread:
+ *
+ * Read-ahead filling thread, reads the file, or the filtered data
+ * from an input filter, into the ring of buffers until end of file,
+ * error or a stop is requested.
+ *********************************************************************/
+static void *
+msfp_readahead_thread (void *arg)
+{
+  struct MSReadAhead_s *ra = (struct MSReadAhead_s *)arg;
+  int readcount;
+  int done;
+  int idx;
+
+  for (;;)
+  {
+    pthread_mutex_lock (&ra->lock);
+
+    while (ra->filledcount >= ra->count && !ra->stop)
+      pthread_cond_wait (&ra->emptied, &ra->lock);
+
+    if (ra->stop)
+    {
+      pthread_mutex_unlock (&ra->lock);
+      break;
+    }
+
+    idx = ra->tail;
+    pthread_mutex_unlock (&ra->lock);
+
+    /* Tail buffer is owned by this thread, read without holding the lock */
+    if (ra->filter)
+      readcount = msfp_filter_read (ra->filter, ra->buffers[idx], ra->size);
+    else
+      readcount = (int)fread (ra->buffers[idx], 1, ra->size, ra->fp);
+
+    pthread_mutex_lock (&ra->lock);
+
+    if (readcount > 0)
+    {
+      ra->lengths[idx] = readcount;
+      ra->tail = (ra->tail + 1) % ra->count;
+      ra->filledcount++;
+    }
+
+    if (readcount < ra->size)
+    {
+      if ((ra->filter) ? ra->filter->error : ferror (ra->fp))
+        ra->error = 1;
+      else
+        ra->eof = 1;
+    }
+
+    done = (ra->eof || ra->error);
+
+    pthread_cond_signal (&ra->filled);
+    pthread_mutex_unlock (&ra->lock);
+
+    if (done)
+      break;
+  }
+
+  return NULL;
+} /* End of msfp_readahead_thread() */
+#endif
+
+/*********************************************************************
+ * msfp_readahead_start:
+ *
+ * Allocate count read-ahead buffers of size bytes and start the
+ * filling thread for the file associated with a MSFP.
+ *
+ * Returns 0 on success and -1 on error or when read-ahead is not
+ * supported, in which case the file will be read directly.
+ *********************************************************************/
+static int
+msfp_readahead_start (MSFileParam *msfp, int count, int size)
+{
+#if defined(MSFP_READAHEAD)
+  struct MSReadAhead_s *ra;
+  int idx;
+
+  if (!msfp || !msfp->fp || msfp->readahead)
+    return -1;
+
+  if ((ra = (struct MSReadAhead_s *)calloc (1, sizeof (struct MSReadAhead_s))) == NULL ||
+      (ra->buffers = (char **)calloc (count, sizeof (char *))) == NULL ||
+      (ra->lengths = (int *)calloc (count, sizeof (int))) == NULL)
+  {
+    ms_log (2, "msfp_readahead_start(): Cannot allocate memory for read-ahead\n");
+    if (ra)
+      free (ra->buffers);
+    free (ra);
+    return -1;
+  }
+
+  ra->fp = msfp->fp;
+  ra->filter = msfp->filter;
+  ra->count = count;
+  ra->size = size;
+
+  if (msfp->filter)
+    ra->position = msfp->filter->position;
+  else
+    ra->position = (msfp->fp != stdin) ? lmp_ftello (msfp->fp) : 0;
+
+  for (idx = 0; idx < ra->count; idx++)
+  {
+    if ((ra->buffers[idx] = (char *)malloc (ra->size)) == NULL)
+    {
+      ms_log (2, "msfp_readahead_start(): Cannot allocate %d byte read-ahead buffer\n", ra->size);
+      break;
+    }
+  }
+
+  if (idx < ra->count ||
+      pthread_mutex_init (&ra->lock, NULL) ||
+      pthread_cond_init (&ra->filled, NULL) ||
+      pthread_cond_init (&ra->emptied, NULL) ||
+      pthread_create (&ra->thread, NULL, msfp_readahead_thread, ra))
+  {
+    if (idx == ra->count)
+      ms_log (2, "msfp_readahead_start(): Cannot start read-ahead thread\n");
+
+    for (idx = 0; idx < ra->count; idx++)
+      free (ra->buffers[idx]);
+    free (ra->buffers);
+    free (ra->lengths);
+    free (ra);
+    return -1;
+  }
+
+  msfp->readahead = ra;
+
+  return 0;
+#else
+  return -1;
+#endif
+} /* End of msfp_readahead_start() */
+
+/*********************************************************************
+ * msfp_readahead_stop:
+ *
+ * Stop the read-ahead filling thread, if any, for a MSFP and free all
+ * associated memory.  Any data in the ring of buffers is discarded
+ * and the file position is undefined afterwards.
+ *********************************************************************/
+static void
+msfp_readahead_stop (MSFileParam *msfp)
+{
+#if defined(MSFP_READAHEAD)
+  struct MSReadAhead_s *ra;
+  int idx;
+
+  if (!msfp || !msfp->readahead)
+    return;
+
+  ra = msfp->readahead;
+
+  pthread_mutex_lock (&ra->lock);
+  ra->stop = 1;
+  pthread_cond_signal (&ra->emptied);
+  pthread_mutex_unlock (&ra->lock);
+
+  pthread_join (ra->thread, NULL);
+
+  pthread_mutex_destroy (&ra->lock);
+  pthread_cond_destroy (&ra->filled);
+  pthread_cond_destroy (&ra->emptied);
+
+  for (idx = 0; idx < ra->count; idx++)
+    free (ra->buffers[idx]);
+  free (ra->buffers);
+  free (ra->lengths);
+  free (ra);
+
+  msfp->readahead = NULL;
+#endif
+} /* End of msfp_readahead_stop() */
+
+/*********************************************************************
+ * ms_addinputfilter:
+ *
+ * Register an input filter, e.g. a decompressor, to be applied by
+ * ms_readmsr_main() to files that begin with the signature of the
+ * filter.  The filter structure is referenced, not copied, and must
+ * remain valid while files are read.
+ *
+ * Filtered input is read sequentially, seeking to a file position
+ * is not supported and the file size is unknown.  Unless read-ahead
+ * is configured with MS_READAHEAD() the filtered data is decoded by
+ * a read-ahead thread with a default configuration where supported.
+ *
+ * Returns 0 on success and -1 on error.
+ *********************************************************************/
+int
+ms_addinputfilter (const MSInputFilter *filter)
+{
+  if (!filter || !filter->magic || !filter->open || !filter->decode || !filter->close)
+  {
+    ms_log (2, "ms_addinputfilter(): Incomplete input filter\n");
+    return -1;
+  }
+
+  if (filter->magiclen <= 0 || filter->magiclen > MSMAXFILTERMAGIC)
+  {
+    ms_log (2, "ms_addinputfilter(): Signature length for %s filter out of range: %d\n",
+            (filter->name) ? filter->name : "", filter->magiclen);
+    return -1;
+  }
+
+  if (inputfiltercount >= MSMAXFILTERS)
+  {
+    ms_log (2, "ms_addinputfilter(): Maximum number of input filters (%d) already registered\n",
+            MSMAXFILTERS);
+    return -1;
+  }
+
+  inputfilters[inputfiltercount++] = filter;
+
+  return 0;
+} /* End of ms_addinputfilter() */
+
+/*********************************************************************
+ * msfp_filter_open:
+ *
+ * Read the signature bytes at the beginning of the file associated
+ * with a MSFP and set up the first registered input filter with a
+ * matching signature.  If no filter matches the signature bytes are
+ * placed in the reading buffer as the first unprocessed data, so no
+ * seeking is needed and standard input is supported.
+ *
+ * Returns 0 on success and -1 on error.
+ *********************************************************************/
+static int
+msfp_filter_open (MSFileParam *msfp, flag verbose)
+{
+  struct MSFilterStream_s *fs;
+  const MSInputFilter *filter = NULL;
+  char magic[MSMAXFILTERMAGIC];
+  int magiclen;
+  int idx;
+
+  magiclen = (int)fread (magic, 1, MSMAXFILTERMAGIC, msfp->fp);
+
+  if (magiclen < MSMAXFILTERMAGIC && ferror (msfp->fp))
+  {
+    ms_log (2, "Cannot read input file: %s\n", msfp->filename);
+    return -1;
+  }
+
+  for (idx = 0; idx < inputfiltercount; idx++)
+  {
+    if (magiclen >= inputfilters[idx]->magiclen &&
+        !memcmp (magic, inputfilters[idx]->magic, inputfilters[idx]->magiclen))
+    {
+      filter = inputfilters[idx];
+      break;
+    }
+  }
+
+  /* No filter matched, signature bytes are the first unprocessed data */
+  if (!filter)
+  {
+    memcpy (msfp->rawrec, magic, magiclen);
+    msfp->readoffset = 0;
+    msfp->readlen    = magiclen;
+
+    return 0;
+  }
+
+  if ((fs = (struct MSFilterStream_s *)calloc (1, sizeof (struct MSFilterStream_s))) == NULL ||
+      (fs->inbuf = (char *)malloc (MSFILTERINLEN)) == NULL)
+  {
+    ms_log (2, "msfp_filter_open(): Cannot allocate memory for input filter\n");
+    free (fs);
+    return -1;
+  }
+
+  if ((fs->handle = filter->open ()) == NULL)
+  {
+    ms_log (2, "Cannot initialize %s input filter for %s\n", filter->name, msfp->filename);
+    free (fs->inbuf);
+    free (fs);
+    return -1;
+  }
+
+  if (verbose > 1)
+    ms_log (1, "Reading %s input from %s\n", filter->name, msfp->filename);
+
+  fs->filter = filter;
+  fs->fp     = msfp->fp;
+  memcpy (fs->inbuf, magic, magiclen);
+  fs->inlen = magiclen;
+  fs->ineof = feof (msfp->fp);
+
+  msfp->filter = fs;
+
+  /* Size of filtered data is unknown */
+  msfp->filesize = 0;
+
+  return 0;
+} /* End of msfp_filter_open() */
+
+/*********************************************************************
+ * msfp_filter_read:
+ *
+ * Read up to size bytes of filtered data into buf, reading
+ * unfiltered input from the file as needed.
+ *
+ * Returns the number of bytes read, less than size only at the end
+ * of the filtered data or on error.
+ *********************************************************************/
+static int
+msfp_filter_read (struct MSFilterStream_s *fs, char *buf, int size)
+{
+  int total = 0;
+  int inused;
+  int count;
+
+  while (total < size && !fs->end && !fs->error)
+  {
+    /* Refill input buffer when all input has been consumed */
+    if (fs->inpos >= fs->inlen && !fs->ineof)
+    {
+      fs->inlen = (int)fread (fs->inbuf, 1, MSFILTERINLEN, fs->fp);
+      fs->inpos = 0;
+
+      if (fs->inlen < MSFILTERINLEN)
+      {
+        if (ferror (fs->fp))
+        {
+          ms_log (2, "Cannot read %s input file\n", fs->filter->name);
+          fs->error = 1;
+          break;
+        }
+
+        fs->ineof = 1;
+      }
+    }
+
+    inused = 0;
+    count  = fs->filter->decode (fs->handle, fs->inbuf + fs->inpos, fs->inlen - fs->inpos,
+                                 &inused, buf + total, size - total);
+
+    if (count < 0)
+    {
+      ms_log (2, "Cannot decode %s input at byte offset %" PRId64 "\n",
+              fs->filter->name, (int64_t)fs->position);
+      fs->error = 1;
+      break;
+    }
+
+    fs->inpos += inused;
+    fs->position += count;
+    total += count;
+
+    /* End of filtered data, or more input is needed but none remains */
+    if (count == 0 && inused == 0 && (fs->inpos < fs->inlen || fs->ineof))
+      fs->end = 1;
+  }
+
+  return total;
+} /* End of msfp_filter_read() */
+
+/*********************************************************************
+ * msfp_filter_close:
+ *
+ * Free the input filter state, if any, for a MSFP.  The file itself
+ * is not closed.
+ *********************************************************************/
+static void
+msfp_filter_close (MSFileParam *msfp)
+{
+  struct MSFilterStream_s *fs;
+
+  if (!msfp || !msfp->filter)
+    return;
+
+  fs = msfp->filter;
+
+  fs->filter->close (fs->handle);
+  free (fs->inbuf);
+  free (fs);
+
+  msfp->filter = NULL;
+} /* End of msfp_filter_close() */
+
 /***************************************************************************
  * ms_record_handler_int:
  *
@@ -464,6 +464,25 @@ typedef struct StreamState_s
 }
 StreamState;
 
+/* Memory arena of a MSRecord, the blockette chain (links and payloads)
+ * is allocated from a single block that is reused for each record
+ * parsed into the same MSRecord, internal use only */
+typedef struct MSRecordArena_s
+{
+  char     *block;                   /* Block for blockette chain allocations */
+  size_t    size;                    /* Size of block in bytes */
+  size_t    used;                    /* Bytes allocated from block */
+  void     *extra;                   /* List of extra blocks used when block was full */
+  size_t    extrasize;               /* Total size of extra blocks in bytes */
+  void     *datasamples;             /* Sample buffer last allocated by msr_unpack_data() */
+  size_t    datasize;                /* Size of sample buffer in bytes */
+  flag      blktpending;             /* Blockette chain left in record, see MS_UNPACKLAZYBLOCKETTES */
+  flag      blktswapflag;            /* Header byte swapping needed for pending chain */
+  int32_t   blktreclen;              /* Record length used to traverse pending chain */
+  flag      dataswapflag;            /* Data byte swapping needed, as determined by msr_unpack() */
+}
+MSRecordArena;
+
 typedef struct MSRecord_s {
   char           *record;            /* Mini-SEED record */
   int32_t         reclen;            /* Length of Mini-SEED record in bytes */
@@ -495,9 +514,31 @@ typedef struct MSRecord_s {
 
   /* Stream oriented state information */
   StreamState    *ststate;           /* Stream processing state information */
+
+  MSRecordArena  *arena;             /* Memory arena, internal use only */
 }
 MSRecord;
 
+/* Maximum number of samples decoded from a single Steim frame */
+#define MS_STEIMFRAMESAMPLES 105
+
+/* Incremental decoding of the Steim data frames of a record */
+typedef struct MSSteimFrames_s {
+  const char     *frames;            /* Data frames in the record */
+  int32_t         framecount;        /* Number of 64-byte frames */
+  int32_t         frameidx;          /* Index of next frame to decode */
+  int64_t         samplecount;       /* Number of samples remaining to decode */
+  int64_t         decoded;           /* Number of samples decoded */
+  int32_t         X0;                /* Forward integration constant, aka first sample */
+  int32_t         Xn;                /* Reverse integration constant, aka last sample */
+  int32_t         last;              /* Last sample decoded */
+  int8_t          encoding;          /* Data encoding, DE_STEIM1 or DE_STEIM2 */
+  flag            swapflag;          /* Byte swapping of frames needed */
+  flag            finished;          /* Final checks done after the last frame */
+  char            srcname[50];       /* Source name for diagnostics */
+}
+MSSteimFrames;
+
 /* Container for a continuous trace, linkable */
 typedef struct MSTrace_s {
   char            network[11];       /* Network designation, NULL terminated */
@@ -526,6 +567,9 @@ typedef struct MSTraceGroup_s {
 }
 MSTraceGroup;
 
+/* Maximum number of levels in the MSTraceID segment skip lists */
+#define MSTL_SKIPLEVELS 16
+
 /* Container for a continuous trace segment, linkable */
 typedef struct MSTraceSeg_s {
   hptime_t        starttime;         /* Time of first sample */
@@ -538,6 +582,8 @@ typedef struct MSTraceSeg_s {
   void           *prvtptr;           /* Private pointer for general use, unused by libmseed */
   struct MSTraceSeg_s *prev;         /* Pointer to previous segment */
   struct MSTraceSeg_s *next;         /* Pointer to next segment */
+  struct MSTraceSeg_s **skipnext;    /* Skip list links above next, internal use only */
+  int8_t          skiplevels;        /* Skip list levels of segment, internal use only */
 }
 MSTraceSeg;
 
@@ -557,6 +603,10 @@ typedef struct MSTraceID_s {
   struct MSTraceSeg_s *first;        /* Pointer to first of list of segments */
   struct MSTraceSeg_s *last;         /* Pointer to last of list of segments */
   struct MSTraceID_s *next;          /* Pointer to next trace */
+  struct MSTraceSeg_s *skiphead[MSTL_SKIPLEVELS-1]; /* Skip list heads above first, internal use only */
+  int8_t          skiplevels;        /* Skip list levels in use, internal use only */
+  hptime_t        maxspan;           /* Longest segment time span, internal use only */
+  struct MSTraceID_s *hashnext;      /* Next trace in hash table bucket, internal use only */
 }
 MSTraceID;
 
@@ -565,6 +615,9 @@ typedef struct MSTraceList_s {
   int32_t             numtraces;     /* Number of traces in list */
   struct MSTraceID_s *traces;        /* Pointer to list of traces */
   struct MSTraceID_s *last;          /* Pointer to last used trace in list */
+  struct MSTraceID_s **idhash;       /* Hash table of traces by source name, internal use only */
+  int32_t             idhashsize;    /* Number of hash table buckets, internal use only */
+  uint32_t            skiprand;      /* Skip list level generator state, internal use only */
 }
 MSTraceList;
 
@@ -604,6 +657,11 @@ extern int unpackencodingfallback;
 #define MS_UNPACKENCODINGFORMAT(X) (unpackencodingformat = X);
 #define MS_UNPACKENCODINGFALLBACK(X) (unpackencodingfallback = X);
 
+/* Global variable (defined in unpack.c) and macro to leave the
+ * blockette chain in the record, decoded on demand */
+extern flag unpacklazyblockettes;
+#define MS_UNPACKLAZYBLOCKETTES(X) (unpacklazyblockettes = X);
+
 /* Mini-SEED record related functions */
 extern int           msr_parse (char *record, int recbuflen, MSRecord **ppmsr, int reclen,
 				flag dataflag, flag verbose);
@@ -622,11 +680,19 @@ extern int           msr_pack_header (MSRecord *msr, flag normalize, flag verbos
 
 extern int           msr_unpack_data (MSRecord *msr, int swapflag, flag verbose);
 
+extern int           msr_steimframes (MSRecord *msr, MSSteimFrames *frames);
+
+extern int           msr_decode_steimframe (MSSteimFrames *frames, int32_t *output);
+
+extern int           msr_decode_blockettes (MSRecord *msr, flag verbose);
+
 extern MSRecord*     msr_init (MSRecord *msr);
 extern void          msr_free (MSRecord **ppmsr);
 extern void          msr_free_blktchain (MSRecord *msr);
+extern void          msr_arena_free (MSRecord *msr);
 extern BlktLink*     msr_addblockette (MSRecord *msr, char *blktdata, int length,
 				       int blkttype, int chainpos);
+extern void*         msr_getblockette (MSRecord *msr, uint16_t blkttype);
 extern int           msr_normalize_header (MSRecord *msr, flag verbose);
 extern MSRecord*     msr_duplicate (MSRecord *msr, flag datadup);
 extern double        msr_samprate (MSRecord *msr);
@@ -683,6 +749,7 @@ extern MSTraceList * mstl_init ( MSTraceList *mstl );
 extern void          mstl_free ( MSTraceList **ppmstl, flag freeprvtptr );
 extern MSTraceSeg *  mstl_addmsr ( MSTraceList *mstl, MSRecord *msr, flag dataquality,
 				   flag autoheal, double timetol, double sampratetol );
+extern int           mstl_heal ( MSTraceList *mstl, double timetol, double sampratetol );
 extern int           mstl_convertsamples ( MSTraceSeg *seg, char type, flag truncate );
 extern void          mstl_printtracelist ( MSTraceList *mstl, flag timeformat,
 					   flag details, flag gaps );
@@ -703,8 +770,37 @@ typedef struct MSFileParam_s
   off_t filepos;
   off_t filesize;
   int   recordcount;
+  struct MSReadAhead_s *readahead; /* Read-ahead state, internal use only */
+  struct MSFilterStream_s *filter; /* Input filter state, internal use only */
 } MSFileParam;
 
+/* Global variables (defined in fileutils.c) and macro to configure
+ * read-ahead, a background thread filling COUNT buffers of SIZE bytes
+ * ahead of record parsing.  A COUNT of 0 disables read-ahead. */
+extern int readaheadcount;
+extern int readaheadsize;
+#define MS_READAHEAD(COUNT,SIZE) (readaheadcount = COUNT, readaheadsize = SIZE);
+
+/* Input filter, e.g. a decompressor, applied by ms_readmsr_main() to
+ * files that begin with the signature (magic bytes) of the filter.
+ * The decode function consumes up to inlen bytes of input, sets
+ * inused to the number of bytes consumed and returns the number of
+ * bytes (up to outsize) written to out, or a negative value on error.
+ * Returning 0 without consuming input indicates the end of the data. */
+#define MSMAXFILTERMAGIC 8
+typedef struct MSInputFilter_s
+{
+  const char *name;             /* Name of filter, e.g. "gzip" */
+  const char *magic;            /* Signature at beginning of file */
+  int         magiclen;         /* Length of signature, up to MSMAXFILTERMAGIC */
+  void     *(*open) (void);     /* Create a decoder, returns handle */
+  int       (*decode) (void *handle, const char *in, int inlen, int *inused,
+                       char *out, int outsize);
+  void      (*close) (void *handle); /* Free a decoder */
+} MSInputFilter;
+
+extern int      ms_addinputfilter (const MSInputFilter *filter);
+
 extern int      ms_readmsr (MSRecord **ppmsr, const char *msfile, int reclen, off_t *fpos, int *last,
 			    flag skipnotdata, flag dataflag, flag verbose);
 extern int      ms_readmsr_r (MSFileParam **ppmsfp, MSRecord **ppmsr, const char *msfile, int reclen,
@@ -23,15 +23,17 @@
  * Initialize and return an MSRecord struct, allocating memory if
  * needed.  If memory for the fsdh and datasamples fields has been
  * allocated the pointers will be retained for reuse.  If a blockette
- * chain is present all associated memory will be released.
+ * chain is present it will be released, the memory arena holding it
+ * is retained for reuse.
  *
  * Returns a pointer to a MSRecord struct on success or NULL on error.
  ***************************************************************************/
 MSRecord *
 msr_init (MSRecord *msr)
 {
-  void *fsdh        = 0;
-  void *datasamples = 0;
+  void *fsdh           = 0;
+  void *datasamples    = 0;
+  MSRecordArena *arena = 0;
 
   if (!msr)
   {
@@ -45,6 +47,11 @@ msr_init (MSRecord *msr)
     if (msr->blkts)
       msr_free_blktchain (msr);
 
+    arena = msr->arena;
+
+    if (arena)
+      arena->blktpending = 0;
+
     if (msr->ststate)
       free (msr->ststate);
   }
@@ -59,6 +66,7 @@ msr_init (MSRecord *msr)
 
   msr->fsdh        = fsdh;
   msr->datasamples = datasamples;
+  msr->arena       = arena;
 
   msr->reclen    = -1;
   msr->samplecnt = -1;
@@ -94,18 +102,145 @@ msr_free (MSRecord **ppmsr)
     if ((*ppmsr)->ststate)
       free ((*ppmsr)->ststate);
 
+    /* Free memory arena if present */
+    if ((*ppmsr)->arena)
+      msr_arena_free (*ppmsr);
+
     free (*ppmsr);
 
     *ppmsr = NULL;
   }
 } /* End of msr_free() */
 
+/* Alignment of allocations from a MSRecordArena */
+#define MSR_ARENA_ALIGN(X) (((X) + 7) & ~((size_t)7))
+
+/* Initial size of a MSRecordArena block */
+#define MSR_ARENA_BLOCKSIZE 512
+
+/***************************************************************************
+ * msr_arena_alloc:
+ *
+ * Allocate size bytes from the memory arena of a MSRecord, creating
+ * the arena if needed.  Allocations are released all at once with
+ * msr_arena_reset().  When the block of the arena is full an extra
+ * block is allocated, on reset the block is enlarged to cover all
+ * extra blocks so that no further allocation is needed for records
+ * with a similar blockette chain.
+ *
+ * Returns a pointer to the memory on success and NULL on error.
+ ***************************************************************************/
+static void *
+msr_arena_alloc (MSRecord *msr, size_t size)
+{
+  MSRecordArena *arena;
+  void **extra;
+  void *ptr;
+
+  if (!msr->arena)
+  {
+    if ((msr->arena = (MSRecordArena *)calloc (1, sizeof (MSRecordArena))) == NULL)
+      return NULL;
+  }
+
+  arena = msr->arena;
+  size  = MSR_ARENA_ALIGN (size);
+
+  if (!arena->block)
+  {
+    arena->size = (size > MSR_ARENA_BLOCKSIZE) ? size : MSR_ARENA_BLOCKSIZE;
+
+    if ((arena->block = (char *)malloc (arena->size)) == NULL)
+    {
+      arena->size = 0;
+      return NULL;
+    }
+  }
+
+  if (arena->used + size <= arena->size)
+  {
+    ptr = arena->block + arena->used;
+    arena->used += size;
+    return ptr;
+  }
+
+  /* Extra block, prefixed with the link to the next extra block */
+  if ((extra = (void **)malloc (MSR_ARENA_ALIGN (sizeof (void *)) + size)) == NULL)
+    return NULL;
+
+  *extra       = arena->extra;
+  arena->extra = extra;
+  arena->extrasize += size;
+
+  return (char *)extra + MSR_ARENA_ALIGN (sizeof (void *));
+} /* End of msr_arena_alloc() */
+
+/***************************************************************************
+ * msr_arena_reset:
+ *
+ * Release all allocations from the memory arena of a MSRecord.
+ ***************************************************************************/
+static void
+msr_arena_reset (MSRecord *msr)
+{
+  MSRecordArena *arena = msr->arena;
+  void *extra;
+  char *block;
+
+  if (!arena)
+    return;
+
+  if (arena->extra)
+  {
+    while (arena->extra)
+    {
+      extra = *(void **)arena->extra;
+      free (arena->extra);
+      arena->extra = extra;
+    }
+
+    /* Enlarge block to hold all allocations without extra blocks */
+    if ((block = (char *)malloc (arena->size + arena->extrasize)) != NULL)
+    {
+      free (arena->block);
+      arena->block = block;
+      arena->size += arena->extrasize;
+    }
+
+    arena->extrasize = 0;
+  }
+
+  arena->used = 0;
+} /* End of msr_arena_reset() */
+
+/***************************************************************************
+ * msr_arena_free:
+ *
+ * Free the memory arena of a MSRecord.  The sample buffer referenced
+ * by the arena is owned by the MSRecord and not freed.
+ ***************************************************************************/
+void
+msr_arena_free (MSRecord *msr)
+{
+  if (!msr || !msr->arena)
+    return;
+
+  msr_arena_reset (msr);
+
+  if (msr->arena->block)
+    free (msr->arena->block);
+
+  free (msr->arena);
+  msr->arena = NULL;
+} /* End of msr_arena_free() */
+
 /***************************************************************************
  * msr_free_blktchain:
  *
  * Free all memory associated with a blockette chain in a MSRecord
  * struct and set MSRecord->blkts to NULL.  Also reset the shortcut
- * blockette pointers.
+ * blockette pointers.  The chain is allocated from the memory arena
+ * of the MSRecord, which is reset for reuse.
  ***************************************************************************/
 void
 msr_free_blktchain (MSRecord *msr)
@@ -114,24 +249,14 @@ msr_free_blktchain (MSRecord *msr)
   {
     if (msr->blkts)
     {
-      BlktLink *bc = msr->blkts;
-      BlktLink *nb = NULL;
-
-      while (bc)
-      {
-        nb = bc->next;
-
-        if (bc->blktdata)
-          free (bc->blktdata);
-
-        free (bc);
-
-        bc = nb;
-      }
+      msr_arena_reset (msr);
 
       msr->blkts = 0;
     }
 
+    if (msr->arena)
+      msr->arena->blktpending = 0;
+
     msr->Blkt100  = 0;
     msr->Blkt1000 = 0;
     msr->Blkt1001 = 0;
@@ -157,66 +282,51 @@ msr_addblockette (MSRecord *msr, char *blktdata, int length, int blkttype,
                   int chainpos)
 {
   BlktLink *blkt;
+  BlktLink *last;
 
   if (!msr)
     return NULL;
 
-  blkt = msr->blkts;
+  /* Decode a pending chain first to retain blockette order */
+  if (msr->arena && msr->arena->blktpending)
+    msr_decode_blockettes (msr, 0);
 
-  if (blkt)
-  {
-    if (chainpos != 0)
-    {
-      blkt = (BlktLink *)malloc (sizeof (BlktLink));
-
-      blkt->next = msr->blkts;
-      msr->blkts = blkt;
-    }
-    else
-    {
-      /* Find the last blockette */
-      while (blkt && blkt->next)
-      {
-        blkt = blkt->next;
-      }
+  /* Allocate link and blockette body together from the arena */
+  blkt = (BlktLink *)msr_arena_alloc (msr, MSR_ARENA_ALIGN (sizeof (BlktLink)) + length);
 
-      blkt->next = (BlktLink *)malloc (sizeof (BlktLink));
+  if (blkt == NULL)
+  {
+    ms_log (2, "msr_addblockette(): Cannot allocate memory\n");
+    return NULL;
+  }
 
-      blkt       = blkt->next;
-      blkt->next = 0;
-    }
+  blkt->next = 0;
 
-    if (blkt == NULL)
-    {
-      ms_log (2, "msr_addblockette(): Cannot allocate memory\n");
-      return NULL;
-    }
+  if (!msr->blkts)
+  {
+    msr->blkts = blkt;
+  }
+  else if (chainpos != 0)
+  {
+    blkt->next = msr->blkts;
+    msr->blkts = blkt;
   }
   else
   {
-    msr->blkts = (BlktLink *)malloc (sizeof (BlktLink));
-
-    if (msr->blkts == NULL)
+    /* Find the last blockette */
+    last = msr->blkts;
+    while (last->next)
     {
-      ms_log (2, "msr_addblockette(): Cannot allocate memory\n");
-      return NULL;
+      last = last->next;
     }
 
-    blkt       = msr->blkts;
-    blkt->next = 0;
+    last->next = blkt;
   }
 
   blkt->blktoffset = 0;
   blkt->blkt_type  = blkttype;
   blkt->next_blkt  = 0;
-
-  blkt->blktdata = (char *)malloc (length);
-
-  if (blkt->blktdata == NULL)
-  {
-    ms_log (2, "msr_addblockette(): Cannot allocate memory\n");
-    return NULL;
-  }
+  blkt->blktdata   = (char *)blkt + MSR_ARENA_ALIGN (sizeof (BlktLink));
 
   memcpy (blkt->blktdata, blktdata, length);
   blkt->blktdatalen = length;
@@ -238,6 +348,36 @@ msr_addblockette (MSRecord *msr, char *blktdata, int length, int blkttype,
   return blkt;
 } /* End of msr_addblockette() */
 
+/***************************************************************************
+ * msr_getblockette:
+ *
+ * Find the first blockette of type 'blkttype' in the blockette chain
+ * of an MSRecord.  A blockette chain left in the record by
+ * msr_unpack() with lazy blockette unpacking is decoded first.
+ *
+ * Returns a pointer to the blockette body (BlktLink->blktdata) on
+ * success and NULL if no such blockette is present.
+ ***************************************************************************/
+void *
+msr_getblockette (MSRecord *msr, uint16_t blkttype)
+{
+  BlktLink *blkt;
+
+  if (!msr)
+    return NULL;
+
+  if (msr_decode_blockettes (msr, 0))
+    return NULL;
+
+  for (blkt = msr->blkts; blkt; blkt = blkt->next)
+  {
+    if (blkt->blkt_type == blkttype)
+      return blkt->blktdata;
+  }
+
+  return NULL;
+} /* End of msr_getblockette() */
+
 /***************************************************************************
  * msr_normalize_header:
  *
@@ -263,6 +403,9 @@ msr_normalize_header (MSRecord *msr, flag verbose)
   if (!msr)
     return -1;
 
+  if (msr_decode_blockettes (msr, verbose))
+    return -1;
+
   /* Get start time rounded to tenths of milliseconds and microsecond offset */
   ms_hptime2tomsusecoffset (msr->starttime, &hptimems, &usecoffset);
 
@@ -381,6 +524,10 @@ msr_duplicate (MSRecord *msr, flag datadup)
   if (!msr)
     return NULL;
 
+  /* Decode blockette chain if left in the record by msr_unpack() */
+  if (msr_decode_blockettes (msr, 0))
+    return NULL;
+
   /* Allocate target MSRecord structure */
   if ((dupmsr = msr_init (NULL)) == NULL)
     return NULL;
@@ -393,6 +540,7 @@ msr_duplicate (MSRecord *msr, flag datadup)
   dupmsr->blkts = NULL;
   dupmsr->datasamples = NULL;
   dupmsr->ststate = NULL;
+  dupmsr->arena = NULL;
 
   /* Copy fixed-section data header structure */
   if (msr->fsdh)
@@ -475,7 +623,8 @@ msr_duplicate (MSRecord *msr, flag datadup)
  * specified MSRecord.  If a Blockette 100 was included and parsed,
  * the "Actual sample rate" (field 3) will be returned, otherwise a
  * nominal sample rate will be calculated from the sample rate factor
- * and multiplier in the fixed section data header.
+ * and multiplier in the fixed section data header.  A blockette
+ * chain pending from lazy unpacking is decoded first.
  *
  * Returns the positive sample rate on success and -1.0 on error.
  ***************************************************************************/
@@ -485,6 +634,8 @@ msr_samprate (MSRecord *msr)
   if (!msr)
     return -1.0;
 
+  msr_decode_blockettes (msr, 0);
+
   if (msr->Blkt100)
     return (double)msr->Blkt100->samprate;
   else
@@ -517,7 +668,8 @@ msr_nomsamprate (MSRecord *msr)
  * corrections if any are specified in the header and bit 1 of the
  * activity flags indicates that it has not already been applied.  If
  * a Blockette 1001 is included and has been parsed the microseconds
- * of field 4 are also applied.
+ * of field 4 are also applied, a blockette chain pending from lazy
+ * unpacking is decoded first.
  *
  * Returns a high precision epoch time on success and HPTERROR on
  * error.
@@ -530,6 +682,8 @@ msr_starttime (MSRecord *msr)
   if (!msr || starttime == HPTERROR)
     return HPTERROR;
 
+  msr_decode_blockettes (msr, 0);
+
   /* Check if a correction is included and if it has been applied,
      bit 1 of activity flags indicates if it has been appiled */
 
@@ -704,6 +858,9 @@ msr_print (MSRecord *msr, flag details)
   if (!msr)
     return;
 
+  if (details > 0)
+    msr_decode_blockettes (msr, 0);
+
   /* Generate a source name string */
   srcname[0] = '\0';
   msr_srcname (msr, srcname, 0);
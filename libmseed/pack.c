@@ -95,6 +95,10 @@ msr_pack (MSRecord *msr, void (*record_handler) (char *, int, void *),
   if (!msr)
     return -1;
 
+  /* Decode blockette chain if left in the record by msr_unpack() */
+  if (msr_decode_blockettes (msr, verbose))
+    return -1;
+
   if (!record_handler)
   {
     ms_log (2, "msr_pack(): record_handler() function pointer not set!\n");
@@ -523,6 +527,9 @@ msr_pack_header_raw (MSRecord *msr, char *rawrec, int maxheaderlen,
   if (!msr || !rawrec)
     return -1;
 
+  if (msr_decode_blockettes (msr, verbose))
+    return -1;
+
   /* Make sure a fixed section of data header is available */
   if (!msr->fsdh)
   {
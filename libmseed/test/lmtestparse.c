@@ -23,14 +23,17 @@ static flag verbose    = 0;
 static flag ppackets   = 0;
 static flag basicsum   = 0;
 static flag tracegap   = 0;
+static flag healafter  = 0;
 static int printraw    = 0;
 static int printdata   = 0;
+static int steimframes = 0;
 static int reclen      = -1;
 static char *inputfile = 0;
 
 static double timetol     = -1.0; /* Time tolerance for continuous traces */
 static double sampratetol = -1.0; /* Sample rate tolerance for continuous traces */
 
+static int decodeframes (MSRecord *msr);
 static int parameter_proc (int argcount, char **argvec);
 static void print_stderr (char *message);
 static void usage (void);
@@ -62,14 +65,17 @@ main (int argc, char **argv)
 
   /* Loop over the input file */
   while ((retcode = ms_readmsr (&msr, inputfile, reclen, NULL, NULL, 1,
-                                printdata, verbose)) == MS_NOERROR)
+                                (printdata && !steimframes), verbose)) == MS_NOERROR)
   {
     totalrecs++;
     totalsamps += msr->samplecnt;
 
+    if (printdata && steimframes)
+      decodeframes (msr);
+
     if (tracegap)
     {
-      mstl_addmsr (mstl, msr, 0, 1, timetol, sampratetol);
+      mstl_addmsr (mstl, msr, 0, !healafter, timetol, sampratetol);
     }
     else
     {
@@ -147,6 +153,9 @@ main (int argc, char **argv)
   if (retcode != MS_ENDOFFILE)
     ms_log (2, "Cannot read %s: %s\n", inputfile, ms_errorstr (retcode));
 
+  if (tracegap && healafter)
+    ms_log (1, "Healed %d segment(s)\n", mstl_heal (mstl, timetol, sampratetol));
+
   if (tracegap)
     mstl_printtracelist (mstl, 0, 1, 1);
 
@@ -163,6 +172,42 @@ main (int argc, char **argv)
   return 0;
 } /* End of main() */
 
+/***************************************************************************
+ * decodeframes():
+ * Decode the Steim data frames of a record one frame at a time with
+ * msr_decode_steimframe() and place the samples in the record.
+ *
+ * Returns the number of samples decoded, -1 on error.
+ ***************************************************************************/
+static int
+decodeframes (MSRecord *msr)
+{
+  MSSteimFrames frames;
+  int32_t block[MS_STEIMFRAMESAMPLES];
+  int nsamples;
+
+  if (msr->samplecnt <= 0 || msr_steimframes (msr, &frames) != MS_NOERROR)
+    return -1;
+
+  if ((msr->datasamples = malloc ((size_t)msr->samplecnt * sizeof (int32_t))) == NULL)
+  {
+    ms_log (2, "Cannot allocate memory for data samples\n");
+    return -1;
+  }
+
+  msr->sampletype = 'i';
+  msr->numsamples = 0;
+
+  while ((nsamples = msr_decode_steimframe (&frames, block)) > 0)
+  {
+    memcpy ((int32_t *)msr->datasamples + msr->numsamples, block,
+            nsamples * sizeof (int32_t));
+    msr->numsamples += nsamples;
+  }
+
+  return (nsamples < 0) ? -1 : (int)msr->numsamples;
+} /* End of decodeframes() */
+
 /***************************************************************************
  * parameter_proc():
  * Process the command line parameters.
@@ -219,6 +264,25 @@ parameter_proc (int argcount, char **argvec)
     {
       reclen = atoi (argvec[++optind]);
     }
+    else if (strcmp (argvec[optind], "-hl") == 0)
+    {
+      healafter = 1;
+    }
+    else if (strcmp (argvec[optind], "-lb") == 0)
+    {
+      MS_UNPACKLAZYBLOCKETTES (1);
+    }
+    else if (strcmp (argvec[optind], "-sf") == 0)
+    {
+      steimframes = 1;
+    }
+    else if (strcmp (argvec[optind], "-ra") == 0)
+    {
+      int count = atoi (argvec[++optind]);
+      int size  = atoi (argvec[++optind]);
+
+      MS_READAHEAD (count, size);
+    }
     else if (strncmp (argvec[optind], "-", 1) == 0 &&
              strlen (argvec[optind]) > 1)
     {
@@ -281,8 +345,12 @@ usage (void)
            " -d             Print first 6 sample values\n"
            " -D             Print all sample values\n"
            " -tg            Print trace listing with gap information\n"
+           " -hl            Heal trace segments after reading instead of while adding\n"
            " -s             Print a basic summary after processing a file\n"
            " -r bytes       Specify record length in bytes, required if no Blockette 1000\n"
+           " -ra count size Read ahead with count buffers of size bytes\n"
+           " -lb            Leave blockettes in the record, decoded on demand\n"
+           " -sf            Decode Steim data one frame at a time\n"
            "\n"
            " file           File of Mini-SEED records\n"
            "\n");
@@ -91,6 +91,10 @@ mstl_free (MSTraceList **ppmstl, flag freeprvtptr)
         if (seg->datasamples)
           free (seg->datasamples);
 
+        /* Free skip list links if allocated */
+        if (seg->skipnext)
+          free (seg->skipnext);
+
         free (seg);
         seg = nextseg;
       }
@@ -103,6 +107,10 @@ mstl_free (MSTraceList **ppmstl, flag freeprvtptr)
       id = nextid;
     }
 
+    /* Free hash table of trace IDs */
+    if ((*ppmstl)->idhash)
+      free ((*ppmstl)->idhash);
+
     free (*ppmstl);
 
     *ppmstl = NULL;
@@ -111,6 +119,314 @@ mstl_free (MSTraceList **ppmstl, flag freeprvtptr)
   return;
 } /* End of mstl_free() */
 
+/* Initial number of buckets in the hash table of trace IDs */
+#define MSTL_IDHASHSIZE 64
+
+/* Segment order in the skip lists: start time ascending and end time
+ * descending for equal start times.  BEFORE is true if the segment
+ * sorts before or equal to the key, STRICTBEFORE if strictly before. */
+#define MSTL_SEGBEFORE(SEG, START, END) \
+  ((SEG)->starttime < (START) || ((SEG)->starttime == (START) && (SEG)->endtime >= (END)))
+#define MSTL_SEGSTRICTBEFORE(SEG, START, END) \
+  ((SEG)->starttime < (START) || ((SEG)->starttime == (START) && (SEG)->endtime > (END)))
+
+/* Sample rate tolerance check, default tolerance if SAMPRATETOL is -1.0 */
+#define MSTL_RATECHECK(RATE1, RATE2, SAMPRATETOL) \
+  (((SAMPRATETOL) == -1.0) ? MS_ISRATETOLERABLE (RATE1, RATE2) : (ms_dabs ((RATE1) - (RATE2)) <= (SAMPRATETOL)))
+
+/* Largest time value, used as a search key */
+#define MSTL_HPTMAX INT64_MAX
+
+/***************************************************************************
+ * mstl_srchash:
+ *
+ * Return the FNV-1a hash of a source name.
+ ***************************************************************************/
+static uint32_t
+mstl_srchash (const char *srcname)
+{
+  uint32_t hash = 2166136261u;
+
+  while (*srcname)
+    hash = (hash ^ (uint8_t)*srcname++) * 16777619u;
+
+  return hash;
+} /* End of mstl_srchash() */
+
+/***************************************************************************
+ * mstl_hashids:
+ *
+ * (Re)build the hash table of trace IDs of a MSTraceList with the
+ * specified number of buckets, which must be a power of 2.
+ *
+ * Returns 0 on success and -1 on error.
+ ***************************************************************************/
+static int
+mstl_hashids (MSTraceList *mstl, int32_t size)
+{
+  MSTraceID **idhash;
+  MSTraceID *id;
+  uint32_t bucket;
+
+  if (!(idhash = (MSTraceID **)calloc (size, sizeof (MSTraceID *))))
+  {
+    ms_log (2, "mstl_hashids(): Error allocating memory\n");
+    return -1;
+  }
+
+  for (id = mstl->traces; id; id = id->next)
+  {
+    bucket         = mstl_srchash (id->srcname) & (size - 1);
+    id->hashnext   = idhash[bucket];
+    idhash[bucket] = id;
+  }
+
+  if (mstl->idhash)
+    free (mstl->idhash);
+
+  mstl->idhash     = idhash;
+  mstl->idhashsize = size;
+
+  return 0;
+} /* End of mstl_hashids() */
+
+/***************************************************************************
+ * mstl_findid:
+ *
+ * Search the hash table of trace IDs of a MSTraceList for a matching
+ * source name, building the table if needed.
+ *
+ * Returns a pointer to the MSTraceID if found, otherwise NULL.
+ ***************************************************************************/
+static MSTraceID *
+mstl_findid (MSTraceList *mstl, const char *srcname)
+{
+  MSTraceID *id;
+
+  if (!mstl->traces)
+    return NULL;
+
+  if (!mstl->idhash && mstl_hashids (mstl, MSTL_IDHASHSIZE))
+    return NULL;
+
+  for (id = mstl->idhash[mstl_srchash (srcname) & (mstl->idhashsize - 1)]; id; id = id->hashnext)
+  {
+    if (!strcmp (id->srcname, srcname))
+      return id;
+  }
+
+  return NULL;
+} /* End of mstl_findid() */
+
+/***************************************************************************
+ * mstl_skiplink:
+ *
+ * Return the address of the skip list link at 'level' of a segment,
+ * or of the list head for the MSTraceID if 'seg' is NULL.  Level 0 of
+ * the skip list is the MSTraceSeg.next list starting at MSTraceID.first.
+ ***************************************************************************/
+static MSTraceSeg **
+mstl_skiplink (MSTraceID *id, MSTraceSeg *seg, int level)
+{
+  if (!seg)
+    return (level == 0) ? &id->first : &id->skiphead[level - 1];
+
+  return (level == 0) ? &seg->next : &seg->skipnext[level - 1];
+} /* End of mstl_skiplink() */
+
+/***************************************************************************
+ * mstl_skipfind:
+ *
+ * Search the segment skip list of a MSTraceID for the last segment at
+ * each level that sorts before or equal to the key specified by
+ * 'starttime' and 'endtime'.  If 'update' is not NULL the segment
+ * found at each level, NULL for the list head, is stored in it.
+ *
+ * Returns the last segment before the key or NULL if none.
+ ***************************************************************************/
+static MSTraceSeg *
+mstl_skipfind (MSTraceID *id, hptime_t starttime, hptime_t endtime,
+               MSTraceSeg **update)
+{
+  MSTraceSeg *seg = NULL;
+  MSTraceSeg *next;
+  int level;
+
+  for (level = ((id->skiplevels > 0) ? id->skiplevels : 1) - 1; level >= 0; level--)
+  {
+    while ((next = *mstl_skiplink (id, seg, level)) &&
+           MSTL_SEGBEFORE (next, starttime, endtime))
+      seg = next;
+
+    if (update)
+      update[level] = seg;
+  }
+
+  return seg;
+} /* End of mstl_skipfind() */
+
+/***************************************************************************
+ * mstl_skipinsert:
+ *
+ * Insert a segment into the segment list of a MSTraceID in time order.
+ * A segment that is not yet in a skip list is assigned a random number
+ * of levels, each additional level with a probability of 1/4.
+ *
+ * Returns 0 on success and -1 on error.
+ ***************************************************************************/
+static int
+mstl_skipinsert (MSTraceList *mstl, MSTraceID *id, MSTraceSeg *seg)
+{
+  MSTraceSeg *update[MSTL_SKIPLEVELS];
+  MSTraceSeg **link;
+  int levels;
+  int level;
+
+  if (seg->skiplevels <= 0)
+  {
+    if (!mstl->skiprand)
+      mstl->skiprand = 2463534242u;
+
+    for (levels = 1; levels < MSTL_SKIPLEVELS; levels++)
+    {
+      /* xorshift32 generator */
+      mstl->skiprand ^= mstl->skiprand << 13;
+      mstl->skiprand ^= mstl->skiprand >> 17;
+      mstl->skiprand ^= mstl->skiprand << 5;
+
+      if (mstl->skiprand & 3)
+        break;
+    }
+
+    if (levels > 1 &&
+        !(seg->skipnext = (MSTraceSeg **)calloc (levels - 1, sizeof (MSTraceSeg *))))
+    {
+      ms_log (2, "mstl_skipinsert(): Error allocating memory\n");
+      return -1;
+    }
+
+    seg->skiplevels = levels;
+  }
+
+  if (id->skiplevels <= 0)
+    id->skiplevels = 1;
+
+  for (level = id->skiplevels; level < seg->skiplevels; level++)
+    id->skiphead[level - 1] = NULL;
+
+  if (seg->skiplevels > id->skiplevels)
+    id->skiplevels = seg->skiplevels;
+
+  mstl_skipfind (id, seg->starttime, seg->endtime, update);
+
+  for (level = 0; level < seg->skiplevels; level++)
+  {
+    link                            = mstl_skiplink (id, update[level], level);
+    *mstl_skiplink (id, seg, level) = *link;
+    *link                           = seg;
+  }
+
+  seg->prev = update[0];
+
+  if (seg->next)
+    seg->next->prev = seg;
+  else
+    id->last = seg;
+
+  if (seg->endtime - seg->starttime > id->maxspan)
+    id->maxspan = seg->endtime - seg->starttime;
+
+  return 0;
+} /* End of mstl_skipinsert() */
+
+/***************************************************************************
+ * mstl_skipremove:
+ *
+ * Remove a segment from the segment list of a MSTraceID.  The segment
+ * is located using the key it was inserted with, 'starttime' and
+ * 'endtime', if not found at a level that level is scanned.  The skip
+ * list levels of the segment are retained for reinsertion.
+ ***************************************************************************/
+static void
+mstl_skipremove (MSTraceID *id, MSTraceSeg *seg, hptime_t starttime,
+                 hptime_t endtime)
+{
+  MSTraceSeg *pred = NULL;
+  MSTraceSeg *next;
+  MSTraceSeg **link;
+  int level;
+
+  for (level = id->skiplevels - 1; level > 0; level--)
+  {
+    while ((next = *mstl_skiplink (id, pred, level)) && next != seg &&
+           MSTL_SEGSTRICTBEFORE (next, starttime, endtime))
+      pred = next;
+
+    if (level >= seg->skiplevels)
+      continue;
+
+    /* Step over segments with an equal key */
+    link = mstl_skiplink (id, pred, level);
+    while (*link && *link != seg &&
+           (*link)->starttime == starttime && (*link)->endtime == endtime)
+      link = mstl_skiplink (id, *link, level);
+
+    /* Scan the level if not found, i.e. when segment order was disturbed */
+    if (*link != seg)
+    {
+      link = mstl_skiplink (id, NULL, level);
+      while (*link && *link != seg)
+        link = mstl_skiplink (id, *link, level);
+    }
+
+    if (*link == seg)
+      *link = seg->skipnext[level - 1];
+  }
+
+  /* Level 0 is doubly linked */
+  if (seg->prev)
+    seg->prev->next = seg->next;
+  else
+    id->first = seg->next;
+
+  if (seg->next)
+    seg->next->prev = seg->prev;
+  else
+    id->last = seg->prev;
+
+  seg->prev = NULL;
+  seg->next = NULL;
+
+  /* Lower the number of levels in use if the top levels are empty */
+  while (id->skiplevels > 1 && !id->skiphead[id->skiplevels - 2])
+    id->skiplevels--;
+} /* End of mstl_skipremove() */
+
+/***************************************************************************
+ * mstl_skipreposition:
+ *
+ * Move a segment to its place in the segment list of a MSTraceID after
+ * its time coverage changed from the key 'starttime' and 'endtime'.
+ *
+ * Returns 0 on success and -1 on error.
+ ***************************************************************************/
+static int
+mstl_skipreposition (MSTraceList *mstl, MSTraceID *id, MSTraceSeg *seg,
+                     hptime_t starttime, hptime_t endtime)
+{
+  if (seg->endtime - seg->starttime > id->maxspan)
+    id->maxspan = seg->endtime - seg->starttime;
+
+  /* Nothing to do if still in order with neighbors */
+  if ((!seg->prev || MSTL_SEGBEFORE (seg->prev, seg->starttime, seg->endtime)) &&
+      (!seg->next || !MSTL_SEGSTRICTBEFORE (seg->next, seg->starttime, seg->endtime)))
+    return 0;
+
+  mstl_skipremove (id, seg, starttime, endtime);
+
+  return mstl_skipinsert (mstl, id, seg);
+} /* End of mstl_skipreposition() */
+
 /***************************************************************************
  * mstl_addmsr:
  *
@@ -130,6 +446,11 @@ mstl_free (MSTraceList **ppmstl, flag freeprvtptr)
  * descending alphanumeric order.  MSTraceIDs are always maintained
  * with MSTraceSegs in data time time order.
  *
+ * MSTraceIDs are found using a hash table of source names and the
+ * MSTraceSegs of each ID are kept in a skip list ordered by time,
+ * locating the segment for a record is O(log n) in the number of
+ * segments.
+ *
  * Return a pointer to the MSTraceSeg updated or 0 on error.
  ***************************************************************************/
 MSTraceSeg *
@@ -147,8 +468,8 @@ mstl_addmsr (MSTraceList *mstl, MSRecord *msr, flag dataquality,
   MSTraceSeg *followseg = 0;
 
   hptime_t endtime;
-  hptime_t pregap;
-  hptime_t postgap;
+  hptime_t segstart = 0;
+  hptime_t segend   = 0;
   hptime_t lastgap;
   hptime_t firstgap;
   hptime_t hpdelta;
@@ -157,7 +478,7 @@ mstl_addmsr (MSTraceList *mstl, MSRecord *msr, flag dataquality,
 
   char srcname[45];
   char *s1, *s2;
-  flag whence;
+  uint32_t bucket;
   flag lastratecheck;
   flag firstratecheck;
   int mag;
@@ -183,7 +504,7 @@ mstl_addmsr (MSTraceList *mstl, MSRecord *msr, flag dataquality,
   }
 
   /* Search for matching trace ID starting with last accessed ID and
-     then looping through the trace ID list. */
+     then in the hash table of trace IDs. */
   if (mstl->last)
   {
     s1 = mstl->last->srcname;
@@ -196,65 +517,55 @@ mstl_addmsr (MSTraceList *mstl, MSRecord *msr, flag dataquality,
     cmp = (*s1 - *--s2);
 
     if (!cmp)
-    {
       id = mstl->last;
-    }
-    else
+  }
+
+  if (!id)
+    id = mstl_findid (mstl, srcname);
+
+  /* If no matching ID was found create new MSTraceID and MSTraceSeg entries */
+  if (!id)
+  {
+    /* Loop through trace ID list tracking the source name which is
+       closest but less than the MSRecord to allow for insertion with
+       sort order. */
+    searchid = mstl->traces;
+    ltcmp    = 0;
+    ltmag    = 0;
+    while (searchid)
     {
-      /* Loop through trace ID list searching for a match, simultaneously
-         track the source name which is closest but less than the MSRecord
-         to allow for later insertion with sort order. */
-      searchid = mstl->traces;
-      ltcmp    = 0;
-      ltmag    = 0;
-      while (searchid)
+      /* Compare source names */
+      s1  = searchid->srcname;
+      s2  = srcname;
+      mag = 0;
+      while (*s1 == *s2++)
       {
-        /* Compare source names */
-        s1  = searchid->srcname;
-        s2  = srcname;
-        mag = 0;
-        while (*s1 == *s2++)
+        mag++;
+        if (*s1++ == '\0')
+          break;
+      }
+      cmp = (*s1 - *--s2);
+
+      /* Track closest "less than" value */
+      if (cmp < 0)
+      {
+        if ((ltcmp == 0 || cmp >= ltcmp) && mag >= ltmag)
         {
-          mag++;
-          if (*s1++ == '\0')
-            break;
+          ltcmp = cmp;
+          ltmag = mag;
+          ltid  = searchid;
         }
-        cmp = (*s1 - *--s2);
-
-        /* If source names did not match track closest "less than" value
-           and continue searching. */
-        if (cmp != 0)
+        else if (mag > ltmag)
         {
-          if (cmp < 0)
-          {
-            if ((ltcmp == 0 || cmp >= ltcmp) && mag >= ltmag)
-            {
-              ltcmp = cmp;
-              ltmag = mag;
-              ltid  = searchid;
-            }
-            else if (mag > ltmag)
-            {
-              ltcmp = cmp;
-              ltmag = mag;
-              ltid  = searchid;
-            }
-          }
-
-          searchid = searchid->next;
-          continue;
+          ltcmp = cmp;
+          ltmag = mag;
+          ltid  = searchid;
         }
-
-        /* If we made it this far we found a match */
-        id = searchid;
-        break;
       }
+
+      searchid = searchid->next;
     }
-  } /* Done searching for match in trace ID list */
 
-  /* If no matching ID was found create new MSTraceID and MSTraceSeg entries */
-  if (!id)
-  {
     if (!(id = (MSTraceID *)calloc (1, sizeof (MSTraceID))))
     {
       ms_log (2, "mstl_addmsr(): Error allocating memory\n");
@@ -277,7 +588,11 @@ mstl_addmsr (MSTraceList *mstl, MSRecord *msr, flag dataquality,
     {
       return 0;
     }
-    id->first = id->last = seg;
+
+    if (mstl_skipinsert (mstl, id, seg))
+    {
+      return 0;
+    }
 
     /* Add new MSTraceID to MSTraceList */
     if (!mstl->traces || !ltid)
@@ -292,6 +607,22 @@ mstl_addmsr (MSTraceList *mstl, MSRecord *msr, flag dataquality,
     }
 
     mstl->numtraces++;
+
+    /* Add new MSTraceID to hash table, enlarging the table as needed */
+    if (!mstl->idhash || mstl->numtraces > mstl->idhashsize)
+    {
+      if (mstl_hashids (mstl, (mstl->idhash) ? mstl->idhashsize * 2 : MSTL_IDHASHSIZE))
+        return 0;
+    }
+    else
+    {
+      bucket               = mstl_srchash (srcname) & (mstl->idhashsize - 1);
+      id->hashnext         = mstl->idhash[bucket];
+      mstl->idhash[bucket] = id;
+    }
+
+    segstart = seg->starttime;
+    segend   = seg->endtime;
   }
   /* Add data coverage to the matching MSTraceID */
   else
@@ -334,16 +665,18 @@ mstl_addmsr (MSTraceList *mstl, MSRecord *msr, flag dataquality,
      * - Record fits before all coverage
      * - Record fits at beginning of first segment
      *
-     * If none of those scenarios are true search the complete segment list.
+     * If none of those scenarios are true search the segment skip list.
      */
 
     /* Record coverage fits at end of last segment */
     if (lastgap <= hptimetol && lastgap >= nhptimetol && lastratecheck)
     {
-      if (!mstl_addmsrtoseg (id->last, msr, endtime, 1))
-        return 0;
+      seg      = id->last;
+      segstart = seg->starttime;
+      segend   = seg->endtime;
 
-      seg = id->last;
+      if (!mstl_addmsrtoseg (seg, msr, endtime, 1))
+        return 0;
 
       if (endtime > id->latest)
         id->latest = endtime;
@@ -355,9 +688,11 @@ mstl_addmsr (MSTraceList *mstl, MSRecord *msr, flag dataquality,
         return 0;
 
       /* Add to end of list */
-      id->last->next = seg;
-      seg->prev      = id->last;
-      id->last       = seg;
+      if (mstl_skipinsert (mstl, id, seg))
+        return 0;
+
+      segstart = seg->starttime;
+      segend   = seg->endtime;
       id->numsegments++;
 
       if (endtime > id->latest)
@@ -370,9 +705,11 @@ mstl_addmsr (MSTraceList *mstl, MSRecord *msr, flag dataquality,
         return 0;
 
       /* Add to beginning of list */
-      id->first->prev = seg;
-      seg->next       = id->first;
-      id->first       = seg;
+      if (mstl_skipinsert (mstl, id, seg))
+        return 0;
+
+      segstart = seg->starttime;
+      segend   = seg->endtime;
       id->numsegments++;
 
       if (msr->starttime < id->earliest)
@@ -381,78 +718,65 @@ mstl_addmsr (MSTraceList *mstl, MSRecord *msr, flag dataquality,
     /* Record coverage fits at beginning of first segment */
     else if (firstgap <= hptimetol && firstgap >= nhptimetol && firstratecheck)
     {
-      if (!mstl_addmsrtoseg (id->first, msr, endtime, 2))
-        return 0;
+      seg      = id->first;
+      segstart = seg->starttime;
+      segend   = seg->endtime;
 
-      seg = id->first;
+      if (!mstl_addmsrtoseg (seg, msr, endtime, 2))
+        return 0;
 
       if (msr->starttime < id->earliest)
         id->earliest = msr->starttime;
     }
-    /* Search complete segment list for matches */
+    /* Search segment skip list for matches */
     else
     {
-      searchseg = id->first;
       segbefore = 0; /* Find segment that record fits before */
       segafter  = 0; /* Find segment that record fits after */
-      followseg = 0; /* Track segment that record follows in time order */
-      while (searchseg)
-      {
-        if (msr->starttime > searchseg->starttime)
-          followseg = searchseg;
 
-        whence = 0;
+      /* Segment that record follows in time order */
+      followseg = mstl_skipfind (id, msr->starttime, MSTL_HPTMAX, NULL);
 
-        postgap = msr->starttime - searchseg->endtime - hpdelta;
-        if (!segbefore && postgap <= hptimetol && postgap >= nhptimetol)
-          whence = 1;
+      /* A segment ending where the record starts begins before the
+       * record, search back from the following segment as far as the
+       * longest segment time span allows.  The earliest match is used. */
+      for (searchseg = followseg; searchseg; searchseg = searchseg->prev)
+      {
+        if (searchseg->starttime < msr->starttime - hpdelta - hptimetol - id->maxspan)
+          break;
 
-        pregap = searchseg->starttime - endtime - hpdelta;
-        if (!segafter && pregap <= hptimetol && pregap >= nhptimetol)
-          whence = 2;
+        lastgap = msr->starttime - searchseg->endtime - hpdelta;
 
-        if (!whence)
-        {
-          searchseg = searchseg->next;
-          continue;
-        }
+        if (lastgap <= hptimetol && lastgap >= nhptimetol &&
+            MSTL_RATECHECK (msr->samprate, searchseg->samprate, sampratetol))
+          segbefore = searchseg;
+      }
 
-        if (sampratetol == -1.0)
-        {
-          if (!MS_ISRATETOLERABLE (msr->samprate, searchseg->samprate))
-          {
-            searchseg = searchseg->next;
-            continue;
-          }
-        }
-        else
+      /* A segment beginning where the record ends is found by start time */
+      if (!segbefore || autoheal)
+      {
+        searchseg = mstl_skipfind (id, endtime + hpdelta + nhptimetol, MSTL_HPTMAX, NULL);
+        searchseg = (searchseg) ? searchseg->next : id->first;
+
+        for (; searchseg && searchseg->starttime <= endtime + hpdelta + hptimetol;
+             searchseg = searchseg->next)
         {
-          if (ms_dabs (msr->samprate - searchseg->samprate) > sampratetol)
+          if (searchseg != segbefore &&
+              MSTL_RATECHECK (msr->samprate, searchseg->samprate, sampratetol))
           {
-            searchseg = searchseg->next;
-            continue;
+            segafter = searchseg;
+            break;
           }
         }
-
-        if (whence == 1)
-          segbefore = searchseg;
-        else
-          segafter = searchseg;
-
-        /* Done searching if not autohealing */
-        if (!autoheal)
-          break;
-
-        /* Done searching if both before and after segments are found */
-        if (segbefore && segafter)
-          break;
-
-        searchseg = searchseg->next;
-      } /* Done looping through segments */
+      }
 
       /* Add MSRecord coverage to end of segment before */
       if (segbefore)
       {
+        seg      = segbefore;
+        segstart = seg->starttime;
+        segend   = seg->endtime;
+
         if (!mstl_addmsrtoseg (segbefore, msr, endtime, 1))
         {
           return 0;
@@ -467,15 +791,9 @@ mstl_addmsr (MSTraceList *mstl, MSRecord *msr, flag dataquality,
             return 0;
           }
 
-          /* Shift last segment pointer if it's going to be removed */
-          if (segafter == id->last)
-            id->last = id->last->prev;
-
           /* Remove segafter from list */
-          if (segafter->prev)
-            segafter->prev->next = segafter->next;
-          if (segafter->next)
-            segafter->next->prev = segafter->prev;
+          mstl_skipremove (id, segafter, segafter->starttime, segafter->endtime);
+          id->numsegments--;
 
           /* Free data samples, private data and segment structure */
           if (segafter->datasamples)
@@ -484,20 +802,23 @@ mstl_addmsr (MSTraceList *mstl, MSRecord *msr, flag dataquality,
           if (segafter->prvtptr)
             free (segafter->prvtptr);
 
+          if (segafter->skipnext)
+            free (segafter->skipnext);
+
           free (segafter);
         }
-
-        seg = segbefore;
       }
       /* Add MSRecord coverage to beginning of segment after */
       else if (segafter)
       {
+        seg      = segafter;
+        segstart = seg->starttime;
+        segend   = seg->endtime;
+
         if (!mstl_addmsrtoseg (segafter, msr, endtime, 2))
         {
           return 0;
         }
-
-        seg = segafter;
       }
       /* Add MSRecord coverage to new segment */
       else
@@ -508,28 +829,14 @@ mstl_addmsr (MSTraceList *mstl, MSRecord *msr, flag dataquality,
           return 0;
         }
 
-        /* Add new segment as first in list */
-        if (!followseg)
-        {
-          seg->next = id->first;
-          if (id->first)
-            id->first->prev = seg;
-
-          id->first = seg;
-        }
-        /* Add new segment after the followseg segment */
-        else
+        /* Add new segment in time order */
+        if (mstl_skipinsert (mstl, id, seg))
         {
-          seg->next = followseg->next;
-          seg->prev = followseg;
-          if (followseg->next)
-            followseg->next->prev = seg;
-          followseg->next         = seg;
-
-          if (followseg == id->last)
-            id->last = seg;
+          return 0;
         }
 
+        segstart = seg->starttime;
+        segend   = seg->endtime;
         id->numsegments++;
       }
 
@@ -542,61 +849,163 @@ mstl_addmsr (MSTraceList *mstl, MSRecord *msr, flag dataquality,
     } /* End of searching segment list */
   }   /* End of adding coverage to matching ID */
 
-  /* Sort modified segment into place, logic above should limit these to few shifts if any */
-  while (seg->next && (seg->starttime > seg->next->starttime ||
-                       (seg->starttime == seg->next->starttime && seg->endtime < seg->next->endtime)))
-  {
-    /* Move segment down list, swap seg and seg->next */
-    segafter = seg->next;
+  /* Move modified segment into place, usually it is already in place */
+  if (mstl_skipreposition (mstl, id, seg, segstart, segend))
+    return 0;
 
-    if (seg->prev)
-      seg->prev->next = segafter;
+  /* Set MSTraceID as last accessed */
+  mstl->last = id;
 
-    if (segafter->next)
-      segafter->next->prev = seg;
+  return seg;
+} /* End of mstl_addmsr() */
 
-    segafter->prev = seg->prev;
-    seg->prev      = segafter;
-    seg->next      = segafter->next;
-    segafter->next = seg;
+/***************************************************************************
+ * mstl_heal:
+ *
+ * Merge trace segments in a MSTraceList that fit together in time,
+ * e.g. segments left separate when records were added out of time
+ * order with mstl_addmsr() without autoheal.  The segments of each
+ * MSTraceID are in start time order, each segment can only be merged
+ * onto the end of an earlier segment.  The segments are healed in a
+ * single pass keeping a list of the earlier segments that may still
+ * be extended, segments are dropped from that list once the pass has
+ * moved beyond their end time.
+ *
+ * The time tolerance and sample rate tolerance are used as by
+ * mstl_addmsr().  For segments that are removed, any memory at the
+ * prvtptr will be freed.
+ *
+ * Return number of segment mergings on success otherwise -1 on error.
+ ***************************************************************************/
+int
+mstl_heal (MSTraceList *mstl, double timetol, double sampratetol)
+{
+  MSTraceID *id;
+  MSTraceSeg *seg;
+  MSTraceSeg *nextseg;
+  MSTraceSeg *curseg;
+  MSTraceSeg **open = 0;
+  MSTraceSeg **newopen;
+  int openmax       = 0;
+  int opencount;
+  int mergings      = 0;
+  int idx;
+  hptime_t segstart;
+  hptime_t segend;
+  hptime_t postgap;
+  hptime_t hpdelta;
+  hptime_t hptimetol = 0;
+  hptime_t nhptimetol;
 
-    /* Reset first and last segment pointers if replaced */
-    if (id->first == seg)
-      id->first = segafter;
+  if (!mstl)
+    return -1;
 
-    if (id->last == segafter)
-      id->last = seg;
-  }
-  while (seg->prev && (seg->starttime < seg->prev->starttime ||
-                       (seg->starttime == seg->prev->starttime && seg->endtime > seg->prev->endtime)))
+  for (id = mstl->traces; id; id = id->next)
   {
-    /* Move segment up list, swap seg and seg->prev */
-    segbefore = seg->prev;
+    opencount = 0;
 
-    if (seg->next)
-      seg->next->prev = segbefore;
+    for (seg = id->first; seg; seg = nextseg)
+    {
+      nextseg = seg->next;
+      curseg  = 0;
 
-    if (segbefore->prev)
-      segbefore->prev->next = seg;
+      /* Search open segments, most recent first, for one this segment extends */
+      for (idx = opencount - 1; idx >= 0; idx--)
+      {
+        /* Calculate high-precision sample period */
+        hpdelta = (hptime_t) ((open[idx]->samprate) ? (HPTMODULUS / open[idx]->samprate) : 0.0);
+
+        /* Calculate high-precision time tolerance */
+        if (timetol == -1.0)
+          hptimetol = (hptime_t) (0.5 * hpdelta); /* Default time tolerance is 1/2 sample period */
+        else if (timetol >= 0.0)
+          hptimetol = (hptime_t) (timetol * HPTMODULUS);
 
-    segbefore->next = seg->next;
-    seg->next       = segbefore;
-    seg->prev       = segbefore->prev;
-    segbefore->prev = seg;
+        nhptimetol = (hptimetol) ? -hptimetol : 0;
 
-    /* Reset first and last segment pointers if replaced */
-    if (id->first == segbefore)
-      id->first = seg;
+        /* postgap is negative when the segment overlaps the open segment
+         * and positive when there is a time gap. */
+        postgap = seg->starttime - open[idx]->endtime - hpdelta;
 
-    if (id->last == seg)
-      id->last = segbefore;
+        /* Later segments start no earlier, the open segment can no longer be extended */
+        if (postgap > hptimetol)
+        {
+          open[idx] = open[--opencount];
+          continue;
+        }
+
+        if (postgap >= nhptimetol &&
+            MSTL_RATECHECK (seg->samprate, open[idx]->samprate, sampratetol))
+        {
+          curseg = open[idx];
+          break;
+        }
+      }
+
+      /* Merge segment onto the end of the open segment it extends */
+      if (curseg)
+      {
+        segstart = curseg->starttime;
+        segend   = curseg->endtime;
+
+        if (!mstl_addsegtoseg (curseg, seg))
+        {
+          if (open)
+            free (open);
+          return -1;
+        }
+
+        mstl_skipremove (id, seg, seg->starttime, seg->endtime);
+        id->numsegments--;
+
+        /* Free data samples, private data and segment structure */
+        if (seg->datasamples)
+          free (seg->datasamples);
+
+        if (seg->prvtptr)
+          free (seg->prvtptr);
+
+        if (seg->skipnext)
+          free (seg->skipnext);
+
+        free (seg);
+
+        if (mstl_skipreposition (mstl, id, curseg, segstart, segend))
+        {
+          if (open)
+            free (open);
+          return -1;
+        }
+
+        mergings++;
+        continue;
+      }
+
+      /* Add to list of open segments, growing the list as needed */
+      if (opencount >= openmax)
+      {
+        openmax = (openmax) ? openmax * 2 : 16;
+
+        if (!(newopen = (MSTraceSeg **)realloc (open, sizeof (MSTraceSeg *) * openmax)))
+        {
+          ms_log (2, "mstl_heal(): Cannot allocate memory\n");
+          if (open)
+            free (open);
+          return -1;
+        }
+
+        open = newopen;
+      }
+
+      open[opencount++] = seg;
+    }
   }
 
-  /* Set MSTraceID as last accessed */
-  mstl->last = id;
+  if (open)
+    free (open);
 
-  return seg;
-} /* End of mstl_addmsr() */
+  return mergings;
+} /* End of mstl_heal() */
 
 /***************************************************************************
  * mstl_msr2seg:
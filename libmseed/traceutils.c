@@ -771,6 +771,13 @@ mst_addtracetogroup (MSTraceGroup *mstg, MSTrace *mst)
  * is -1.0 the default tolerance check of abs(1-sr1/sr2) < 0.0001 is
  * used (defined in libmseed.h).
  *
+ * After sorting, traces of the same channel are in start time order
+ * and each trace can only be merged onto the end of an earlier trace.
+ * The group is healed in a single pass over the traces, keeping a
+ * list of the earlier traces of the current channel that may still be
+ * extended.  Traces are dropped from that list once the pass has moved
+ * beyond their end time.
+ *
  * Return number of trace mergings on success otherwise -1 on error.
  ***************************************************************************/
 int
@@ -780,43 +787,66 @@ mst_groupheal (MSTraceGroup *mstg, double timetol, double sampratetol)
   MSTrace *curtrace    = 0;
   MSTrace *nexttrace   = 0;
   MSTrace *searchtrace = 0;
-  MSTrace *prevtrace   = 0;
-  int8_t merged        = 0;
-  double postgap, pregap, delta;
+  MSTrace *lasttrace   = 0;
+  MSTrace **open       = 0;
+  MSTrace **newopen;
+  int openmax          = 0;
+  int opencount        = 0;
+  int8_t mixedquality  = 0;
+  char chanquality     = 0;
+  int8_t merged;
+  int idx;
+  double postgap, delta, tolerance;
 
   if (!mstg)
     return -1;
 
-  /* Sort MSTraceGroup before any healing */
-  if (mst_groupsort (mstg, 1))
+  /* Sort MSTraceGroup on channel and time before any healing */
+  if (mst_groupsort (mstg, 0))
     return -1;
 
-  curtrace = mstg->traces;
+  searchtrace = mstg->traces;
 
-  while (curtrace)
+  while (searchtrace)
   {
-    nexttrace = mstg->traces;
-    prevtrace = mstg->traces;
+    nexttrace = searchtrace->next;
+
+    /* Start a new list of open traces with each new channel */
+    if (!lasttrace ||
+        strcmp (searchtrace->network, lasttrace->network) ||
+        strcmp (searchtrace->station, lasttrace->station) ||
+        strcmp (searchtrace->location, lasttrace->location) ||
+        strcmp (searchtrace->channel, lasttrace->channel))
+    {
+      opencount   = 0;
+      chanquality = searchtrace->dataquality;
+    }
+    /* Track if the sort order within a channel depends on the quality */
+    else if (searchtrace->dataquality != chanquality)
+    {
+      mixedquality = 1;
+    }
+
+    merged = 0;
 
-    while (nexttrace)
+    /* Search open traces, most recent first, for one this trace extends */
+    for (idx = opencount - 1; idx >= 0; idx--)
     {
-      searchtrace = nexttrace;
-      nexttrace   = searchtrace->next;
+      curtrace = open[idx];
 
-      /* Do not process the same MSTrace we are trying to match */
-      if (searchtrace == curtrace)
-      {
-        prevtrace = searchtrace;
-        continue;
-      }
+      /* postgap is negative when searchtrace overlaps curtrace
+         and positive when there is a time gap. */
+      delta = (curtrace->samprate) ? (1.0 / curtrace->samprate) : 0.0;
+
+      postgap = ((double)(searchtrace->starttime - curtrace->endtime) / HPTMODULUS) - delta;
+
+      /* Calculate default time tolerance (1/2 sample period) if needed */
+      tolerance = (timetol == -1.0) ? 0.5 * delta : timetol;
 
-      /* Check if this trace matches the curtrace */
-      if (strcmp (searchtrace->network, curtrace->network) ||
-          strcmp (searchtrace->station, curtrace->station) ||
-          strcmp (searchtrace->location, curtrace->location) ||
-          strcmp (searchtrace->channel, curtrace->channel))
+      /* Later traces start no earlier, curtrace can no longer be extended */
+      if (postgap > tolerance)
       {
-        prevtrace = searchtrace;
+        open[idx] = open[--opencount];
         continue;
       }
 
@@ -824,34 +854,16 @@ mst_groupheal (MSTraceGroup *mstg, double timetol, double sampratetol)
       if (sampratetol == -1.0)
       {
         if (!MS_ISRATETOLERABLE (searchtrace->samprate, curtrace->samprate))
-        {
-          prevtrace = searchtrace;
           continue;
-        }
       }
       /* Otherwise check against the specified sample rates tolerance */
       else if (ms_dabs (searchtrace->samprate - curtrace->samprate) > sampratetol)
       {
-        prevtrace = searchtrace;
         continue;
       }
 
-      merged = 0;
-
-      /* post/pregap are negative when searchtrace overlaps curtrace
-         segment and positive when there is a time gap. */
-      delta = (curtrace->samprate) ? (1.0 / curtrace->samprate) : 0.0;
-
-      postgap = ((double)(searchtrace->starttime - curtrace->endtime) / HPTMODULUS) - delta;
-
-      pregap = ((double)(curtrace->starttime - searchtrace->endtime) / HPTMODULUS) - delta;
-
-      /* Calculate default time tolerance (1/2 sample period) if needed */
-      if (timetol == -1.0)
-        timetol = 0.5 * delta;
-
       /* Fits right at the end of curtrace */
-      if (ms_dabs (postgap) <= timetol)
+      if (ms_dabs (postgap) <= tolerance)
       {
         /* Merge searchtrace with curtrace */
         mst_addspan (curtrace, searchtrace->starttime, searchtrace->endtime,
@@ -867,50 +879,52 @@ mst_groupheal (MSTraceGroup *mstg, double timetol, double sampratetol)
           curtrace->dataquality = 0;
 
         merged = 1;
+        break;
       }
+    }
 
-      /* Fits right at the beginning of curtrace */
-      else if (ms_dabs (pregap) <= timetol)
-      {
-        /* Merge searchtrace with curtrace */
-        mst_addspan (curtrace, searchtrace->starttime, searchtrace->endtime,
-                     searchtrace->datasamples, searchtrace->numsamples,
-                     searchtrace->sampletype, 2);
-
-        /* If no data is present, make sure sample count is updated */
-        if (searchtrace->numsamples <= 0)
-          curtrace->samplecnt += searchtrace->samplecnt;
-
-        /* If qualities do not match reset the indicator */
-        if (curtrace->dataquality != searchtrace->dataquality)
-          curtrace->dataquality = 0;
+    /* If searchtrace was merged with an earlier trace remove it from the chain */
+    if (merged)
+    {
+      lasttrace->next = nexttrace;
 
-        merged = 1;
-      }
+      mst_free (&searchtrace);
 
-      /* If searchtrace was merged with curtrace remove it from the chain */
-      if (merged)
+      mstg->numtraces--;
+      mergings++;
+    }
+    else
+    {
+      /* Add to list of open traces, growing the list as needed */
+      if (opencount >= openmax)
       {
-        /* Re-link trace chain and free searchtrace */
-        if (searchtrace == mstg->traces)
-          mstg->traces = nexttrace;
-        else
-          prevtrace->next = nexttrace;
+        openmax = (openmax) ? openmax * 2 : 16;
 
-        mst_free (&searchtrace);
+        if (!(newopen = (MSTrace **)realloc (open, sizeof (MSTrace *) * openmax)))
+        {
+          ms_log (2, "mst_groupheal(): Cannot allocate memory\n");
+          if (open)
+            free (open);
+          return -1;
+        }
 
-        mstg->numtraces--;
-        mergings++;
-      }
-      else
-      {
-        prevtrace = searchtrace;
+        open = newopen;
       }
+
+      open[opencount++] = searchtrace;
+      lasttrace         = searchtrace;
     }
 
-    curtrace = curtrace->next;
+    searchtrace = nexttrace;
   }
 
+  if (open)
+    free (open);
+
+  /* Restore the sort order including quality if qualities were mixed */
+  if (mixedquality && mst_groupsort (mstg, 1))
+    return -1;
+
   return mergings;
 } /* End of mst_groupheal() */
 
@@ -22,7 +22,22 @@
 #include "libmseed.h"
 #include "unpackdata.h"
 
+/* Values extracted while traversing a blockette chain */
+typedef struct BlktScan_s
+{
+  int chainend;     /* Offset to the end of the last blockette */
+  flag b1000;       /* Blockette 1000 found */
+  flag b100;        /* Blockette 100 found, lazy traversal only */
+  float samprate;   /* Sample rate from Blockette 100 */
+  flag b1001;       /* Blockette 1001 found, lazy traversal only */
+  int8_t usec;      /* Microsecond offset from Blockette 1001 */
+} BlktScan;
+
 /* Function(s) internal to this file */
+static int msr_unpack_blockettes (MSRecord *msr, int reclen, flag swapflag, flag lazy,
+                                  BlktScan *scan, flag quiet, char *srcname, flag verbose);
+static int blkt_datalen (uint16_t blkttype, const char *blktbody, uint32_t blktlength,
+                         flag swapflag);
 static int check_environment (int verbose);
 
 /* Header and data byte order flags controlled by environment variables */
@@ -35,6 +50,9 @@ flag unpackdatabyteorder   = -2;
 int unpackencodingformat   = -2;
 int unpackencodingfallback = -2;
 
+/* Blockette chain decoding on demand controlled by MS_UNPACKLAZYBLOCKETTES() */
+flag unpacklazyblockettes = 0;
+
 /***************************************************************************
  * msr_unpack:
  *
@@ -57,6 +75,13 @@ int unpackencodingfallback = -2;
  * All header values, blockette values and data samples will be
  * overwritten by subsequent calls to this function.
  *
+ * If lazy blockette unpacking is enabled with MS_UNPACKLAZYBLOCKETTES(1)
+ * the blockette chain is traversed and validated but left in the
+ * record, only the values needed for the common header fields are
+ * extracted.  The chain is decoded on demand by functions that need
+ * it or explicitly with msr_decode_blockettes(), which requires that
+ * the record buffer is still valid.
+ *
  * If the msr struct is NULL it will be allocated.
  *
  * Returns MS_NOERROR and populates the MSRecord struct at *ppmsr on
@@ -69,6 +94,8 @@ msr_unpack (char *record, int reclen, MSRecord **ppmsr,
 {
   flag headerswapflag = 0;
   flag dataswapflag   = 0;
+  flag dswapflag;
+  flag bigendianhost;
   int retval;
 
   MSRecord *msr = NULL;
@@ -76,12 +103,9 @@ msr_unpack (char *record, int reclen, MSRecord **ppmsr,
   char srcname[50];
 
   /* For blockette parsing */
-  BlktLink *blkt_link = 0;
-  uint16_t blkt_type;
-  uint16_t next_blkt;
-  uint32_t blkt_offset;
-  uint32_t blkt_length;
+  BlktScan scan;
   int blkt_count = 0;
+  flag lazy;
 
   if (!ppmsr)
   {
@@ -126,8 +150,9 @@ msr_unpack (char *record, int reclen, MSRecord **ppmsr,
     if (check_environment (verbose))
       return MS_GENERROR;
 
-  /* Allocate and copy fixed section of data header */
-  msr->fsdh = realloc (msr->fsdh, sizeof (struct fsdh_s));
+  /* Allocate, if not retained from a previous record, and copy fixed section of data header */
+  if (msr->fsdh == NULL)
+    msr->fsdh = malloc (sizeof (struct fsdh_s));
 
   if (msr->fsdh == NULL)
   {
@@ -191,7 +216,307 @@ msr_unpack (char *record, int reclen, MSRecord **ppmsr,
       ms_log (1, "%s: Byte swapping NOT needed for unpacking of header\n", srcname);
   }
 
-  /* Traverse the blockettes */
+  /* Traverse the blockettes, decoding them unless lazy unpacking is enabled */
+  lazy = (unpacklazyblockettes) ? 1 : 0;
+
+  if (lazy && !msr->arena)
+  {
+    if ((msr->arena = (MSRecordArena *)calloc (1, sizeof (MSRecordArena))) == NULL)
+    {
+      ms_log (2, "msr_unpack(): Cannot allocate memory\n");
+      return MS_GENERROR;
+    }
+  }
+
+  blkt_count = msr_unpack_blockettes (msr, reclen, headerswapflag, lazy,
+                                      &scan, 0, srcname, verbose);
+
+  if (lazy)
+  {
+    msr->arena->blktpending  = (blkt_count > 0) ? 1 : 0;
+    msr->arena->blktswapflag = headerswapflag;
+    msr->arena->blktreclen   = reclen;
+  }
+
+  /* Check for a Blockette 1000 */
+  if (!scan.b1000)
+  {
+    if (verbose > 1)
+    {
+      ms_log (1, "%s: Warning: No Blockette 1000 found\n", srcname);
+    }
+  }
+
+  /* Check that the data offset is after the blockette chain */
+  if (scan.chainend && msr->fsdh->numsamples && msr->fsdh->data_offset < scan.chainend)
+  {
+    ms_log (1, "%s: Warning: Data offset in fixed header (%d) is within the blockette chain ending at %d\n",
+            srcname, msr->fsdh->data_offset, scan.chainend);
+  }
+
+  /* Check that the blockette count matches the number parsed */
+  if (msr->fsdh->numblockettes != blkt_count)
+  {
+    ms_log (1, "%s: Warning: Number of blockettes in fixed header (%d) does not match the number parsed (%d)\n",
+            srcname, msr->fsdh->numblockettes, blkt_count);
+  }
+
+  /* Populate remaining common header fields */
+  if (lazy)
+  {
+    /* Same as msr_starttime() and msr_samprate() using the extracted values */
+    msr->starttime = msr_starttime_uc (msr);
+
+    if (msr->starttime != HPTERROR)
+    {
+      if (msr->fsdh->time_correct != 0 && !(msr->fsdh->act_flags & 0x02))
+        msr->starttime += (hptime_t)msr->fsdh->time_correct * (HPTMODULUS / 10000);
+
+      if (scan.b1001)
+        msr->starttime += (hptime_t)scan.usec * (HPTMODULUS / 1000000);
+    }
+
+    msr->samprate = (scan.b100) ? (double)scan.samprate : msr_nomsamprate (msr);
+  }
+  else
+  {
+    msr->starttime = msr_starttime (msr);
+    msr->samprate  = msr_samprate (msr);
+  }
+
+  /* Set MSRecord->byteorder if data byte order is forced */
+  if (unpackdatabyteorder >= 0)
+  {
+    msr->byteorder = unpackdatabyteorder;
+  }
+
+  /* Check if encoding format is forced */
+  if (unpackencodingformat >= 0)
+  {
+    msr->encoding = unpackencodingformat;
+  }
+
+  /* Use encoding format fallback if defined and no encoding is set,
+     also make sure the byteorder is set by default to big endian */
+  if (unpackencodingfallback >= 0 && msr->encoding == -1)
+  {
+    msr->encoding = unpackencodingfallback;
+
+    if (msr->byteorder == -1)
+    {
+      msr->byteorder = 1;
+    }
+  }
+
+  /* Determine byte order of the data and set the dswapflag as
+     needed; if no Blkt1000 or UNPACK_DATA_BYTEORDER environment
+     variable setting assume the order is the same as the header */
+  dswapflag     = headerswapflag;
+  bigendianhost = ms_bigendianhost ();
+
+  if (scan.b1000 && unpackdatabyteorder < 0)
+  {
+    dswapflag = 0;
+
+    /* If BE host and LE data need swapping */
+    if (bigendianhost && msr->byteorder == 0)
+      dswapflag = 1;
+    /* If LE host and BE data (or bad byte order value) need swapping */
+    else if (!bigendianhost && msr->byteorder > 0)
+      dswapflag = 1;
+  }
+  else if (unpackdatabyteorder >= 0)
+  {
+    dswapflag = dataswapflag;
+  }
+
+  /* Retain data byte order for decoding after unpacking, see msr_steimframes() */
+  if (msr->arena)
+    msr->arena->dataswapflag = dswapflag;
+
+  /* Unpack the data samples if requested */
+  if (dataflag && msr->samplecnt > 0)
+  {
+    if (verbose > 2 && dswapflag)
+      ms_log (1, "%s: Byte swapping needed for unpacking of data samples\n", srcname);
+    else if (verbose > 2)
+      ms_log (1, "%s: Byte swapping NOT needed for unpacking of data samples\n", srcname);
+
+    retval = msr_unpack_data (msr, dswapflag, verbose);
+
+    if (retval < 0)
+      return retval;
+    else
+      msr->numsamples = retval;
+  }
+  else
+  {
+    if (msr->datasamples)
+      free (msr->datasamples);
+
+    msr->datasamples = 0;
+    msr->numsamples  = 0;
+  }
+
+  return MS_NOERROR;
+} /* End of msr_unpack() */
+
+/***************************************************************************
+ * msr_steimframes:
+ *
+ * Prepare the incremental decoding of the Steim1 or Steim2 data frames
+ * of an unpacked record with msr_decode_steimframe(), one frame at a
+ * time.  The record may have been unpacked without data samples.  The
+ * frames are decoded from the record at MSRecord->record which must
+ * remain valid while decoding.
+ *
+ * The byte order of the data is the order determined by msr_unpack()
+ * when the record has a memory arena, e.g. with lazy blockette
+ * unpacking, otherwise it is taken from MSRecord->byteorder with big
+ * endian assumed when not known.
+ *
+ * Returns MS_NOERROR on success and a libmseed error code on error.
+ ***************************************************************************/
+int
+msr_steimframes (MSRecord *msr, MSSteimFrames *frames)
+{
+  if (!msr || !frames || !msr->record || !msr->fsdh)
+    return MS_GENERROR;
+
+  memset (frames, 0, sizeof (MSSteimFrames));
+
+  if (msr_srcname (msr, frames->srcname, 1) == NULL)
+  {
+    ms_log (2, "msr_steimframes(): Cannot generate srcname\n");
+    return MS_GENERROR;
+  }
+
+  if (msr->encoding != DE_STEIM1 && msr->encoding != DE_STEIM2)
+  {
+    ms_log (2, "msr_steimframes(%s): Encoding is not Steim1 or Steim2: %d\n",
+            frames->srcname, msr->encoding);
+    return MS_UNKNOWNFORMAT;
+  }
+
+  /* Sanity check record length and data offset as msr_unpack_data() */
+  if (msr->reclen < MINRECLEN || msr->reclen > MAXRECLEN)
+  {
+    ms_log (2, "msr_steimframes(%s): Unsupported record length: %d\n",
+            frames->srcname, msr->reclen);
+    return MS_OUTOFRANGE;
+  }
+
+  if (msr->fsdh->data_offset < 48 || msr->fsdh->data_offset >= msr->reclen)
+  {
+    ms_log (2, "msr_steimframes(%s): data offset value is not valid: %d\n",
+            frames->srcname, msr->fsdh->data_offset);
+    return MS_GENERROR;
+  }
+
+  frames->frames      = msr->record + msr->fsdh->data_offset;
+  frames->framecount  = (msr->reclen - msr->fsdh->data_offset) / 64;
+  frames->samplecount = msr->samplecnt;
+  frames->encoding    = msr->encoding;
+
+  if (msr->arena)
+    frames->swapflag = msr->arena->dataswapflag;
+  else if (msr->byteorder == 0)
+    frames->swapflag = ms_bigendianhost ();
+  else
+    frames->swapflag = !ms_bigendianhost ();
+
+  return MS_NOERROR;
+} /* End of msr_steimframes() */
+
+/***************************************************************************
+ * msr_decode_blockettes:
+ *
+ * Decode a blockette chain left in the raw record by msr_unpack()
+ * when lazy blockette unpacking is enabled with
+ * MS_UNPACKLAZYBLOCKETTES(1).  The chain is decoded from the record
+ * at MSRecord->record which must still contain the record originally
+ * unpacked.  Record length, encoding and byte order of the MSRecord
+ * are retained, they may have been forced or changed since unpacking.
+ *
+ * Functions that need the blockette chain call this function as
+ * needed; nothing is done if no chain is pending.
+ *
+ * Returns MS_NOERROR on success and a libmseed error code on error.
+ ***************************************************************************/
+int
+msr_decode_blockettes (MSRecord *msr, flag verbose)
+{
+  MSRecordArena *arena;
+  BlktScan scan;
+  char srcname[50];
+  int32_t reclen;
+  int8_t encoding;
+  int8_t byteorder;
+
+  if (!msr)
+    return MS_GENERROR;
+
+  arena = msr->arena;
+
+  if (!arena || !arena->blktpending)
+    return MS_NOERROR;
+
+  arena->blktpending = 0;
+
+  if (!msr->record || !msr->fsdh)
+  {
+    ms_log (2, "msr_decode_blockettes(): No record for pending blockette chain\n");
+    return MS_GENERROR;
+  }
+
+  srcname[0] = '\0';
+  msr_srcname (msr, srcname, 1);
+
+  reclen    = msr->reclen;
+  encoding  = msr->encoding;
+  byteorder = msr->byteorder;
+
+  msr_unpack_blockettes (msr, arena->blktreclen, arena->blktswapflag, 0,
+                         &scan, 1, srcname, verbose);
+
+  msr->reclen    = reclen;
+  msr->encoding  = encoding;
+  msr->byteorder = byteorder;
+
+  return MS_NOERROR;
+} /* End of msr_decode_blockettes() */
+
+/***************************************************************************
+ * msr_unpack_blockettes:
+ *
+ * Traverse the blockette chain of the record at MSRecord->record.  If
+ * 'lazy' is false each blockette is decoded into the blockette chain
+ * of the MSRecord.  If 'lazy' is true the chain is only traversed and
+ * validated, the values needed for the common header fields are
+ * extracted into the BlktScan struct and the blockettes are left in
+ * the raw record to be decoded on demand by msr_decode_blockettes().
+ * Record length, encoding and byte order from a Blockette 1000 are
+ * set in the MSRecord in both cases.
+ *
+ * If 'quiet' is true problems with the chain are not reported, used
+ * when a chain that was already traversed is decoded.
+ *
+ * Returns the number of blockettes traversed.
+ ***************************************************************************/
+static int
+msr_unpack_blockettes (MSRecord *msr, int reclen, flag swapflag, flag lazy,
+                       BlktScan *scan, flag quiet, char *srcname, flag verbose)
+{
+  char *record = msr->record;
+  BlktLink *blkt_link = 0;
+  uint16_t blkt_type;
+  uint16_t next_blkt;
+  uint32_t blkt_offset;
+  uint32_t blkt_length;
+  int blkt_count = 0;
+
+  memset (scan, 0, sizeof (BlktScan));
+
   blkt_offset = msr->fsdh->blockette_offset;
 
   while ((blkt_offset != 0) &&
@@ -204,7 +529,7 @@ msr_unpack (char *record, int reclen, MSRecord **ppmsr,
     memcpy (&next_blkt, record + blkt_offset, 2);
     blkt_offset += 2;
 
-    if (headerswapflag)
+    if (swapflag)
     {
       ms_gswap2 (&blkt_type);
       ms_gswap2 (&next_blkt);
@@ -213,386 +538,433 @@ msr_unpack (char *record, int reclen, MSRecord **ppmsr,
     /* Get blockette length */
     blkt_length = ms_blktlen (blkt_type,
                               record + blkt_offset - 4,
-                              headerswapflag);
+                              swapflag);
 
     if (blkt_length == 0)
     {
-      ms_log (2, "msr_unpack(%s): Unknown blockette length for type %d\n",
-              srcname, blkt_type);
+      if (!quiet)
+        ms_log (2, "msr_unpack(%s): Unknown blockette length for type %d\n",
+                srcname, blkt_type);
       break;
     }
 
     /* Make sure blockette is contained within the msrecord buffer */
     if ((int)(blkt_offset - 4 + blkt_length) > reclen)
     {
-      ms_log (2, "msr_unpack(%s): Blockette %d extends beyond record size, truncated?\n",
-              srcname, blkt_type);
+      if (!quiet)
+        ms_log (2, "msr_unpack(%s): Blockette %d extends beyond record size, truncated?\n",
+                srcname, blkt_type);
       break;
     }
 
-    if (blkt_type == 100)
-    { /* Found a Blockette 100 */
-      struct blkt_100_s *blkt_100;
+    if (lazy)
+    { /* Extract values for the common header fields, no decoding */
+      if (blkt_type == 100)
+      {
+        memcpy (&scan->samprate, record + blkt_offset, sizeof (float));
+        if (swapflag)
+          ms_gswap4 (&scan->samprate);
 
-      blkt_link = msr_addblockette (msr, record + blkt_offset,
-                                    sizeof (struct blkt_100_s),
-                                    blkt_type, 0);
-      if (!blkt_link)
-        break;
+        scan->b100 = 1;
+      }
+      else if (blkt_type == 1000)
+      {
+        /* All fields of Blockette 1000 are single bytes */
+        struct blkt_1000_s *blkt_1000 = (struct blkt_1000_s *)(record + blkt_offset);
 
-      blkt_link->blktoffset = blkt_offset - 4;
-      blkt_link->next_blkt  = next_blkt;
+        msr->reclen = (uint32_t)1 << blkt_1000->reclen;
 
-      blkt_100 = (struct blkt_100_s *)blkt_link->blktdata;
+        if (msr->reclen != reclen && verbose && !quiet)
+        {
+          ms_log (2, "msr_unpack(%s): Record length in Blockette 1000 (%d) != specified length (%d)\n",
+                  srcname, msr->reclen, reclen);
+        }
 
-      if (headerswapflag)
+        msr->encoding  = blkt_1000->encoding;
+        msr->byteorder = blkt_1000->byteorder;
+        scan->b1000    = 1;
+      }
+      else if (blkt_type == 1001)
       {
-        ms_gswap4 (&blkt_100->samprate);
+        scan->usec  = ((struct blkt_1001_s *)(record + blkt_offset))->usec;
+        scan->b1001 = 1;
       }
 
-      msr->samprate = msr->Blkt100->samprate;
+      scan->chainend = blkt_offset + blkt_datalen (blkt_type, record + blkt_offset,
+                                                   blkt_length, swapflag);
     }
+    else
+    {
+      if (blkt_type == 100)
+      { /* Found a Blockette 100 */
+        struct blkt_100_s *blkt_100;
 
-    else if (blkt_type == 200)
-    { /* Found a Blockette 200 */
-      struct blkt_200_s *blkt_200;
+        blkt_link = msr_addblockette (msr, record + blkt_offset,
+                                      sizeof (struct blkt_100_s),
+                                      blkt_type, 0);
+        if (!blkt_link)
+          break;
 
-      blkt_link = msr_addblockette (msr, record + blkt_offset,
-                                    sizeof (struct blkt_200_s),
-                                    blkt_type, 0);
-      if (!blkt_link)
-        break;
+        blkt_link->blktoffset = blkt_offset - 4;
+        blkt_link->next_blkt  = next_blkt;
 
-      blkt_link->blktoffset = blkt_offset - 4;
-      blkt_link->next_blkt  = next_blkt;
+        blkt_100 = (struct blkt_100_s *)blkt_link->blktdata;
 
-      blkt_200 = (struct blkt_200_s *)blkt_link->blktdata;
+        if (swapflag)
+        {
+          ms_gswap4 (&blkt_100->samprate);
+        }
 
-      if (headerswapflag)
-      {
-        ms_gswap4 (&blkt_200->amplitude);
-        ms_gswap4 (&blkt_200->period);
-        ms_gswap4 (&blkt_200->background_estimate);
-        MS_SWAPBTIME (&blkt_200->time);
+        msr->samprate = msr->Blkt100->samprate;
       }
-    }
 
-    else if (blkt_type == 201)
-    { /* Found a Blockette 201 */
-      struct blkt_201_s *blkt_201;
+      else if (blkt_type == 200)
+      { /* Found a Blockette 200 */
+        struct blkt_200_s *blkt_200;
 
-      blkt_link = msr_addblockette (msr, record + blkt_offset,
-                                    sizeof (struct blkt_201_s),
-                                    blkt_type, 0);
-      if (!blkt_link)
-        break;
+        blkt_link = msr_addblockette (msr, record + blkt_offset,
+                                      sizeof (struct blkt_200_s),
+                                      blkt_type, 0);
+        if (!blkt_link)
+          break;
 
-      blkt_link->blktoffset = blkt_offset - 4;
-      blkt_link->next_blkt  = next_blkt;
+        blkt_link->blktoffset = blkt_offset - 4;
+        blkt_link->next_blkt  = next_blkt;
 
-      blkt_201 = (struct blkt_201_s *)blkt_link->blktdata;
+        blkt_200 = (struct blkt_200_s *)blkt_link->blktdata;
 
-      if (headerswapflag)
-      {
-        ms_gswap4 (&blkt_201->amplitude);
-        ms_gswap4 (&blkt_201->period);
-        ms_gswap4 (&blkt_201->background_estimate);
-        MS_SWAPBTIME (&blkt_201->time);
+        if (swapflag)
+        {
+          ms_gswap4 (&blkt_200->amplitude);
+          ms_gswap4 (&blkt_200->period);
+          ms_gswap4 (&blkt_200->background_estimate);
+          MS_SWAPBTIME (&blkt_200->time);
+        }
       }
-    }
 
-    else if (blkt_type == 300)
-    { /* Found a Blockette 300 */
-      struct blkt_300_s *blkt_300;
+      else if (blkt_type == 201)
+      { /* Found a Blockette 201 */
+        struct blkt_201_s *blkt_201;
 
-      blkt_link = msr_addblockette (msr, record + blkt_offset,
-                                    sizeof (struct blkt_300_s),
-                                    blkt_type, 0);
-      if (!blkt_link)
-        break;
+        blkt_link = msr_addblockette (msr, record + blkt_offset,
+                                      sizeof (struct blkt_201_s),
+                                      blkt_type, 0);
+        if (!blkt_link)
+          break;
 
-      blkt_link->blktoffset = blkt_offset - 4;
-      blkt_link->next_blkt  = next_blkt;
+        blkt_link->blktoffset = blkt_offset - 4;
+        blkt_link->next_blkt  = next_blkt;
 
-      blkt_300 = (struct blkt_300_s *)blkt_link->blktdata;
+        blkt_201 = (struct blkt_201_s *)blkt_link->blktdata;
 
-      if (headerswapflag)
-      {
-        MS_SWAPBTIME (&blkt_300->time);
-        ms_gswap4 (&blkt_300->step_duration);
-        ms_gswap4 (&blkt_300->interval_duration);
-        ms_gswap4 (&blkt_300->amplitude);
-        ms_gswap4 (&blkt_300->reference_amplitude);
+        if (swapflag)
+        {
+          ms_gswap4 (&blkt_201->amplitude);
+          ms_gswap4 (&blkt_201->period);
+          ms_gswap4 (&blkt_201->background_estimate);
+          MS_SWAPBTIME (&blkt_201->time);
+        }
       }
-    }
 
-    else if (blkt_type == 310)
-    { /* Found a Blockette 310 */
-      struct blkt_310_s *blkt_310;
+      else if (blkt_type == 300)
+      { /* Found a Blockette 300 */
+        struct blkt_300_s *blkt_300;
 
-      blkt_link = msr_addblockette (msr, record + blkt_offset,
-                                    sizeof (struct blkt_310_s),
-                                    blkt_type, 0);
-      if (!blkt_link)
-        break;
+        blkt_link = msr_addblockette (msr, record + blkt_offset,
+                                      sizeof (struct blkt_300_s),
+                                      blkt_type, 0);
+        if (!blkt_link)
+          break;
 
-      blkt_link->blktoffset = blkt_offset - 4;
-      blkt_link->next_blkt  = next_blkt;
+        blkt_link->blktoffset = blkt_offset - 4;
+        blkt_link->next_blkt  = next_blkt;
 
-      blkt_310 = (struct blkt_310_s *)blkt_link->blktdata;
+        blkt_300 = (struct blkt_300_s *)blkt_link->blktdata;
 
-      if (headerswapflag)
-      {
-        MS_SWAPBTIME (&blkt_310->time);
-        ms_gswap4 (&blkt_310->duration);
-        ms_gswap4 (&blkt_310->period);
-        ms_gswap4 (&blkt_310->amplitude);
-        ms_gswap4 (&blkt_310->reference_amplitude);
+        if (swapflag)
+        {
+          MS_SWAPBTIME (&blkt_300->time);
+          ms_gswap4 (&blkt_300->step_duration);
+          ms_gswap4 (&blkt_300->interval_duration);
+          ms_gswap4 (&blkt_300->amplitude);
+          ms_gswap4 (&blkt_300->reference_amplitude);
+        }
       }
-    }
 
-    else if (blkt_type == 320)
-    { /* Found a Blockette 320 */
-      struct blkt_320_s *blkt_320;
+      else if (blkt_type == 310)
+      { /* Found a Blockette 310 */
+        struct blkt_310_s *blkt_310;
 
-      blkt_link = msr_addblockette (msr, record + blkt_offset,
-                                    sizeof (struct blkt_320_s),
-                                    blkt_type, 0);
-      if (!blkt_link)
-        break;
+        blkt_link = msr_addblockette (msr, record + blkt_offset,
+                                      sizeof (struct blkt_310_s),
+                                      blkt_type, 0);
+        if (!blkt_link)
+          break;
 
-      blkt_link->blktoffset = blkt_offset - 4;
-      blkt_link->next_blkt  = next_blkt;
+        blkt_link->blktoffset = blkt_offset - 4;
+        blkt_link->next_blkt  = next_blkt;
 
-      blkt_320 = (struct blkt_320_s *)blkt_link->blktdata;
+        blkt_310 = (struct blkt_310_s *)blkt_link->blktdata;
 
-      if (headerswapflag)
-      {
-        MS_SWAPBTIME (&blkt_320->time);
-        ms_gswap4 (&blkt_320->duration);
-        ms_gswap4 (&blkt_320->ptp_amplitude);
-        ms_gswap4 (&blkt_320->reference_amplitude);
+        if (swapflag)
+        {
+          MS_SWAPBTIME (&blkt_310->time);
+          ms_gswap4 (&blkt_310->duration);
+          ms_gswap4 (&blkt_310->period);
+          ms_gswap4 (&blkt_310->amplitude);
+          ms_gswap4 (&blkt_310->reference_amplitude);
+        }
       }
-    }
 
-    else if (blkt_type == 390)
-    { /* Found a Blockette 390 */
-      struct blkt_390_s *blkt_390;
+      else if (blkt_type == 320)
+      { /* Found a Blockette 320 */
+        struct blkt_320_s *blkt_320;
 
-      blkt_link = msr_addblockette (msr, record + blkt_offset,
-                                    sizeof (struct blkt_390_s),
-                                    blkt_type, 0);
-      if (!blkt_link)
-        break;
+        blkt_link = msr_addblockette (msr, record + blkt_offset,
+                                      sizeof (struct blkt_320_s),
+                                      blkt_type, 0);
+        if (!blkt_link)
+          break;
 
-      blkt_link->blktoffset = blkt_offset - 4;
-      blkt_link->next_blkt  = next_blkt;
+        blkt_link->blktoffset = blkt_offset - 4;
+        blkt_link->next_blkt  = next_blkt;
 
-      blkt_390 = (struct blkt_390_s *)blkt_link->blktdata;
+        blkt_320 = (struct blkt_320_s *)blkt_link->blktdata;
 
-      if (headerswapflag)
-      {
-        MS_SWAPBTIME (&blkt_390->time);
-        ms_gswap4 (&blkt_390->duration);
-        ms_gswap4 (&blkt_390->amplitude);
+        if (swapflag)
+        {
+          MS_SWAPBTIME (&blkt_320->time);
+          ms_gswap4 (&blkt_320->duration);
+          ms_gswap4 (&blkt_320->ptp_amplitude);
+          ms_gswap4 (&blkt_320->reference_amplitude);
+        }
       }
-    }
 
-    else if (blkt_type == 395)
-    { /* Found a Blockette 395 */
-      struct blkt_395_s *blkt_395;
+      else if (blkt_type == 390)
+      { /* Found a Blockette 390 */
+        struct blkt_390_s *blkt_390;
 
-      blkt_link = msr_addblockette (msr, record + blkt_offset,
-                                    sizeof (struct blkt_395_s),
-                                    blkt_type, 0);
-      if (!blkt_link)
-        break;
+        blkt_link = msr_addblockette (msr, record + blkt_offset,
+                                      sizeof (struct blkt_390_s),
+                                      blkt_type, 0);
+        if (!blkt_link)
+          break;
 
-      blkt_link->blktoffset = blkt_offset - 4;
-      blkt_link->next_blkt  = next_blkt;
+        blkt_link->blktoffset = blkt_offset - 4;
+        blkt_link->next_blkt  = next_blkt;
 
-      blkt_395 = (struct blkt_395_s *)blkt_link->blktdata;
+        blkt_390 = (struct blkt_390_s *)blkt_link->blktdata;
 
-      if (headerswapflag)
-      {
-        MS_SWAPBTIME (&blkt_395->time);
+        if (swapflag)
+        {
+          MS_SWAPBTIME (&blkt_390->time);
+          ms_gswap4 (&blkt_390->duration);
+          ms_gswap4 (&blkt_390->amplitude);
+        }
       }
-    }
 
-    else if (blkt_type == 400)
-    { /* Found a Blockette 400 */
-      struct blkt_400_s *blkt_400;
+      else if (blkt_type == 395)
+      { /* Found a Blockette 395 */
+        struct blkt_395_s *blkt_395;
 
-      blkt_link = msr_addblockette (msr, record + blkt_offset,
-                                    sizeof (struct blkt_400_s),
-                                    blkt_type, 0);
-      if (!blkt_link)
-        break;
+        blkt_link = msr_addblockette (msr, record + blkt_offset,
+                                      sizeof (struct blkt_395_s),
+                                      blkt_type, 0);
+        if (!blkt_link)
+          break;
 
-      blkt_link->blktoffset = blkt_offset - 4;
-      blkt_link->next_blkt  = next_blkt;
+        blkt_link->blktoffset = blkt_offset - 4;
+        blkt_link->next_blkt  = next_blkt;
 
-      blkt_400 = (struct blkt_400_s *)blkt_link->blktdata;
+        blkt_395 = (struct blkt_395_s *)blkt_link->blktdata;
 
-      if (headerswapflag)
-      {
-        ms_gswap4 (&blkt_400->azimuth);
-        ms_gswap4 (&blkt_400->slowness);
-        ms_gswap2 (&blkt_400->configuration);
+        if (swapflag)
+        {
+          MS_SWAPBTIME (&blkt_395->time);
+        }
       }
-    }
 
-    else if (blkt_type == 405)
-    { /* Found a Blockette 405 */
-      struct blkt_405_s *blkt_405;
+      else if (blkt_type == 400)
+      { /* Found a Blockette 400 */
+        struct blkt_400_s *blkt_400;
 
-      blkt_link = msr_addblockette (msr, record + blkt_offset,
-                                    sizeof (struct blkt_405_s),
-                                    blkt_type, 0);
-      if (!blkt_link)
-        break;
+        blkt_link = msr_addblockette (msr, record + blkt_offset,
+                                      sizeof (struct blkt_400_s),
+                                      blkt_type, 0);
+        if (!blkt_link)
+          break;
 
-      blkt_link->blktoffset = blkt_offset - 4;
-      blkt_link->next_blkt  = next_blkt;
+        blkt_link->blktoffset = blkt_offset - 4;
+        blkt_link->next_blkt  = next_blkt;
 
-      blkt_405 = (struct blkt_405_s *)blkt_link->blktdata;
+        blkt_400 = (struct blkt_400_s *)blkt_link->blktdata;
 
-      if (headerswapflag)
-      {
-        ms_gswap2 (&blkt_405->delay_values);
+        if (swapflag)
+        {
+          ms_gswap4 (&blkt_400->azimuth);
+          ms_gswap4 (&blkt_400->slowness);
+          ms_gswap2 (&blkt_400->configuration);
+        }
       }
 
-      if (verbose > 0)
-      {
-        ms_log (1, "msr_unpack(%s): WARNING Blockette 405 cannot be fully supported\n",
-                srcname);
-      }
-    }
+      else if (blkt_type == 405)
+      { /* Found a Blockette 405 */
+        struct blkt_405_s *blkt_405;
 
-    else if (blkt_type == 500)
-    { /* Found a Blockette 500 */
-      struct blkt_500_s *blkt_500;
+        blkt_link = msr_addblockette (msr, record + blkt_offset,
+                                      sizeof (struct blkt_405_s),
+                                      blkt_type, 0);
+        if (!blkt_link)
+          break;
 
-      blkt_link = msr_addblockette (msr, record + blkt_offset,
-                                    sizeof (struct blkt_500_s),
-                                    blkt_type, 0);
-      if (!blkt_link)
-        break;
+        blkt_link->blktoffset = blkt_offset - 4;
+        blkt_link->next_blkt  = next_blkt;
 
-      blkt_link->blktoffset = blkt_offset - 4;
-      blkt_link->next_blkt  = next_blkt;
+        blkt_405 = (struct blkt_405_s *)blkt_link->blktdata;
 
-      blkt_500 = (struct blkt_500_s *)blkt_link->blktdata;
+        if (swapflag)
+        {
+          ms_gswap2 (&blkt_405->delay_values);
+        }
 
-      if (headerswapflag)
-      {
-        ms_gswap4 (&blkt_500->vco_correction);
-        MS_SWAPBTIME (&blkt_500->time);
-        ms_gswap4 (&blkt_500->exception_count);
+        if (verbose > 0 && !quiet)
+        {
+          ms_log (1, "msr_unpack(%s): WARNING Blockette 405 cannot be fully supported\n",
+                  srcname);
+        }
       }
-    }
-
-    else if (blkt_type == 1000)
-    { /* Found a Blockette 1000 */
-      struct blkt_1000_s *blkt_1000;
 
-      blkt_link = msr_addblockette (msr, record + blkt_offset,
-                                    sizeof (struct blkt_1000_s),
-                                    blkt_type, 0);
-      if (!blkt_link)
-        break;
+      else if (blkt_type == 500)
+      { /* Found a Blockette 500 */
+        struct blkt_500_s *blkt_500;
 
-      blkt_link->blktoffset = blkt_offset - 4;
-      blkt_link->next_blkt  = next_blkt;
+        blkt_link = msr_addblockette (msr, record + blkt_offset,
+                                      sizeof (struct blkt_500_s),
+                                      blkt_type, 0);
+        if (!blkt_link)
+          break;
 
-      blkt_1000 = (struct blkt_1000_s *)blkt_link->blktdata;
+        blkt_link->blktoffset = blkt_offset - 4;
+        blkt_link->next_blkt  = next_blkt;
 
-      /* Calculate record length in bytes as 2^(blkt_1000->reclen) */
-      msr->reclen = (uint32_t)1 << blkt_1000->reclen;
+        blkt_500 = (struct blkt_500_s *)blkt_link->blktdata;
 
-      /* Compare against the specified length */
-      if (msr->reclen != reclen && verbose)
-      {
-        ms_log (2, "msr_unpack(%s): Record length in Blockette 1000 (%d) != specified length (%d)\n",
-                srcname, msr->reclen, reclen);
+        if (swapflag)
+        {
+          ms_gswap4 (&blkt_500->vco_correction);
+          MS_SWAPBTIME (&blkt_500->time);
+          ms_gswap4 (&blkt_500->exception_count);
+        }
       }
 
-      msr->encoding  = blkt_1000->encoding;
-      msr->byteorder = blkt_1000->byteorder;
-    }
+      else if (blkt_type == 1000)
+      { /* Found a Blockette 1000 */
+        struct blkt_1000_s *blkt_1000;
 
-    else if (blkt_type == 1001)
-    { /* Found a Blockette 1001 */
-      blkt_link = msr_addblockette (msr, record + blkt_offset,
-                                    sizeof (struct blkt_1001_s),
-                                    blkt_type, 0);
-      if (!blkt_link)
-        break;
-
-      blkt_link->blktoffset = blkt_offset - 4;
-      blkt_link->next_blkt  = next_blkt;
-    }
-
-    else if (blkt_type == 2000)
-    { /* Found a Blockette 2000 */
-      struct blkt_2000_s *blkt_2000;
-      uint16_t b2klen;
-
-      /* Read the blockette length from blockette */
-      memcpy (&b2klen, record + blkt_offset, 2);
-      if (headerswapflag)
-        ms_gswap2 (&b2klen);
+        blkt_link = msr_addblockette (msr, record + blkt_offset,
+                                      sizeof (struct blkt_1000_s),
+                                      blkt_type, 0);
+        if (!blkt_link)
+          break;
 
-      /* Minus four bytes for the blockette type and next fields */
-      b2klen -= 4;
+        blkt_link->blktoffset = blkt_offset - 4;
+        blkt_link->next_blkt  = next_blkt;
 
-      blkt_link = msr_addblockette (msr, record + blkt_offset,
-                                    b2klen, blkt_type, 0);
-      if (!blkt_link)
-        break;
+        blkt_1000 = (struct blkt_1000_s *)blkt_link->blktdata;
 
-      blkt_link->blktoffset = blkt_offset - 4;
-      blkt_link->next_blkt  = next_blkt;
+        /* Calculate record length in bytes as 2^(blkt_1000->reclen) */
+        msr->reclen = (uint32_t)1 << blkt_1000->reclen;
 
-      blkt_2000 = (struct blkt_2000_s *)blkt_link->blktdata;
+        /* Compare against the specified length */
+        if (msr->reclen != reclen && verbose && !quiet)
+        {
+          ms_log (2, "msr_unpack(%s): Record length in Blockette 1000 (%d) != specified length (%d)\n",
+                  srcname, msr->reclen, reclen);
+        }
 
-      if (headerswapflag)
-      {
-        ms_gswap2 (&blkt_2000->length);
-        ms_gswap2 (&blkt_2000->data_offset);
-        ms_gswap4 (&blkt_2000->recnum);
+        msr->encoding  = blkt_1000->encoding;
+        msr->byteorder = blkt_1000->byteorder;
+        scan->b1000    = 1;
       }
-    }
 
-    else
-    { /* Unknown blockette type */
-      if (blkt_length >= 4)
-      {
+      else if (blkt_type == 1001)
+      { /* Found a Blockette 1001 */
         blkt_link = msr_addblockette (msr, record + blkt_offset,
-                                      blkt_length - 4,
+                                      sizeof (struct blkt_1001_s),
                                       blkt_type, 0);
+        if (!blkt_link)
+          break;
 
+        blkt_link->blktoffset = blkt_offset - 4;
+        blkt_link->next_blkt  = next_blkt;
+      }
+
+      else if (blkt_type == 2000)
+      { /* Found a Blockette 2000 */
+        struct blkt_2000_s *blkt_2000;
+        uint16_t b2klen;
+
+        /* Read the blockette length from blockette */
+        memcpy (&b2klen, record + blkt_offset, 2);
+        if (swapflag)
+          ms_gswap2 (&b2klen);
+
+        /* Minus four bytes for the blockette type and next fields */
+        b2klen -= 4;
+
+        blkt_link = msr_addblockette (msr, record + blkt_offset,
+                                      b2klen, blkt_type, 0);
         if (!blkt_link)
           break;
 
         blkt_link->blktoffset = blkt_offset - 4;
         blkt_link->next_blkt  = next_blkt;
+
+        blkt_2000 = (struct blkt_2000_s *)blkt_link->blktdata;
+
+        if (swapflag)
+        {
+          ms_gswap2 (&blkt_2000->length);
+          ms_gswap2 (&blkt_2000->data_offset);
+          ms_gswap4 (&blkt_2000->recnum);
+        }
+      }
+
+      else
+      { /* Unknown blockette type */
+        if (blkt_length >= 4)
+        {
+          blkt_link = msr_addblockette (msr, record + blkt_offset,
+                                        blkt_length - 4,
+                                        blkt_type, 0);
+
+          if (!blkt_link)
+            break;
+
+          blkt_link->blktoffset = blkt_offset - 4;
+          blkt_link->next_blkt  = next_blkt;
+        }
       }
+
+      if (blkt_link)
+        scan->chainend = blkt_link->blktoffset + blkt_link->blktdatalen + 4;
     }
 
     /* Check that the next blockette offset is beyond the current blockette */
     if (next_blkt && next_blkt < (blkt_offset + blkt_length - 4))
     {
-      ms_log (2, "msr_unpack(%s): Offset to next blockette (%d) is within current blockette ending at byte %d\n",
-              srcname, next_blkt, (blkt_offset + blkt_length - 4));
+      if (!quiet)
+        ms_log (2, "msr_unpack(%s): Offset to next blockette (%d) is within current blockette ending at byte %d\n",
+                srcname, next_blkt, (blkt_offset + blkt_length - 4));
 
       blkt_offset = 0;
     }
     /* Check that the offset is within record length */
     else if (next_blkt && next_blkt > reclen)
     {
-      ms_log (2, "msr_unpack(%s): Offset to next blockette (%d) from type %d is beyond record length\n",
-              srcname, next_blkt, blkt_type);
+      if (!quiet)
+        ms_log (2, "msr_unpack(%s): Offset to next blockette (%d) from type %d is beyond record length\n",
+                srcname, next_blkt, blkt_type);
 
       blkt_offset = 0;
     }
@@ -604,105 +976,62 @@ msr_unpack (char *record, int reclen, MSRecord **ppmsr,
     blkt_count++;
   } /* End of while looping through blockettes */
 
-  /* Check for a Blockette 1000 */
-  if (msr->Blkt1000 == 0)
-  {
-    if (verbose > 1)
-    {
-      ms_log (1, "%s: Warning: No Blockette 1000 found\n", srcname);
-    }
-  }
-
-  /* Check that the data offset is after the blockette chain */
-  if (blkt_link && msr->fsdh->numsamples && msr->fsdh->data_offset < (blkt_link->blktoffset + blkt_link->blktdatalen + 4))
-  {
-    ms_log (1, "%s: Warning: Data offset in fixed header (%d) is within the blockette chain ending at %d\n",
-            srcname, msr->fsdh->data_offset, (blkt_link->blktoffset + blkt_link->blktdatalen + 4));
-  }
-
-  /* Check that the blockette count matches the number parsed */
-  if (msr->fsdh->numblockettes != blkt_count)
-  {
-    ms_log (1, "%s: Warning: Number of blockettes in fixed header (%d) does not match the number parsed (%d)\n",
-            srcname, msr->fsdh->numblockettes, blkt_count);
-  }
+  return blkt_count;
+} /* End of msr_unpack_blockettes() */
 
-  /* Populate remaining common header fields */
-  msr->starttime = msr_starttime (msr);
-  msr->samprate  = msr_samprate (msr);
-
-  /* Set MSRecord->byteorder if data byte order is forced */
-  if (unpackdatabyteorder >= 0)
-  {
-    msr->byteorder = unpackdatabyteorder;
-  }
-
-  /* Check if encoding format is forced */
-  if (unpackencodingformat >= 0)
-  {
-    msr->encoding = unpackencodingformat;
-  }
-
-  /* Use encoding format fallback if defined and no encoding is set,
-     also make sure the byteorder is set by default to big endian */
-  if (unpackencodingfallback >= 0 && msr->encoding == -1)
-  {
-    msr->encoding = unpackencodingfallback;
-
-    if (msr->byteorder == -1)
-    {
-      msr->byteorder = 1;
-    }
-  }
-
-  /* Unpack the data samples if requested */
-  if (dataflag && msr->samplecnt > 0)
-  {
-    flag dswapflag     = headerswapflag;
-    flag bigendianhost = ms_bigendianhost ();
-
-    /* Determine byte order of the data and set the dswapflag as
-       needed; if no Blkt1000 or UNPACK_DATA_BYTEORDER environment
-       variable setting assume the order is the same as the header */
-    if (msr->Blkt1000 != 0 && unpackdatabyteorder < 0)
-    {
-      dswapflag = 0;
-
-      /* If BE host and LE data need swapping */
-      if (bigendianhost && msr->byteorder == 0)
-        dswapflag = 1;
-      /* If LE host and BE data (or bad byte order value) need swapping */
-      else if (!bigendianhost && msr->byteorder > 0)
-        dswapflag = 1;
-    }
-    else if (unpackdatabyteorder >= 0)
-    {
-      dswapflag = dataswapflag;
-    }
-
-    if (verbose > 2 && dswapflag)
-      ms_log (1, "%s: Byte swapping needed for unpacking of data samples\n", srcname);
-    else if (verbose > 2)
-      ms_log (1, "%s: Byte swapping NOT needed for unpacking of data samples\n", srcname);
-
-    retval = msr_unpack_data (msr, dswapflag, verbose);
+/***************************************************************************
+ * blkt_datalen:
+ *
+ * Determine the length of the blockette body, as decoded into a
+ * blockette chain by msr_unpack_blockettes(), for a blockette of
+ * 'blkttype' starting at 'blktbody' with a total length of
+ * 'blktlength' as reported by ms_blktlen().
+ *
+ * Returns the body length in bytes.
+ ***************************************************************************/
+static int
+blkt_datalen (uint16_t blkttype, const char *blktbody, uint32_t blktlength,
+              flag swapflag)
+{
+  uint16_t b2klen;
 
-    if (retval < 0)
-      return retval;
-    else
-      msr->numsamples = retval;
-  }
-  else
+  switch (blkttype)
   {
-    if (msr->datasamples)
-      free (msr->datasamples);
-
-    msr->datasamples = 0;
-    msr->numsamples  = 0;
+  case 100:
+    return sizeof (struct blkt_100_s);
+  case 200:
+    return sizeof (struct blkt_200_s);
+  case 201:
+    return sizeof (struct blkt_201_s);
+  case 300:
+    return sizeof (struct blkt_300_s);
+  case 310:
+    return sizeof (struct blkt_310_s);
+  case 320:
+    return sizeof (struct blkt_320_s);
+  case 390:
+    return sizeof (struct blkt_390_s);
+  case 395:
+    return sizeof (struct blkt_395_s);
+  case 400:
+    return sizeof (struct blkt_400_s);
+  case 405:
+    return sizeof (struct blkt_405_s);
+  case 500:
+    return sizeof (struct blkt_500_s);
+  case 1000:
+    return sizeof (struct blkt_1000_s);
+  case 1001:
+    return sizeof (struct blkt_1001_s);
+  case 2000:
+    memcpy (&b2klen, blktbody, 2);
+    if (swapflag)
+      ms_gswap2 (&b2klen);
+    return (uint16_t) (b2klen - 4);
   }
 
-  return MS_NOERROR;
-} /* End of msr_unpack() */
+  return (blktlength >= 4) ? (int)blktlength - 4 : 0;
+} /* End of blkt_datalen() */
 
 /************************************************************************
  *  msr_unpack_data:
@@ -792,15 +1121,27 @@ msr_unpack_data (MSRecord *msr, int swapflag, flag verbose)
   /* Calculate buffer size needed for unpacked samples */
   unpacksize = (int)msr->samplecnt * samplesize;
 
-  /* (Re)Allocate space for the unpacked data */
+  /* (Re)Allocate space for the unpacked data, the buffer from a
+   * previous record is reused if large enough */
   if (unpacksize > 0)
   {
-    msr->datasamples = realloc (msr->datasamples, unpacksize);
-
-    if (msr->datasamples == NULL)
+    if (!msr->arena || !msr->datasamples ||
+        msr->datasamples != msr->arena->datasamples ||
+        msr->arena->datasize < (size_t)unpacksize)
     {
-      ms_log (2, "msr_unpack_data(%s): Cannot (re)allocate memory\n", srcname);
-      return MS_GENERROR;
+      msr->datasamples = realloc (msr->datasamples, unpacksize);
+
+      if (msr->datasamples == NULL)
+      {
+        ms_log (2, "msr_unpack_data(%s): Cannot (re)allocate memory\n", srcname);
+        return MS_GENERROR;
+      }
+
+      if (msr->arena)
+      {
+        msr->arena->datasamples = msr->datasamples;
+        msr->arena->datasize    = unpacksize;
+      }
     }
   }
   else
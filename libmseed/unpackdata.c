@@ -24,6 +24,107 @@ int decodedebug = 0;
 #define MAX16 0x7FFFul   /* maximum 16 bit positive # */
 #define MAX24 0x7FFFFFul /* maximum 24 bit positive # */
 
+/* Byte swapping and widening of uncompressed samples with SSSE3 when
+ * built for x86 with GCC or Clang, used if the CPU supports it.  The
+ * remaining samples of a block are decoded one at a time. */
+#if (defined(__x86_64__) || defined(__i386__)) && \
+    (defined(__clang__) || (defined(__GNUC__) && (__GNUC__ > 4 || (__GNUC__ == 4 && __GNUC_MINOR__ >= 9))))
+#define DECODE_SSSE3 1
+#include <tmmintrin.h>
+
+static int ssse3supported = -1;
+
+/************************************************************************
+ * decode_ssse3:
+ *
+ * Check if the CPU supports SSSE3, the result is cached.
+ *
+ * Return 1 if supported, 0 if not.
+ ************************************************************************/
+static int
+decode_ssse3 (void)
+{
+  if (ssse3supported < 0)
+  {
+    __builtin_cpu_init ();
+    ssse3supported = (__builtin_cpu_supports ("ssse3")) ? 1 : 0;
+  }
+
+  return ssse3supported;
+} /* End of decode_ssse3() */
+
+/************************************************************************
+ * decode_int16_ssse3:
+ *
+ * Decode 16-bit integers, 8 at a time, optionally reversing the bytes
+ * of each and sign extending to 32-bit integers.
+ *
+ * Return number of samples decoded, a multiple of 8.
+ ************************************************************************/
+__attribute__ ((target ("ssse3"))) static int
+decode_int16_ssse3 (const int16_t *input, int samplecount, int32_t *output,
+                    int swapflag)
+{
+  const __m128i mask = _mm_setr_epi8 (1, 0, 3, 2, 5, 4, 7, 6, 9, 8, 11, 10, 13, 12, 15, 14);
+  __m128i block;
+  int idx;
+
+  for (idx = 0; idx + 8 <= samplecount; idx += 8)
+  {
+    block = _mm_loadu_si128 ((const __m128i *)(input + idx));
+
+    if (swapflag)
+      block = _mm_shuffle_epi8 (block, mask);
+
+    /* Duplicate each value into both halves of 32 bits and shift back to sign extend */
+    _mm_storeu_si128 ((__m128i *)(output + idx), _mm_srai_epi32 (_mm_unpacklo_epi16 (block, block), 16));
+    _mm_storeu_si128 ((__m128i *)(output + idx + 4), _mm_srai_epi32 (_mm_unpackhi_epi16 (block, block), 16));
+  }
+
+  return idx;
+} /* End of decode_int16_ssse3() */
+
+/************************************************************************
+ * decode_swap4_ssse3:
+ *
+ * Reverse the bytes of 4-byte quantities, 4 at a time.
+ *
+ * Return number of quantities swapped, a multiple of 4.
+ ************************************************************************/
+__attribute__ ((target ("ssse3"))) static int
+decode_swap4_ssse3 (const void *input, int samplecount, void *output)
+{
+  const __m128i mask = _mm_setr_epi8 (3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8, 15, 14, 13, 12);
+  int idx;
+
+  for (idx = 0; idx + 4 <= samplecount; idx += 4)
+    _mm_storeu_si128 ((__m128i *)((char *)output + idx * 4),
+                      _mm_shuffle_epi8 (_mm_loadu_si128 ((const __m128i *)((const char *)input + idx * 4)), mask));
+
+  return idx;
+} /* End of decode_swap4_ssse3() */
+
+/************************************************************************
+ * decode_swap8_ssse3:
+ *
+ * Reverse the bytes of 8-byte quantities, 2 at a time.
+ *
+ * Return number of quantities swapped, a multiple of 2.
+ ************************************************************************/
+__attribute__ ((target ("ssse3"))) static int
+decode_swap8_ssse3 (const void *input, int samplecount, void *output)
+{
+  const __m128i mask = _mm_setr_epi8 (7, 6, 5, 4, 3, 2, 1, 0, 15, 14, 13, 12, 11, 10, 9, 8);
+  int idx;
+
+  for (idx = 0; idx + 2 <= samplecount; idx += 2)
+    _mm_storeu_si128 ((__m128i *)((char *)output + idx * 8),
+                      _mm_shuffle_epi8 (_mm_loadu_si128 ((const __m128i *)((const char *)input + idx * 8)), mask));
+
+  return idx;
+} /* End of decode_swap8_ssse3() */
+#endif /* DECODE_SSSE3 */
+
 /************************************************************************
  * msr_decode_int16:
  *
@@ -37,7 +138,7 @@ msr_decode_int16 (int16_t *input, int samplecount, int32_t *output,
                   int outputlength, int swapflag)
 {
   int16_t sample;
-  int idx;
+  int idx = 0;
 
   if (samplecount <= 0)
     return 0;
@@ -45,16 +146,27 @@ msr_decode_int16 (int16_t *input, int samplecount, int32_t *output,
   if (!input || !output || outputlength <= 0)
     return -1;
 
-  for (idx = 0; idx < samplecount && outputlength >= (int)sizeof (int32_t); idx++)
-  {
-    sample = input[idx];
+  if (samplecount > outputlength / (int)sizeof (int32_t))
+    samplecount = outputlength / (int)sizeof (int32_t);
 
-    if (swapflag)
-      ms_gswap2a (&sample);
-
-    output[idx] = (int32_t)sample;
+#ifdef DECODE_SSSE3
+  if (decode_ssse3 ())
+    idx = decode_int16_ssse3 (input, samplecount, output, swapflag);
+#endif
 
-    outputlength -= sizeof (int32_t);
+  if (swapflag)
+  {
+    for (; idx < samplecount; idx++)
+    {
+      sample = input[idx];
+      ms_gswap2a (&sample);
+      output[idx] = (int32_t)sample;
+    }
+  }
+  else
+  {
+    for (; idx < samplecount; idx++)
+      output[idx] = (int32_t)input[idx];
   }
 
   return idx;
@@ -73,7 +185,7 @@ msr_decode_int32 (int32_t *input, int samplecount, int32_t *output,
                   int outputlength, int swapflag)
 {
   int32_t sample;
-  int idx;
+  int idx = 0;
 
   if (samplecount <= 0)
     return 0;
@@ -81,16 +193,25 @@ msr_decode_int32 (int32_t *input, int samplecount, int32_t *output,
   if (!input || !output || outputlength <= 0)
     return -1;
 
-  for (idx = 0; idx < samplecount && outputlength >= (int)sizeof (int32_t); idx++)
+  if (samplecount > outputlength / (int)sizeof (int32_t))
+    samplecount = outputlength / (int)sizeof (int32_t);
+
+  if (!swapflag)
   {
-    sample = input[idx];
+    memcpy (output, input, samplecount * sizeof (int32_t));
+    return samplecount;
+  }
 
-    if (swapflag)
-      ms_gswap4a (&sample);
+#ifdef DECODE_SSSE3
+  if (decode_ssse3 ())
+    idx = decode_swap4_ssse3 (input, samplecount, output);
+#endif
 
+  for (; idx < samplecount; idx++)
+  {
+    sample = input[idx];
+    ms_gswap4a (&sample);
     output[idx] = sample;
-
-    outputlength -= sizeof (int32_t);
   }
 
   return idx;
@@ -109,7 +230,7 @@ msr_decode_float32 (float *input, int samplecount, float *output,
                     int outputlength, int swapflag)
 {
   float sample;
-  int idx;
+  int idx = 0;
 
   if (samplecount <= 0)
     return 0;
@@ -117,16 +238,25 @@ msr_decode_float32 (float *input, int samplecount, float *output,
   if (!input || !output || outputlength <= 0)
     return -1;
 
-  for (idx = 0; idx < samplecount && outputlength >= (int)sizeof (float); idx++)
+  if (samplecount > outputlength / (int)sizeof (float))
+    samplecount = outputlength / (int)sizeof (float);
+
+  if (!swapflag)
   {
-    memcpy (&sample, &input[idx], sizeof (float));
+    memcpy (output, input, samplecount * sizeof (float));
+    return samplecount;
+  }
 
-    if (swapflag)
-      ms_gswap4a (&sample);
+#ifdef DECODE_SSSE3
+  if (decode_ssse3 ())
+    idx = decode_swap4_ssse3 (input, samplecount, output);
+#endif
 
+  for (; idx < samplecount; idx++)
+  {
+    memcpy (&sample, &input[idx], sizeof (float));
+    ms_gswap4a (&sample);
     output[idx] = sample;
-
-    outputlength -= sizeof (float);
   }
 
   return idx;
@@ -145,7 +275,7 @@ msr_decode_float64 (double *input, int samplecount, double *output,
                     int outputlength, int swapflag)
 {
   double sample;
-  int idx;
+  int idx = 0;
 
   if (samplecount <= 0)
     return 0;
@@ -153,41 +283,98 @@ msr_decode_float64 (double *input, int samplecount, double *output,
   if (!input || !output || outputlength <= 0)
     return -1;
 
-  for (idx = 0; idx < samplecount && outputlength >= (int)sizeof (double); idx++)
+  if (samplecount > outputlength / (int)sizeof (double))
+    samplecount = outputlength / (int)sizeof (double);
+
+  if (!swapflag)
   {
-    memcpy (&sample, &input[idx], sizeof (double));
+    memcpy (output, input, samplecount * sizeof (double));
+    return samplecount;
+  }
 
-    if (swapflag)
-      ms_gswap8a (&sample);
+#ifdef DECODE_SSSE3
+  if (decode_ssse3 ())
+    idx = decode_swap8_ssse3 (input, samplecount, output);
+#endif
 
+  for (; idx < samplecount; idx++)
+  {
+    memcpy (&sample, &input[idx], sizeof (double));
+    ms_gswap8a (&sample);
     output[idx] = sample;
-
-    outputlength -= sizeof (double);
   }
 
   return idx;
 } /* End of msr_decode_float64() */
 
 /************************************************************************
- * msr_decode_steim1:
+ * msr_steim_loadframe:
  *
- * Decode Steim1 encoded miniSEED data and place in supplied buffer
- * as 32-bit integers.
+ * Copy a Steim frame and swap the word containing the nibbles if
+ * needed.  From the first frame the forward (X0) and reverse (Xn)
+ * integration constants are also extracted.
  *
- * Return number of samples in output buffer on success, -1 on error.
+ * Return the index of the first word of differences in the frame.
  ************************************************************************/
-int
-msr_decode_steim1 (int32_t *input, int inputlength, int samplecount,
-                   int32_t *output, int outputlength, char *srcname,
-                   int swapflag)
+static int
+msr_steim_loadframe (const void *input, int frameidx, uint32_t *frame,
+                     int32_t *X0, int32_t *Xn, int swapflag)
 {
-  int32_t *outputptr = output; /* Pointer to next output sample location */
-  uint32_t frame[16];          /* Frame, 16 x 32-bit quantities = 64 bytes */
-  int32_t X0    = 0;           /* Forward integration constant, aka first sample */
-  int32_t Xn    = 0;           /* Reverse integration constant, aka last sample */
-  int maxframes = inputlength / 64;
-  int frameidx;
   int startnibble;
+
+  /* Copy frame, each is 16x32-bit quantities = 64 bytes */
+  memcpy (frame, (const char *)input + (64 * frameidx), 64);
+
+  /* Save forward integration constant (X0) and reverse integration constant (Xn)
+     and set the starting nibble index depending on frame. */
+  if (frameidx == 0)
+  {
+    if (swapflag)
+    {
+      ms_gswap4a (&frame[1]);
+      ms_gswap4a (&frame[2]);
+    }
+
+    *X0 = frame[1];
+    *Xn = frame[2];
+
+    startnibble = 3; /* First frame: skip nibbles, X0, and Xn */
+
+    if (decodedebug)
+      ms_log (1, "Frame %d: X0=%d  Xn=%d\n", frameidx, *X0, *Xn);
+  }
+  else
+  {
+    startnibble = 1; /* Subsequent frames: skip nibbles */
+
+    if (decodedebug)
+      ms_log (1, "Frame %d\n", frameidx);
+  }
+
+  /* Swap 32-bit word containing the nibbles */
+  if (swapflag)
+    ms_gswap4a (&frame[0]);
+
+  return startnibble;
+} /* End of msr_steim_loadframe() */
+
+/************************************************************************
+ * msr_steim1_frame:
+ *
+ * Decode the words of a Steim1 frame, starting at startnibble, and
+ * apply the differences to calculate up to maxsamples output samples
+ * from the last sample.  For the first sample of a record (first is
+ * not zero) the difference is ignored and X0 is stored instead.
+ *
+ * Return number of samples placed in output.
+ ************************************************************************/
+static int
+msr_steim1_frame (uint32_t *frame, int startnibble, int32_t *output,
+                  int maxsamples, int32_t X0, int32_t *last, int first,
+                  int swapflag)
+{
+  int32_t sample = *last;
+  int count      = 0;
   int nibble;
   int widx;
   int diffcount;
@@ -199,117 +386,309 @@ msr_decode_steim1 (int32_t *input, int inputlength, int samplecount,
     int32_t d32;
   } * word;
 
-  if (inputlength <= 0)
-    return 0;
+  /* Decode each 32-bit word according to nibble */
+  for (widx = startnibble; widx < 16 && count < maxsamples; widx++)
+  {
+    /* W0: the first 32-bit contains 16 x 2-bit nibbles for each word */
+    nibble = EXTRACTBITRANGE (frame[0], (30 - (2 * widx)), 2);
 
-  if (!input || !output || outputlength <= 0 || maxframes <= 0)
-    return -1;
+    word      = (union dword *)&frame[widx];
+    diffcount = 0;
 
-  if (decodedebug)
-    ms_log (1, "Decoding %d Steim1 frames, swapflag: %d, srcname: %s\n",
-            maxframes, swapflag, (srcname) ? srcname : "");
+    switch (nibble)
+    {
+    case 0: /* 00: Special flag, no differences */
+      if (decodedebug)
+        ms_log (1, "  W%02d: 00=special\n", widx);
+      break;
 
-  for (frameidx = 0; frameidx < maxframes && samplecount > 0; frameidx++)
-  {
-    /* Copy frame, each is 16x32-bit quantities = 64 bytes */
-    memcpy (frame, input + (16 * frameidx), 64);
+    case 1: /* 01: Four 1-byte differences */
+      diffcount = 4;
+
+      if (decodedebug)
+        ms_log (1, "  W%02d: 01=4x8b  %d  %d  %d  %d\n",
+                widx, word->d8[0], word->d8[1], word->d8[2], word->d8[3]);
+      break;
+
+    case 2: /* 10: Two 2-byte differences */
+      diffcount = 2;
 
-    /* Save forward integration constant (X0) and reverse integration constant (Xn)
-       and set the starting nibble index depending on frame. */
-    if (frameidx == 0)
-    {
       if (swapflag)
       {
-        ms_gswap4a (&frame[1]);
-        ms_gswap4a (&frame[2]);
+        ms_gswap2a (&word->d16[0]);
+        ms_gswap2a (&word->d16[1]);
       }
 
-      X0 = frame[1];
-      Xn = frame[2];
+      if (decodedebug)
+        ms_log (1, "  W%02d: 10=2x16b  %d  %d\n", widx, word->d16[0], word->d16[1]);
+      break;
 
-      startnibble = 3; /* First frame: skip nibbles, X0, and Xn */
+    case 3: /* 11: One 4-byte difference */
+      diffcount = 1;
+      if (swapflag)
+        ms_gswap4a (&word->d32);
 
       if (decodedebug)
-        ms_log (1, "Frame %d: X0=%d  Xn=%d\n", frameidx, X0, Xn);
-    }
-    else
-    {
-      startnibble = 1; /* Subsequent frames: skip nibbles */
+        ms_log (1, "  W%02d: 11=1x32b  %d\n", widx, word->d32);
+      break;
+    } /* Done with decoding 32-bit word based on nibble */
 
-      if (decodedebug)
-        ms_log (1, "Frame %d\n", frameidx);
+    /* Apply accumulated differences to calculate output samples */
+    for (idx = 0; idx < diffcount && count < maxsamples; idx++)
+    {
+      if (first) /* Ignore first difference, instead store X0 */
+      {
+        sample = X0;
+        first  = 0;
+      }
+      else if (diffcount == 4) /* Otherwise store difference from previous sample */
+        sample += word->d8[idx];
+      else if (diffcount == 2)
+        sample += word->d16[idx];
+      else if (diffcount == 1)
+        sample += word->d32;
+
+      output[count++] = sample;
     }
+  } /* Done looping over nibbles and 32-bit words */
 
-    /* Swap 32-bit word containing the nibbles */
-    if (swapflag)
-      ms_gswap4a (&frame[0]);
+  *last = sample;
+
+  return count;
+} /* End of msr_steim1_frame() */
 
-    /* Decode each 32-bit word according to nibble */
-    for (widx = startnibble; widx < 16 && samplecount > 0; widx++)
+/************************************************************************
+ * msr_steim2_frame:
+ *
+ * Decode the words of a Steim2 frame, starting at startnibble, and
+ * apply the differences to calculate up to maxsamples output samples
+ * from the last sample.  For the first sample of a record (first is
+ * not zero) the difference is ignored and X0 is stored instead.
+ *
+ * Return number of samples placed in output, -1 on error.
+ ************************************************************************/
+static int
+msr_steim2_frame (uint32_t *frame, int startnibble, int32_t *output,
+                  int maxsamples, int32_t X0, int32_t *last, int first,
+                  char *srcname, int swapflag)
+{
+  int32_t sample = *last;
+  int32_t diff[7];
+  int32_t semask;
+  int count = 0;
+  int diffcount;
+  int nibble;
+  int widx;
+  int dnib;
+  int idx;
+
+  union dword {
+    int8_t d8[4];
+    int32_t d32;
+  } * word;
+
+  /* Decode each 32-bit word according to nibble */
+  for (widx = startnibble; widx < 16 && count < maxsamples; widx++)
+  {
+    /* W0: the first 32-bit quantity contains 16 x 2-bit nibbles */
+    nibble    = EXTRACTBITRANGE (frame[0], (30 - (2 * widx)), 2);
+    diffcount = 0;
+
+    switch (nibble)
     {
-      /* W0: the first 32-bit contains 16 x 2-bit nibbles for each word */
-      nibble = EXTRACTBITRANGE (frame[0], (30 - (2 * widx)), 2);
+    case 0: /* nibble=00: Special flag, no differences */
+      if (decodedebug)
+        ms_log (1, "  W%02d: 00=special\n", widx);
 
-      word      = (union dword *)&frame[widx];
-      diffcount = 0;
+      break;
+    case 1: /* nibble=01: Four 1-byte differences */
+      diffcount = 4;
 
-      switch (nibble)
+      word = (union dword *)&frame[widx];
+      for (idx = 0; idx < diffcount; idx++)
       {
-      case 0: /* 00: Special flag, no differences */
-        if (decodedebug)
-          ms_log (1, "  W%02d: 00=special\n", widx);
+        diff[idx] = word->d8[idx];
+      }
+
+      if (decodedebug)
+        ms_log (1, "  W%02d: 01=4x8b  %d  %d  %d  %d\n", widx, diff[0], diff[1], diff[2], diff[3]);
+      break;
+
+    case 2: /* nibble=10: Must consult dnib, the high order two bits */
+      if (swapflag)
+        ms_gswap4a (&frame[widx]);
+      dnib = EXTRACTBITRANGE (frame[widx], 30, 2);
+
+      switch (dnib)
+      {
+      case 0: /* nibble=10, dnib=00: Error, undefined value */
+        ms_log (2, "%s: Impossible Steim2 dnib=00 for nibble=10\n", srcname);
+
+        return -1;
         break;
 
-      case 1: /* 01: Four 1-byte differences */
-        diffcount = 4;
+      case 1: /* nibble=10, dnib=01: One 30-bit difference */
+        diffcount = 1;
+        semask    = 1ul << (30 - 1); /* Sign extension from bit 30 */
+        diff[0]   = EXTRACTBITRANGE (frame[widx], 0, 30);
+        diff[0]   = (diff[0] ^ semask) - semask;
 
         if (decodedebug)
-          ms_log (1, "  W%02d: 01=4x8b  %d  %d  %d  %d\n",
-                  widx, word->d8[0], word->d8[1], word->d8[2], word->d8[3]);
+          ms_log (1, "  W%02d: 10,01=1x30b  %d\n", widx, diff[0]);
         break;
 
-      case 2: /* 10: Two 2-byte differences */
+      case 2: /* nibble=10, dnib=10: Two 15-bit differences */
         diffcount = 2;
-
-        if (swapflag)
+        semask    = 1ul << (15 - 1); /* Sign extension from bit 15 */
+        for (idx = 0; idx < diffcount; idx++)
         {
-          ms_gswap2a (&word->d16[0]);
-          ms_gswap2a (&word->d16[1]);
+          diff[idx] = EXTRACTBITRANGE (frame[widx], (15 - idx * 15), 15);
+          diff[idx] = (diff[idx] ^ semask) - semask;
         }
 
         if (decodedebug)
-          ms_log (1, "  W%02d: 10=2x16b  %d  %d\n", widx, word->d16[0], word->d16[1]);
+          ms_log (1, "  W%02d: 10,10=2x15b  %d  %d\n", widx, diff[0], diff[1]);
         break;
 
-      case 3: /* 11: One 4-byte difference */
-        diffcount = 1;
-        if (swapflag)
-          ms_gswap4a (&word->d32);
+      case 3: /* nibble=10, dnib=11: Three 10-bit differences */
+        diffcount = 3;
+        semask    = 1ul << (10 - 1); /* Sign extension from bit 10 */
+        for (idx = 0; idx < diffcount; idx++)
+        {
+          diff[idx] = EXTRACTBITRANGE (frame[widx], (20 - idx * 10), 10);
+          diff[idx] = (diff[idx] ^ semask) - semask;
+        }
 
         if (decodedebug)
-          ms_log (1, "  W%02d: 11=1x32b  %d\n", widx, word->d32);
+          ms_log (1, "  W%02d: 10,11=3x10b  %d  %d  %d\n", widx, diff[0], diff[1], diff[2]);
         break;
-      } /* Done with decoding 32-bit word based on nibble */
+      }
+
+      break;
+
+    case 3: /* nibble=11: Must consult dnib, the high order two bits */
+      if (swapflag)
+        ms_gswap4a (&frame[widx]);
+      dnib = EXTRACTBITRANGE (frame[widx], 30, 2);
 
-      /* Apply accumulated differences to calculate output samples */
-      if (diffcount > 0)
+      switch (dnib)
       {
-        for (idx = 0; idx < diffcount && samplecount > 0; idx++, outputptr++)
+      case 0: /* nibble=11, dnib=00: Five 6-bit differences */
+        diffcount = 5;
+        semask    = 1ul << (6 - 1); /* Sign extension from bit 6 */
+        for (idx = 0; idx < diffcount; idx++)
+        {
+          diff[idx] = EXTRACTBITRANGE (frame[widx], (24 - idx * 6), 6);
+          diff[idx] = (diff[idx] ^ semask) - semask;
+        }
+
+        if (decodedebug)
+          ms_log (1, "  W%02d: 11,00=5x6b  %d  %d  %d  %d  %d\n",
+                  widx, diff[0], diff[1], diff[2], diff[3], diff[4]);
+        break;
+
+      case 1: /* nibble=11, dnib=01: Six 5-bit differences */
+        diffcount = 6;
+        semask    = 1ul << (5 - 1); /* Sign extension from bit 5 */
+        for (idx = 0; idx < diffcount; idx++)
         {
-          if (outputptr == output) /* Ignore first difference, instead store X0 */
-            *outputptr = X0;
-          else if (diffcount == 4) /* Otherwise store difference from previous sample */
-            *outputptr = *(outputptr - 1) + word->d8[idx];
-          else if (diffcount == 2)
-            *outputptr = *(outputptr - 1) + word->d16[idx];
-          else if (diffcount == 1)
-            *outputptr = *(outputptr - 1) + word->d32;
-
-          samplecount--;
+          diff[idx] = EXTRACTBITRANGE (frame[widx], (25 - idx * 5), 5);
+          diff[idx] = (diff[idx] ^ semask) - semask;
         }
+
+        if (decodedebug)
+          ms_log (1, "  W%02d: 11,01=6x5b  %d  %d  %d  %d  %d  %d\n",
+                  widx, diff[0], diff[1], diff[2], diff[3], diff[4], diff[5]);
+        break;
+
+      case 2: /* nibble=11, dnib=10: Seven 4-bit differences */
+        diffcount = 7;
+        semask    = 1ul << (4 - 1); /* Sign extension from bit 4 */
+        for (idx = 0; idx < diffcount; idx++)
+        {
+          diff[idx] = EXTRACTBITRANGE (frame[widx], (24 - idx * 4), 4);
+          diff[idx] = (diff[idx] ^ semask) - semask;
+        }
+
+        if (decodedebug)
+          ms_log (1, "  W%02d: 11,10=7x4b  %d  %d  %d  %d  %d  %d  %d\n",
+                  widx, diff[0], diff[1], diff[2], diff[3], diff[4], diff[5], diff[6]);
+        break;
+
+      case 3: /* nibble=11, dnib=11: Error, undefined value */
+        ms_log (2, "%s: Impossible Steim2 dnib=11 for nibble=11\n", srcname);
+
+        return -1;
+        break;
       }
-    } /* Done looping over nibbles and 32-bit words */
-  }   /* Done looping over frames */
+
+      break;
+    } /* Done with decoding 32-bit word based on nibble */
+
+    /* Apply differences to calculate output samples */
+    for (idx = 0; idx < diffcount && count < maxsamples; idx++)
+    {
+      if (first) /* Ignore first difference, instead store X0 */
+      {
+        sample = X0;
+        first  = 0;
+      }
+      else /* Otherwise store difference from previous sample */
+        sample += diff[idx];
+
+      output[count++] = sample;
+    }
+  } /* Done looping over nibbles and 32-bit words */
+
+  *last = sample;
+
+  return count;
+} /* End of msr_steim2_frame() */
+
+
+/************************************************************************
+ * msr_decode_steim1:
+ *
+ * Decode Steim1 encoded miniSEED data and place in supplied buffer
+ * as 32-bit integers.
+ *
+ * Return number of samples in output buffer on success, -1 on error.
+ ************************************************************************/
+int
+msr_decode_steim1 (int32_t *input, int inputlength, int samplecount,
+                   int32_t *output, int outputlength, char *srcname,
+                   int swapflag)
+{
+  int32_t *outputptr = output; /* Pointer to next output sample location */
+  uint32_t frame[16];          /* Frame, 16 x 32-bit quantities = 64 bytes */
+  int32_t X0    = 0;           /* Forward integration constant, aka first sample */
+  int32_t Xn    = 0;           /* Reverse integration constant, aka last sample */
+  int32_t last  = 0;           /* Last sample decoded */
+  int maxframes = inputlength / 64;
+  int frameidx;
+  int startnibble;
+  int count;
+
+  if (inputlength <= 0)
+    return 0;
+
+  if (!input || !output || outputlength <= 0 || maxframes <= 0)
+    return -1;
+
+  if (decodedebug)
+    ms_log (1, "Decoding %d Steim1 frames, swapflag: %d, srcname: %s\n",
+            maxframes, swapflag, (srcname) ? srcname : "");
+
+  for (frameidx = 0; frameidx < maxframes && samplecount > 0; frameidx++)
+  {
+    startnibble = msr_steim_loadframe (input, frameidx, frame, &X0, &Xn, swapflag);
+
+    count = msr_steim1_frame (frame, startnibble, outputptr, samplecount,
+                              X0, &last, (outputptr == output), swapflag);
+
+    outputptr += count;
+    samplecount -= count;
+  } /* Done looping over frames */
 
   /* Check data integrity by comparing last sample to Xn (reverse integration constant) */
   if (outputptr != output && *(outputptr - 1) != Xn)
@@ -336,23 +715,13 @@ msr_decode_steim2 (int32_t *input, int inputlength, int samplecount,
 {
   int32_t *outputptr = output; /* Pointer to next output sample location */
   uint32_t frame[16];          /* Frame, 16 x 32-bit quantities = 64 bytes */
-  int32_t X0 = 0;              /* Forward integration constant, aka first sample */
-  int32_t Xn = 0;              /* Reverse integration constant, aka last sample */
-  int32_t diff[7];
-  int32_t semask;
+  int32_t X0    = 0;           /* Forward integration constant, aka first sample */
+  int32_t Xn    = 0;           /* Reverse integration constant, aka last sample */
+  int32_t last  = 0;           /* Last sample decoded */
   int maxframes = inputlength / 64;
   int frameidx;
   int startnibble;
-  int nibble;
-  int widx;
-  int diffcount;
-  int dnib;
-  int idx;
-
-  union dword {
-    int8_t d8[4];
-    int32_t d32;
-  } * word;
+  int count;
 
   if (inputlength <= 0)
     return 0;
@@ -366,202 +735,108 @@ msr_decode_steim2 (int32_t *input, int inputlength, int samplecount,
 
   for (frameidx = 0; frameidx < maxframes && samplecount > 0; frameidx++)
   {
-    /* Copy frame, each is 16x32-bit quantities = 64 bytes */
-    memcpy (frame, input + (16 * frameidx), 64);
+    startnibble = msr_steim_loadframe (input, frameidx, frame, &X0, &Xn, swapflag);
 
-    /* Save forward integration constant (X0) and reverse integration constant (Xn)
-       and set the starting nibble index depending on frame. */
-    if (frameidx == 0)
-    {
-      if (swapflag)
-      {
-        ms_gswap4a (&frame[1]);
-        ms_gswap4a (&frame[2]);
-      }
+    count = msr_steim2_frame (frame, startnibble, outputptr, samplecount,
+                              X0, &last, (outputptr == output), srcname, swapflag);
 
-      X0 = frame[1];
-      Xn = frame[2];
+    if (count < 0)
+      return -1;
 
-      startnibble = 3; /* First frame: skip nibbles, X0, and Xn */
+    outputptr += count;
+    samplecount -= count;
+  } /* Done looping over frames */
 
-      if (decodedebug)
-        ms_log (1, "Frame %d: X0=%d  Xn=%d\n", frameidx, X0, Xn);
-    }
-    else
-    {
-      startnibble = 1; /* Subsequent frames: skip nibbles */
-
-      if (decodedebug)
-        ms_log (1, "Frame %d\n", frameidx);
-    }
-
-    /* Swap 32-bit word containing the nibbles */
-    if (swapflag)
-      ms_gswap4a (&frame[0]);
-
-    /* Decode each 32-bit word according to nibble */
-    for (widx = startnibble; widx < 16 && samplecount > 0; widx++)
-    {
-      /* W0: the first 32-bit quantity contains 16 x 2-bit nibbles */
-      nibble    = EXTRACTBITRANGE (frame[0], (30 - (2 * widx)), 2);
-      diffcount = 0;
-
-      switch (nibble)
-      {
-      case 0: /* nibble=00: Special flag, no differences */
-        if (decodedebug)
-          ms_log (1, "  W%02d: 00=special\n", widx);
+  /* Check data integrity by comparing last sample to Xn (reverse integration constant) */
+  if (outputptr != output && *(outputptr - 1) != Xn)
+  {
+    ms_log (1, "%s: Warning: Data integrity check for Steim2 failed, Last sample=%d, Xn=%d\n",
+            srcname, *(outputptr - 1), Xn);
+  }
 
-        break;
-      case 1: /* nibble=01: Four 1-byte differences */
-        diffcount = 4;
+  return (outputptr - output);
+} /* End of msr_decode_steim2() */
 
-        word = (union dword *)&frame[widx];
-        for (idx = 0; idx < diffcount; idx++)
-        {
-          diff[idx] = word->d8[idx];
-        }
+/************************************************************************
+ * msr_decode_steimframe:
+ *
+ * Decode the next Steim1 or Steim2 data frame of a record, as prepared
+ * by msr_steimframes(), and place the samples in the supplied buffer
+ * as 32-bit integers.  The buffer must hold MS_STEIMFRAMESAMPLES
+ * samples.  Frames without differences are skipped.
+ *
+ * When no samples remain the last sample is checked against the
+ * reverse integration constant and the number of samples decoded
+ * against the number expected, as when decoding a complete record.
+ *
+ * Return number of samples in output buffer, 0 when all samples have
+ * been decoded and -1 on error.
+ ************************************************************************/
+int
+msr_decode_steimframe (MSSteimFrames *frames, int32_t *output)
+{
+  uint32_t frame[16]; /* Frame, 16 x 32-bit quantities = 64 bytes */
+  int startnibble;
+  int maxsamples;
+  int count;
 
-        if (decodedebug)
-          ms_log (1, "  W%02d: 01=4x8b  %d  %d  %d  %d\n", widx, diff[0], diff[1], diff[2], diff[3]);
-        break;
+  if (!frames || !output)
+    return -1;
 
-      case 2: /* nibble=10: Must consult dnib, the high order two bits */
-        if (swapflag)
-          ms_gswap4a (&frame[widx]);
-        dnib = EXTRACTBITRANGE (frame[widx], 30, 2);
+  while (frames->frameidx < frames->framecount && frames->samplecount > 0)
+  {
+    startnibble = msr_steim_loadframe (frames->frames, frames->frameidx, frame,
+                                       &frames->X0, &frames->Xn, frames->swapflag);
+    frames->frameidx++;
 
-        switch (dnib)
-        {
-        case 0: /* nibble=10, dnib=00: Error, undefined value */
-          ms_log (2, "%s: Impossible Steim2 dnib=00 for nibble=10\n", srcname);
-
-          return -1;
-          break;
-
-        case 1: /* nibble=10, dnib=01: One 30-bit difference */
-          diffcount = 1;
-          semask    = 1ul << (30 - 1); /* Sign extension from bit 30 */
-          diff[0]   = EXTRACTBITRANGE (frame[widx], 0, 30);
-          diff[0]   = (diff[0] ^ semask) - semask;
-
-          if (decodedebug)
-            ms_log (1, "  W%02d: 10,01=1x30b  %d\n", widx, diff[0]);
-          break;
-
-        case 2: /* nibble=10, dnib=10: Two 15-bit differences */
-          diffcount = 2;
-          semask    = 1ul << (15 - 1); /* Sign extension from bit 15 */
-          for (idx = 0; idx < diffcount; idx++)
-          {
-            diff[idx] = EXTRACTBITRANGE (frame[widx], (15 - idx * 15), 15);
-            diff[idx] = (diff[idx] ^ semask) - semask;
-          }
-
-          if (decodedebug)
-            ms_log (1, "  W%02d: 10,10=2x15b  %d  %d\n", widx, diff[0], diff[1]);
-          break;
-
-        case 3: /* nibble=10, dnib=11: Three 10-bit differences */
-          diffcount = 3;
-          semask    = 1ul << (10 - 1); /* Sign extension from bit 10 */
-          for (idx = 0; idx < diffcount; idx++)
-          {
-            diff[idx] = EXTRACTBITRANGE (frame[widx], (20 - idx * 10), 10);
-            diff[idx] = (diff[idx] ^ semask) - semask;
-          }
-
-          if (decodedebug)
-            ms_log (1, "  W%02d: 10,11=3x10b  %d  %d  %d\n", widx, diff[0], diff[1], diff[2]);
-          break;
-        }
+    maxsamples = (frames->samplecount < MS_STEIMFRAMESAMPLES) ?
+      (int)frames->samplecount : MS_STEIMFRAMESAMPLES;
 
-        break;
+    if (frames->encoding == DE_STEIM1)
+      count = msr_steim1_frame (frame, startnibble, output, maxsamples, frames->X0,
+                                &frames->last, (frames->decoded == 0), frames->swapflag);
+    else
+      count = msr_steim2_frame (frame, startnibble, output, maxsamples, frames->X0,
+                                &frames->last, (frames->decoded == 0),
+                                frames->srcname, frames->swapflag);
 
-      case 3: /* nibble=11: Must consult dnib, the high order two bits */
-        if (swapflag)
-          ms_gswap4a (&frame[widx]);
-        dnib = EXTRACTBITRANGE (frame[widx], 30, 2);
+    if (count < 0)
+    {
+      frames->finished = 1;
+      return -1;
+    }
 
-        switch (dnib)
-        {
-        case 0: /* nibble=11, dnib=00: Five 6-bit differences */
-          diffcount = 5;
-          semask    = 1ul << (6 - 1); /* Sign extension from bit 6 */
-          for (idx = 0; idx < diffcount; idx++)
-          {
-            diff[idx] = EXTRACTBITRANGE (frame[widx], (24 - idx * 6), 6);
-            diff[idx] = (diff[idx] ^ semask) - semask;
-          }
-
-          if (decodedebug)
-            ms_log (1, "  W%02d: 11,00=5x6b  %d  %d  %d  %d  %d\n",
-                    widx, diff[0], diff[1], diff[2], diff[3], diff[4]);
-          break;
-
-        case 1: /* nibble=11, dnib=01: Six 5-bit differences */
-          diffcount = 6;
-          semask    = 1ul << (5 - 1); /* Sign extension from bit 5 */
-          for (idx = 0; idx < diffcount; idx++)
-          {
-            diff[idx] = EXTRACTBITRANGE (frame[widx], (25 - idx * 5), 5);
-            diff[idx] = (diff[idx] ^ semask) - semask;
-          }
-
-          if (decodedebug)
-            ms_log (1, "  W%02d: 11,01=6x5b  %d  %d  %d  %d  %d  %d\n",
-                    widx, diff[0], diff[1], diff[2], diff[3], diff[4], diff[5]);
-          break;
-
-        case 2: /* nibble=11, dnib=10: Seven 4-bit differences */
-          diffcount = 7;
-          semask    = 1ul << (4 - 1); /* Sign extension from bit 4 */
-          for (idx = 0; idx < diffcount; idx++)
-          {
-            diff[idx] = EXTRACTBITRANGE (frame[widx], (24 - idx * 4), 4);
-            diff[idx] = (diff[idx] ^ semask) - semask;
-          }
-
-          if (decodedebug)
-            ms_log (1, "  W%02d: 11,10=7x4b  %d  %d  %d  %d  %d  %d  %d\n",
-                    widx, diff[0], diff[1], diff[2], diff[3], diff[4], diff[5], diff[6]);
-          break;
-
-        case 3: /* nibble=11, dnib=11: Error, undefined value */
-          ms_log (2, "%s: Impossible Steim2 dnib=11 for nibble=11\n", srcname);
-
-          return -1;
-          break;
-        }
+    if (count > 0)
+    {
+      frames->samplecount -= count;
+      frames->decoded += count;
 
-        break;
-      } /* Done with decoding 32-bit word based on nibble */
+      return count;
+    }
+  }
 
-      /* Apply differences to calculate output samples */
-      if (diffcount > 0)
-      {
-        for (idx = 0; idx < diffcount && samplecount > 0; idx++, outputptr++)
-        {
-          if (outputptr == output) /* Ignore first difference, instead store X0 */
-            *outputptr = X0;
-          else /* Otherwise store difference from previous sample */
-            *outputptr = *(outputptr - 1) + diff[idx];
+  if (frames->finished)
+    return 0;
 
-          samplecount--;
-        }
-      }
-    } /* Done looping over nibbles and 32-bit words */
-  }   /* Done looping over frames */
+  frames->finished = 1;
 
   /* Check data integrity by comparing last sample to Xn (reverse integration constant) */
-  if (outputptr != output && *(outputptr - 1) != Xn)
+  if (frames->decoded > 0 && frames->last != frames->Xn)
   {
-    ms_log (1, "%s: Warning: Data integrity check for Steim2 failed, Last sample=%d, Xn=%d\n",
-            srcname, *(outputptr - 1), Xn);
+    ms_log (1, "%s: Warning: Data integrity check for Steim%d failed, Last sample=%d, Xn=%d\n",
+            frames->srcname, (frames->encoding == DE_STEIM1) ? 1 : 2,
+            frames->last, frames->Xn);
   }
 
-  return (outputptr - output);
-} /* End of msr_decode_steim2() */
+  if (frames->samplecount > 0)
+  {
+    ms_log (2, "msr_decode_steimframe(%s): only decoded %" PRId64 " samples of %" PRId64 " expected\n",
+            frames->srcname, frames->decoded, frames->decoded + frames->samplecount);
+    return -1;
+  }
+
+  return 0;
+} /* End of msr_decode_steimframe() */
 
 /* Defines for GEOSCOPE encoding */
 #define GEOSCOPE_MANTISSA_MASK 0x0FFFul /* mask for mantissa */
@@ -569,6 +844,13 @@ msr_decode_steim2 (int32_t *input, int inputlength, int samplecount,
 #define GEOSCOPE_GAIN4_MASK 0xf000ul    /* mask for gainrange factor */
 #define GEOSCOPE_SHIFT 12               /* # bits in mantissa */
 
+/* Scale factors 1/2^gain for the GEOSCOPE gain range factors, products
+ * with the 12-bit mantissa are exact in single precision */
+static const float geoscope_scale[16] = {
+    1.0f, 1.0f / 2, 1.0f / 4, 1.0f / 8, 1.0f / 16, 1.0f / 32, 1.0f / 64, 1.0f / 128,
+    1.0f / 256, 1.0f / 512, 1.0f / 1024, 1.0f / 2048, 1.0f / 4096, 1.0f / 8192,
+    1.0f / 16384, 1.0f / 32768};
+
 /************************************************************************
  * msr_decode_geoscope:
  *
@@ -583,13 +865,10 @@ msr_decode_geoscope (char *input, int samplecount, float *output,
                      char *srcname, int swapflag)
 {
   int idx = 0;
-  int mantissa;  /* mantissa from SEED data */
-  int gainrange; /* gain range factor */
-  int exponent;  /* total exponent */
+  int mantissa; /* mantissa from SEED data */
   int k;
-  uint64_t exp2val;
-  int16_t sint;
-  double dsample = 0.0;
+  uint16_t sint;
+  uint16_t gainmask;
 
   union {
     uint8_t b[4];
@@ -612,17 +891,19 @@ msr_decode_geoscope (char *input, int samplecount, float *output,
     return -1;
   }
 
-  for (idx = 0; idx < samplecount && outputlength >= (int)sizeof (float); idx++)
+  if (samplecount > outputlength / (int)sizeof (float))
+    samplecount = outputlength / (int)sizeof (float);
+
+  if (encoding == DE_GEOSCOPE24)
   {
-    switch (encoding)
+    for (idx = 0; idx < samplecount; idx++, input += 3)
     {
-    case DE_GEOSCOPE24:
       sample32.i = 0;
       if (swapflag)
-        for (k              = 0; k < 3; k++)
+        for (k = 0; k < 3; k++)
           sample32.b[2 - k] = input[k];
       else
-        for (k              = 0; k < 3; k++)
+        for (k = 0; k < 3; k++)
           sample32.b[1 + k] = input[k];
 
       mantissa = sample32.i;
@@ -631,61 +912,25 @@ msr_decode_geoscope (char *input, int samplecount, float *output,
       if ((unsigned long)mantissa > MAX24)
         mantissa -= 2 * (MAX24 + 1);
 
-      /* Store */
-      dsample = (double)mantissa;
-
-      break;
-    case DE_GEOSCOPE163:
-      memcpy (&sint, input, sizeof (int16_t));
-      if (swapflag)
-        ms_gswap2a (&sint);
-
-      /* Recover mantissa and gain range factor */
-      mantissa  = (sint & GEOSCOPE_MANTISSA_MASK);
-      gainrange = (sint & GEOSCOPE_GAIN3_MASK) >> GEOSCOPE_SHIFT;
-
-      /* Exponent is just gainrange for GEOSCOPE */
-      exponent = gainrange;
-
-      /* Calculate sample as mantissa / 2^exponent */
-      exp2val = (uint64_t)1 << exponent;
-      dsample = ((double)(mantissa - 2048)) / exp2val;
-
-      break;
-    case DE_GEOSCOPE164:
-      memcpy (&sint, input, sizeof (int16_t));
-      if (swapflag)
-        ms_gswap2a (&sint);
-
-      /* Recover mantissa and gain range factor */
-      mantissa  = (sint & GEOSCOPE_MANTISSA_MASK);
-      gainrange = (sint & GEOSCOPE_GAIN4_MASK) >> GEOSCOPE_SHIFT;
-
-      /* Exponent is just gainrange for GEOSCOPE */
-      exponent = gainrange;
+      /* Save sample in output array */
+      output[idx] = (float)mantissa;
+    }
 
-      /* Calculate sample as mantissa / 2^exponent */
-      exp2val = (uint64_t)1 << exponent;
-      dsample = ((double)(mantissa - 2048)) / exp2val;
+    return idx;
+  }
 
-      break;
-    }
+  /* 16-bit with 3 or 4 bit gain range factor, the exponent is just the
+   * gain range factor, sample = mantissa / 2^exponent */
+  gainmask = (encoding == DE_GEOSCOPE163) ? GEOSCOPE_GAIN3_MASK : GEOSCOPE_GAIN4_MASK;
 
-    /* Save sample in output array */
-    output[idx] = (float)dsample;
-    outputlength -= sizeof (float);
+  for (idx = 0; idx < samplecount; idx++)
+  {
+    memcpy (&sint, input + (idx * 2), sizeof (uint16_t));
+    if (swapflag)
+      sint = (uint16_t) ((sint << 8) | (sint >> 8));
 
-    /* Increment edata pointer depending on size */
-    switch (encoding)
-    {
-    case DE_GEOSCOPE24:
-      input += 3;
-      break;
-    case DE_GEOSCOPE163:
-    case DE_GEOSCOPE164:
-      input += 2;
-      break;
-    }
+    output[idx] = (float)((int)(sint & GEOSCOPE_MANTISSA_MASK) - 2048) *
+                  geoscope_scale[(sint & gainmask) >> GEOSCOPE_SHIFT];
   }
 
   return idx;
@@ -696,6 +941,9 @@ msr_decode_geoscope (char *input, int samplecount, float *output,
 #define CDSN_GAINRANGE_MASK 0xC000ul /* mask for gainrange factor */
 #define CDSN_SHIFT 14                /* # bits in mantissa */
 
+/* Multiplier exponents for the CDSN gain range keys */
+static const uint8_t cdsn_mult[4] = {0, 2, 4, 7};
+
 /************************************************************************
  * msr_decode_cdsn:
  *
@@ -738,46 +986,27 @@ msr_decode_cdsn (int16_t *input, int samplecount, int32_t *output,
                  int outputlength, int swapflag)
 {
   int32_t idx = 0;
-  int32_t mantissa;  /* mantissa */
-  int32_t gainrange; /* gain range factor */
-  int32_t mult = -1; /* multiplier for gain range */
+  int32_t mantissa; /* mantissa */
   uint16_t sint;
-  int32_t sample;
 
   if (samplecount <= 0)
     return 0;
 
-  for (idx = 0; idx < samplecount && outputlength >= (int)sizeof (int32_t); idx++)
+  if (samplecount > outputlength / (int)sizeof (int32_t))
+    samplecount = (outputlength > 0) ? outputlength / (int)sizeof (int32_t) : 0;
+
+  for (idx = 0; idx < samplecount; idx++)
   {
     memcpy (&sint, &input[idx], sizeof (int16_t));
     if (swapflag)
-      ms_gswap2a (&sint);
-
-    /* Recover mantissa and gain range factor */
-    mantissa  = (sint & CDSN_MANTISSA_MASK);
-    gainrange = (sint & CDSN_GAINRANGE_MASK) >> CDSN_SHIFT;
-
-    /* Determine multiplier from the gain range factor and format definition
-     * because shift operator is used later, these are powers of two */
-    if (gainrange == 0)
-      mult = 0;
-    else if (gainrange == 1)
-      mult = 2;
-    else if (gainrange == 2)
-      mult = 4;
-    else if (gainrange == 3)
-      mult = 7;
-
-    /* Unbias the mantissa */
-    mantissa -= MAX14;
+      sint = (uint16_t) ((sint << 8) | (sint >> 8));
+
+    /* Recover and unbias the mantissa */
+    mantissa = (int32_t) (sint & CDSN_MANTISSA_MASK) - (int32_t)MAX14;
 
     /* Calculate sample from mantissa and multiplier using left shift
      * mantissa << mult is equivalent to mantissa * (2 exp (mult)) */
-    sample = ((uint32_t)mantissa << mult);
-
-    /* Save sample in output array */
-    output[idx] = sample;
-    outputlength -= sizeof (int32_t);
+    output[idx] = (int32_t) ((uint32_t)mantissa << cdsn_mult[(sint & CDSN_GAINRANGE_MASK) >> CDSN_SHIFT]);
   }
 
   return idx;
@@ -788,6 +1017,11 @@ msr_decode_cdsn (int16_t *input, int samplecount, int32_t *output,
 #define SRO_GAINRANGE_MASK 0xF000ul /* mask for gainrange factor */
 #define SRO_SHIFT 12                /* # bits in mantissa */
 
+/* Multipliers 2^exponent for the SRO gain range factors, the exponent
+ * is 10 - gain range factor and factors above 10 are invalid (0) */
+static const int32_t sro_mult[16] = {
+    1024, 512, 256, 128, 64, 32, 16, 8, 4, 2, 1, 0, 0, 0, 0, 0};
+
 /************************************************************************
  * msr_decode_sro:
  *
@@ -824,52 +1058,51 @@ msr_decode_sro (int16_t *input, int samplecount, int32_t *output,
                 int outputlength, char *srcname, int swapflag)
 {
   int32_t idx = 0;
-  int32_t mantissa;   /* mantissa */
-  int32_t gainrange;  /* gain range factor */
-  int32_t add2gr;     /* added to gainrage factor */
-  int32_t mult;       /* multiplier for gain range */
-  int32_t add2result; /* added to multiplied gain rage */
-  int32_t exponent;   /* total exponent */
+  int32_t mantissa;  /* mantissa */
+  int32_t gainrange; /* gain range factor */
   uint16_t sint;
-  int32_t sample;
+  uint16_t maxgain = 0;
 
   if (samplecount <= 0)
     return 0;
 
-  add2gr     = 0;
-  mult       = -1;
-  add2result = 10;
+  if (samplecount > outputlength / (int)sizeof (int32_t))
+    samplecount = (outputlength > 0) ? outputlength / (int)sizeof (int32_t) : 0;
 
-  for (idx = 0; idx < samplecount && outputlength >= (int)sizeof (int32_t); idx++)
+  for (idx = 0; idx < samplecount; idx++)
   {
     memcpy (&sint, &input[idx], sizeof (int16_t));
     if (swapflag)
-      ms_gswap2a (&sint);
+      sint = (uint16_t) ((sint << 8) | (sint >> 8));
 
-    /* Recover mantissa and gain range factor */
-    mantissa  = (sint & SRO_MANTISSA_MASK);
-    gainrange = (sint & SRO_GAINRANGE_MASK) >> SRO_SHIFT;
+    /* Sign extend the 12-bit mantissa */
+    mantissa = (int32_t) ((int16_t) (sint << 4) >> 4);
 
-    /* Take 2's complement for mantissa */
-    if ((unsigned long)mantissa > MAX12)
-      mantissa -= 2 * (MAX12 + 1);
+    /* Track the largest gain range, checked after the loop */
+    maxgain |= (sint & SRO_GAINRANGE_MASK);
 
-    /* Calculate exponent, SRO exponent = 0..10 */
-    exponent = (mult * (gainrange + add2gr)) + add2result;
+    /* Calculate sample as mantissa * 2^exponent */
+    output[idx] = mantissa * sro_mult[(sint & SRO_GAINRANGE_MASK) >> SRO_SHIFT];
+  }
 
-    if (exponent < 0 || exponent > 10)
+  /* SRO exponent = 10 - gain range factor = 0..10, report the first invalid */
+  if ((maxgain >> SRO_SHIFT) > 10)
+  {
+    for (idx = 0; idx < samplecount; idx++)
     {
-      ms_log (2, "msr_decode_sro(%s): SRO gain ranging exponent out of range: %d\n",
-              srcname, exponent);
-      return MS_GENERROR;
-    }
+      memcpy (&sint, &input[idx], sizeof (int16_t));
+      if (swapflag)
+        sint = (uint16_t) ((sint << 8) | (sint >> 8));
 
-    /* Calculate sample as mantissa * 2^exponent */
-    sample = mantissa * ((uint64_t)1 << exponent);
+      gainrange = (sint & SRO_GAINRANGE_MASK) >> SRO_SHIFT;
 
-    /* Save sample in output array */
-    output[idx] = sample;
-    outputlength -= sizeof (int32_t);
+      if (gainrange > 10)
+      {
+        ms_log (2, "msr_decode_sro(%s): SRO gain ranging exponent out of range: %d\n",
+                srcname, 10 - gainrange);
+        return MS_GENERROR;
+      }
+    }
   }
 
   return idx;
@@ -887,28 +1120,9 @@ int
 msr_decode_dwwssn (int16_t *input, int samplecount, int32_t *output,
                    int outputlength, int swapflag)
 {
-  int32_t idx = 0;
-  int32_t sample;
-  uint16_t sint;
-
-  if (samplecount < 0)
+  if (samplecount <= 0 || outputlength < (int)sizeof (int32_t))
     return 0;
 
-  for (idx = 0; idx < samplecount && outputlength >= (int)sizeof (int32_t); idx++)
-  {
-    memcpy (&sint, &input[idx], sizeof (uint16_t));
-    if (swapflag)
-      ms_gswap2a (&sint);
-    sample = (int32_t)sint;
-
-    /* Take 2's complement for sample */
-    if ((unsigned long)sample > MAX16)
-      sample -= 2 * (MAX16 + 1);
-
-    /* Save sample in output array */
-    output[idx] = sample;
-    outputlength -= sizeof (int32_t);
-  }
-
-  return idx;
+  /* DWWSSN samples are 16-bit two's complement integers */
+  return msr_decode_int16 (input, samplecount, output, outputlength, swapflag);
 } /* End of msr_decode_dwwssn() */
@@ -19,11 +19,19 @@ INCS = -I..\libmseed
 
 all: $(BIN)
 
-$(BIN):	mseed2ascii.obj
-	wlink $(lflags) name $(BIN) file {mseed2ascii.obj}
+$(BIN):	mseed2ascii.obj msindex.obj msdecomp.obj mssort.obj msspill.obj mslazy.obj msarrow.obj msformat.obj mscomp.obj
+	wlink $(lflags) name $(BIN) file {mseed2ascii.obj msindex.obj msdecomp.obj mssort.obj msspill.obj mslazy.obj msarrow.obj msformat.obj mscomp.obj}
 
 # Source dependencies:
 mseed2ascii.obj:	mseed2ascii.c
+msindex.obj:	msindex.c msindex.h
+msdecomp.obj:	msdecomp.c msdecomp.h
+mssort.obj:	mssort.c mssort.h
+msspill.obj:	msspill.c msspill.h
+mslazy.obj:	mslazy.c mslazy.h
+msarrow.obj:	msarrow.c msarrow.h
+msformat.obj:	msformat.c msformat.h
+mscomp.obj:	mscomp.c mscomp.h
 
 # How to compile sources:
 .c.obj:
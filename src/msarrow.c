@@ -0,0 +1,581 @@
+/***************************************************************************
+ * msarrow.c
+ *
+ * Routines to write Arrow IPC files (Feather version 2) holding a
+ * single record batch of primitive columns without any Arrow library.
+ *
+ * The file layout is:
+ *   "ARROW1" magic, padded to 8 bytes
+ *   Schema message
+ *   RecordBatch message metadata followed by the body of column values
+ *   End of stream marker
+ *   Footer, a copy of the schema and the location of the record batch
+ *   Footer length (int32) and "ARROW1" magic
+ *
+ * Each message is a continuation marker (0xFFFFFFFF), the metadata
+ * length and the Message flatbuffer, padded to a multiple of 8 bytes.
+ *
+ * The Message and Footer flatbuffers are built front to back: a table
+ * is written before the objects it refers to and the offsets to them,
+ * which always point forward, are patched in when they are written.
+ * Each table is preceded by its vtable.
+ ***************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "msarrow.h"
+
+/* Arrow metadata version V5 */
+#define ARROW_VERSION 4
+
+/* Message header types */
+#define ARROW_SCHEMA      1
+#define ARROW_RECORDBATCH 3
+
+/* Field types */
+#define ARROW_INT           2
+#define ARROW_FLOATINGPOINT 3
+#define ARROW_TIMESTAMP     10
+
+/* Flatbuffer being built */
+typedef struct FBBuilder_s
+{
+  uint8_t *buf;
+  int64_t  len;
+  int64_t  size;
+  int      error;
+} FBBuilder;
+
+/* Scalar or offset field of a table, offsets are patched later */
+typedef struct FBField_s
+{
+  int      id;              /* Field id in the schema definition */
+  int      size;            /* Size of field in bytes */
+  uint64_t value;           /* Scalar value */
+} FBField;
+
+static int64_t fb_reserve (FBBuilder *fb, int64_t size, int align);
+static void fb_put (FBBuilder *fb, int64_t pos, uint64_t value, int size);
+static void fb_patch (FBBuilder *fb, int64_t pos, int64_t target);
+static int64_t fb_table (FBBuilder *fb, FBField *fields, int count, int64_t *fieldpos);
+static int64_t fb_vector (FBBuilder *fb, int count, int elemsize, int align);
+static int64_t fb_string (FBBuilder *fb, const char *str);
+static int64_t msa_schema (FBBuilder *fb, MSArrowFile *af);
+static int64_t msa_message (FBBuilder *fb, MSArrowFile *af, int headertype);
+static int64_t msa_valuesize (char type);
+
+
+/***************************************************************************
+ * msa_columnsize:
+ *
+ * Determine the size of the values of a column in the record batch
+ * body, padded to a multiple of 8 bytes.
+ *
+ * Returns the size in bytes.
+ ***************************************************************************/
+int64_t
+msa_columnsize (char type, int64_t rows)
+{
+  return (msa_valuesize (type) * rows + 7) & ~(int64_t)7;
+} /* End of msa_columnsize() */
+
+
+/***************************************************************************
+ * msa_header:
+ *
+ * Build the header of an Arrow file: the magic, the schema message and
+ * the metadata of the record batch message.  The record batch offset
+ * and metadata length in af are set for msa_footer().  The column
+ * values follow the header.
+ *
+ * The buffer is allocated and must be freed by the caller.
+ *
+ * Returns the length of the header on success and -1 on error.
+ ***************************************************************************/
+int64_t
+msa_header (MSArrowFile *af, char **buffer)
+{
+  FBBuilder fb;
+  int64_t schemalength;
+
+  if (!af || !buffer)
+    return -1;
+
+  memset (&fb, 0, sizeof (fb));
+
+  /* Magic padded to 8 bytes */
+  fb_reserve (&fb, 8, 8);
+  if (!fb.error)
+    memcpy (fb.buf, "ARROW1", 6);
+
+  if ((schemalength = msa_message (&fb, af, ARROW_SCHEMA)) < 0)
+  {
+    free (fb.buf);
+    return -1;
+  }
+
+  af->batchoffset = 8 + schemalength;
+
+  if ((schemalength = msa_message (&fb, af, ARROW_RECORDBATCH)) < 0)
+  {
+    free (fb.buf);
+    return -1;
+  }
+
+  af->batchlength = (int32_t)schemalength;
+
+  *buffer = (char *)fb.buf;
+
+  return fb.len;
+} /* End of msa_header() */
+
+
+/***************************************************************************
+ * msa_footer:
+ *
+ * Build the trailer of an Arrow file following the record batch body:
+ * the end of stream marker, the footer with the schema and location
+ * of the record batch, the footer length and the closing magic.
+ *
+ * The buffer is allocated and must be freed by the caller.
+ *
+ * Returns the length of the trailer on success and -1 on error.
+ ***************************************************************************/
+int64_t
+msa_footer (MSArrowFile *af, char **buffer)
+{
+  FBBuilder fb;
+  FBField fields[4];
+  int64_t fieldpos[4];
+  int64_t footer;
+  int64_t root;
+  int64_t table;
+  int64_t vector;
+  int64_t bodylength = 0;
+  int idx;
+
+  if (!af || !buffer)
+    return -1;
+
+  memset (&fb, 0, sizeof (fb));
+
+  for (idx = 0; idx < af->ncolumns; idx++)
+    bodylength += msa_columnsize (af->columns[idx].type, af->rows);
+
+  /* End of stream marker */
+  fb_reserve (&fb, 8, 8);
+  fb_put (&fb, 0, 0xFFFFFFFF, 4);
+
+  /* Footer flatbuffer */
+  footer = fb.len;
+  root = fb_reserve (&fb, 4, 8);
+
+  fields[0].id = 0; fields[0].size = 2; fields[0].value = ARROW_VERSION;
+  fields[1].id = 1; fields[1].size = 4; fields[1].value = 0; /* schema */
+  fields[2].id = 2; fields[2].size = 4; fields[2].value = 0; /* dictionaries */
+  fields[3].id = 3; fields[3].size = 4; fields[3].value = 0; /* recordBatches */
+
+  table = fb_table (&fb, fields, 4, fieldpos);
+  fb_patch (&fb, root, table);
+
+  fb_patch (&fb, fieldpos[1], msa_schema (&fb, af));
+  fb_patch (&fb, fieldpos[2], fb_vector (&fb, 0, 24, 8));
+
+  /* Block of the record batch: offset, metadata length, body length */
+  vector = fb_vector (&fb, 1, 24, 8);
+  fb_patch (&fb, fieldpos[3], vector);
+  fb_put (&fb, vector + 4, (uint64_t)af->batchoffset, 8);
+  fb_put (&fb, vector + 12, (uint64_t)af->batchlength, 4);
+  fb_put (&fb, vector + 20, (uint64_t)bodylength, 8);
+
+  /* Footer length and magic */
+  root = fb.len - footer;
+  table = fb_reserve (&fb, 10, 1);
+  fb_put (&fb, table, (uint64_t)root, 4);
+  if (!fb.error)
+    memcpy (fb.buf + table + 4, "ARROW1", 6);
+
+  if (fb.error)
+  {
+    free (fb.buf);
+    return -1;
+  }
+
+  *buffer = (char *)fb.buf;
+
+  return fb.len;
+} /* End of msa_footer() */
+
+
+/***************************************************************************
+ * msa_message:
+ *
+ * Append an encapsulated schema or record batch message to a buffer:
+ * the continuation marker, metadata length and Message flatbuffer
+ * padded to a multiple of 8 bytes.
+ *
+ * Returns the length of the message on success and -1 on error.
+ ***************************************************************************/
+static int64_t
+msa_message (FBBuilder *fb, MSArrowFile *af, int headertype)
+{
+  FBField fields[4];
+  int64_t fieldpos[4];
+  int64_t start = fb->len;
+  int64_t root;
+  int64_t table;
+  int64_t header;
+  int64_t vector;
+  int64_t bodylength = 0;
+  int64_t offset;
+  int64_t size;
+  int idx;
+
+  for (idx = 0; idx < af->ncolumns; idx++)
+    bodylength += msa_columnsize (af->columns[idx].type, af->rows);
+
+  /* Continuation marker and metadata length */
+  fb_reserve (fb, 8, 8);
+  fb_put (fb, start, 0xFFFFFFFF, 4);
+
+  root = fb_reserve (fb, 4, 8);
+
+  fields[0].id = 0; fields[0].size = 2; fields[0].value = ARROW_VERSION;
+  fields[1].id = 1; fields[1].size = 1; fields[1].value = headertype;
+  fields[2].id = 2; fields[2].size = 4; fields[2].value = 0; /* header */
+  fields[3].id = 3; fields[3].size = 8;
+  fields[3].value = (headertype == ARROW_RECORDBATCH) ? (uint64_t)bodylength : 0;
+
+  table = fb_table (fb, fields, 4, fieldpos);
+  fb_patch (fb, root, table);
+
+  if (headertype == ARROW_SCHEMA)
+  {
+    fb_patch (fb, fieldpos[2], msa_schema (fb, af));
+  }
+  else
+  {
+    /* RecordBatch: length, nodes and buffers */
+    header = fieldpos[2];
+
+    fields[0].id = 0; fields[0].size = 8; fields[0].value = (uint64_t)af->rows;
+    fields[1].id = 1; fields[1].size = 4; fields[1].value = 0;
+    fields[2].id = 2; fields[2].size = 4; fields[2].value = 0;
+
+    table = fb_table (fb, fields, 3, fieldpos + 1);
+    fb_patch (fb, header, table);
+
+    /* A field node per column: length and null count */
+    vector = fb_vector (fb, af->ncolumns, 16, 8);
+    fb_patch (fb, fieldpos[2], vector);
+    for (idx = 0; idx < af->ncolumns; idx++)
+      fb_put (fb, vector + 4 + idx * 16, (uint64_t)af->rows, 8);
+
+    /* Validity and value buffers per column: offset and length,
+     * without nulls the validity buffers are empty */
+    vector = fb_vector (fb, af->ncolumns * 2, 16, 8);
+    fb_patch (fb, fieldpos[3], vector);
+    for (idx = 0, offset = 0; idx < af->ncolumns; idx++)
+    {
+      size = msa_valuesize (af->columns[idx].type) * af->rows;
+
+      fb_put (fb, vector + 4 + idx * 32, (uint64_t)offset, 8);
+      fb_put (fb, vector + 4 + idx * 32 + 16, (uint64_t)offset, 8);
+      fb_put (fb, vector + 4 + idx * 32 + 24, (uint64_t)size, 8);
+
+      offset += msa_columnsize (af->columns[idx].type, af->rows);
+    }
+  }
+
+  /* Pad metadata to a multiple of 8 bytes */
+  fb_reserve (fb, 0, 8);
+  fb_put (fb, start + 4, (uint64_t)(fb->len - start - 8), 4);
+
+  if (fb->error)
+    return -1;
+
+  return fb->len - start;
+} /* End of msa_message() */
+
+
+/***************************************************************************
+ * msa_schema:
+ *
+ * Append a Schema table with a field for each column and the metadata
+ * entries of an Arrow file.
+ *
+ * Returns the position of the table.
+ ***************************************************************************/
+static int64_t
+msa_schema (FBBuilder *fb, MSArrowFile *af)
+{
+  FBField fields[5];
+  int64_t fieldpos[5];
+  int64_t typepos[2];
+  int64_t metadata;
+  int64_t schema;
+  int64_t vector;
+  int64_t table;
+  int idx;
+
+  /* Schema: endianness of column values, fields and metadata */
+  fields[0].id = 0; fields[0].size = 2; fields[0].value = (ms_bigendianhost ()) ? 1 : 0;
+  fields[1].id = 1; fields[1].size = 4; fields[1].value = 0;
+  fields[2].id = 2; fields[2].size = 4; fields[2].value = 0;
+
+  schema = fb_table (fb, fields, 3, fieldpos);
+  metadata = fieldpos[2];
+
+  vector = fb_vector (fb, af->ncolumns, 4, 4);
+  fb_patch (fb, fieldpos[1], vector);
+
+  for (idx = 0; idx < af->ncolumns; idx++)
+  {
+    /* Field: name, nullable, type and children */
+    fields[0].id = 0; fields[0].size = 4; fields[0].value = 0;
+    fields[1].id = 1; fields[1].size = 1; fields[1].value = 0;
+    fields[2].id = 2; fields[2].size = 1;
+    fields[3].id = 3; fields[3].size = 4; fields[3].value = 0;
+    fields[4].id = 5; fields[4].size = 4; fields[4].value = 0;
+
+    if (af->columns[idx].type == 't')
+      fields[2].value = ARROW_TIMESTAMP;
+    else if (af->columns[idx].type == 'i')
+      fields[2].value = ARROW_INT;
+    else
+      fields[2].value = ARROW_FLOATINGPOINT;
+
+    table = fb_table (fb, fields, 5, fieldpos);
+    fb_patch (fb, vector + 4 + idx * 4, table);
+
+    fb_patch (fb, fieldpos[0], fb_string (fb, af->columns[idx].name));
+    fb_patch (fb, fieldpos[4], fb_vector (fb, 0, 4, 4));
+
+    /* Type: Int (bit width, signed), FloatingPoint (precision) or
+     * Timestamp (unit, time zone) */
+    if (af->columns[idx].type == 't')
+    {
+      fields[0].id = 0; fields[0].size = 2; fields[0].value = 2; /* MICROSECOND */
+      fields[1].id = 1; fields[1].size = 4; fields[1].value = 0;
+
+      table = fb_table (fb, fields, 2, typepos);
+      fb_patch (fb, fieldpos[3], table);
+      fb_patch (fb, typepos[1], fb_string (fb, "UTC"));
+    }
+    else if (af->columns[idx].type == 'i')
+    {
+      fields[0].id = 0; fields[0].size = 4; fields[0].value = 32;
+      fields[1].id = 1; fields[1].size = 1; fields[1].value = 1;
+
+      table = fb_table (fb, fields, 2, typepos);
+      fb_patch (fb, fieldpos[3], table);
+    }
+    else
+    {
+      fields[0].id = 0; fields[0].size = 2;
+      fields[0].value = (af->columns[idx].type == 'd') ? 2 : 1; /* DOUBLE : SINGLE */
+
+      table = fb_table (fb, fields, 1, typepos);
+      fb_patch (fb, fieldpos[3], table);
+    }
+  }
+
+  /* Metadata as KeyValue tables */
+  vector = fb_vector (fb, af->nkeys, 4, 4);
+  fb_patch (fb, metadata, vector);
+
+  for (idx = 0; idx < af->nkeys; idx++)
+  {
+    fields[0].id = 0; fields[0].size = 4; fields[0].value = 0;
+    fields[1].id = 1; fields[1].size = 4; fields[1].value = 0;
+
+    table = fb_table (fb, fields, 2, fieldpos);
+    fb_patch (fb, vector + 4 + idx * 4, table);
+
+    fb_patch (fb, fieldpos[0], fb_string (fb, af->keys[idx]));
+    fb_patch (fb, fieldpos[1], fb_string (fb, af->values[idx]));
+  }
+
+  return schema;
+} /* End of msa_schema() */
+
+
+/***************************************************************************
+ * msa_valuesize:
+ *
+ * Returns the size in bytes of a value of a column type.
+ ***************************************************************************/
+static int64_t
+msa_valuesize (char type)
+{
+  return (type == 'd' || type == 't') ? 8 : 4;
+} /* End of msa_valuesize() */
+
+
+/***************************************************************************
+ * fb_reserve:
+ *
+ * Pad a flatbuffer with zeros to an alignment and append size zero
+ * bytes.  On allocation failure the error flag is set and the
+ * position is returned as if successful, writes are then ignored.
+ *
+ * Returns the position of the appended bytes.
+ ***************************************************************************/
+static int64_t
+fb_reserve (FBBuilder *fb, int64_t size, int align)
+{
+  int64_t pos = (fb->len + align - 1) / align * align;
+  int64_t newsize;
+  uint8_t *newbuf;
+
+  if (!fb->error && pos + size > fb->size)
+  {
+    newsize = (fb->size) ? fb->size : 1024;
+    while (newsize < pos + size)
+      newsize *= 2;
+
+    if ((newbuf = (uint8_t *)realloc (fb->buf, (size_t)newsize)) == NULL)
+    {
+      fprintf (stderr, "Cannot allocate memory for Arrow metadata\n");
+      fb->error = 1;
+    }
+    else
+    {
+      memset (newbuf + fb->size, 0, (size_t)(newsize - fb->size));
+      fb->buf = newbuf;
+      fb->size = newsize;
+    }
+  }
+
+  fb->len = pos + size;
+
+  return pos;
+} /* End of fb_reserve() */
+
+
+/***************************************************************************
+ * fb_put:
+ *
+ * Write a little-endian scalar value of size bytes at a position.
+ ***************************************************************************/
+static void
+fb_put (FBBuilder *fb, int64_t pos, uint64_t value, int size)
+{
+  int idx;
+
+  if (fb->error)
+    return;
+
+  for (idx = 0; idx < size; idx++)
+    fb->buf[pos + idx] = (uint8_t)(value >> (idx * 8));
+} /* End of fb_put() */
+
+
+/***************************************************************************
+ * fb_patch:
+ *
+ * Set the offset field at a position to refer to a target position.
+ ***************************************************************************/
+static void
+fb_patch (FBBuilder *fb, int64_t pos, int64_t target)
+{
+  fb_put (fb, pos, (uint64_t)(target - pos), 4);
+} /* End of fb_patch() */
+
+
+/***************************************************************************
+ * fb_table:
+ *
+ * Append a vtable and a table with the specified fields, in id order.
+ * The fields are laid out in order, each aligned to its size, and the
+ * position of each is returned in fieldpos for patching offsets.
+ *
+ * Returns the position of the table.
+ ***************************************************************************/
+static int64_t
+fb_table (FBBuilder *fb, FBField *fields, int count, int64_t *fieldpos)
+{
+  int offsets[8];
+  int vtablesize;
+  int tablesize = 4;
+  int64_t vtable;
+  int64_t table;
+  int idx;
+
+  for (idx = 0; idx < count; idx++)
+  {
+    tablesize = (tablesize + fields[idx].size - 1) / fields[idx].size * fields[idx].size;
+    offsets[idx] = tablesize;
+    tablesize += fields[idx].size;
+  }
+
+  vtablesize = 4 + 2 * (fields[count - 1].id + 1);
+
+  vtable = fb_reserve (fb, vtablesize, 2);
+  table = fb_reserve (fb, tablesize, 8);
+
+  fb_put (fb, vtable, (uint64_t)vtablesize, 2);
+  fb_put (fb, vtable + 2, (uint64_t)tablesize, 2);
+
+  /* Table starts with the offset back to its vtable */
+  fb_put (fb, table, (uint64_t)(table - vtable), 4);
+
+  for (idx = 0; idx < count; idx++)
+  {
+    fb_put (fb, vtable + 4 + 2 * fields[idx].id, (uint64_t)offsets[idx], 2);
+    fb_put (fb, table + offsets[idx], fields[idx].value, fields[idx].size);
+
+    fieldpos[idx] = table + offsets[idx];
+  }
+
+  return table;
+} /* End of fb_table() */
+
+
+/***************************************************************************
+ * fb_vector:
+ *
+ * Append a vector of count elements of elemsize bytes, aligned so that
+ * the elements following the length are at the alignment.
+ *
+ * Returns the position of the vector, the elements start 4 bytes after.
+ ***************************************************************************/
+static int64_t
+fb_vector (FBBuilder *fb, int count, int elemsize, int align)
+{
+  int64_t pos;
+
+  /* Pad so that the elements after the length are aligned */
+  while ((fb->len + 4) % align)
+    fb_reserve (fb, 1, 1);
+
+  pos = fb_reserve (fb, 4 + (int64_t)count * elemsize, 4);
+  fb_put (fb, pos, (uint64_t)count, 4);
+
+  return pos;
+} /* End of fb_vector() */
+
+
+/***************************************************************************
+ * fb_string:
+ *
+ * Append a string: length, characters and a terminating NUL.
+ *
+ * Returns the position of the string.
+ ***************************************************************************/
+static int64_t
+fb_string (FBBuilder *fb, const char *str)
+{
+  int64_t length = (int64_t)strlen (str);
+  int64_t pos;
+
+  pos = fb_reserve (fb, 4 + length + 1, 4);
+  fb_put (fb, pos, (uint64_t)length, 4);
+
+  if (!fb->error)
+    memcpy (fb->buf + pos + 4, str, (size_t)length);
+
+  return pos;
+} /* End of fb_string() */
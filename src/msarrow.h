@@ -0,0 +1,54 @@
+/***************************************************************************
+ * msarrow.h
+ *
+ * Interface declarations for the Arrow IPC file writing routines in
+ * msarrow.c
+ *
+ * An Arrow IPC file (Feather version 2) holding a single record batch
+ * is written in three parts: the file header with the schema and the
+ * record batch metadata from msa_header(), the body with the values of
+ * each column written by the caller, each padded to a multiple of 8
+ * bytes as given by msa_columnsize(), and the file footer from
+ * msa_footer().  Column values are written in host byte order.
+ ***************************************************************************/
+
+#ifndef MSARROW_H
+#define MSARROW_H 1
+
+#include <libmseed.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Column of a record batch, the type is a sample type, 'i' (int32),
+ * 'f' (float32) or 'd' (float64), or 't' for UTC time stamps as
+ * microseconds since the epoch (int64) */
+typedef struct MSArrowColumn_s
+{
+  char    *name;            /* Column name */
+  char     type;            /* Column value type */
+} MSArrowColumn;
+
+/* Description of an Arrow file with a single record batch */
+typedef struct MSArrowFile_s
+{
+  MSArrowColumn *columns;   /* Columns of the record batch */
+  int      ncolumns;        /* Number of columns */
+  char   **keys;            /* Schema metadata keys */
+  char   **values;          /* Schema metadata values */
+  int      nkeys;           /* Number of schema metadata entries */
+  int64_t  rows;            /* Number of rows in the record batch */
+  int64_t  batchoffset;     /* Set by msa_header(): record batch message offset */
+  int32_t  batchlength;     /* Set by msa_header(): record batch metadata length */
+} MSArrowFile;
+
+extern int64_t  msa_columnsize (char type, int64_t rows);
+extern int64_t  msa_header (MSArrowFile *af, char **buffer);
+extern int64_t  msa_footer (MSArrowFile *af, char **buffer);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* MSARROW_H */
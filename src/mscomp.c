@@ -0,0 +1,488 @@
+/***************************************************************************
+ * mscomp.c
+ *
+ * Compressed output streams, writing files as gzip or zstd streams
+ * while they are written.
+ *
+ * gzip output is supported with zlib unless NOFDZIP is defined.  zstd
+ * output is supported when built with WITHZSTD defined and linked with
+ * libzstd.
+ *
+ * A stream has two input buffers.  While one is filled by the caller
+ * the other is compressed and written by the compression thread of the
+ * stream, the caller only waits when it fills a buffer before the
+ * thread has finished the other.  If the thread cannot be started, or
+ * threads are not supported, buffers are compressed when full by the
+ * caller.
+ ***************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+#ifndef NOFDZIP
+#include <zlib.h>
+#endif
+
+#ifdef WITHZSTD
+#include <zstd.h>
+#endif
+
+#include "mscomp.h"
+
+#if !defined(LMP_WIN32)
+#include <pthread.h>
+#endif
+
+/* Size of the buffer for compressed data before writing */
+#define MSC_OUTSIZE 262144
+
+struct MSCompStream_s
+{
+  FILE    *fp;              /* Output file */
+  int      method;          /* Compression method */
+  void    *encoder;         /* z_stream or ZSTD_CCtx */
+  char    *buffers[2];      /* Input buffers, filled and compressed in turn */
+  int      current;         /* Index of the buffer being filled */
+  size_t   fill;            /* Bytes in the buffer being filled */
+  char    *outbuffer;       /* Compressed data before writing */
+  int      pending;         /* Index of the buffer to compress, -1 if none */
+  size_t   pendingsize;     /* Bytes in the buffer to compress */
+  int      finish;          /* Flag: the buffer to compress ends the stream */
+  int      error;           /* Flag: compressing or writing failed */
+#if !defined(LMP_WIN32)
+  pthread_t thread;
+  pthread_mutex_t lock;
+  pthread_cond_t cond;      /* Signaled when pending changes */
+  int      started;         /* Flag: thread started */
+#endif
+};
+
+static int msc_encode (MSCompStream *cs, const char *buffer, size_t size, int finish);
+static int msc_handoff (MSCompStream *cs, int finish);
+static void msc_free (MSCompStream *cs);
+#if !defined(LMP_WIN32)
+static void *msc_thread (void *arg);
+#endif
+
+
+/***************************************************************************
+ * msc_supported:
+ *
+ * Returns 1 if a compression method is supported by this build and 0
+ * otherwise.
+ ***************************************************************************/
+int
+msc_supported (int method)
+{
+#ifndef NOFDZIP
+  if (method == MSC_GZIP)
+    return 1;
+#endif
+
+#ifdef WITHZSTD
+  if (method == MSC_ZSTD)
+    return 1;
+#endif
+
+  return 0;
+} /* End of msc_supported() */
+
+
+/***************************************************************************
+ * msc_extension:
+ *
+ * Returns the file name extension of a compression method, including
+ * the leading dot.
+ ***************************************************************************/
+const char *
+msc_extension (int method)
+{
+  return (method == MSC_ZSTD) ? ".zst" : ".gz";
+} /* End of msc_extension() */
+
+
+/***************************************************************************
+ * msc_open:
+ *
+ * Create a compressed stream writing to fp with a compression method
+ * and level, 1 to 9 for gzip and 1 to 19 for zstd, or the default
+ * level of the method if level is negative.  The compression thread
+ * of the stream is started.
+ *
+ * Returns a new MSCompStream on success and NULL on error.
+ ***************************************************************************/
+MSCompStream *
+msc_open (FILE *fp, int method, int level)
+{
+  MSCompStream *cs;
+
+  if ((cs = (MSCompStream *)calloc (1, sizeof (MSCompStream))) == NULL ||
+      (cs->buffers[0] = (char *)malloc (MSC_BUFFERSIZE)) == NULL ||
+      (cs->buffers[1] = (char *)malloc (MSC_BUFFERSIZE)) == NULL ||
+      (cs->outbuffer = (char *)malloc (MSC_OUTSIZE)) == NULL)
+  {
+    fprintf (stderr, "Cannot allocate memory for compressed output\n");
+    msc_free (cs);
+    return NULL;
+  }
+
+  cs->fp = fp;
+  cs->method = method;
+  cs->pending = -1;
+
+#ifndef NOFDZIP
+  if (method == MSC_GZIP)
+  {
+    z_stream *zs;
+
+    if ((zs = (z_stream *)calloc (1, sizeof (z_stream))) == NULL)
+    {
+      fprintf (stderr, "Cannot allocate memory for compressed output\n");
+      msc_free (cs);
+      return NULL;
+    }
+
+    /* 15 window bits + 16 for gzip wrapper */
+    if (deflateInit2 (zs, (level < 0) ? Z_DEFAULT_COMPRESSION : level,
+                      Z_DEFLATED, 15 + 16, 8, Z_DEFAULT_STRATEGY) != Z_OK)
+    {
+      fprintf (stderr, "Cannot initialize gzip compression\n");
+      free (zs);
+      msc_free (cs);
+      return NULL;
+    }
+
+    cs->encoder = zs;
+  }
+#endif
+
+#ifdef WITHZSTD
+  if (method == MSC_ZSTD)
+  {
+    ZSTD_CCtx *cctx;
+
+    if ((cctx = ZSTD_createCCtx ()) == NULL ||
+        ZSTD_isError (ZSTD_CCtx_setParameter (cctx, ZSTD_c_compressionLevel,
+                                              (level < 0) ? ZSTD_CLEVEL_DEFAULT : level)))
+    {
+      fprintf (stderr, "Cannot initialize zstd compression\n");
+      ZSTD_freeCCtx (cctx);
+      msc_free (cs);
+      return NULL;
+    }
+
+    cs->encoder = cctx;
+  }
+#endif
+
+  if (cs->encoder == NULL)
+  {
+    fprintf (stderr, "Compression method %d is not supported\n", method);
+    msc_free (cs);
+    return NULL;
+  }
+
+#if !defined(LMP_WIN32)
+  pthread_mutex_init (&cs->lock, NULL);
+  pthread_cond_init (&cs->cond, NULL);
+
+  cs->started = (pthread_create (&cs->thread, NULL, msc_thread, cs) == 0);
+#endif
+
+  return cs;
+} /* End of msc_open() */
+
+
+/***************************************************************************
+ * msc_write:
+ *
+ * Add data to a compressed stream, handing each full input buffer to
+ * the compression thread.
+ *
+ * Returns 0 on success and -1 on error.
+ ***************************************************************************/
+int
+msc_write (MSCompStream *cs, const void *buffer, size_t size)
+{
+  const char *bp = (const char *)buffer;
+  size_t chunk;
+
+  while (size > 0)
+  {
+    chunk = MSC_BUFFERSIZE - cs->fill;
+    if (chunk > size)
+      chunk = size;
+
+    memcpy (cs->buffers[cs->current] + cs->fill, bp, chunk);
+    cs->fill += chunk;
+    bp += chunk;
+    size -= chunk;
+
+    if (cs->fill == MSC_BUFFERSIZE && msc_handoff (cs, 0))
+      return -1;
+  }
+
+  return 0;
+} /* End of msc_write() */
+
+
+/***************************************************************************
+ * msc_close:
+ *
+ * Compress the remaining data and end the stream, stop the compression
+ * thread and free the stream.  The file of the stream is not closed.
+ *
+ * Returns 0 on success and -1 on error.
+ ***************************************************************************/
+int
+msc_close (MSCompStream *cs)
+{
+  int retval;
+
+  if (cs == NULL)
+    return -1;
+
+  retval = msc_handoff (cs, 1);
+
+#if !defined(LMP_WIN32)
+  if (cs->started)
+  {
+    pthread_join (cs->thread, NULL);
+    cs->started = 0;
+
+    if (cs->error)
+      retval = -1;
+  }
+#endif
+
+  msc_free (cs);
+
+  return retval;
+} /* End of msc_close() */
+
+
+/***************************************************************************
+ * msc_handoff:
+ *
+ * Hand the buffer being filled to the compression thread, waiting
+ * until the thread has finished the previous buffer, and continue
+ * with the other buffer.  Without a thread the buffer is compressed
+ * directly.
+ *
+ * Returns 0 on success and -1 if compressing has failed.
+ ***************************************************************************/
+static int
+msc_handoff (MSCompStream *cs, int finish)
+{
+  int error;
+
+#if !defined(LMP_WIN32)
+  if (cs->started)
+  {
+    pthread_mutex_lock (&cs->lock);
+
+    while (cs->pending >= 0)
+      pthread_cond_wait (&cs->cond, &cs->lock);
+
+    cs->pending = cs->current;
+    cs->pendingsize = cs->fill;
+    cs->finish = finish;
+    error = cs->error;
+
+    pthread_cond_broadcast (&cs->cond);
+    pthread_mutex_unlock (&cs->lock);
+  }
+  else
+#endif
+  {
+    if (!cs->error && msc_encode (cs, cs->buffers[cs->current], cs->fill, finish))
+      cs->error = 1;
+
+    error = cs->error;
+  }
+
+  cs->current ^= 1;
+  cs->fill = 0;
+
+  return (error) ? -1 : 0;
+} /* End of msc_handoff() */
+
+
+#if !defined(LMP_WIN32)
+/***************************************************************************
+ * msc_thread:
+ *
+ * Compress the buffers handed over until the end of the stream, the
+ * compression thread of a stream.  After an error the remaining
+ * buffers are skipped.
+ *
+ * Returns NULL.
+ ***************************************************************************/
+static void *
+msc_thread (void *arg)
+{
+  MSCompStream *cs = (MSCompStream *)arg;
+  const char *buffer;
+  size_t size;
+  int finish = 0;
+  int error;
+
+  pthread_mutex_lock (&cs->lock);
+
+  while (!finish)
+  {
+    while (cs->pending < 0)
+      pthread_cond_wait (&cs->cond, &cs->lock);
+
+    buffer = cs->buffers[cs->pending];
+    size = cs->pendingsize;
+    finish = cs->finish;
+    error = cs->error;
+
+    pthread_mutex_unlock (&cs->lock);
+
+    if (!error)
+      error = msc_encode (cs, buffer, size, finish);
+
+    pthread_mutex_lock (&cs->lock);
+
+    if (error)
+      cs->error = 1;
+
+    cs->pending = -1;
+    pthread_cond_broadcast (&cs->cond);
+  }
+
+  pthread_mutex_unlock (&cs->lock);
+
+  return NULL;
+} /* End of msc_thread() */
+#endif
+
+
+/***************************************************************************
+ * msc_encode:
+ *
+ * Compress a buffer of input and write the compressed data produced,
+ * ending the compressed stream if finish is set.
+ *
+ * Returns 0 on success and -1 on error.
+ ***************************************************************************/
+static int
+msc_encode (MSCompStream *cs, const char *buffer, size_t size, int finish)
+{
+#ifndef NOFDZIP
+  if (cs->method == MSC_GZIP)
+  {
+    z_stream *zs = (z_stream *)cs->encoder;
+    size_t produced;
+    int rv;
+
+    zs->next_in = (Bytef *)buffer;
+    zs->avail_in = (uInt)size;
+
+    do
+    {
+      zs->next_out = (Bytef *)cs->outbuffer;
+      zs->avail_out = MSC_OUTSIZE;
+
+      rv = deflate (zs, (finish) ? Z_FINISH : Z_NO_FLUSH);
+
+      if (rv == Z_STREAM_ERROR)
+      {
+        fprintf (stderr, "gzip: %s\n", (zs->msg) ? zs->msg : "deflate error");
+        return -1;
+      }
+
+      produced = MSC_OUTSIZE - zs->avail_out;
+
+      if (produced > 0 && fwrite (cs->outbuffer, produced, 1, cs->fp) != 1)
+      {
+        fprintf (stderr, "Error writing compressed output: %s\n", strerror (errno));
+        return -1;
+      }
+    } while ((finish) ? rv != Z_STREAM_END : zs->avail_out == 0);
+
+    return 0;
+  }
+#endif
+
+#ifdef WITHZSTD
+  if (cs->method == MSC_ZSTD)
+  {
+    ZSTD_inBuffer input = {buffer, size, 0};
+    ZSTD_outBuffer output;
+    size_t produced;
+    size_t remaining;
+
+    do
+    {
+      output.dst = cs->outbuffer;
+      output.size = MSC_OUTSIZE;
+      output.pos = 0;
+
+      remaining = ZSTD_compressStream2 ((ZSTD_CCtx *)cs->encoder, &output, &input,
+                                        (finish) ? ZSTD_e_end : ZSTD_e_continue);
+
+      if (ZSTD_isError (remaining))
+      {
+        fprintf (stderr, "zstd: %s\n", ZSTD_getErrorName (remaining));
+        return -1;
+      }
+
+      produced = output.pos;
+
+      if (produced > 0 && fwrite (cs->outbuffer, produced, 1, cs->fp) != 1)
+      {
+        fprintf (stderr, "Error writing compressed output: %s\n", strerror (errno));
+        return -1;
+      }
+    } while ((finish) ? remaining != 0 : input.pos < input.size);
+
+    return 0;
+  }
+#endif
+
+  return -1;
+} /* End of msc_encode() */
+
+
+/***************************************************************************
+ * msc_free:
+ *
+ * Free a compressed stream and its encoder.
+ ***************************************************************************/
+static void
+msc_free (MSCompStream *cs)
+{
+  if (cs == NULL)
+    return;
+
+  if (cs->encoder)
+  {
+#ifndef NOFDZIP
+    if (cs->method == MSC_GZIP)
+    {
+      deflateEnd ((z_stream *)cs->encoder);
+      free (cs->encoder);
+    }
+#endif
+
+#ifdef WITHZSTD
+    if (cs->method == MSC_ZSTD)
+      ZSTD_freeCCtx ((ZSTD_CCtx *)cs->encoder);
+#endif
+
+#if !defined(LMP_WIN32)
+    pthread_mutex_destroy (&cs->lock);
+    pthread_cond_destroy (&cs->cond);
+#endif
+  }
+
+  free (cs->buffers[0]);
+  free (cs->buffers[1]);
+  free (cs->outbuffer);
+  free (cs);
+} /* End of msc_free() */
@@ -0,0 +1,44 @@
+/***************************************************************************
+ * mscomp.h
+ *
+ * Interface declarations for the compressed output streams in
+ * mscomp.c
+ *
+ * Output written to a stream with msc_write() is collected in a buffer
+ * that is handed to a compression thread when full, so that formatting
+ * and compression run in parallel.  The compressed data is written to
+ * the file of the stream, which must not be used otherwise until the
+ * stream is finished with msc_close().
+ ***************************************************************************/
+
+#ifndef MSCOMP_H
+#define MSCOMP_H 1
+
+#include <stdio.h>
+
+#include <libmseed.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Compression methods */
+#define MSC_GZIP 1
+#define MSC_ZSTD 2
+
+/* Size of each of the two input buffers of a stream */
+#define MSC_BUFFERSIZE 1048576
+
+typedef struct MSCompStream_s MSCompStream;
+
+extern int msc_supported (int method);
+extern const char *msc_extension (int method);
+extern MSCompStream *msc_open (FILE *fp, int method, int level);
+extern int msc_write (MSCompStream *cs, const void *buffer, size_t size);
+extern int msc_close (MSCompStream *cs);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* MSCOMP_H */
@@ -0,0 +1,231 @@
+/***************************************************************************
+ * msdecomp.c
+ *
+ * Input filters to read compressed miniSEED directly, decompressing
+ * in-stream instead of via temporary files.
+ *
+ * gzip input, including concatenated members, is supported with zlib
+ * unless NOFDZIP is defined.  zstd input is supported when built with
+ * WITHZSTD defined and linked with libzstd.
+ *
+ * The decompression runs in the libmseed read-ahead thread, in
+ * parallel with record parsing and decoding.
+ ***************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifndef NOFDZIP
+#include <zlib.h>
+#endif
+
+#ifdef WITHZSTD
+#include <zstd.h>
+#endif
+
+#include "msdecomp.h"
+
+#ifndef NOFDZIP
+/* gzip decoder state */
+typedef struct GzipState_s
+{
+  z_stream zs;
+  int memberend;    /* End of a gzip member reached */
+} GzipState;
+
+/***************************************************************************
+ * gzip_open:
+ *
+ * Create a zlib inflate stream for gzip input.
+ *
+ * Returns a stream handle on success and NULL on error.
+ ***************************************************************************/
+static void *
+gzip_open (void)
+{
+  GzipState *gs;
+
+  if ((gs = (GzipState *)calloc (1, sizeof (GzipState))) == NULL)
+    return NULL;
+
+  /* 15 window bits + 16 for gzip wrapper */
+  if (inflateInit2 (&gs->zs, 15 + 16) != Z_OK)
+  {
+    free (gs);
+    return NULL;
+  }
+
+  return gs;
+} /* End of gzip_open() */
+
+/***************************************************************************
+ * gzip_decode:
+ *
+ * Inflate gzip input.  At the end of a gzip member decoding continues
+ * with the next member, as produced by concatenating gzip files, if
+ * the following input starts with the gzip signature; other trailing
+ * input is ignored.
+ *
+ * Returns the number of bytes written to out or -1 on error.
+ ***************************************************************************/
+static int
+gzip_decode (void *handle, const char *in, int inlen, int *inused,
+             char *out, int outsize)
+{
+  GzipState *gs = (GzipState *)handle;
+  z_stream *zs = &gs->zs;
+  int rv;
+
+  *inused = 0;
+
+  if (gs->memberend)
+  {
+    if (inlen == 0)
+      return 0;
+
+    if ((unsigned char)in[0] != 0x1f)
+    {
+      fprintf (stderr, "gzip: trailing data ignored\n");
+      return 0;
+    }
+
+    gs->memberend = 0;
+  }
+
+  zs->next_in   = (Bytef *)in;
+  zs->avail_in  = (uInt)inlen;
+  zs->next_out  = (Bytef *)out;
+  zs->avail_out = (uInt)outsize;
+
+  rv = inflate (zs, Z_NO_FLUSH);
+
+  *inused = inlen - (int)zs->avail_in;
+
+  if (rv == Z_STREAM_END)
+  {
+    if (inflateReset (zs) != Z_OK)
+      return -1;
+
+    gs->memberend = 1;
+  }
+  /* Z_BUF_ERROR only indicates that no progress was possible */
+  else if (rv != Z_OK && rv != Z_BUF_ERROR)
+  {
+    fprintf (stderr, "gzip: %s\n", (zs->msg) ? zs->msg : "inflate error");
+    return -1;
+  }
+  /* No input remaining in the middle of a member */
+  else if (inlen == 0 && zs->avail_out == (uInt)outsize)
+  {
+    fprintf (stderr, "gzip: unexpected end of compressed data\n");
+  }
+
+  return outsize - (int)zs->avail_out;
+} /* End of gzip_decode() */
+
+/***************************************************************************
+ * gzip_close:
+ *
+ * Free a zlib inflate stream.
+ ***************************************************************************/
+static void
+gzip_close (void *handle)
+{
+  GzipState *gs = (GzipState *)handle;
+
+  inflateEnd (&gs->zs);
+  free (gs);
+} /* End of gzip_close() */
+
+static const MSInputFilter gzipfilter = {
+    "gzip", "\x1f\x8b", 2, gzip_open, gzip_decode, gzip_close};
+#endif /* NOFDZIP */
+
+#ifdef WITHZSTD
+/***************************************************************************
+ * zstd_open:
+ *
+ * Create a zstd decompression stream.
+ *
+ * Returns a stream handle on success and NULL on error.
+ ***************************************************************************/
+static void *
+zstd_open (void)
+{
+  return ZSTD_createDStream ();
+} /* End of zstd_open() */
+
+/***************************************************************************
+ * zstd_decode:
+ *
+ * Decompress zstd input, concatenated frames are handled by the
+ * zstd stream.
+ *
+ * Returns the number of bytes written to out or -1 on error.
+ ***************************************************************************/
+static int
+zstd_decode (void *handle, const char *in, int inlen, int *inused,
+             char *out, int outsize)
+{
+  ZSTD_inBuffer input   = {in, (size_t)inlen, 0};
+  ZSTD_outBuffer output = {out, (size_t)outsize, 0};
+  size_t rv;
+
+  rv = ZSTD_decompressStream ((ZSTD_DStream *)handle, &output, &input);
+
+  if (ZSTD_isError (rv))
+  {
+    fprintf (stderr, "zstd: %s\n", ZSTD_getErrorName (rv));
+    return -1;
+  }
+
+  *inused = (int)input.pos;
+
+  return (int)output.pos;
+} /* End of zstd_decode() */
+
+/***************************************************************************
+ * zstd_close:
+ *
+ * Free a zstd decompression stream.
+ ***************************************************************************/
+static void
+zstd_close (void *handle)
+{
+  ZSTD_freeDStream ((ZSTD_DStream *)handle);
+} /* End of zstd_close() */
+
+static const MSInputFilter zstdfilter = {
+    "zstd", "\x28\xb5\x2f\xfd", 4, zstd_open, zstd_decode, zstd_close};
+#endif /* WITHZSTD */
+
+/***************************************************************************
+ * msd_addfilters:
+ *
+ * Register the supported decompression filters with libmseed.
+ *
+ * Returns the number of filters registered or -1 on error.
+ ***************************************************************************/
+int
+msd_addfilters (int verbose)
+{
+  int count = 0;
+
+#ifndef NOFDZIP
+  if (ms_addinputfilter (&gzipfilter))
+    return -1;
+  count++;
+#endif
+
+#ifdef WITHZSTD
+  if (ms_addinputfilter (&zstdfilter))
+    return -1;
+  count++;
+#endif
+
+  if (verbose > 2)
+    fprintf (stderr, "Registered %d decompression filter(s)\n", count);
+
+  return count;
+} /* End of msd_addfilters() */
@@ -0,0 +1,26 @@
+/***************************************************************************
+ * msdecomp.h
+ *
+ * Interface declarations for the compressed input filters in
+ * msdecomp.c
+ *
+ * The filters are registered with libmseed and applied by the record
+ * reader to files that begin with the gzip or zstd signature.
+ ***************************************************************************/
+
+#ifndef MSDECOMP_H
+#define MSDECOMP_H 1
+
+#include <libmseed.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+extern int msd_addfilters (int verbose);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* MSDECOMP_H */
@@ -15,11 +15,27 @@
 
 #include <libmseed.h>
 
+#include "msindex.h"
+#include "msdecomp.h"
+#include "mssort.h"
+#include "msspill.h"
+#include "mslazy.h"
+#include "sacformat.h"
+#include "msarrow.h"
+#include "msformat.h"
+#include "mscomp.h"
+
+#if !defined(LMP_WIN32)
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#endif
+
 #ifndef NOFDZIP
 #include "fdzipstream.h"
 #endif
 
-#define VERSION "2.6"
+#define VERSION "2.7"
 #define PACKAGE "mseed2ascii"
 
 /* Maximum number of metadata fields per line */
@@ -40,12 +56,95 @@ struct metanode
   hptime_t endtime;
 };
 
-static int64_t writeascii (MSTrace *mst);
+/* Details of a trace segment shared by the output format writers */
+struct traceinfo
+{
+  MSTraceID *id;
+  MSTraceSeg *seg;
+  struct metanode *mn;     /* Matching metadata, NULL if none */
+  int64_t nsamples;        /* Number of samples to write */
+  char sampletype;         /* Type of samples written, after scaling */
+  char *samptype;          /* Sample type description for headers */
+  int scale;               /* Scale samples by metadata scale factor */
+  char srcname[50];        /* Source name for headers */
+  char timestr[50];        /* Start time for headers */
+  char basename[1024];     /* Output file name without extension */
+};
+
+/* Output index of a text trace, an entry every indexinterval samples
+ * with the sample index, the offset of its text in the output file or
+ * ZIP entry, the offset in a stored ZIP entry in the archive, -1
+ * otherwise, and the sample time */
+struct outputindex
+{
+  int64_t *entries;        /* Entries, 4 values each */
+  int64_t count;           /* Number of entries */
+  int64_t next;            /* Sample index of the next entry */
+};
+
+/* Length of the header of a trace in an output index file */
+#define INDEXHEADER 96
+
+/* Number of rows of a matrix filled and written at a time */
+#define MATRIXROWS 1024
+
+/* Reading state of a channel of matrix output */
+struct matrixchannel
+{
+  MSTraceID *id;
+  MSTraceSeg *seg;         /* Segment being read, NULL when done */
+  int mapped;              /* Spilled samples of the segment are mapped */
+  int64_t position;        /* Decoding position in the segment */
+  void *samples;           /* Current block of decoded samples */
+  int64_t blockstart;      /* Index of the first sample of the block in the segment */
+  int64_t blockcount;      /* Samples in the block, -1 if no more can be decoded */
+  char sampletype;         /* Column sample type, after scaling */
+  double scalefactor;      /* Scale factor of the samples, 0 if not scaled */
+  char *units;             /* Units of the samples */
+  MSLazyReader reader;     /* Record decoding state with lazy decoding */
+};
+
+static void addrecord (MSRecord *msr, void *handlerdata);
+static void addsortedrecord (MSRecord *msr, void *handlerdata);
+static void healsegments (MSTraceList *mstl);
+static void writetraces (MSTraceList *mstl);
+static int buildindexes (void);
+static int64_t writetrace (MSTraceID *id, MSTraceSeg *seg);
+static int traceheader (struct traceinfo *ti, char *outbuffer, size_t size);
+static int beginoutput (char *outfile, int *opened);
+static int endoutput (char *outfile, int opened);
+static int64_t writeascii (struct traceinfo *ti);
+static int writefixed (MSFormatKernel kernel, MSFormatState *state, void *samples,
+                       int64_t count, int samplesize, int linelength,
+                       char *outbuffer, int *outsize, char *outfile);
+static int addindex (MSFormatState *state, int64_t sample, int64_t offset);
+static int writeindex (struct traceinfo *ti, char *outfile);
+static char *packle64 (char *buffer, uint64_t value);
+static int formatsamples (MSFormatKernel kernel, MSFormatState *state, void *samples,
+                          int64_t count, int samplesize, char *outbuffer,
+                          size_t buffersize, int *outsize, char *outfile);
+static int64_t writebinary (struct traceinfo *ti);
+static int writeheader (char *outbuffer, size_t outsize, char *hdrfile);
+static int writesamples (void *samples, int64_t count, int samplesize, char *outfile);
+static int64_t writesac (struct traceinfo *ti);
+static void sacsamples (struct traceinfo *ti, void *samples, int64_t count, int first,
+                        float *min, float *max, double *sum);
+static void sacstring (char *field, const char *value);
+static int64_t writearrow (struct traceinfo *ti);
+static int64_t writearrowfile (struct traceinfo *ti, MSArrowFile *af);
+static int64_t writematrix (MSTraceList *mstl);
+static void matrixsegment (struct matrixchannel *mc, MSTraceSeg *seg);
+static void matrixfill (struct matrixchannel *mc, double *column, int stride,
+                        hptime_t origin, double hpperiod, int64_t firstrow, int rows);
+static int64_t nextsamples (MSTraceSeg *seg, int64_t *position, MSLazyReader *reader,
+                            void **samples);
+static void scalesamples (void *samples, int64_t count, char sampletype, double scalefactor);
 static int writedata (char *outbuffer, size_t outsize, char *outfile);
 static int parameter_proc (int argcount, char **argvec);
 static char *getoptval (int argcount, char **argvec, int argopt, int dasharg);
+static hptime_t parsetime (char *timestr);
 static int readlistfile (char *listfile);
-struct metanode *getmetadata (MSTrace *mst);
+struct metanode *getmetadata (MSTraceID *id, MSTraceSeg *seg);
 static int addmetadata (char *metaline);
 static int readmetadata (char *metafile);
 static struct listnode *addnode (struct listnode **listroot, void *key, int keylen,
@@ -59,12 +158,51 @@ static int    indifile     = 0;    /* Individual file processing flag */
 static char  *unitsstr     = "Counts"; /* Units to write into output headers */
 static char  *outputfile   = 0;    /* Output file name for single file output */
 static FILE  *ofp          = 0;    /* Output file pointer */
+static FILE  *hfp          = 0;    /* Header or index file pointer for single file output */
 static int    outformat    = 1;    /* Output file format */
 static int    headerformat = 1;    /* 1 = Simple ASCII, 2 = GeoCSV */
 static int    slistcols    = 1;    /* Number of columns for sample list output */
+static int    precision    = -1;   /* Decimals of float samples in text, -1 = %g */
+static int    timeformat   = 0;    /* TSPAIR time: 0 = ISO, 1 = epoch seconds, 2 = relative seconds */
+static int    fixedwidth   = -1;   /* Width of fixed-width text fields, 0 = widest, -1 = not fixed */
+static int64_t indexinterval = 0;  /* Samples between output index entries, 0 = no index */
+static struct outputindex outindex; /* Output index of the trace being written */
+static int64_t outputbytes = 0;    /* Bytes written to the output file or ZIP entry */
+static int64_t zipdataoffset = -1; /* Archive offset of stored ZIP entry data, -1 if compressed */
 static int    scaledata    = 0;    /* Scale data, inversly, by factor in metadata */
 static double timetol      = -1.0; /* Time tolerance for continuous traces */
 static double sampratetol  = -1.0; /* Sample rate tolerance for continuous traces */
+static int    healtraces   = 1;    /* Heal trace segments while and after reading input */
+static Selections *selections = 0; /* Data selections, source name and time */
+static int    buildindex   = 0;    /* Build record indexes for input files and exit */
+static int    useindex     = 0;    /* Use record indexes when available */
+static char  *indexdir     = 0;    /* Directory for record indexes, default is sidecar */
+static int    sortinput    = 0;    /* Read records in source name and time order */
+static int64_t sortmemory  = MSSORT_DEFMEMORY; /* Memory budget for sorting records */
+static char  *tmpdir       = 0;    /* Directory for temporary files, default is system */
+static int64_t maxmemory   = 0;    /* Memory budget for decoded samples, 0 = unlimited */
+static MSSpill *spill      = 0;    /* Sample spill state when limiting memory */
+static int    lazydecode   = 0;    /* Keep raw records in traces and decode while writing */
+static int    compressmethod = 0;  /* Compression of output files, MSC_GZIP or MSC_ZSTD, 0 = none */
+static int    compresslevel = -1;  /* Compression level, -1 = default of the method */
+static MSCompStream *cstream = 0;  /* Compressed stream of the current output file */
+static MSLazyReader lazyreader;   /* Record decoding state while writing with lazy decoding */
+static int    matrixoutput = 0;    /* Write all traces as a time-aligned matrix */
+static hptime_t matrixstart = HPTERROR; /* Start of the matrix time window, -ts */
+static hptime_t matrixend  = HPTERROR; /* End of the matrix time window, -te */
+static int64_t totalrecs   = 0;    /* Total records read */
+static int64_t totalsamps  = 0;    /* Total samples read */
+static int64_t sactraces   = 0;    /* SAC traces written to a single output file */
+static int    exitstatus   = 0;    /* Exit status, set to 1 when output is incomplete */
+
+/* GeoCSV header keys of metadata fields, by field index */
+static const char *metakeys[MAXMETAFIELDS] = {
+  NULL, NULL, NULL, NULL,
+  "latitude_deg", "longitude_deg", "elevation_m", "depth_m",
+  "azimuth_deg", "dip_deg", "instrument", "scale_factor",
+  "scale_frequency_hz", "scale_units",
+  NULL, NULL, NULL
+};
 
 static char *zipfile = 0;
 #ifndef NOFDZIP
@@ -80,15 +218,17 @@ struct listnode *extraheader = NULL; /* List of extra headers to insert */
 int
 main (int argc, char **argv)
 {
-  MSTraceGroup *mstg = 0;
-  MSTrace *mst;
+  MSTraceList *mstl = 0;
   MSRecord *msr = 0;
+  MSFileParam *msfp = 0;
+  MSIndex *index = 0;
+  MSSort *sort = 0;
 
   struct listnode *flp;
 
+  char indexfile[4096];
+  char hdrfile[4096];
   int retcode;
-  int64_t totalrecs = 0;
-  int64_t totalsamps = 0;
   int totalfiles = 0;
 
 #ifndef NOFDZIP
@@ -101,8 +241,28 @@ main (int argc, char **argv)
   if (parameter_proc (argc, argv) < 0)
     return -1;
 
-  /* Init MSTraceGroup */
-  mstg = mst_initgroup (mstg);
+  /* Register decompression filters for compressed input */
+  if (msd_addfilters (verbose) < 0)
+    return -1;
+
+  /* Only header values extracted by msr_unpack() are needed, leave
+     the blockette chains in the records to be decoded on demand */
+  MS_UNPACKLAZYBLOCKETTES (1);
+
+  /* Build record indexes and exit if requested */
+  if ( buildindex )
+    return ( buildindexes () ) ? 1 : 0;
+
+  /* Init MSTraceList */
+  mstl = mstl_init (mstl);
+
+  /* Init external sort of records if reading in sorted order */
+  if ( sortinput && (sort = mss_init (tmpdir, sortmemory, verbose)) == NULL )
+    return -1;
+
+  /* Init sample memory budget if requested */
+  if ( maxmemory > 0 && (spill = msp_init (tmpdir, maxmemory, verbose)) == NULL )
+    return -1;
 
   /* Open the output file if specified */
   if ( outputfile )
@@ -117,6 +277,21 @@ main (int argc, char **argv)
                outputfile, strerror(errno));
       return -1;
     }
+
+    /* Headers of binary formats and indexes of text formats are
+     * written to a separate file */
+    if ( (outformat == 3 || outformat == 4 || indexinterval > 0) && ofp != stdout )
+    {
+      snprintf (hdrfile, sizeof(hdrfile), "%s.%s", outputfile,
+                (outformat <= 2) ? "idx" : "hdr");
+
+      if ( (hfp = fopen (hdrfile, "wb")) == NULL )
+      {
+        fprintf (stderr, "Cannot open output header file: %s (%s)\n",
+                 hdrfile, strerror(errno));
+        return -1;
+      }
+    }
   }
 
 #ifndef NOFDZIP
@@ -153,42 +328,59 @@ main (int argc, char **argv)
   }
 #endif /* NOFDZIP */
 
-  /* Read input miniSEED files into MSTraceGroup */
+  /* Read input miniSEED files into MSTraceList */
   flp = filelist;
   while ( flp != 0 )
   {
     if ( verbose )
       fprintf (stderr, "Reading %s\n", flp->data);
 
-    while ( (retcode = ms_readmsr(&msr, flp->data, reclen, NULL, NULL,
-                                  1, 1, verbose-1)) == MS_NOERROR )
+    /* Read only the selected records if a current index is available */
+    if ( useindex && strcmp (flp->data, "-") &&
+         msi_indexpath (flp->data, indexdir, indexfile, sizeof(indexfile)) &&
+         (index = msi_read (flp->data, indexfile, verbose)) )
     {
-      if ( verbose > 1)
-        msr_print (msr, verbose - 2);
-
-      mst_addmsrtogroup (mstg, msr, 1, timetol, sampratetol);
+      if ( sort )
+      {
+        if ( mss_addindex (sort, index, selections) )
+          fprintf (stderr, "Error sorting %s using index %s\n", flp->data, indexfile);
+      }
+      else if ( msi_readrecords (index, selections, addrecord, mstl, 1, verbose) < 0 )
+      {
+        fprintf (stderr, "Error reading %s using index %s\n", flp->data, indexfile);
+      }
 
-      totalrecs++;
-      totalsamps += msr->samplecnt;
+      msi_free (&index);
+    }
+    /* Collect sort keys, records are read after all input is scanned */
+    else if ( sort )
+    {
+      mss_addfile (sort, flp->data, reclen, selections);
     }
+    else
+    {
+      while ( (retcode = ms_readmsr_main (&msfp, &msr, flp->data, reclen, NULL, NULL,
+                                          1, 1, selections, verbose-1)) == MS_NOERROR )
+      {
+        addrecord (msr, mstl);
+      }
 
-    if ( retcode != MS_ENDOFFILE )
-      fprintf (stderr, "Error reading %s: %s\n", flp->data, ms_errorstr(retcode));
+      if ( retcode != MS_ENDOFFILE )
+        fprintf (stderr, "Error reading %s: %s\n", flp->data, ms_errorstr(retcode));
 
-    /* Make sure everything is cleaned up */
-    ms_readmsr (&msr, NULL, 0, NULL, NULL, 0, 0, 0);
+      /* Make sure everything is cleaned up */
+      ms_readmsr_main (&msfp, &msr, NULL, 0, NULL, NULL, 0, 0, NULL, 0);
+    }
 
     /* If processing each file individually, write ASCII and reset */
     if ( indifile )
     {
-      mst = mstg->traces;
-      while ( mst )
-      {
-        writeascii (mst);
-        mst = mst->next;
-      }
+      if ( sort && mss_readrecords (sort, addsortedrecord, &mstl, 1) < 0 )
+        fprintf (stderr, "Error reading %s in sorted order\n", flp->data);
+
+      writetraces (mstl);
 
-      mstg = mst_initgroup (mstg);
+      mstl = mstl_init (mstl);
     }
 
     totalfiles++;
@@ -197,20 +389,35 @@ main (int argc, char **argv)
 
   if ( ! indifile )
   {
-    mst = mstg->traces;
-    while ( mst )
-    {
-      writeascii (mst);
-      mst = mst->next;
-    }
+    if ( sort && mss_readrecords (sort, addsortedrecord, &mstl, 1) < 0 )
+      fprintf (stderr, "Error reading input in sorted order\n");
+
+    writetraces (mstl);
   }
 
-  /* Make sure everything is cleaned up */
-  mst_freegroup (&mstg);
+  /* Make sure everything is cleaned up, including segment spill states */
+  mstl_free (&mstl, 1);
+
+  if ( sort )
+    mss_free (&sort);
+
+  if ( spill )
+    msp_free (&spill);
+
+  msl_freereader (&lazyreader);
+
+  if ( outindex.entries )
+    free (outindex.entries);
+
+  if ( selections )
+    ms_freeselections (selections);
 
   if ( ofp )
     fclose (ofp);
 
+  if ( hfp )
+    fclose (hfp);
+
 #ifndef NOFDZIP
   /* Finish output ZIP archive if needed */
   if (zipfile)
@@ -229,53 +436,230 @@ main (int argc, char **argv)
     printf ("Files: %d, Records: %lld, Samples: %lld\n", totalfiles,
 	    (long long int)totalrecs, (long long int)totalsamps);
 
-  return 0;
+  return exitstatus;
 }  /* End of main() */
 
 
 /***************************************************************************
- * writeascii:
+ * addrecord:
+ *
+ * Add a record to the MSTraceList specified as handlerdata and
+ * update the record and sample totals.
+ ***************************************************************************/
+static void
+addrecord (MSRecord *msr, void *handlerdata)
+{
+  MSTraceList *mstl = (MSTraceList *) handlerdata;
+  MSTraceSeg *seg;
+
+  if ( verbose > 1)
+    msr_print (msr, verbose - 2);
+
+  /* With lazy decoding the sample type is that decoded while writing */
+  if ( lazydecode && (msr->sampletype = msl_sampletype (msr->encoding)) == 0 )
+  {
+    fprintf (stderr, "Skipping record with unsupported encoding %d for %s_%s_%s_%s\n",
+             msr->encoding, msr->network, msr->station, msr->location, msr->channel);
+    return;
+  }
+
+  /* With lazy decoding records are decoded while reading only to reject
+   * those that cannot be decoded, the samples are not kept */
+  if ( lazydecode )
+    msr->numsamples = 0;
+
+  /* Segments bridged by a record are joined as it is added, others by
+   * healsegments() after reading */
+  seg = mstl_addmsr (mstl, msr, 1, healtraces, timetol, sampratetol);
+
+  /* Keep the raw record with the segment to decode while writing */
+  if ( lazydecode && seg && msl_addrecord (seg, msr) )
+    fprintf (stderr, "Error keeping raw record for %s_%s_%s_%s\n",
+             msr->network, msr->station, msr->location, msr->channel);
+
+  /* Account samples against the memory budget, spilling if exceeded */
+  if ( spill && seg && msp_addrecord (spill, mstl, seg, msr) )
+    fprintf (stderr, "Error limiting sample memory, continuing without\n");
+
+  totalrecs++;
+  totalsamps += msr->samplecnt;
+}  /* End of addrecord() */
+
+
+/***************************************************************************
+ * addsortedrecord:
+ *
+ * Add a record, read in source name and time order, to the
+ * MSTraceList pointed to by handlerdata.  All records of a trace have
+ * been read when the source name changes, the trace is written and
+ * the MSTraceList is reset so that only one trace is held in memory.
+ * Matrix output needs all traces, they are written after reading.
+ ***************************************************************************/
+static void
+addsortedrecord (MSRecord *msr, void *handlerdata)
+{
+  MSTraceList **ppmstl = (MSTraceList **) handlerdata;
+  char srcname[50];
+
+  msr_srcname (msr, srcname, 1);
+
+  if ( ! matrixoutput && (*ppmstl)->traces &&
+       strcmp ((*ppmstl)->traces->srcname, srcname) )
+  {
+    writetraces (*ppmstl);
+
+    *ppmstl = mstl_init (*ppmstl);
+  }
+
+  addrecord (msr, *ppmstl);
+}  /* End of addsortedrecord() */
+
+
+/***************************************************************************
+ * healsegments:
+ *
+ * Join trace segments that fit together, unless disabled, e.g.
+ * segments from input records that are not in time order.
+ ***************************************************************************/
+static void
+healsegments (MSTraceList *mstl)
+{
+  int mergings;
+
+  if ( ! healtraces )
+    return;
+
+  if ( (mergings = mstl_heal (mstl, timetol, sampratetol)) < 0 )
+    fprintf (stderr, "Error healing trace segments\n");
+  else if ( verbose )
+    fprintf (stderr, "Healed %d trace segment(s)\n", mergings);
+}  /* End of healsegments() */
+
+
+/***************************************************************************
+ * writetraces:
+ *
+ * Heal, unless disabled, and write all trace segments in a MSTraceList.
+ * With a sample memory budget spilled segments are mapped from the
+ * spill file for writing and the samples of each segment are released
+ * once written.  With matrix output all traces are written together.
+ ***************************************************************************/
+static void
+writetraces (MSTraceList *mstl)
+{
+  MSTraceID *id;
+  MSTraceSeg *seg;
+
+  healsegments (mstl);
+
+  if ( matrixoutput )
+  {
+    writematrix (mstl);
+    return;
+  }
+
+  /* A SAC file holds a single trace, refuse to concatenate several */
+  if ( outformat == 5 && outputfile )
+  {
+    for ( id = mstl->traces; id; id = id->next )
+      sactraces += id->numsegments;
+
+    if ( sactraces > 1 )
+    {
+      fprintf (stderr, "SAC output holds a single trace, -o cannot be used for %lld traces\n",
+               (long long int)sactraces);
+      exitstatus = 1;
+      return;
+    }
+  }
+
+  for ( id = mstl->traces; id; id = id->next )
+    for ( seg = id->first; seg; seg = seg->next )
+    {
+      if ( ! spill )
+      {
+        writetrace (id, seg);
+        continue;
+      }
+
+      if ( msp_map (spill, seg) )
+        fprintf (stderr, "Error mapping spilled samples for %s\n", id->srcname);
+      else
+        writetrace (id, seg);
+
+      msp_release (spill, seg);
+    }
+}  /* End of writetraces() */
+
+
+/***************************************************************************
+ * buildindexes:
+ *
+ * Build and write a record index for each input file.
+ *
+ * Returns 0 on success and -1 if any index could not be built.
+ ***************************************************************************/
+static int
+buildindexes (void)
+{
+  struct listnode *flp;
+  MSIndex *index;
+  char indexfile[4096];
+  int retval = 0;
+
+  for ( flp = filelist; flp; flp = flp->next )
+  {
+    if ( ! msi_indexpath (flp->data, indexdir, indexfile, sizeof(indexfile)) ||
+         ! (index = msi_build (flp->data, reclen, verbose)) )
+    {
+      retval = -1;
+      continue;
+    }
+
+    if ( msi_write (index, indexfile, verbose) )
+      retval = -1;
+
+    msi_free (&index);
+  }
+
+  return retval;
+}  /* End of buildindexes() */
+
+
+/***************************************************************************
+ * writetrace:
  *
- * Write data buffer to output file as ASCII.
+ * Collect the details of a trace segment common to all output formats,
+ * matching metadata and scaling, and write the segment in the selected
+ * format.  Sample types without a binary form, i.e. ASCII, are always
+ * written as a text sample list.
  *
  * Returns the number of samples written or -1 on error.
  ***************************************************************************/
 static int64_t
-writeascii (MSTrace *mst)
+writetrace (MSTraceID *id, MSTraceSeg *seg)
 {
-  struct metanode *mn = NULL;
-  struct listnode *en = NULL;
+  struct traceinfo ti;
   BTime btime;
-  char outfile[1024];
-  char *outname = outputfile;
-  char timestr[50];
-  char srcname[50];
-  char *samptype;
-  char *delimiter = " ";
-  char outbuffer[8192];
-  int outsize;
-
   int month, mday;
-  int col, cnt, samplesize;
-  int64_t line;
-  int64_t lines;
-  void *sptr;
-  int32_t *idata;
-  float *fdata;
-  double *ddata;
-
-#ifndef NOFDZIP
-  int64_t writestatus = 0;
-#endif /* NOFDZIP */
+  int64_t cnt;
 
-  if ( ! mst )
+  if ( ! id || ! seg )
     return -1;
 
-  if ( mst->numsamples == 0 || mst->samprate == 0.0 )
+  memset (&ti, 0, sizeof(ti));
+  ti.id = id;
+  ti.seg = seg;
+
+  /* With lazy decoding the samples are decoded while writing */
+  ti.nsamples = ( lazydecode ) ? seg->samplecnt : seg->numsamples;
+  ti.sampletype = seg->sampletype;
+
+  if ( ti.nsamples == 0 || seg->samprate == 0.0 )
     return 0;
 
   /* Check reported versus derived sampling rates */
-  if ( mst->starttime < mst->endtime )
+  if ( seg->starttime < seg->endtime )
   {
     hptime_t hptimeshift;
     hptime_t hpdelta;
@@ -283,233 +667,199 @@ writeascii (MSTrace *mst)
 
     /* Calculate difference between end time of last miniSEED record and the end time
      * as calculated based on the start time, reported sample rate and number of samples. */
-    hptimeshift = llabs (mst->endtime - mst->starttime - (hptime_t)((mst->numsamples - 1) * HPTMODULUS / mst->samprate));
+    hptimeshift = llabs (seg->endtime - seg->starttime - (hptime_t)((ti.nsamples - 1) * HPTMODULUS / seg->samprate));
 
     /* Calculate high-precision sample period using reported sample rate */
-    hpdelta = (hptime_t)(( mst->samprate ) ? (HPTMODULUS / mst->samprate) : 0.0);
+    hpdelta = (hptime_t)(( seg->samprate ) ? (HPTMODULUS / seg->samprate) : 0.0);
 
     /* Test if time shift is beyond half a sample period */
     if ( hptimeshift > (hpdelta * 0.5) )
     {
       /* Derive sample rate from start and end times and number of samples */
-      samprate = (double) (mst->numsamples - 1) * HPTMODULUS / (mst->endtime - mst->starttime);
+      samprate = (double) (ti.nsamples - 1) * HPTMODULUS / (seg->endtime - seg->starttime);
 
       if ( deriverate )
       {
         if ( verbose )
           fprintf (stderr, "Using derived sample rate of %g over reported rate of %g\n",
-                   samprate, mst->samprate);
+                   samprate, seg->samprate);
 
-        mst->samprate = samprate;
+        seg->samprate = samprate;
       }
       else
       {
         fprintf (stderr, "[%s.%s.%s.%s] Reported sample rate different than derived rate (%g versus %g)\n",
-                 mst->network, mst->station, mst->location, mst->channel,
-                 mst->samprate, samprate);
+                 id->network, id->station, id->location, id->channel,
+                 seg->samprate, samprate);
         fprintf (stderr, "   Consider using the -dr option to use the sample rate derived from the series\n");
       }
     }
   }
 
-  if ( verbose )
-    fprintf (stderr, "Writing ASCII for %.8s.%.8s.%.8s.%.8s\n",
-	     mst->network, mst->station, mst->location, mst->channel);
-
   /* Generate source name, ISO time string and time components */
   if (headerformat == 1) /* For simple text include quality code */
-    mst_srcname (mst, srcname, 1);
+    snprintf (ti.srcname, sizeof(ti.srcname), "%s_%s_%s_%s_%c",
+              id->network, id->station, id->location, id->channel, id->dataquality);
   else                   /* For GeoCSV exclude quality code */
-    mst_srcname (mst, srcname, 0);
-  ms_hptime2isotimestr (mst->starttime, timestr, 1);
-  ms_hptime2btime (mst->starttime, &btime);
+    snprintf (ti.srcname, sizeof(ti.srcname), "%s_%s_%s_%s",
+              id->network, id->station, id->location, id->channel);
+  ms_hptime2isotimestr (seg->starttime, ti.timestr, 1);
+  ms_hptime2btime (seg->starttime, &btime);
   ms_doy2md (btime.year, btime.day, &month, &mday);
 
   /* Set sample type description */
-  if ( mst->sampletype == 'f' || mst-> sampletype == 'd' )
+  if ( ti.sampletype == 'f' || ti.sampletype == 'd' )
   {
-    samptype = "FLOAT";
+    ti.samptype = "FLOAT";
   }
-  else if ( mst->sampletype == 'i' )
+  else if ( ti.sampletype == 'i' )
   {
-    samptype = "INTEGER";
+    ti.samptype = "INTEGER";
   }
-  else if ( mst->sampletype == 'a' )
+  else if ( ti.sampletype == 'a' )
   {
-    samptype = "ASCII";
+    ti.samptype = "ASCII";
   }
   else
   {
     fprintf (stderr, "Error, unrecognized sample type: '%c'\n",
-             mst->sampletype);
+             ti.sampletype);
     return -1;
   }
 
-  /* Create output file name: Net.Sta.Loc.Chan.Qual.Year-Month-DayTHourMinSec.Subsec.[txt|csv] */
-  snprintf (outfile, sizeof(outfile), "%s.%s.%s.%s.%c.%04d-%02d-%02dT%02d%02d%02d.%06d.%s",
-            mst->network, mst->station, mst->location, mst->channel, mst->dataquality,
+  /* Create output file base name: Net.Sta.Loc.Chan.Qual.Year-Month-DayTHourMinSec.Subsec */
+  snprintf (ti.basename, sizeof(ti.basename), "%s.%s.%s.%s.%c.%04d-%02d-%02dT%02d%02d%02d.%06d",
+            id->network, id->station, id->location, id->channel, id->dataquality,
             btime.year, month, mday, btime.hour, btime.min, btime.sec,
-            (int)(mst->starttime - (hptime_t)MS_HPTIME2EPOCH(mst->starttime) * HPTMODULUS),
-            (headerformat == 1) ? "txt" : "csv");
-
-  /* Generate and open output file name if single file not being used and no ZIP output */
-  if ( ! ofp && ! zipfile )
-  {
-    /* Open output file */
-    if ( (ofp = fopen (outfile, "wb")) == NULL )
-    {
-      fprintf (stderr, "Cannot open output file: %s (%s)\n",
-               outfile, strerror(errno));
-      return -1;
-    }
-
-    outname = outfile;
-  }
-
-  if ( (samplesize = ms_samplesize(mst->sampletype)) == 0 )
-  {
-    fprintf (stderr, "Unrecognized sample type: %c\n", mst->sampletype);
-  }
+            (int)(seg->starttime - (hptime_t)MS_HPTIME2EPOCH(seg->starttime) * HPTMODULUS));
 
   /* Search for matching metadata */
   if (metadata)
-    mn = getmetadata (mst);
+    ti.mn = getmetadata (id, seg);
 
-  /* Scale data samples if scale factor available
+  /* Scale data samples, as they are written, if scale factor available
    * Integer data are converted to float
    * Units are taken from the metata */
-  if (scaledata && mn && mn->metafields[11] && mn->scalefactor)
+  if (scaledata && ti.mn && ti.mn->metafields[11] && ti.mn->scalefactor)
   {
-    for (cnt = 0; cnt < mst->numsamples; cnt++)
+    ti.scale = 1;
+
+    if (ti.sampletype == 'i')
     {
-      idata = (int32_t *)mst->datasamples + cnt;
-      fdata = (float *)mst->datasamples + cnt;
-      ddata = (double *)mst->datasamples + cnt;
+      ti.sampletype = 'f';
+      ti.samptype = "FLOAT";
+    }
 
-      /* Integers are converted to floats */
-      if (mst->sampletype == 'i')
-        *fdata = (float)*idata / mn->scalefactor;
+    unitsstr = ti.mn->metafields[13];
+  }
 
-      else if (mst->sampletype == 'f')
-        *fdata = *fdata / mn->scalefactor;
+  if ( (outformat == 3 || outformat == 4) && ti.sampletype != 'a' )
+    cnt = writebinary (&ti);
+  else if ( outformat == 5 && ti.sampletype != 'a' )
+    cnt = writesac (&ti);
+  else if ( (outformat == 6 || outformat == 7) && ti.sampletype != 'a' )
+    cnt = writearrow (&ti);
+  else
+    cnt = writeascii (&ti);
 
-      else if (mst->sampletype == 'd')
-        *ddata = *ddata / mn->scalefactor;
-    }
+  if ( cnt < 0 )
+    return -1;
 
-    if (mst->sampletype == 'i')
-    {
-      mst->sampletype = 'f';
-      samptype = "FLOAT";
-    }
+  if ( cnt != ti.nsamples )
+    fprintf (stderr, "Decoded %lld of %lld samples for %s\n",
+             (long long int)cnt, (long long int)ti.nsamples, ti.srcname);
 
-    unitsstr = mn->metafields[13];
-  }
+  fprintf (stderr, "Wrote %lld samples for %s\n",
+	   (long long int)cnt, ti.srcname);
 
-#ifndef NOFDZIP
-  /* Begin ZIP entry */
-  if (zipfile)
-  {
-    if (!(zentry = zs_entrybegin (zstream, outfile, time (NULL),
-                                  zipmethod, &writestatus)))
-    {
-      fprintf (stderr, "Cannot begin ZIP entry, write status: %lld\n",
-               (long long int)writestatus);
-      return -1;
-    }
-  }
-#endif /* NOFDZIP */
+  return cnt;
+}  /* End of writetrace() */
 
-  /* Simple ASCII header format:
-   * "TIMESERIES Net_Sta_Loc_Chan_Qual, ## samples, ## sps, isotime, SLIST|TSPAIR, INTEGER|FLOAT|ASCII, Units"
-   *
-   * GeoCSV header format:
-   * "# dataset: GeoCSV 2.0"
-   * "# delimiter: <DELIMITER>"
-   * "# SID: <SOURCE ID>"
-   * "# sample_count: <COUNT>"
-   * "# sample_rate_hz: <RATE>"
-   * "# start_time: <RATE>"
-
-   * If metadata is present these may be included:
-   * "# latitude_deg: <LATITUDE>"
-   * "# longitude_deg: <LONGITUDE>"
-   * "# elevation_m: <ELEVATION>"
-   * "# depth_m: <DEPTH>"
-   * "# azimuth_deg: <AZIMUTH>"
-   * "# dip_deg: <DIP>"
-   * "# instrument: <INSTRUMENT>"
-   * "# scale_factor: <SCALEFACTOR>"
-   * "# scale_frequency: <SCALEFREQ>"
-   * "# scale_units: <SCALEUNITS>"
-
-   * If extra headers are specified these are included as:
-   * "# <KEY>: <VALUE>"
-
-   * "# field_unit: UTC, <TYPE>"
-   * "# field_type: datetime, <TYPE>"
-   */
 
-  /* Create initial part of header */
+/***************************************************************************
+ * traceheader:
+ *
+ * Generate the initial part of the header for a trace in the selected
+ * header format into buffer, the output format specific remainder is
+ * added by each writer.
+ *
+ * Simple ASCII header format:
+ * "TIMESERIES Net_Sta_Loc_Chan_Qual, ## samples, ## sps, isotime, SLIST|TSPAIR[-EPOCH|-RELATIVE], INTEGER|FLOAT|ASCII, Units"
+ *
+ * GeoCSV header format:
+ * "# dataset: GeoCSV 2.0"
+ * "# delimiter: <DELIMITER>"
+ * "# SID: <SOURCE ID>"
+ * "# sample_count: <COUNT>"
+ * "# sample_rate_hz: <RATE>"
+ * "# start_time: <RATE>"
+ *
+ * If metadata is present these may be included:
+ * "# latitude_deg: <LATITUDE>"
+ * "# longitude_deg: <LONGITUDE>"
+ * "# elevation_m: <ELEVATION>"
+ * "# depth_m: <DEPTH>"
+ * "# azimuth_deg: <AZIMUTH>"
+ * "# dip_deg: <DIP>"
+ * "# instrument: <INSTRUMENT>"
+ * "# scale_factor: <SCALEFACTOR>"
+ * "# scale_frequency: <SCALEFREQ>"
+ * "# scale_units: <SCALEUNITS>"
+ *
+ * If extra headers are specified these are included as:
+ * "# <KEY>: <VALUE>"
+ *
+ * "# field_unit: UTC, <TYPE>"
+ * "# field_type: datetime, <TYPE>"
+ *
+ * With epoch or relative times the time field is "s" and
+ * "epoch_seconds" or "relative_seconds".
+ *
+ * Returns the length of the header in buffer.
+ ***************************************************************************/
+static int
+traceheader (struct traceinfo *ti, char *outbuffer, size_t size)
+{
+  struct metanode *mn = ti->mn;
+  struct listnode *en = NULL;
+  int outsize;
+  int idx;
+
   if (headerformat == 1)
   {
-    delimiter = " ";
-
     /* Simple text header */
-    outsize = snprintf (outbuffer, sizeof(outbuffer),
+    outsize = snprintf (outbuffer, size,
                         "TIMESERIES %s, %lld samples, %g sps, %s, ",
-                        srcname, (long long int)mst->numsamples, mst->samprate, timestr);
+                        ti->srcname, (long long int)ti->nsamples, ti->seg->samprate, ti->timestr);
   }
   else
   {
-    delimiter = ",";
-
     /* GeoCSV header */
-    outsize = snprintf (outbuffer, sizeof(outbuffer),
+    outsize = snprintf (outbuffer, size,
                         "# dataset: GeoCSV 2.0\n"
                         "# delimiter: %s\n"
                         "# SID: %s\n"
                         "# sample_count: %lld\n"
                         "# sample_rate_hz: %g\n"
                         "# start_time: %sZ\n",
-                        delimiter,
-                        srcname,
-                        (long long int)mst->numsamples,
-                        mst->samprate,
-                        timestr);
-
-    if (mn)
-    {
-      if (mn->metafields[4])
-        outsize += snprintf (outbuffer + outsize, sizeof(outbuffer) - outsize,
-                             "# latitude_deg: %s\n", mn->metafields[4]);
-      if (mn->metafields[5])
-        outsize += snprintf (outbuffer + outsize, sizeof(outbuffer) - outsize,
-                             "# longitude_deg: %s\n", mn->metafields[5]);
-      if (mn->metafields[6])
-        outsize += snprintf (outbuffer + outsize, sizeof(outbuffer) - outsize,
-                             "# elevation_m: %s\n", mn->metafields[6]);
-      if (mn->metafields[7])
-        outsize += snprintf (outbuffer + outsize, sizeof(outbuffer) - outsize,
-                             "# depth_m: %s\n", mn->metafields[7]);
-      if (mn->metafields[8])
-        outsize += snprintf (outbuffer + outsize, sizeof(outbuffer) - outsize,
-                             "# azimuth_deg: %s\n", mn->metafields[8]);
-      if (mn->metafields[9])
-        outsize += snprintf (outbuffer + outsize, sizeof(outbuffer) - outsize,
-                             "# dip_deg: %g\n", mn->dip);
-      if (mn->metafields[10])
-        outsize += snprintf (outbuffer + outsize, sizeof(outbuffer) - outsize,
-                             "# instrument: %s\n", mn->metafields[10]);
-      if (mn->metafields[11])
-        outsize += snprintf (outbuffer + outsize, sizeof(outbuffer) - outsize,
-                             "# scale_factor: %s\n", mn->metafields[11]);
-      if (mn->metafields[12])
-        outsize += snprintf (outbuffer + outsize, sizeof(outbuffer) - outsize,
-                             "# scale_frequency_hz: %s\n", mn->metafields[12]);
-      if (mn->metafields[13])
-        outsize += snprintf (outbuffer + outsize, sizeof(outbuffer) - outsize,
-                             "# scale_units: %s\n", mn->metafields[13]);
+                        ",",
+                        ti->srcname,
+                        (long long int)ti->nsamples,
+                        ti->seg->samprate,
+                        ti->timestr);
+
+    for (idx = 0; mn && idx < MAXMETAFIELDS; idx++)
+    {
+      if (!metakeys[idx] || !mn->metafields[idx])
+        continue;
+
+      /* Dip is reported in SEED convention */
+      if (idx == 9)
+        outsize += snprintf (outbuffer + outsize, size - outsize,
+                             "# %s: %g\n", metakeys[idx], mn->dip);
+      else
+        outsize += snprintf (outbuffer + outsize, size - outsize,
+                             "# %s: %s\n", metakeys[idx], mn->metafields[idx]);
     }
 
     if (extraheader)
@@ -517,7 +867,7 @@ writeascii (MSTrace *mst)
       en = extraheader;
       while (en)
       {
-        outsize += snprintf (outbuffer + outsize, sizeof(outbuffer) - outsize,
+        outsize += snprintf (outbuffer + outsize, size - outsize,
                              "# %s: %s\n", en->key, en->data);
 
         en = en->next;
@@ -525,106 +875,269 @@ writeascii (MSTrace *mst)
     }
   }
 
-  if (outsize > sizeof(outbuffer))
-    outsize = sizeof(outbuffer);
+  if (outsize > size)
+    outsize = size;
+
+  return outsize;
+}  /* End of traceheader() */
 
-  if (writedata (outbuffer, outsize, outfile))
-    return -1;
 
-  if ( outformat == 1 || mst->sampletype == 'a' )
+/***************************************************************************
+ * beginoutput:
+ *
+ * Begin writing an output file for a trace.  If neither a single
+ * output file nor ZIP output is used the file is opened, otherwise a
+ * ZIP entry is started if needed.  The opened flag is set when the
+ * file was opened and must be closed by endoutput().
+ *
+ * Returns 0 on success or -1 on error.
+ ***************************************************************************/
+static int
+beginoutput (char *outfile, int *opened)
+{
+  char filename[1110];
+#ifndef NOFDZIP
+  int64_t writestatus = 0;
+#endif /* NOFDZIP */
+
+  *opened = 0;
+
+  /* Open output file if single file not being used and no ZIP output */
+  if ( ! ofp && ! zipfile )
   {
-    if ( verbose > 1 )
-      fprintf (stderr, "Writing ASCII sample list file: %s\n", outname);
+    /* Compressed files are named with the extension of the method */
+    snprintf (filename, sizeof(filename), "%s%s", outfile,
+              (compressmethod) ? msc_extension (compressmethod) : "");
 
-    /* Finish header */
-    if (headerformat == 1)
+    if ( (ofp = fopen (filename, "wb")) == NULL )
     {
-      outsize = snprintf (outbuffer, sizeof(outbuffer),
-                          "SLIST, %s, %s\n", samptype, unitsstr);
+      fprintf (stderr, "Cannot open output file: %s (%s)\n",
+               filename, strerror(errno));
+      return -1;
     }
-    else
-    {
-      /* GeoCSV sample list can only be a single column */
-      slistcols = 1;
 
-      outsize = snprintf (outbuffer, sizeof(outbuffer),
-                          "# field_unit: %s\n"
-                          "# field_type: %s\n"
-                          "Sample\n",
-                          unitsstr,
-                          samptype);
+    if ( compressmethod &&
+         (cstream = msc_open (ofp, compressmethod, compresslevel)) == NULL )
+    {
+      fclose (ofp);
+      ofp = 0;
+      return -1;
     }
 
-    if (outsize > sizeof(outbuffer))
+    *opened = 1;
+  }
+
+  /* Offsets in a single output file continue from trace to trace */
+  if ( *opened || zipfile )
+    outputbytes = 0;
+
+#ifndef NOFDZIP
+  /* Begin ZIP entry */
+  if (zipfile)
+  {
+    if (!(zentry = zs_entrybegin (zstream, outfile, time (NULL),
+                                  zipmethod, &writestatus)))
+    {
+      fprintf (stderr, "Cannot begin ZIP entry, write status: %lld\n",
+               (long long int)writestatus);
+      return -1;
+    }
+
+    /* The data of a stored entry follows the local header unchanged */
+    zipdataoffset = ( zipmethod == ZS_STORE ) ? zstream->WriteOffset : -1;
+  }
+#endif /* NOFDZIP */
+
+  return 0;
+}  /* End of beginoutput() */
+
+
+/***************************************************************************
+ * endoutput:
+ *
+ * Finish writing an output file for a trace started with
+ * beginoutput(), closing the file if it was opened and ending the ZIP
+ * entry if needed.
+ *
+ * Returns 0 on success or -1 on error.
+ ***************************************************************************/
+static int
+endoutput (char *outfile, int opened)
+{
+#ifndef NOFDZIP
+  int64_t writestatus = 0;
+#endif /* NOFDZIP */
+
+  int retval = 0;
+
+  if ( opened )
+  {
+    /* Finish compressing before closing the file */
+    if ( cstream && msc_close (cstream) )
+    {
+      fprintf (stderr, "Error compressing output file for %s\n", outfile);
+      retval = -1;
+    }
+
+    cstream = 0;
+
+    fclose (ofp);
+    ofp = 0;
+  }
+
+#ifndef NOFDZIP
+  /* End ZIP entry */
+  if (zipfile)
+  {
+    if (!zs_entryend (zstream, zentry, &writestatus))
+    {
+      fprintf (stderr, "Error ending ZIP entry for %s, write status: %lld\n",
+               outfile, (long long int)writestatus);
+      zentry = 0;
+      return -1;
+    }
+  }
+
+  zentry = 0;
+#endif /* NOFDZIP */
+
+  return retval;
+}  /* End of endoutput() */
+
+
+/***************************************************************************
+ * writeascii:
+ *
+ * Write the samples of a trace to an output file as ASCII.
+ *
+ * Returns the number of samples written or -1 on error.
+ ***************************************************************************/
+static int64_t
+writeascii (struct traceinfo *ti)
+{
+  MSTraceSeg *seg = ti->seg;
+  char outfile[1100];
+  char *outname = outputfile;
+  char outbuffer[8192];
+  int outsize;
+  int opened;
+
+  int samplesize;
+  int64_t cnt = 0;
+  int64_t position = 0;
+  int64_t blocksamples;
+  void *samples;
+  char sampletype = ti->sampletype;
+  MSFormatState state;
+  MSFormatKernel kernel;
+  int linelength = 0;
+  int layout;
+  int status;
+
+  if ( verbose )
+    fprintf (stderr, "Writing ASCII for %.8s.%.8s.%.8s.%.8s\n",
+	     ti->id->network, ti->id->station, ti->id->location, ti->id->channel);
+
+  /* Output file name: Net.Sta.Loc.Chan.Qual.Year-Month-DayTHourMinSec.Subsec.[txt|csv] */
+  snprintf (outfile, sizeof(outfile), "%s.%s",
+            ti->basename, (headerformat == 1) ? "txt" : "csv");
+
+  if ( beginoutput (outfile, &opened) )
+    return -1;
+
+  if ( opened )
+    outname = outfile;
+
+  if ( (samplesize = ms_samplesize(sampletype)) == 0 )
+  {
+    fprintf (stderr, "Unrecognized sample type: %c\n", sampletype);
+  }
+
+  /* Index numeric samples from the first sample if requested */
+  outindex.count = 0;
+  outindex.next = ( indexinterval > 0 && sampletype != 'a' ) ? 0 : -1;
+
+  /* Create initial part of header */
+  outsize = traceheader (ti, outbuffer, sizeof(outbuffer));
+
+  if (writedata (outbuffer, outsize, outfile))
+    return -1;
+
+  if ( outformat != 2 || sampletype == 'a' )
+  {
+    if ( verbose > 1 )
+      fprintf (stderr, "Writing ASCII sample list file: %s\n", outname);
+
+    /* Finish header */
+    if (headerformat == 1)
+    {
+      outsize = snprintf (outbuffer, sizeof(outbuffer),
+                          "SLIST, %s, %s\n", ti->samptype, unitsstr);
+    }
+    else
+    {
+      /* GeoCSV sample list can only be a single column */
+      slistcols = 1;
+
+      outsize = snprintf (outbuffer, sizeof(outbuffer),
+                          "# field_unit: %s\n"
+                          "# field_type: %s\n"
+                          "Sample\n",
+                          unitsstr,
+                          ti->samptype);
+    }
+
+    if (outsize > sizeof(outbuffer))
       outsize = sizeof(outbuffer);
 
     if (writedata (outbuffer, outsize, outfile))
       return -1;
 
-    lines = (mst->numsamples / slistcols) + ((slistcols == 1) ? 0 : 1);
-
     outsize = 0;
+    cnt = 0;
 
-    if ( mst->sampletype == 'a' )
+    if ( sampletype == 'a' )
     {
-      if (writedata (mst->datasamples, (size_t)mst->numsamples, outfile))
-        return -1;
+      while ( (blocksamples = nextsamples (seg, &position, &lazyreader, &samples)) > 0 )
+      {
+        if (writedata (samples, (size_t)blocksamples, outfile))
+          return -1;
+
+        cnt += blocksamples;
+      }
       if (writedata ("\n", 1, outfile))
         return -1;
     }
     else
     {
+      msf_init (&state, slistcols, precision, fixedwidth, seg->starttime, seg->samprate);
+      kernel = msf_kernel (&state, sampletype, (slistcols > 1) ? MSF_SLISTCOLS : MSF_SLIST);
+
+      if ( fixedwidth >= 0 )
+        linelength = msf_fixedwidth (&state, sampletype, MSF_SLIST, ti->nsamples);
+
       outsize = 0;
-      for ( cnt = 0, line = 0; line < lines; line++ )
+      while ( (blocksamples = nextsamples (seg, &position, &lazyreader, &samples)) > 0 )
       {
-        for ( col = 1; col <= slistcols ; col ++ )
-        {
-          if ( cnt < mst->numsamples )
-          {
-            sptr = (char*)mst->datasamples + (cnt * samplesize);
-
-            if (mst->sampletype == 'i')
-            {
-              if (col != slistcols)
-                outsize += snprintf (outbuffer + outsize, sizeof (outbuffer) - outsize,
-                                     "%-10d  ", *(int32_t *)sptr);
-              else
-                outsize += snprintf (outbuffer + outsize, sizeof (outbuffer) - outsize,
-                                     "%d", *(int32_t *)sptr);
-            }
-            else if (mst->sampletype == 'f')
-            {
-              if ( col != slistcols )
-                outsize += snprintf (outbuffer + outsize, sizeof (outbuffer) - outsize,
-                                     "%-10.8g  ", *(float *)sptr);
-              else
-                outsize += snprintf (outbuffer + outsize, sizeof (outbuffer) - outsize,
-                                     "%.8g", *(float *)sptr);
-            }
-            else if ( mst->sampletype == 'd' )
-            {
-              if ( col != slistcols )
-                outsize += snprintf (outbuffer + outsize, sizeof (outbuffer) - outsize,
-                                     "%-10.10g  ", *(double *)sptr);
-              else
-                outsize += snprintf (outbuffer + outsize, sizeof (outbuffer) - outsize,
-                                     "%.10g", *(double *)sptr);
-            }
-
-            cnt++;
-          }
-        }
+        if ( ti->scale )
+          scalesamples (samples, blocksamples, seg->sampletype, ti->mn->scalefactor);
 
-        outsize += snprintf (outbuffer + outsize, sizeof (outbuffer) - outsize, "\n");
+        /* Fixed-width text is written directly to a file if possible */
+        status = ( linelength > 0 ) ? writefixed (kernel, &state, samples, blocksamples,
+                                                  samplesize, linelength, outbuffer,
+                                                  &outsize, outfile) : 1;
 
-        /* Write data if less than 1024 bytes available */
-        if ((sizeof (outbuffer) - outsize) < 1024)
-        {
-          if (writedata (outbuffer, outsize, outfile))
-            return -1;
-          outsize = 0;
-        }
-      } /* Done looping through lines and samples */
+        if ( status < 0 ||
+             (status > 0 && formatsamples (kernel, &state, samples, blocksamples, samplesize,
+                                           outbuffer, sizeof(outbuffer), &outsize, outfile)) )
+          return -1;
+
+        cnt += blocksamples;
+      } /* Done looping through blocks and samples */
+
+      /* Multiple column lists end with a partial, or empty, line */
+      if ( slistcols > 1 )
+        outsize += snprintf (outbuffer + outsize, sizeof (outbuffer) - outsize, "\n");
 
       /* Flush any unwritten output */
       if (outsize > 0)
@@ -635,105 +1148,1634 @@ writeascii (MSTrace *mst)
       }
     }
   }
-  else if ( outformat == 2 )
+  else
+  {
+    if ( verbose > 1 )
+      fprintf (stderr, "Writing ASCII time-sample pair file: %s\n", outname);
+
+    /* Finish header, naming the time format unless ISO */
+    if (headerformat == 1)
+    {
+      outsize = snprintf (outbuffer, sizeof(outbuffer),
+                          "TSPAIR%s, %s, %s\n",
+                          (timeformat == 1) ? "-EPOCH" : (timeformat == 2) ? "-RELATIVE" : "",
+                          ti->samptype, unitsstr);
+    }
+    else
+    {
+      outsize = snprintf (outbuffer, sizeof(outbuffer),
+                          "# field_unit: %s, %s\n"
+                          "# field_type: %s, %s\n"
+                          "Time, Sample\n",
+                          (timeformat) ? "s" : "UTC",
+                          unitsstr,
+                          (timeformat == 1) ? "epoch_seconds" : (timeformat == 2) ? "relative_seconds" : "datetime",
+                          ti->samptype);
+    }
+
+    if (outsize > sizeof(outbuffer))
+      outsize = sizeof(outbuffer);
+
+    if (writedata (outbuffer, outsize, outfile))
+      return -1;
+
+    layout = MSF_TSPAIR + timeformat * 2 + (headerformat == 2);
+
+    msf_init (&state, 1, precision, fixedwidth, seg->starttime, seg->samprate);
+    kernel = msf_kernel (&state, sampletype, layout);
+
+    if ( fixedwidth >= 0 )
+      linelength = msf_fixedwidth (&state, sampletype, layout, ti->nsamples);
+
+    outsize = 0;
+    cnt = 0;
+    while ( (blocksamples = nextsamples (seg, &position, &lazyreader, &samples)) > 0 )
+    {
+      if ( ti->scale )
+        scalesamples (samples, blocksamples, seg->sampletype, ti->mn->scalefactor);
+
+      /* Fixed-width text is written directly to a file if possible */
+      status = ( linelength > 0 ) ? writefixed (kernel, &state, samples, blocksamples,
+                                                samplesize, linelength, outbuffer,
+                                                &outsize, outfile) : 1;
+
+      if ( status < 0 ||
+           (status > 0 && formatsamples (kernel, &state, samples, blocksamples, samplesize,
+                                         outbuffer, sizeof(outbuffer), &outsize, outfile)) )
+        return -1;
+
+      cnt += blocksamples;
+    } /* Done looping through blocks and samples */
+
+    /* Flush any unwritten output */
+    if (outsize > 0)
+    {
+      if (writedata (outbuffer, outsize, outfile))
+        return -1;
+      outsize = 0;
+    }
+  }
+
+  /* Values replaced by '*' fill are lost, the output is incomplete */
+  if ( linelength > 0 && state.overflows > 0 )
+  {
+    fprintf (stderr, "Error: %lld values of %.8s.%.8s.%.8s.%.8s do not fit a field width of %d\n",
+             (long long int)state.overflows, ti->id->network, ti->id->station,
+             ti->id->location, ti->id->channel, state.width);
+    exitstatus = 1;
+  }
+
+  if ( endoutput (outfile, opened) )
+    return -1;
+
+  if ( outindex.next >= 0 && writeindex (ti, outfile) )
+    return -1;
+
+  return cnt;
+}  /* End of writeascii() */
+
+
+/***************************************************************************
+ * writefixed:
+ *
+ * Write the fixed-width text of samples directly to a regular output
+ * file at the current position.  The space for the text, count times
+ * linelength bytes, is allocated first, then ranges of the text are
+ * formatted and written at their offsets by a thread per processor.
+ * Any output in the buffer is written before.
+ *
+ * Returns 0 on success, 1 if the output is not a regular file or too
+ * small to be written this way and -1 on error.
+ ***************************************************************************/
+static int
+writefixed (MSFormatKernel kernel, MSFormatState *state, void *samples,
+            int64_t count, int samplesize, int linelength,
+            char *outbuffer, int *outsize, char *outfile)
+{
+#if defined(LMP_WIN32)
+  return 1;
+#else
+  struct stat st;
+  int64_t size = count * linelength;
+  int64_t offset;
+  long threads;
+  int fd;
+
+  if ( ! ofp || zipfile || cstream || size < 2 * MSF_THREADSIZE )
+    return 1;
+
+  /* Positioned writes need a regular file not opened for appending */
+  fd = fileno (ofp);
+  if ( fstat (fd, &st) || ! S_ISREG (st.st_mode) || (fcntl (fd, F_GETFL) & O_APPEND) )
+    return 1;
+
+  if ( *outsize > 0 )
+  {
+    if ( writedata (outbuffer, *outsize, outfile) )
+      return -1;
+    *outsize = 0;
+  }
+
+  if ( fflush (ofp) || (offset = (int64_t)ftello (ofp)) < 0 )
+  {
+    fprintf (stderr, "Error writing output file %s: %s\n", outfile, strerror(errno));
+    return -1;
+  }
+
+  /* Allocate the space for the text, only extend the file if the file
+   * system does not support allocation */
+  if ( posix_fallocate (fd, (off_t)offset, (off_t)size) &&
+       st.st_size < offset + size && ftruncate (fd, (off_t)(offset + size)) )
+  {
+    fprintf (stderr, "Cannot allocate %lld bytes in output file %s: %s\n",
+             (long long int)size, outfile, strerror(errno));
+    return -1;
+  }
+
+  if ( (threads = sysconf (_SC_NPROCESSORS_ONLN)) < 1 )
+    threads = 1;
+
+  if ( verbose > 1 )
+    fprintf (stderr, "Writing %lld bytes of fixed-width text at offset %lld with up to %ld threads\n",
+             (long long int)size, (long long int)offset, threads);
+
+  /* Index entries of the samples at the offsets of their text */
+  while ( outindex.next >= state->sample && outindex.next < state->sample + count )
+  {
+    if ( addindex (state, outindex.next,
+                   outputbytes + (outindex.next - state->sample) * linelength) )
+      return -1;
+  }
+
+  if ( msf_writefixed (fd, offset, kernel, state, samples, count,
+                       samplesize, linelength, (int)threads) )
+    return -1;
+
+  outputbytes += size;
+
+  if ( fseeko (ofp, (off_t)(offset + size), SEEK_SET) )
+  {
+    fprintf (stderr, "Error writing output file %s: %s\n", outfile, strerror(errno));
+    return -1;
+  }
+
+  return 0;
+#endif
+}  /* End of writefixed() */
+
+
+/***************************************************************************
+ * addindex:
+ *
+ * Add an entry for a sample to the output index, with the offset of
+ * the text of the sample in the output file or ZIP entry, and set the
+ * next sample to index.
+ *
+ * Returns 0 on success or -1 on error.
+ ***************************************************************************/
+static int
+addindex (MSFormatState *state, int64_t sample, int64_t offset)
+{
+  int64_t *entry;
+
+  /* Grow the entries 1024 at a time */
+  if ( (outindex.count % 1024) == 0 )
+  {
+    if ( (entry = (int64_t *)realloc (outindex.entries,
+                                      (size_t)(outindex.count + 1024) * 4 * sizeof(int64_t))) == NULL )
+    {
+      fprintf (stderr, "Cannot allocate memory for output index\n");
+      return -1;
+    }
+
+    outindex.entries = entry;
+  }
+
+  entry = outindex.entries + outindex.count * 4;
+  entry[0] = sample;
+  entry[1] = offset;
+  entry[2] = ( zipdataoffset >= 0 ) ? zipdataoffset + offset : -1;
+  entry[3] = state->starttime + (hptime_t)(sample * state->hpperiod);
+
+  outindex.count++;
+  outindex.next = sample + indexinterval;
+
+  return 0;
+}  /* End of addindex() */
+
+
+/***************************************************************************
+ * writeindex:
+ *
+ * Write the output index of a text trace, as an index file named after
+ * the output file with an .idx extension, the same way as the header
+ * files of binary formats.  All values are little-endian, the header
+ * of a trace is:
+ *
+ *   0   magic "MSAIDX01"
+ *   8   source name, 48 bytes padded with NULs
+ *   56  start time, int64 microseconds since the epoch
+ *   64  sample rate, float64
+ *   72  number of samples, int64
+ *   80  samples between entries, int64
+ *   88  number of entries, int64
+ *
+ * followed by the entries, each four int64 values: sample index,
+ * offset of the text of the sample in the output file or ZIP entry,
+ * offset in the ZIP archive for stored entries or -1 and sample time
+ * in microseconds since the epoch.  Entry n is for sample n times the
+ * interval, so the entry before a time is found without a search.
+ *
+ * Returns 0 on success or -1 on error.
+ ***************************************************************************/
+static int
+writeindex (struct traceinfo *ti, char *outfile)
+{
+  char idxfile[1110];
+  char *buffer;
+  char *bp;
+  size_t size = INDEXHEADER + (size_t)outindex.count * 4 * 8;
+  uint64_t samprate;
+  int64_t idx;
+  int retval;
+
+  snprintf (idxfile, sizeof(idxfile), "%s.idx", outfile);
+
+  if ( (buffer = (char *)calloc (1, size)) == NULL )
   {
-    hptime_t samptime = mst->starttime;
-    double hpperiod = ( mst->samprate ) ? (HPTMODULUS / mst->samprate) : 0;
+    fprintf (stderr, "Cannot allocate memory for output index\n");
+    return -1;
+  }
+
+  memcpy (buffer, "MSAIDX01", 8);
+  memcpy (buffer + 8, ti->srcname, strnlen (ti->srcname, 47));
+
+  memcpy (&samprate, &ti->seg->samprate, sizeof(samprate));
+
+  bp = packle64 (buffer + 56, (uint64_t)ti->seg->starttime);
+  bp = packle64 (bp, samprate);
+  bp = packle64 (bp, (uint64_t)ti->nsamples);
+  bp = packle64 (bp, (uint64_t)indexinterval);
+  bp = packle64 (bp, (uint64_t)outindex.count);
+
+  for ( idx = 0; idx < outindex.count * 4; idx++ )
+    bp = packle64 (bp, (uint64_t)outindex.entries[idx]);
+
+  if ( verbose > 1 )
+    fprintf (stderr, "Writing output index with %lld entries: %s\n",
+             (long long int)outindex.count, idxfile);
+
+  retval = writeheader (buffer, size, idxfile);
+
+  free (buffer);
+
+  return retval;
+}  /* End of writeindex() */
+
+
+/***************************************************************************
+ * packle64:
+ *
+ * Pack a 64-bit value into a buffer in little-endian byte order.
+ *
+ * Returns a pointer to the end of the packed value.
+ ***************************************************************************/
+static char *
+packle64 (char *buffer, uint64_t value)
+{
+  int idx;
+
+  for ( idx = 0; idx < 8; idx++ )
+    buffer[idx] = (char)(value >> (idx * 8));
+
+  return buffer + 8;
+}  /* End of packle64() */
+
+
+/***************************************************************************
+ * formatsamples:
+ *
+ * Format samples as text with a formatting kernel into an output
+ * buffer holding outsize bytes, in runs that fit the buffer.  The
+ * buffer is written when it cannot hold the text of another sample.
+ * Samples to index are added to the output index with the offset of
+ * their text.
+ *
+ * Returns 0 on success or -1 on error.
+ ***************************************************************************/
+static int
+formatsamples (MSFormatKernel kernel, MSFormatState *state, void *samples,
+               int64_t count, int samplesize, char *outbuffer,
+               size_t buffersize, int *outsize, char *outfile)
+{
+  char *sptr = (char *)samples;
+  int64_t run;
+
+  while ( count > 0 )
+  {
+    run = (int64_t)(buffersize - *outsize) / MSF_MAXSAMPLE;
+
+    if ( run == 0 )
+    {
+      if ( writedata (outbuffer, *outsize, outfile) )
+        return -1;
+
+      *outsize = 0;
+      continue;
+    }
+
+    if ( run > count )
+      run = count;
+
+    /* Index a sample at the start of a run, runs end at the next
+     * sample to index */
+    if ( state->sample == outindex.next &&
+         addindex (state, state->sample, outputbytes + *outsize) )
+      return -1;
+
+    if ( outindex.next > state->sample && run > outindex.next - state->sample )
+      run = outindex.next - state->sample;
+
+    *outsize += (int)kernel (outbuffer + *outsize, sptr, run, state);
+
+    sptr += run * samplesize;
+    count -= run;
+  }
+
+  return 0;
+}  /* End of formatsamples() */
+
+
+/***************************************************************************
+ * writebinary:
+ *
+ * Write the samples of a trace to an output file as a NumPy array file
+ * (.npy) or as raw little-endian binary values (.bin), with the trace
+ * details written to a separate header file (.hdr) in the selected
+ * header format.  The samples of each block, all samples of a segment
+ * unless decoding lazily, are written with a single write.
+ *
+ * The array shape in a NumPy header is the expected sample count, if
+ * fewer samples can be decoded the array is padded with zeros.
+ *
+ * Returns the number of samples written or -1 on error.
+ ***************************************************************************/
+static int64_t
+writebinary (struct traceinfo *ti)
+{
+  MSTraceSeg *seg = ti->seg;
+  char outfile[1100];
+  char hdrfile[1100];
+  char outbuffer[8192];
+  char *samptype;
+  char *descr;
+  int outsize;
+  int opened;
+
+  int samplesize;
+  int64_t cnt = 0;
+  int64_t position = 0;
+  int64_t blocksamples;
+  void *samples;
+
+  if ( verbose )
+    fprintf (stderr, "Writing binary for %.8s.%.8s.%.8s.%.8s\n",
+	     ti->id->network, ti->id->station, ti->id->location, ti->id->channel);
+
+  samplesize = ms_samplesize (ti->sampletype);
+
+  /* NumPy array type and header sample type description */
+  if ( ti->sampletype == 'd' )
+  {
+    descr = "<f8";
+    samptype = "DOUBLE";
+  }
+  else
+  {
+    descr = ( ti->sampletype == 'f' ) ? "<f4" : "<i4";
+    samptype = ti->samptype;
+  }
+
+  snprintf (outfile, sizeof(outfile), "%s.%s",
+            ti->basename, (outformat == 3) ? "npy" : "bin");
+  snprintf (hdrfile, sizeof(hdrfile), "%s.hdr", ti->basename);
+
+  /* Header file with the same details as text output */
+  outsize = traceheader (ti, outbuffer, sizeof(outbuffer));
+
+  if (headerformat == 1)
+    outsize += snprintf (outbuffer + outsize, sizeof(outbuffer) - outsize,
+                         "%s, %s, %s\n", (outformat == 3) ? "NPY" : "BINARY",
+                         samptype, unitsstr);
+  else
+    outsize += snprintf (outbuffer + outsize, sizeof(outbuffer) - outsize,
+                         "# field_unit: %s\n"
+                         "# field_type: %s\n",
+                         unitsstr, samptype);
+
+  if (outsize > sizeof(outbuffer))
+    outsize = sizeof(outbuffer);
+
+  if ( writeheader (outbuffer, outsize, hdrfile) )
+    return -1;
+
+  if ( beginoutput (outfile, &opened) )
+    return -1;
+
+  if ( verbose > 1 )
+    fprintf (stderr, "Writing binary sample file: %s\n", (opened) ? outfile : outputfile);
+
+  /* NumPy format 1.0 header: magic, version, header length and a
+   * dictionary describing the array, padded to a multiple of 64 bytes */
+  if ( outformat == 3 )
+  {
+    outsize = snprintf (outbuffer + 10, sizeof(outbuffer) - 10,
+                        "{'descr': '%s', 'fortran_order': False, 'shape': (%lld,), }",
+                        descr, (long long int)ti->nsamples);
+    outsize += 10;
+
+    while ( (outsize + 1) % 64 )
+      outbuffer[outsize++] = ' ';
+    outbuffer[outsize++] = '\n';
+
+    memcpy (outbuffer, "\x93NUMPY\x01\x00", 8);
+    outbuffer[8] = (char)((outsize - 10) & 0xff);
+    outbuffer[9] = (char)((outsize - 10) >> 8);
+
+    if (writedata (outbuffer, outsize, outfile))
+      return -1;
+  }
+
+  while ( (blocksamples = nextsamples (seg, &position, &lazyreader, &samples)) > 0 )
+  {
+    if ( ti->scale )
+      scalesamples (samples, blocksamples, seg->sampletype, ti->mn->scalefactor);
+
+    if ( writesamples (samples, blocksamples, samplesize, outfile) )
+      return -1;
+
+    cnt += blocksamples;
+  }
+
+  /* Pad to the sample count in the headers with zeros */
+  if ( cnt < ti->nsamples )
+  {
+    memset (outbuffer, 0, sizeof(outbuffer));
+
+    for ( blocksamples = ti->nsamples - cnt; blocksamples > 0; )
+    {
+      outsize = ( blocksamples * samplesize > sizeof(outbuffer) ) ?
+        sizeof(outbuffer) : (int)(blocksamples * samplesize);
+
+      if (writedata (outbuffer, outsize, outfile))
+        return -1;
+
+      blocksamples -= outsize / samplesize;
+    }
+  }
+
+  if ( endoutput (outfile, opened) )
+    return -1;
+
+  return cnt;
+}  /* End of writebinary() */
+
+
+/***************************************************************************
+ * writeheader:
+ *
+ * Write the header file of a trace written in a binary format, or the
+ * index file of a trace written as text.  With ZIP output the header
+ * is added as an entry, with a single output file it is added to the
+ * header file of the output file and otherwise it is written to its
+ * own file.  Without a header destination, i.e.
+ * output to stdout, the header is not written.
+ *
+ * Returns 0 on success or -1 on error.
+ ***************************************************************************/
+static int
+writeheader (char *outbuffer, size_t outsize, char *hdrfile)
+{
+  FILE *fp;
+  int retval = 0;
+
+#ifndef NOFDZIP
+  int64_t writestatus = 0;
+
+  if (zipfile)
+  {
+    if (!(zentry = zs_entrybegin (zstream, hdrfile, time (NULL),
+                                  zipmethod, &writestatus)) ||
+        !zs_entrydata (zstream, zentry, (uint8_t *)outbuffer, outsize, &writestatus) ||
+        !zs_entryend (zstream, zentry, &writestatus))
+    {
+      fprintf (stderr, "Error adding ZIP entry for %s, write status: %lld\n",
+               hdrfile, (long long int)writestatus);
+      retval = -1;
+    }
+
+    zentry = 0;
+  }
+#endif /* NOFDZIP */
+
+  if (hfp)
+  {
+    if (fwrite (outbuffer, outsize, 1, hfp) != 1)
+    {
+      fprintf (stderr, "Error adding header for %s to output header file\n", hdrfile);
+      retval = -1;
+    }
+  }
+  else if ( ! ofp && ! zipfile )
+  {
+    if ( (fp = fopen (hdrfile, "wb")) == NULL )
+    {
+      fprintf (stderr, "Cannot open output file: %s (%s)\n",
+               hdrfile, strerror(errno));
+      return -1;
+    }
+
+    if (fwrite (outbuffer, outsize, 1, fp) != 1)
+    {
+      fprintf (stderr, "Error writing header file %s\n", hdrfile);
+      retval = -1;
+    }
+
+    fclose (fp);
+  }
+
+  return retval;
+}  /* End of writeheader() */
+
+
+/***************************************************************************
+ * writesamples:
+ *
+ * Write binary samples to output destinations in little-endian byte
+ * order.  On little-endian hosts the samples are written as they are,
+ * otherwise they are swapped in chunks through a buffer.
+ *
+ * Returns 0 on success or -1 on error.
+ ***************************************************************************/
+static int
+writesamples (void *samples, int64_t count, int samplesize, char *outfile)
+{
+  char swapbuffer[8192];
+  char *sptr = (char *)samples;
+  int64_t chunk;
+  int64_t idx;
+
+  if ( ! ms_bigendianhost () )
+    return writedata (samples, (size_t)(count * samplesize), outfile);
+
+  while ( count > 0 )
+  {
+    chunk = sizeof(swapbuffer) / samplesize;
+    if ( chunk > count )
+      chunk = count;
+
+    memcpy (swapbuffer, sptr, (size_t)(chunk * samplesize));
+
+    for ( idx = 0; idx < chunk; idx++ )
+    {
+      if ( samplesize == 8 )
+        ms_gswap8a (swapbuffer + idx * 8);
+      else
+        ms_gswap4a (swapbuffer + idx * 4);
+    }
+
+    if ( writedata (swapbuffer, (size_t)(chunk * samplesize), outfile) )
+      return -1;
+
+    sptr += chunk * samplesize;
+    count -= chunk;
+  }
+
+  return 0;
+}  /* End of writesamples() */
+
+/***************************************************************************
+ * writesac:
+ *
+ * Write the samples of a trace to an output file in SAC binary format,
+ * in host byte order.  The header is filled from the trace and, if
+ * available, the matching metadata: coordinates, component azimuth,
+ * incidence converted from the SEED dip and scale factor, which is
+ * only set when the samples are not already scaled.
+ *
+ * The samples are converted to float in place in a single pass that
+ * also determines the minimum, maximum and mean for the header and are
+ * written with a single write.  With lazy decoding the header values
+ * are determined in a first decoding pass and the samples of each
+ * block are converted and written in a second.  If fewer samples can
+ * be decoded than expected the samples are padded with zeros.
+ *
+ * Returns the number of samples written or -1 on error.
+ ***************************************************************************/
+static int64_t
+writesac (struct traceinfo *ti)
+{
+  MSTraceSeg *seg = ti->seg;
+  struct metanode *mn = ti->mn;
+  struct SACHeader sh;
+  BTime btime;
+  hptime_t reftime;
+  char outfile[1100];
+  char zeros[4096];
+  float *fdata = NULL;
+  float depmin = 0.0;
+  float depmax = 0.0;
+  double depsum = 0.0;
+  int opened;
+  int idx;
+  int64_t outsize;
+
+  int64_t cnt = 0;
+  int64_t position = 0;
+  int64_t blocksamples;
+  void *samples;
+
+  if ( verbose )
+    fprintf (stderr, "Writing SAC for %.8s.%.8s.%.8s.%.8s\n",
+	     ti->id->network, ti->id->station, ti->id->location, ti->id->channel);
+
+  if ( ti->nsamples > INT32_MAX )
+  {
+    fprintf (stderr, "Too many samples for SAC format (%lld) for %s\n",
+             (long long int)ti->nsamples, ti->srcname);
+    return -1;
+  }
+
+  /* Convert samples and determine minimum, maximum and mean, with lazy
+   * decoding the converted blocks are discarded */
+  while ( (blocksamples = nextsamples (seg, &position, &lazyreader, &samples)) > 0 )
+  {
+    sacsamples (ti, samples, blocksamples, cnt == 0, &depmin, &depmax, &depsum);
+
+    fdata = (float *)samples;
+    cnt += blocksamples;
+  }
+
+  if ( cnt < ti->nsamples )
+  {
+    if ( depmin > 0.0 || cnt == 0 )
+      depmin = 0.0;
+    if ( depmax < 0.0 || cnt == 0 )
+      depmax = 0.0;
+  }
+
+  /* Initialize all header values as undefined */
+  for ( idx = 0; idx < SACNUMFLOATS; idx++ )
+    ((float *)&sh)[idx] = SFUNDEF;
+  for ( idx = 0; idx < SACNUMINTS; idx++ )
+    ((int32_t *)&sh)[SACNUMFLOATS + idx] = SUNDEF;
+  for ( idx = 0; idx < SACNUMSTRS; idx++ )
+    memcpy ((char *)&sh + (SACNUMFLOATS + SACNUMINTS) * 4 + idx * 8, SSUNDEF, 8);
+
+  /* Reference time is the start time truncated to milliseconds, the
+   * begin time is the remainder */
+  reftime = seg->starttime - (((seg->starttime % 1000) + 1000) % 1000);
+  ms_hptime2btime (reftime, &btime);
+
+  sh.nzyear = btime.year;
+  sh.nzjday = btime.day;
+  sh.nzhour = btime.hour;
+  sh.nzmin = btime.min;
+  sh.nzsec = btime.sec;
+  sh.nzmsec = btime.fract / 10;
+
+  sh.delta = (float)(1.0 / seg->samprate);
+  sh.b = (float)((double)(seg->starttime - reftime) / HPTMODULUS);
+  sh.e = (float)((double)(seg->starttime - reftime) / HPTMODULUS +
+                 (ti->nsamples - 1) / seg->samprate);
+  sh.depmin = depmin;
+  sh.depmax = depmax;
+  sh.depmen = (float)(depsum / ti->nsamples);
+
+  sh.nvhdr = SACVERSION;
+  sh.npts = (int32_t)ti->nsamples;
+  sh.iftype = ITIME;
+  sh.idep = IUNKN;
+  sh.iztype = IB;
+  sh.leven = 1;
+  sh.lpspol = 1;
+  sh.lovrok = 1;
+  sh.lcalda = 1;
+
+  sacstring (sh.knetwk, ti->id->network);
+  sacstring (sh.kstnm, ti->id->station);
+  sacstring (sh.khole, ti->id->location);
+  sacstring (sh.kcmpnm, ti->id->channel);
+
+  if ( mn )
+  {
+    if ( mn->metafields[4] )
+      sh.stla = (float)strtod (mn->metafields[4], NULL);
+    if ( mn->metafields[5] )
+      sh.stlo = (float)strtod (mn->metafields[5], NULL);
+    if ( mn->metafields[6] )
+      sh.stel = (float)strtod (mn->metafields[6], NULL);
+    if ( mn->metafields[7] )
+      sh.stdp = (float)strtod (mn->metafields[7], NULL);
+    if ( mn->metafields[8] )
+      sh.cmpaz = (float)strtod (mn->metafields[8], NULL);
+    /* Convert SEED dip to SAC inclination */
+    if ( mn->metafields[9] )
+      sh.cmpinc = (float)(mn->dip + 90.0);
+    if ( mn->metafields[10] )
+      sacstring (sh.kinst, mn->metafields[10]);
+    if ( mn->metafields[11] && ! ti->scale )
+      sh.scale = (float)mn->scalefactor;
+  }
+
+  snprintf (outfile, sizeof(outfile), "%s.sac", ti->basename);
+
+  if ( beginoutput (outfile, &opened) )
+    return -1;
+
+  if ( verbose > 1 )
+    fprintf (stderr, "Writing SAC binary file: %s\n", (opened) ? outfile : outputfile);
+
+  if ( writedata ((char *)&sh, SACHEADERLEN, outfile) )
+    return -1;
+
+  /* Samples of a whole segment were converted in the first pass */
+  if ( ! lazydecode )
+  {
+    if ( cnt > 0 && writedata ((char *)fdata, (size_t)(cnt * sizeof(float)), outfile) )
+      return -1;
+  }
+  else
+  {
+    cnt = 0;
+    position = 0;
+    while ( (blocksamples = nextsamples (seg, &position, &lazyreader, &samples)) > 0 )
+    {
+      sacsamples (ti, samples, blocksamples, 1, &depmin, &depmax, &depsum);
+
+      if ( writedata (samples, (size_t)(blocksamples * sizeof(float)), outfile) )
+        return -1;
+
+      cnt += blocksamples;
+    }
+  }
+
+  /* Pad to the sample count in the header with zeros */
+  if ( cnt < ti->nsamples )
+  {
+    memset (zeros, 0, sizeof(zeros));
+
+    for ( blocksamples = ti->nsamples - cnt; blocksamples > 0; )
+    {
+      outsize = ( blocksamples * 4 > sizeof(zeros) ) ? sizeof(zeros) : blocksamples * 4;
+
+      if ( writedata (zeros, (size_t)outsize, outfile) )
+        return -1;
+
+      blocksamples -= outsize / 4;
+    }
+  }
+
+  if ( endoutput (outfile, opened) )
+    return -1;
+
+  return cnt;
+}  /* End of writesac() */
+
+
+/***************************************************************************
+ * sacsamples:
+ *
+ * Scale, if requested, and convert a block of samples of a trace to
+ * float in place and update the minimum, maximum and sum of samples.
+ * The minimum and maximum are initialized from the block if first is
+ * set.
+ ***************************************************************************/
+static void
+sacsamples (struct traceinfo *ti, void *samples, int64_t count, int first,
+            float *min, float *max, double *sum)
+{
+  float *fdata = (float *)samples;
+  int64_t idx;
+
+  if ( ti->scale )
+    scalesamples (samples, count, ti->seg->sampletype, ti->mn->scalefactor);
+
+  /* Doubles shrink to floats moving forward, never overwriting an
+   * unconverted value */
+  if ( ti->sampletype == 'i' )
+    for ( idx = 0; idx < count; idx++ )
+      fdata[idx] = (float)((int32_t *)samples)[idx];
+  else if ( ti->sampletype == 'd' )
+    for ( idx = 0; idx < count; idx++ )
+      fdata[idx] = (float)((double *)samples)[idx];
+
+  if ( first && count > 0 )
+    *min = *max = fdata[0];
+
+  for ( idx = 0; idx < count; idx++ )
+  {
+    if ( fdata[idx] < *min )
+      *min = fdata[idx];
+    if ( fdata[idx] > *max )
+      *max = fdata[idx];
+
+    *sum += fdata[idx];
+  }
+}  /* End of sacsamples() */
+
+
+/***************************************************************************
+ * sacstring:
+ *
+ * Copy a string into a SAC header string field of 8 characters,
+ * padded with spaces.  An empty string is left undefined.
+ ***************************************************************************/
+static void
+sacstring (char *field, const char *value)
+{
+  size_t length = strlen (value);
+
+  if ( length == 0 )
+    return;
+
+  if ( length > 8 )
+    length = 8;
+
+  memset (field, ' ', 8);
+  memcpy (field, value, length);
+}  /* End of sacstring() */
+
+/***************************************************************************
+ * writearrow:
+ *
+ * Write the samples of a trace to an Arrow IPC file (Feather version
+ * 2) with a single record batch.  The record batch has a Sample column
+ * of the sample type and, for time-sample pairs, a preceding Time
+ * column of UTC time stamps in microseconds.  The GeoCSV header fields
+ * are included as schema metadata.
+ *
+ * The column values are written in host byte order, as denoted in the
+ * schema, and the samples of each block, all samples of a segment
+ * unless decoding lazily, are written with a single write.  If fewer
+ * samples can be decoded than expected the column is padded with
+ * zeros.
+ *
+ * Returns the number of samples written or -1 on error.
+ ***************************************************************************/
+static int64_t
+writearrow (struct traceinfo *ti)
+{
+  MSTraceSeg *seg = ti->seg;
+  struct metanode *mn = ti->mn;
+  struct listnode *en;
+  MSArrowFile af;
+  MSArrowColumn columns[2];
+  char **keys;
+  char **values;
+  char countstr[30];
+  char ratestr[30];
+  char startstr[60];
+  char dipstr[30];
+  char unitstr[100];
+  char typestr[100];
+  int64_t cnt;
+  int nkeys = 0;
+  int nextra = 0;
+  int idx;
+
+  if ( verbose )
+    fprintf (stderr, "Writing Arrow for %.8s.%.8s.%.8s.%.8s\n",
+	     ti->id->network, ti->id->station, ti->id->location, ti->id->channel);
+
+  memset (&af, 0, sizeof(af));
+
+  /* Columns: time stamps for time-sample pairs and samples */
+  if ( outformat == 7 )
+  {
+    columns[af.ncolumns].name = "Time";
+    columns[af.ncolumns++].type = 't';
+  }
+  columns[af.ncolumns].name = "Sample";
+  columns[af.ncolumns++].type = ti->sampletype;
+
+  /* Schema metadata from GeoCSV header fields */
+  snprintf (countstr, sizeof(countstr), "%lld", (long long int)ti->nsamples);
+  snprintf (ratestr, sizeof(ratestr), "%g", seg->samprate);
+  snprintf (startstr, sizeof(startstr), "%sZ", ti->timestr);
+  snprintf (unitstr, sizeof(unitstr), "%s%s", (outformat == 7) ? "UTC, " : "", unitsstr);
+  snprintf (typestr, sizeof(typestr), "%s%s", (outformat == 7) ? "datetime, " : "", ti->samptype);
+
+  for ( en = extraheader; en; en = en->next )
+    nextra++;
+
+  if ( (keys = (char **) malloc (sizeof(char *) * 2 * (MAXMETAFIELDS + 6 + nextra))) == NULL )
+  {
+    fprintf (stderr, "Cannot allocate memory for Arrow metadata\n");
+    return -1;
+  }
+  values = keys + MAXMETAFIELDS + 6 + nextra;
+
+  keys[nkeys] = "SID"; values[nkeys++] = ti->srcname;
+  keys[nkeys] = "sample_count"; values[nkeys++] = countstr;
+  keys[nkeys] = "sample_rate_hz"; values[nkeys++] = ratestr;
+  keys[nkeys] = "start_time"; values[nkeys++] = startstr;
+
+  for ( idx = 0; mn && idx < MAXMETAFIELDS; idx++ )
+  {
+    if ( ! metakeys[idx] || ! mn->metafields[idx] )
+      continue;
+
+    keys[nkeys] = (char *)metakeys[idx];
+    values[nkeys++] = mn->metafields[idx];
+
+    /* Dip is reported in SEED convention */
+    if ( idx == 9 )
+    {
+      snprintf (dipstr, sizeof(dipstr), "%g", mn->dip);
+      values[nkeys - 1] = dipstr;
+    }
+  }
+
+  for ( en = extraheader; en; en = en->next )
+  {
+    keys[nkeys] = en->key;
+    values[nkeys++] = en->data;
+  }
+
+  keys[nkeys] = "field_unit"; values[nkeys++] = unitstr;
+  keys[nkeys] = "field_type"; values[nkeys++] = typestr;
+
+  af.keys = keys;
+  af.values = values;
+  af.nkeys = nkeys;
+  af.columns = columns;
+  af.rows = ti->nsamples;
+
+  if ( (cnt = writearrowfile (ti, &af)) < 0 )
+    fprintf (stderr, "Error writing Arrow file for %s\n", ti->srcname);
+
+  free (keys);
+
+  return cnt;
+}  /* End of writearrow() */
+
+
+/***************************************************************************
+ * writearrowfile:
+ *
+ * Write the header, column values and footer of an Arrow file for a
+ * trace as described by af.
+ *
+ * Returns the number of samples written or -1 on error.
+ ***************************************************************************/
+static int64_t
+writearrowfile (struct traceinfo *ti, MSArrowFile *af)
+{
+  MSTraceSeg *seg = ti->seg;
+  char outfile[1100];
+  char *buffer = NULL;
+  int64_t buffersize;
+  int64_t times[1024];
+  double hpperiod;
+  int opened;
+  int idx;
+
+  int64_t cnt = 0;
+  int64_t position = 0;
+  int64_t blocksamples;
+  int64_t padding;
+  void *samples;
+
+  if ( (buffersize = msa_header (af, &buffer)) < 0 )
+    return -1;
+
+  snprintf (outfile, sizeof(outfile), "%s.arrow", ti->basename);
+
+  if ( beginoutput (outfile, &opened) )
+  {
+    free (buffer);
+    return -1;
+  }
+
+  if ( verbose > 1 )
+    fprintf (stderr, "Writing Arrow file: %s\n", outfile);
+
+  if ( writedata (buffer, (size_t)buffersize, outfile) )
+  {
+    free (buffer);
+    return -1;
+  }
+
+  free (buffer);
+  buffer = NULL;
+
+  /* Time stamps of samples, calculated as for text time-sample pairs */
+  if ( outformat == 7 )
+  {
+    hpperiod = ( seg->samprate ) ? (HPTMODULUS / seg->samprate) : 0;
+
+    for ( cnt = 0; cnt < ti->nsamples; )
+    {
+      for ( idx = 0; idx < 1024 && cnt < ti->nsamples; idx++, cnt++ )
+        times[idx] = seg->starttime + (hptime_t)(cnt * hpperiod);
+
+      if ( writedata ((char *)times, (size_t)idx * sizeof(int64_t), outfile) )
+        return -1;
+    }
+
+    cnt = 0;
+  }
+
+  while ( (blocksamples = nextsamples (seg, &position, &lazyreader, &samples)) > 0 )
+  {
+    if ( ti->scale )
+      scalesamples (samples, blocksamples, seg->sampletype, ti->mn->scalefactor);
+
+    if ( writedata (samples, (size_t)(blocksamples * ms_samplesize (ti->sampletype)), outfile) )
+      return -1;
+
+    cnt += blocksamples;
+  }
+
+  /* Pad to the sample count in the metadata and to the column size */
+  padding = msa_columnsize (ti->sampletype, ti->nsamples) - cnt * ms_samplesize (ti->sampletype);
+  memset (times, 0, sizeof(times));
+
+  while ( padding > 0 )
+  {
+    blocksamples = ( padding > sizeof(times) ) ? sizeof(times) : padding;
+
+    if ( writedata ((char *)times, (size_t)blocksamples, outfile) )
+      return -1;
+
+    padding -= blocksamples;
+  }
+
+  if ( (buffersize = msa_footer (af, &buffer)) < 0 )
+    return -1;
+
+  if ( writedata (buffer, (size_t)buffersize, outfile) )
+  {
+    free (buffer);
+    return -1;
+  }
+
+  free (buffer);
+
+  if ( endoutput (outfile, opened) )
+    return -1;
+
+  return cnt;
+}  /* End of writearrowfile() */
+
+
+/***************************************************************************
+ * writematrix:
+ *
+ * Write all traces of a MSTraceList as a time-aligned matrix with a
+ * time column and a column per channel.  The sample grid has the
+ * sample rate of the first trace and starts at the earliest start time,
+ * or the first grid time in the -ts window, and ends at the latest end
+ * time or the -te window end.  Traces with a different sample rate or
+ * ASCII samples are skipped.
+ *
+ * Each grid time takes the nearest sample of a channel within half a
+ * sample period, without interpolation, and gaps are filled with NaN
+ * in binary output and left empty in text output.  Text output is
+ * GeoCSV, binary output (formats 3 and 4) is a float64 matrix with
+ * the time relative to the start time in seconds in the first column
+ * and a header file.
+ *
+ * The matrix is produced in a single pass in blocks of MATRIXROWS rows,
+ * only one block is held in memory.  The channels are read in time
+ * order with their own decoding state, with a sample memory budget the
+ * samples of a segment are mapped while it is being read.
+ *
+ * Returns the number of rows written or -1 on error.
+ ***************************************************************************/
+static int64_t
+writematrix (MSTraceList *mstl)
+{
+  struct matrixchannel *channels = NULL;
+  struct matrixchannel *mc;
+  struct metanode *mn;
+  struct listnode *en;
+  MSTraceID *id;
+  MSTraceSeg *seg;
+  BTime btime;
+  hptime_t origin = HPTERROR;
+  hptime_t endtime = HPTERROR;
+  hptime_t samptime;
+  double samprate = 0.0;
+  double hpperiod;
+  double *block = NULL;
+  char *textbuffer = NULL;
+  size_t textsize;
+  size_t rowsize;
+  char basename[100];
+  char outfile[120];
+  char hdrfile[120];
+  char timestr[50];
+  int nchannels = 0;
+  int ncols;
+  int month, mday;
+  int opened = 0;
+  int begun = 0;
+  int outsize;
+  int row, rows;
+  int col;
+  int64_t nrows;
+  int64_t lastrow;
+  int64_t cnt;
+  int64_t retval = -1;
+
+  /* Count traces for channel columns */
+  for ( id = mstl->traces; id; id = id->next )
+    nchannels++;
+
+  if ( nchannels == 0 )
+    return 0;
+
+  if ( (channels = (struct matrixchannel *) calloc (nchannels, sizeof(struct matrixchannel))) == NULL )
+  {
+    fprintf (stderr, "Cannot allocate memory for matrix channels\n");
+    return -1;
+  }
+
+  /* Collect channels with the sample rate of the first trace */
+  nchannels = 0;
+  for ( id = mstl->traces; id; id = id->next )
+  {
+    mc = &channels[nchannels];
+    mc->sampletype = 0;
+
+    for ( seg = id->first; seg; seg = seg->next )
+    {
+      if ( seg->sampletype == 'a' || seg->samprate == 0.0 )
+        continue;
+
+      if ( samprate == 0.0 )
+        samprate = seg->samprate;
+
+      if ( ! MS_ISRATETOLERABLE (seg->samprate, samprate) )
+        break;
+
+      /* Column type is the widest type of the segments */
+      if ( seg->sampletype == 'd' || mc->sampletype == 'd' )
+        mc->sampletype = 'd';
+      else if ( seg->sampletype == 'f' || mc->sampletype == 'f' )
+        mc->sampletype = 'f';
+      else
+        mc->sampletype = 'i';
+    }
+
+    if ( seg || ! mc->sampletype )
+    {
+      fprintf (stderr, "Skipping %s for matrix, %s\n", id->srcname,
+               (seg) ? "sample rate differs" : "no numeric samples");
+      continue;
+    }
+
+    mc->id = id;
+    mc->units = unitsstr;
+
+    /* Scale samples by the scale factor in matching metadata */
+    if ( scaledata && metadata && (mn = getmetadata (id, id->first)) &&
+         mn->metafields[11] && mn->scalefactor )
+    {
+      mc->scalefactor = mn->scalefactor;
+      mc->units = mn->metafields[13];
+
+      if ( mc->sampletype == 'i' )
+        mc->sampletype = 'f';
+    }
+
+    for ( seg = id->first; seg; seg = seg->next )
+    {
+      if ( seg->sampletype == 'a' || seg->samprate == 0.0 )
+        continue;
+
+      if ( origin == HPTERROR || seg->starttime < origin )
+        origin = seg->starttime;
+      if ( endtime == HPTERROR || seg->endtime > endtime )
+        endtime = seg->endtime;
+    }
+
+    nchannels++;
+  }
+
+  if ( nchannels == 0 )
+  {
+    free (channels);
+    return 0;
+  }
+
+  hpperiod = HPTMODULUS / samprate;
+
+  /* Limit the grid to the selected time window */
+  if ( matrixstart != HPTERROR && matrixstart > origin )
+    origin += (hptime_t)(ceil ((matrixstart - origin) / hpperiod) * hpperiod);
+
+  lastrow = (int64_t)((endtime - origin) / hpperiod + 0.5);
+
+  if ( matrixend != HPTERROR && matrixend < endtime )
+    lastrow = (int64_t)floor ((matrixend - origin) / hpperiod);
+
+  nrows = lastrow + 1;
+
+  if ( nrows <= 0 )
+  {
+    free (channels);
+    return 0;
+  }
+
+  for ( col = 0; col < nchannels; col++ )
+    matrixsegment (&channels[col], channels[col].id->first);
+
+  /* Output file base name: MATRIX.Year-Month-DayTHourMinSec.Subsec */
+  ms_hptime2btime (origin, &btime);
+  ms_doy2md (btime.year, btime.day, &month, &mday);
+  snprintf (basename, sizeof(basename), "MATRIX.%04d-%02d-%02dT%02d%02d%02d.%06d",
+            btime.year, month, mday, btime.hour, btime.min, btime.sec,
+            (int)(origin - (hptime_t)MS_HPTIME2EPOCH(origin) * HPTMODULUS));
+  snprintf (outfile, sizeof(outfile), "%s.%s", basename,
+            (outformat == 3) ? "npy" : (outformat == 4) ? "bin" : "csv");
+  snprintf (hdrfile, sizeof(hdrfile), "%s.hdr", basename);
+
+  if ( verbose )
+    fprintf (stderr, "Writing matrix of %d channels and %lld rows at %g sps\n",
+             nchannels, (long long int)nrows, samprate);
+
+  /* Text buffer for the header or a block of rows of typical length,
+   * longer rows are written as the buffer fills */
+  ncols = nchannels + 1;
+  textsize = 65536 + (size_t)MATRIXROWS * (40 + 32 * ncols);
+  rowsize = 40 + (size_t)(MSF_MAXSAMPLE + 2) * ncols;
+
+  if ( (block = (double *) malloc (sizeof(double) * MATRIXROWS * ncols)) == NULL ||
+       (textbuffer = (char *) malloc (textsize)) == NULL )
+  {
+    fprintf (stderr, "Cannot allocate memory for matrix block\n");
+    goto cleanup;
+  }
+
+  /* GeoCSV header with a field per column */
+  ms_hptime2isotimestr (origin, timestr, 1);
+  outsize = snprintf (textbuffer, textsize,
+                      "# dataset: GeoCSV 2.0\n"
+                      "# delimiter: ,\n"
+                      "# sample_count: %lld\n"
+                      "# sample_rate_hz: %g\n"
+                      "# start_time: %sZ\n",
+                      (long long int)nrows, samprate, timestr);
+
+  for ( en = extraheader; en; en = en->next )
+    outsize += snprintf (textbuffer + outsize, textsize - outsize,
+                         "# %s: %s\n", en->key, en->data);
+
+  outsize += snprintf (textbuffer + outsize, textsize - outsize,
+                       "# field_unit: %s", (outformat <= 2) ? "UTC" : "s");
+  for ( col = 0; col < nchannels; col++ )
+    outsize += snprintf (textbuffer + outsize, textsize - outsize, ", %s", channels[col].units);
+
+  outsize += snprintf (textbuffer + outsize, textsize - outsize,
+                       "\n# field_type: %s", (outformat <= 2) ? "datetime" : "DOUBLE");
+  for ( col = 0; col < nchannels; col++ )
+    outsize += snprintf (textbuffer + outsize, textsize - outsize, ", %s",
+                         (outformat > 2) ? "DOUBLE" : (channels[col].sampletype == 'i') ? "INTEGER" : "FLOAT");
+
+  outsize += snprintf (textbuffer + outsize, textsize - outsize, "\nTime");
+  for ( col = 0; col < nchannels; col++ )
+    outsize += snprintf (textbuffer + outsize, textsize - outsize, ", %s",
+                         channels[col].id->srcname);
+  outsize += snprintf (textbuffer + outsize, textsize - outsize, "\n");
+
+  if ( outsize > textsize )
+    outsize = textsize;
+
+  if ( outformat > 2 && writeheader (textbuffer, outsize, hdrfile) )
+    goto cleanup;
+
+  if ( beginoutput (outfile, &opened) )
+    goto cleanup;
+
+  begun = 1;
+
+  if ( outformat <= 2 && writedata (textbuffer, outsize, outfile) )
+    goto cleanup;
+
+  /* NumPy format 1.0 header for a matrix of rows by columns */
+  if ( outformat == 3 )
+  {
+    outsize = snprintf (textbuffer + 10, textsize - 10,
+                        "{'descr': '<f8', 'fortran_order': False, 'shape': (%lld, %d), }",
+                        (long long int)nrows, ncols);
+    outsize += 10;
+
+    while ( (outsize + 1) % 64 )
+      textbuffer[outsize++] = ' ';
+    textbuffer[outsize++] = '\n';
+
+    memcpy (textbuffer, "\x93NUMPY\x01\x00", 8);
+    textbuffer[8] = (char)((outsize - 10) & 0xff);
+    textbuffer[9] = (char)((outsize - 10) >> 8);
+
+    if ( writedata (textbuffer, outsize, outfile) )
+      goto cleanup;
+  }
+
+  /* Fill and write the matrix a block of rows at a time */
+  for ( cnt = 0; cnt < nrows; cnt += rows )
+  {
+    rows = ( nrows - cnt > MATRIXROWS ) ? MATRIXROWS : (int)(nrows - cnt);
+
+    for ( row = 0; row < rows; row++ )
+    {
+      samptime = origin + (hptime_t)((cnt + row) * hpperiod);
+      block[row * ncols] = (double)(samptime - origin) / HPTMODULUS;
+    }
+
+    for ( col = 0; col < nchannels; col++ )
+      matrixfill (&channels[col], block + col + 1, ncols, origin, hpperiod, cnt, rows);
+
+    if ( outformat > 2 )
+    {
+      if ( writesamples (block, (int64_t)rows * ncols, sizeof(double), outfile) )
+        goto cleanup;
+
+      continue;
+    }
+
+    for ( row = 0, outsize = 0; row < rows; row++ )
+    {
+      if ( textsize - outsize < rowsize )
+      {
+        if ( writedata (textbuffer, outsize, outfile) )
+          goto cleanup;
+
+        outsize = 0;
+      }
+
+      ms_hptime2isotimestr (origin + (hptime_t)((cnt + row) * hpperiod), timestr, 1);
+      outsize += snprintf (textbuffer + outsize, textsize - outsize, "%sZ", timestr);
+
+      for ( col = 0; col < nchannels; col++ )
+      {
+        double value = block[row * ncols + col + 1];
+
+        if ( isnan (value) )
+        {
+          outsize += snprintf (textbuffer + outsize, textsize - outsize, ", ");
+        }
+        else if ( precision >= 0 && channels[col].sampletype != 'i' )
+        {
+          textbuffer[outsize++] = ',';
+          textbuffer[outsize++] = ' ';
+          outsize = (int)(msf_fixed (textbuffer + outsize, value, precision) - textbuffer);
+        }
+        else if ( channels[col].sampletype == 'i' )
+          outsize += snprintf (textbuffer + outsize, textsize - outsize, ", %d", (int32_t)value);
+        else if ( channels[col].sampletype == 'f' )
+          outsize += snprintf (textbuffer + outsize, textsize - outsize, ", %.8g", (float)value);
+        else
+          outsize += snprintf (textbuffer + outsize, textsize - outsize, ", %.10g", value);
+      }
+
+      outsize += snprintf (textbuffer + outsize, textsize - outsize, "\n");
+    }
+
+    if ( writedata (textbuffer, outsize, outfile) )
+      goto cleanup;
+  }
+
+  begun = 0;
+
+  if ( endoutput (outfile, opened) )
+    goto cleanup;
+
+  retval = nrows;
+
+  fprintf (stderr, "Wrote %lld rows of %d channels to %s\n",
+           (long long int)nrows, nchannels, (outputfile) ? outputfile : outfile);
+
+ cleanup:
+  if ( begun )
+    endoutput (outfile, opened);
+
+  for ( col = 0; col < nchannels; col++ )
+  {
+    matrixsegment (&channels[col], NULL);
+    msl_freereader (&channels[col].reader);
+  }
+
+  free (channels);
+  free (block);
+  free (textbuffer);
+
+  return retval;
+}  /* End of writematrix() */
+
+
+/***************************************************************************
+ * matrixsegment:
+ *
+ * Set the segment of a matrix channel being read, starting with its
+ * first sample.  The samples of the previous segment are released and
+ * those of the new segment mapped when using a sample memory budget.
+ * Segments of ASCII or without a sample rate are skipped.
+ ***************************************************************************/
+static void
+matrixsegment (struct matrixchannel *mc, MSTraceSeg *seg)
+{
+  if ( spill && mc->seg && mc->mapped )
+    msp_release (spill, mc->seg);
 
-    if ( verbose > 1 )
-      fprintf (stderr, "Writing ASCII time-sample pair file: %s\n", outname);
+  while ( seg && (seg->sampletype == 'a' || seg->samprate == 0.0) )
+    seg = seg->next;
 
-    /* Finish header */
-    if (headerformat == 1)
+  mc->seg = seg;
+  mc->mapped = 0;
+  mc->position = 0;
+  mc->blockstart = 0;
+  mc->blockcount = 0;
+
+  if ( spill && seg )
+  {
+    if ( msp_map (spill, seg) )
     {
-      outsize = snprintf (outbuffer, sizeof(outbuffer),
-                          "TSPAIR, %s, %s\n", samptype, unitsstr);
+      fprintf (stderr, "Error mapping spilled samples for %s\n", mc->id->srcname);
+      mc->blockcount = -1;
     }
     else
     {
-      outsize = snprintf (outbuffer, sizeof(outbuffer),
-                          "# field_unit: UTC, %s\n"
-                          "# field_type: datetime, %s\n"
-                          "Time, Sample\n",
-                          unitsstr,
-                          samptype);
+      mc->mapped = 1;
     }
+  }
+}  /* End of matrixsegment() */
 
-    if (outsize > sizeof(outbuffer))
-      outsize = sizeof(outbuffer);
 
-    if (writedata (outbuffer, outsize, outfile))
-      return -1;
+/***************************************************************************
+ * matrixfill:
+ *
+ * Fill the column of a channel in a block of rows of the matrix.  Each
+ * row takes the nearest sample within half a sample period of its grid
+ * time, otherwise NaN.  Rows are filled in runs of consecutive samples
+ * within a block of decoded samples, converting and interleaving each
+ * run into the column with a stride of the number of matrix columns;
+ * the nearest sample is determined again at the start of each run.
+ ***************************************************************************/
+static void
+matrixfill (struct matrixchannel *mc, double *column, int stride,
+            hptime_t origin, double hpperiod, int64_t firstrow, int rows)
+{
+  MSTraceSeg *seg;
+  hptime_t samptime;
+  void *samples;
+  char sampletype;
+  int64_t segsamples;
+  int64_t count;
+  int64_t idx;
+  int64_t run;
+  int row = 0;
+
+  while ( row < rows )
+  {
+    samptime = origin + (hptime_t)((firstrow + row) * hpperiod);
 
-    outsize = 0;
-    for ( cnt = 0; cnt < mst->numsamples; cnt++ )
+    /* Move to the segment containing or following the grid time */
+    while ( (seg = mc->seg) && samptime > seg->endtime + (hptime_t)(hpperiod / 2) )
+      matrixsegment (mc, seg->next);
+
+    if ( ! seg || samptime < seg->starttime - (hptime_t)(hpperiod / 2) || mc->blockcount < 0 )
     {
-      ms_hptime2isotimestr (samptime, timestr, 1);
+      column[(int64_t)row++ * stride] = NAN;
+      continue;
+    }
 
-      sptr = (char*)mst->datasamples + (cnt * samplesize);
+    segsamples = ( lazydecode ) ? seg->samplecnt : seg->numsamples;
+    idx = (int64_t)floor ((samptime - seg->starttime) * seg->samprate / HPTMODULUS + 0.5);
 
-      if ( mst->sampletype == 'i' )
-        outsize += snprintf (outbuffer + outsize, sizeof(outbuffer) - outsize, "%s%s%s %d\n",
-                             timestr, (headerformat == 1) ? "" : "Z", delimiter, *(int32_t *)sptr);
+    /* Decode blocks until the block containing the sample */
+    while ( idx < segsamples && idx >= mc->blockstart + mc->blockcount )
+    {
+      mc->blockstart += mc->blockcount;
 
-      else if ( mst->sampletype == 'f' )
-        outsize += snprintf (outbuffer + outsize, sizeof(outbuffer) - outsize, "%s%s%s %.8g\n",
-                             timestr, (headerformat == 1) ? "" : "Z", delimiter, *(float *)sptr);
+      if ( (count = nextsamples (seg, &mc->position, &mc->reader, &mc->samples)) <= 0 )
+      {
+        if ( count < 0 )
+          fprintf (stderr, "Filling rest of segment of %s with gaps\n", mc->id->srcname);
 
-      else if ( mst->sampletype == 'd' )
-        outsize += snprintf (outbuffer + outsize, sizeof(outbuffer) - outsize, "%s%s%s %.10g\n",
-                             timestr, (headerformat == 1) ? "" : "Z", delimiter, *(double *)sptr);
+        mc->blockcount = -1;
+        break;
+      }
 
-      samptime = mst->starttime + (hptime_t)((cnt+1) * hpperiod);
+      mc->blockcount = count;
 
-      /* Write data if less than 1024 bytes available */
-      if ((sizeof (outbuffer) - outsize) < 1024)
-      {
-        if (writedata (outbuffer, outsize, outfile))
-          return -1;
-        outsize = 0;
-      }
-    } /* Done looping through samples */
+      if ( mc->scalefactor )
+        scalesamples (mc->samples, count, seg->sampletype, mc->scalefactor);
+    }
 
-    /* Flush any unwritten output */
-    if (outsize > 0)
+    if ( idx < 0 || idx >= segsamples || mc->blockcount < 0 || idx < mc->blockstart ||
+         mc->reader.gap )
     {
-      if (writedata (outbuffer, outsize, outfile))
-        return -1;
-      outsize = 0;
+      column[(int64_t)row++ * stride] = NAN;
+      continue;
     }
+
+    /* Run of consecutive samples from the block */
+    run = mc->blockstart + mc->blockcount - idx;
+    if ( run > rows - row )
+      run = rows - row;
+
+    sampletype = seg->sampletype;
+    if ( mc->scalefactor && sampletype == 'i' )
+      sampletype = 'f';
+
+    samples = mc->samples;
+    idx -= mc->blockstart;
+
+    if ( sampletype == 'i' )
+      for ( count = 0; count < run; count++ )
+        column[(int64_t)(row + count) * stride] = ((int32_t *)samples)[idx + count];
+    else if ( sampletype == 'f' )
+      for ( count = 0; count < run; count++ )
+        column[(int64_t)(row + count) * stride] = ((float *)samples)[idx + count];
+    else
+      for ( count = 0; count < run; count++ )
+        column[(int64_t)(row + count) * stride] = ((double *)samples)[idx + count];
+
+    row += (int)run;
   }
-  else
-  {
-    fprintf (stderr, "Error, unrecognized format: '%d'\n", outformat);
-  }
+}  /* End of matrixfill() */
+
+
+/***************************************************************************
+ * nextsamples:
+ *
+ * Get the next block of samples of a trace segment for writing,
+ * position starts at 0.  With lazy decoding each block is the samples
+ * of one data frame of a Steim record or of one raw record of the
+ * segment, decoded with reader, otherwise the single block is all
+ * samples of the segment.  Samples that cannot be decoded are returned
+ * as zero samples with the reader gap flag set, see msl_nextblock().
+ *
+ * Returns the number of samples in the block, 0 when all samples have
+ * been returned and -1 on error.
+ ***************************************************************************/
+static int64_t
+nextsamples (MSTraceSeg *seg, int64_t *position, MSLazyReader *reader,
+             void **samples)
+{
+  char sampletype;
 
-  if ( outname == outfile )
+  if ( ! lazydecode )
   {
-    fclose (ofp);
-    ofp = 0;
+    if ( *position >= seg->numsamples )
+      return 0;
+
+    *samples = seg->datasamples;
+    *position = seg->numsamples;
+
+    return seg->numsamples;
   }
 
-#ifndef NOFDZIP
-  /* End ZIP entry */
-  if (zipfile)
+  return msl_nextblock (seg, position, reader, samples,
+                        &sampletype, verbose - 1);
+}  /* End of nextsamples() */
+
+
+/***************************************************************************
+ * scalesamples:
+ *
+ * Scale data samples, inversely, by a scale factor in place.  Integer
+ * samples are converted to float.
+ ***************************************************************************/
+static void
+scalesamples (void *samples, int64_t count, char sampletype, double scalefactor)
+{
+  int32_t *idata;
+  float *fdata;
+  double *ddata;
+  int64_t cnt;
+
+  for (cnt = 0; cnt < count; cnt++)
   {
-    if (!zs_entryend (zstream, zentry, &writestatus))
-    {
-      fprintf (stderr, "Error ending ZIP entry for %s, write status: %lld\n",
-               outfile, (long long int)writestatus);
-      return 1;
-    }
-  }
+    idata = (int32_t *)samples + cnt;
+    fdata = (float *)samples + cnt;
+    ddata = (double *)samples + cnt;
 
-  zentry = 0;
-#endif /* NOFDZIP */
+    /* Integers are converted to floats */
+    if (sampletype == 'i')
+      *fdata = (float)*idata / scalefactor;
 
-  fprintf (stderr, "Wrote %lld samples for %s\n",
-	   (long long int)mst->numsamples, srcname);
+    else if (sampletype == 'f')
+      *fdata = *fdata / scalefactor;
 
-  return mst->numsamples;
-}  /* End of writeascii() */
+    else if (sampletype == 'd')
+      *ddata = *ddata / scalefactor;
+  }
+}  /* End of scalesamples() */
 
 /***************************************************************************
  * writedata:
@@ -749,7 +2791,15 @@ writedata (char *outbuffer, size_t outsize, char *outfile)
   int64_t writestatus = 0;
 #endif /* NOFDZIP */
 
-  if (ofp)
+  if (cstream)
+  {
+    if (msc_write (cstream, outbuffer, outsize))
+    {
+      fprintf (stderr, "Error adding entry data for %s to compressed output file\n", outfile);
+      return -1;
+    }
+  }
+  else if (ofp)
   {
     if (fwrite (outbuffer, outsize, 1, ofp) != 1 )
     {
@@ -770,6 +2820,8 @@ writedata (char *outbuffer, size_t outsize, char *outfile)
   }
 #endif /* NOFDZIP */
 
+  outputbytes += outsize;
+
   return 0;
 }  /* End of writedata() */
 
@@ -786,6 +2838,13 @@ parameter_proc (int argcount, char **argvec)
   char *metafile = NULL;
   char *metaline = NULL;
   char *value;
+  struct listnode *selectlist = NULL;
+  struct listnode *sln;
+  char *starttimestr = NULL;
+  char *endtimestr = NULL;
+  hptime_t starttime = HPTERROR;
+  hptime_t endtime = HPTERROR;
+  char *endptr;
   int optind;
 
   /* Process all command line arguments */
@@ -842,6 +2901,55 @@ parameter_proc (int argcount, char **argvec)
     {
       slistcols = strtoul (getoptval(argcount, argvec, optind++, 0), NULL, 10);
     }
+    else if (strcmp (argvec[optind], "-p") == 0)
+    {
+      precision = strtol (getoptval(argcount, argvec, optind++, 0), &endptr, 10);
+
+      if ( *endptr || precision < 0 || precision > MSF_MAXDIGITS )
+      {
+        fprintf (stderr, "Invalid number of decimals, 0 to %d: %s\n",
+                 MSF_MAXDIGITS, argvec[optind]);
+        exit (1);
+      }
+    }
+    else if (strcmp (argvec[optind], "-fw") == 0)
+    {
+      fixedwidth = strtol (getoptval(argcount, argvec, optind++, 0), &endptr, 10);
+
+      if ( *endptr || fixedwidth < 0 || fixedwidth > MSF_MAXWIDTH )
+      {
+        fprintf (stderr, "Invalid field width, 0 to %d: %s\n",
+                 MSF_MAXWIDTH, argvec[optind]);
+        exit (1);
+      }
+    }
+    else if (strcmp (argvec[optind], "-index") == 0)
+    {
+      indexinterval = strtoll (getoptval(argcount, argvec, optind++, 0), &endptr, 10);
+
+      if ( *endptr || indexinterval <= 0 )
+      {
+        fprintf (stderr, "Invalid number of samples between index entries: %s\n",
+                 argvec[optind]);
+        exit (1);
+      }
+    }
+    else if (strcmp (argvec[optind], "-tf") == 0)
+    {
+      value = getoptval (argcount, argvec, optind++, 0);
+
+      if ( ! strcmp (value, "iso") )
+        timeformat = 0;
+      else if ( ! strcmp (value, "epoch") )
+        timeformat = 1;
+      else if ( ! strcmp (value, "relative") )
+        timeformat = 2;
+      else
+      {
+        fprintf (stderr, "Unrecognized time format: %s\n", value);
+        exit (1);
+      }
+    }
     else if (strcmp (argvec[optind], "-u") == 0)
     {
       unitsstr = getoptval(argcount, argvec, optind++, 0);
@@ -882,10 +2990,74 @@ parameter_proc (int argcount, char **argvec)
       zipmethod = ZS_STORE;
     }
 #endif
+    else if (strcmp (argvec[optind], "-gz") == 0)
+    {
+      compressmethod = MSC_GZIP;
+    }
+    else if (strcmp (argvec[optind], "-zst") == 0)
+    {
+      compressmethod = MSC_ZSTD;
+    }
+    else if (strcmp (argvec[optind], "-cl") == 0)
+    {
+      compresslevel = strtol (getoptval(argcount, argvec, optind++, 0), &endptr, 10);
+
+      if ( *endptr || compresslevel < 1 )
+      {
+        fprintf (stderr, "Invalid compression level: %s\n", argvec[optind]);
+        exit (1);
+      }
+    }
     else if (strcmp (argvec[optind], "-r") == 0)
     {
       reclen = strtoul (getoptval(argcount, argvec, optind++, 0), NULL, 10);
     }
+    else if (strcmp (argvec[optind], "-S") == 0)
+    {
+      value = getoptval (argcount, argvec, optind++, 0);
+
+      if ( ! addnode (&selectlist, NULL, 0, value, strlen(value)+1) )
+      {
+        fprintf (stderr, "Error adding selection to list\n");
+        exit (1);
+      }
+    }
+    else if (strcmp (argvec[optind], "-ts") == 0)
+    {
+      starttimestr = getoptval (argcount, argvec, optind++, 0);
+    }
+    else if (strcmp (argvec[optind], "-te") == 0)
+    {
+      endtimestr = getoptval (argcount, argvec, optind++, 0);
+    }
+    else if (strcmp (argvec[optind], "-ib") == 0)
+    {
+      buildindex = 1;
+    }
+    else if (strcmp (argvec[optind], "-ix") == 0)
+    {
+      useindex = 1;
+    }
+    else if (strcmp (argvec[optind], "-id") == 0)
+    {
+      indexdir = getoptval (argcount, argvec, optind++, 0);
+    }
+    else if (strcmp (argvec[optind], "-ra") == 0)
+    {
+      int racount = 0;
+      int rasize = 0;
+
+      value = getoptval (argcount, argvec, optind++, 0);
+
+      if ( sscanf (value, "%dx%d", &racount, &rasize) != 2 ||
+           racount < 1 || rasize < 1 || rasize > 1024 )
+      {
+        fprintf (stderr, "Invalid read-ahead specification: %s\n", value);
+        exit (1);
+      }
+
+      MS_READAHEAD (racount, rasize * 1048576);
+    }
     else if (strcmp (argvec[optind], "-tt") == 0)
     {
       timetol = strtod (getoptval(argcount, argvec, optind++, 0), NULL);
@@ -894,6 +3066,47 @@ parameter_proc (int argcount, char **argvec)
     {
       sampratetol = strtod (getoptval(argcount, argvec, optind++, 0), NULL);
     }
+    else if (strcmp (argvec[optind], "-noheal") == 0)
+    {
+      healtraces = 0;
+    }
+    else if (strcmp (argvec[optind], "-sort") == 0)
+    {
+      sortinput = 1;
+    }
+    else if (strcmp (argvec[optind], "-sortmem") == 0)
+    {
+      sortinput = 1;
+      sortmemory = (int64_t) (strtod (getoptval(argcount, argvec, optind++, 0), NULL) * 1048576);
+
+      if ( sortmemory <= 0 )
+      {
+        fprintf (stderr, "Invalid sort memory: %s\n", argvec[optind]);
+        exit (1);
+      }
+    }
+    else if (strcmp (argvec[optind], "-maxmem") == 0)
+    {
+      maxmemory = (int64_t) (strtod (getoptval(argcount, argvec, optind++, 0), NULL) * 1048576);
+
+      if ( maxmemory <= 0 )
+      {
+        fprintf (stderr, "Invalid maximum memory: %s\n", argvec[optind]);
+        exit (1);
+      }
+    }
+    else if (strcmp (argvec[optind], "-lazy") == 0)
+    {
+      lazydecode = 1;
+    }
+    else if (strcmp (argvec[optind], "-matrix") == 0)
+    {
+      matrixoutput = 1;
+    }
+    else if (strcmp (argvec[optind], "-tmp") == 0)
+    {
+      tmpdir = getoptval (argcount, argvec, optind++, 0);
+    }
     else if (strncmp (argvec[optind], "-", 1) == 0 &&
              strlen (argvec[optind]) > 1 )
     {
@@ -923,6 +3136,65 @@ parameter_proc (int argcount, char **argvec)
   if ( verbose )
     fprintf (stderr, "%s version: %s\n", PACKAGE, VERSION);
 
+  /* Check the output format */
+  if (outformat < 1 || outformat > 7)
+  {
+    fprintf (stderr, "Unrecognized output format: %d\n", outformat);
+    exit (1);
+  }
+
+  /* Arrow files hold a single trace */
+  if ((outformat == 6 || outformat == 7) && outputfile)
+  {
+    fprintf (stderr, "Arrow output is written to a file per trace, -o cannot be used\n");
+    exit (1);
+  }
+
+  /* Matrix output is written as text or a binary array */
+  if (matrixoutput && outformat > 4)
+  {
+    fprintf (stderr, "Matrix output is only supported for formats 1 to 4\n");
+    exit (1);
+  }
+
+  /* Output files are compressed individually */
+  if (compressmethod)
+  {
+    if (! msc_supported (compressmethod))
+    {
+      fprintf (stderr, "%s output is not supported by this build\n",
+               (compressmethod == MSC_ZSTD) ? "zstd" : "gzip");
+      exit (1);
+    }
+
+    if (outputfile || zipfile)
+    {
+      fprintf (stderr, "Compressed output files cannot be combined with -o or -z\n");
+      exit (1);
+    }
+
+    if (compresslevel > ((compressmethod == MSC_ZSTD) ? 19 : 9))
+    {
+      fprintf (stderr, "Compression level must be 1 to %d\n",
+               (compressmethod == MSC_ZSTD) ? 19 : 9);
+      exit (1);
+    }
+  }
+
+  /* Output indexes are only written for the text trace formats */
+  if (indexinterval > 0 && (matrixoutput || outformat > 2))
+  {
+    fprintf (stderr, "Output indexes are only supported for formats 1 and 2\n");
+    exit (1);
+  }
+
+  /* Fixed-width fields are only written by the text trace formats */
+  if (fixedwidth >= 0 && (matrixoutput || outformat > 2))
+  {
+    fprintf (stderr, "Fixed-width output is only supported for formats 1 and 2\n");
+    exit (1);
+  }
+
   /* Sanity check the number of columns */
   if (slistcols > 100)
   {
@@ -930,6 +3202,61 @@ parameter_proc (int argcount, char **argvec)
     exit (1);
   }
 
+  /* Lazy decoding already limits sample memory to the raw records */
+  if ( lazydecode && maxmemory > 0 )
+  {
+    fprintf (stderr, "Options -lazy and -maxmem cannot be combined\n");
+    exit (1);
+  }
+
+  /* Merging segments would break spilled sample extents or raw record
+   * lists, in these cases heal by reading records in sorted order
+   * unless healing is disabled */
+  if ( (maxmemory > 0 || lazydecode) && healtraces )
+  {
+    if ( verbose )
+      fprintf (stderr, "Healing by reading records in sorted order with %s\n",
+               (lazydecode) ? "-lazy" : "-maxmem");
+
+    healtraces = 0;
+    sortinput = 1;
+  }
+
+  /* Parse selection time limits */
+  if ( starttimestr && (starttime = parsetime (starttimestr)) == HPTERROR )
+  {
+    fprintf (stderr, "Cannot parse start time: %s\n", starttimestr);
+    exit (1);
+  }
+  if ( endtimestr && (endtime = parsetime (endtimestr)) == HPTERROR )
+  {
+    fprintf (stderr, "Cannot parse end time: %s\n", endtimestr);
+    exit (1);
+  }
+
+  /* The matrix time grid is limited to the selected time window */
+  matrixstart = starttime;
+  matrixend = endtime;
+
+  /* Build data selections from source name patterns and time limits */
+  if ( selectlist || starttimestr || endtimestr )
+  {
+    if ( ! selectlist )
+      addnode (&selectlist, NULL, 0, "*", 2);
+
+    for ( sln = selectlist; sln; sln = sln->next )
+    {
+      if ( ms_addselect (&selections, sln->data, starttime, endtime) )
+      {
+        fprintf (stderr, "Error adding selection for %s\n", sln->data);
+        exit (1);
+      }
+    }
+
+    if ( verbose > 1 )
+      ms_printselections (selections);
+  }
+
   /* Check the input files for any list files, if any are found
    * remove them from the list and add the contained list */
   if ( filelist )
@@ -1022,6 +3349,23 @@ getoptval (int argcount, char **argvec, int argopt, int dasharg)
 }  /* End of getoptval() */
 
 
+/***************************************************************************
+ * parsetime:
+ * Parse a time string in either ISO (YYYY-MM-DDTHH:MM:SS.FFFFFF) or
+ * SEED (YYYY,DDD,HH:MM:SS.FFFFFF) form, trailing fields are optional.
+ *
+ * Returns high precision time on success and HPTERROR on failure.
+ ***************************************************************************/
+static hptime_t
+parsetime (char *timestr)
+{
+  if ( strchr (timestr, '-') )
+    return ms_timestr2hptime (timestr);
+  else
+    return ms_seedtimestr2hptime (timestr);
+}  /* End of parsetime() */
+
+
 /***************************************************************************
  * readlistfile:
  *
@@ -1139,12 +3483,12 @@ readlistfile (char *listfile)
  * Returns matching metadata node if match found, NULL otherwise.
  ***************************************************************************/
 struct metanode *
-getmetadata (MSTrace *mst)
+getmetadata (MSTraceID *id, MSTraceSeg *seg)
 {
   struct listnode *mlp = metadata;
   struct metanode *mn = NULL;
 
-  if (!mst)
+  if (!id || !seg)
     return NULL;
 
   while (mlp)
@@ -1158,10 +3502,10 @@ getmetadata (MSTrace *mst)
       fprintf (stderr, "getmetadata(): error, source name fields not all present\n");
     }
     /* Test if network, station, location and channel; also handle simple wildcards */
-    else if ((!strcmp (mst->network, mn->metafields[0]) || (*(mn->metafields[0]) == '*')) &&
-             (!strcmp (mst->station, mn->metafields[1]) || (*(mn->metafields[1]) == '*')) &&
-             (!strcmp (mst->location, mn->metafields[2]) || (*(mn->metafields[2]) == '*')) &&
-             (!strcmp (mst->channel, mn->metafields[3]) || (*(mn->metafields[3]) == '*')))
+    else if ((!strcmp (id->network, mn->metafields[0]) || (*(mn->metafields[0]) == '*')) &&
+             (!strcmp (id->station, mn->metafields[1]) || (*(mn->metafields[1]) == '*')) &&
+             (!strcmp (id->location, mn->metafields[2]) || (*(mn->metafields[2]) == '*')) &&
+             (!strcmp (id->channel, mn->metafields[3]) || (*(mn->metafields[3]) == '*')))
     {
       /* Check time window match */
       if (mn->starttime != HPTERROR || mn->endtime != HPTERROR)
@@ -1169,7 +3513,7 @@ getmetadata (MSTrace *mst)
         /* Check for overlap with metadata window */
         if (mn->starttime != HPTERROR && mn->endtime != HPTERROR)
         {
-          if (!(mst->endtime >= mn->starttime && mst->starttime <= mn->endtime))
+          if (!(seg->endtime >= mn->starttime && seg->starttime <= mn->endtime))
           {
             mlp = mlp->next;
             continue;
@@ -1178,7 +3522,7 @@ getmetadata (MSTrace *mst)
         /* Check if data after start time */
         else if (mn->starttime != HPTERROR)
         {
-          if (mst->endtime < mn->starttime)
+          if (seg->endtime < mn->starttime)
           {
             mlp = mlp->next;
             continue;
@@ -1187,7 +3531,7 @@ getmetadata (MSTrace *mst)
         /* Check if data before end time */
         else if (mn->endtime != HPTERROR)
         {
-          if (mst->starttime > mn->endtime)
+          if (seg->starttime > mn->endtime)
           {
             mlp = mlp->next;
             continue;
@@ -1197,7 +3541,7 @@ getmetadata (MSTrace *mst)
 
       if (verbose > 1)
         fprintf (stderr, "Found metadata for N: '%s', S: '%s', L: '%s', C: '%s' (%s - %s)\n",
-                 mst->network, mst->station, mst->location, mst->channel,
+                 id->network, id->station, id->location, id->channel,
                  (mn->metafields[15]) ? mn->metafields[15] : "NONE",
                  (mn->metafields[16]) ? mn->metafields[16] : "NONE");
 
@@ -1538,6 +3882,9 @@ usage (void)
 	   " -G           Produce GeoCSV formatted output\n"
 	   " -E key:value Add extra header to output (currently only GeoCSV)\n"
 	   " -c cols      Number of columns for sample value list output (default is %d)\n"
+           " -p digits    Write float samples in fixed-point notation with digits decimals\n"
+           " -fw width    Write values right-aligned in fields of width characters,\n"
+           "                0 for the widest value of the sample type, formats 1 and 2\n"
 	   " -u units     Specify units string for headers, default is 'Counts'\n"
            " -m metafile    File containing channel metadata (coordinates and more)\n"
            " -M metaline    Channel metadata, same format as lines in metafile\n"
@@ -1545,23 +3892,63 @@ usage (void)
 	   " -f format    Specify output format (default is 1):\n"
            "                1=Header followed by sample value list\n"
            "                2=Header followed by time-sample value pairs\n"
+           "                3=NumPy array file (.npy) and header file (.hdr)\n"
+           "                4=Raw little-endian samples (.bin) and header file (.hdr)\n"
+           "                5=SAC binary file (.sac) in host byte order\n"
+           "                6=Arrow IPC file (.arrow) with a sample column\n"
+           "                7=Arrow IPC file (.arrow) with time and sample columns\n"
+           " -tf time     Time format of time-sample pairs: iso (default), epoch\n"
+           "                or relative seconds from the start time\n"
            " -o outfile   Specify the output file, default is segment files\n"
+           " -index N     Write an index (.idx) of the text offset of every Nth sample\n"
+           " -matrix      Write all traces as a time-aligned matrix, formats 1-4\n"
            "\n"
            " -r bytes     Specify SEED record length in bytes, default: autodetect\n"
+           " -ra NxM      Read ahead of parsing with N buffers of M MiB, e.g. 4x8\n"
            " -tt secs     Specify a time tolerance for continuous traces\n"
-           " -rt diff     Specify a sample rate tolerance for continuous traces\n",
-	   slistcols);
+           " -rt diff     Specify a sample rate tolerance for continuous traces\n"
+           " -noheal      Do not join segments that fit together, e.g. from records\n"
+           "                that are not in time order\n"
+           " -sort        Read records in source name and time order, one trace is\n"
+           "                assembled at a time regardless of input order\n"
+           " -sortmem MiB Memory for sorting records before spilling, implies -sort\n"
+           " -maxmem MiB  Memory for decoded samples before spilling to a temporary file\n"
+           " -lazy        Keep compressed records in traces and decode while writing\n"
+           " -tmp dir     Directory for temporary files, default: system default\n"
+           "\n"
+           " -S srcname   Select records matching Net_Sta_Loc_Chan_Qual, globbing\n"
+           "                is supported, can be specified multiple times\n"
+           " -ts time     Select records that contain data after time\n"
+           " -te time     Select records that contain data before time\n"
+           "                time format: 'YYYY-MM-DD[THH:MM:SS.FFFFFF]' or\n"
+           "                'YYYY,DDD[,HH:MM:SS.FFFFFF]'\n"
+           "\n"
+           " -ib          Build a record index for each input file and exit\n"
+           " -ix          Read input files using their record indexes, when current\n"
+           " -id dir      Directory for record indexes, default: file name + '%s'\n",
+	   slistcols, MSINDEX_SUFFIX);
 
 #ifndef NOFDZIP
   fprintf (stderr,
            " -z zipfile   Write all files to a ZIP archive, use '-' for stdout\n"
-           " -z0 zipfile  Same as -z but do not compress archive entries\n");
+           " -z0 zipfile  Same as -z but do not compress archive entries\n"
+           " -gz          Compress each output file with gzip (.gz)\n");
+#endif
+
+#ifdef WITHZSTD
+  fprintf (stderr,
+           " -zst         Compress each output file with zstd (.zst)\n");
+#endif
+
+#if !defined(NOFDZIP) || defined(WITHZSTD)
+  fprintf (stderr,
+           " -cl level    Compression level, 1-9 for gzip, 1-19 for zstd\n");
 #endif
 
   fprintf (stderr,
            "\n"
 	   "A separate output file is written for each continuous input time-series\n"
 	   "with file names of the form:\n"
-	   "Net.Sta.Loc.Chan.Qual.YYYY-MM-DDTHHMMSS.FFFFFF.[txt | csv]\n"
+	   "Net.Sta.Loc.Chan.Qual.YYYY-MM-DDTHHMMSS.FFFFFF.[txt | csv | npy | bin | sac | arrow]\n"
 	   "\n");
 }  /* End of usage() */
@@ -0,0 +1,1007 @@
+/***************************************************************************
+ * msformat.c
+ *
+ * Routines to format samples as text for the sample list and
+ * time-sample pair output formats.
+ *
+ * A kernel is generated for each combination of sample type, integer,
+ * float or double, and output layout, one or multiple sample list
+ * columns and time-sample pairs with either header style.  Each kernel
+ * loop only formats samples of its type in its layout, the selection
+ * is done once per trace with msf_kernel().
+ *
+ * Integers are formatted with msf_int32(), two digits at a time from a
+ * table of digit pairs.  Floats use the C library %g formats, or with
+ * a number of decimals msf_fixed(), which uses the same digit
+ * formatting on the integer part and the scaled fraction.  Time
+ * stamps are formatted in full with ms_hptime2isotimestr() once per
+ * second, within a second only the microseconds are formatted.  All
+ * output is identical to the printf() formats previously used:
+ *
+ *   sample list:          "%d", "%.8g", "%.10g"
+ *   sample list columns:  "%-10d  ", "%-10.8g  ", "%-10.10g  "
+ *   time-sample pairs:    "TIME  VALUE", GeoCSV: "TIMEZ, VALUE"
+ *
+ * Time-sample pairs can also have the time as epoch seconds or seconds
+ * relative to the start time, with six decimals, without the Z in
+ * GeoCSV.  All time formats use the time of a sample computed from
+ * its index, as start time + (hptime_t)(index * period), so that they
+ * agree exactly and have no accumulated error.
+ *
+ * Kernels are also generated for fixed-point float and double samples,
+ * which are padded to the same column width, and for fixed-width
+ * output, where values are right-aligned in fields of a set width and
+ * times in fields as wide as the longest time of the trace.  A value
+ * too long for its field is replaced by '*' characters.  Sample list
+ * fields are separated by a space, or a newline at the end of a line.
+ * As the text of every sample then has the same length, the text of
+ * separate runs of samples can be written concurrently to known
+ * offsets of a file with msf_writefixed().
+ ***************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <float.h>
+
+#include "msformat.h"
+
+#if !defined(LMP_WIN32)
+#include <unistd.h>
+#include <pthread.h>
+#endif
+
+/* Size of the output buffer of a thread of msf_writefixed() */
+#define MSF_WRITESIZE 1048576
+
+#if !defined(LMP_WIN32)
+/* Range of samples formatted and written by a thread of msf_writefixed() */
+typedef struct MSFormatRange_s
+{
+  MSFormatKernel kernel;
+  MSFormatState state;      /* State at the first sample of the range */
+  const char *samples;      /* First sample of the range */
+  int64_t  count;           /* Number of samples in the range */
+  int      samplesize;
+  int      linelength;      /* Length of the text of each sample */
+  int      fd;
+  int64_t  offset;          /* File offset of the text of the range */
+  pthread_t thread;
+  int      started;         /* Flag: thread started */
+  int      retval;
+} MSFormatRange;
+
+static void *msf_writerange (void *arg);
+static int msf_pwrite (int fd, const void *buffer, size_t size, int64_t offset);
+#endif
+
+static const char digitpairs[201] =
+  "00010203040506070809"
+  "10111213141516171819"
+  "20212223242526272829"
+  "30313233343536373839"
+  "40414243444546474849"
+  "50515253545556575859"
+  "60616263646566676869"
+  "70717273747576777879"
+  "80818283848586878889"
+  "90919293949596979899";
+
+
+/***************************************************************************
+ * msf_digits:
+ *
+ * Write the decimal digits of an unsigned integer, two digits at a
+ * time from a table of digit pairs.
+ *
+ * Returns a pointer to the end of the written digits.
+ ***************************************************************************/
+static char *
+msf_digits (char *buffer, uint32_t value)
+{
+  char digits[10];
+  char *dp = digits + sizeof (digits);
+  uint32_t pair;
+
+  while (value >= 100)
+  {
+    pair = (value % 100) * 2;
+    value /= 100;
+    *--dp = digitpairs[pair + 1];
+    *--dp = digitpairs[pair];
+  }
+
+  if (value >= 10)
+  {
+    *--dp = digitpairs[value * 2 + 1];
+    *--dp = digitpairs[value * 2];
+  }
+  else
+  {
+    *--dp = (char)('0' + value);
+  }
+
+  memcpy (buffer, dp, (size_t)(digits + sizeof (digits) - dp));
+
+  return buffer + (digits + sizeof (digits) - dp);
+} /* End of msf_digits() */
+
+
+/***************************************************************************
+ * msf_fixeddigits:
+ *
+ * Write exactly count decimal digits of an unsigned integer less than
+ * 10^count, with leading zeros.
+ *
+ * Returns a pointer to the end of the written digits.
+ ***************************************************************************/
+static char *
+msf_fixeddigits (char *buffer, uint32_t value, int count)
+{
+  char *dp = buffer + count;
+  uint32_t pair;
+
+  while (dp - buffer >= 2)
+  {
+    pair = (value % 100) * 2;
+    value /= 100;
+    *--dp = digitpairs[pair + 1];
+    *--dp = digitpairs[pair];
+  }
+
+  if (dp > buffer)
+    *--dp = (char)('0' + value % 10);
+
+  return buffer + count;
+} /* End of msf_fixeddigits() */
+
+
+/***************************************************************************
+ * msf_digits64:
+ *
+ * Write the decimal digits of a 64-bit unsigned integer, in groups of
+ * 9 digits beyond 32 bits.
+ *
+ * Returns a pointer to the end of the written digits.
+ ***************************************************************************/
+static char *
+msf_digits64 (char *buffer, uint64_t value)
+{
+  if (value <= 0xFFFFFFFFu)
+    return msf_digits (buffer, (uint32_t)value);
+
+  buffer = msf_digits64 (buffer, value / 1000000000);
+
+  return msf_fixeddigits (buffer, (uint32_t)(value % 1000000000), 9);
+} /* End of msf_digits64() */
+
+
+/***************************************************************************
+ * msf_int32:
+ *
+ * Write the decimal digits of an integer, as printf() "%d", to a
+ * buffer with room for at least 11 characters.  The string is not
+ * terminated.
+ *
+ * Returns a pointer to the end of the written digits.
+ ***************************************************************************/
+char *
+msf_int32 (char *buffer, int32_t value)
+{
+  if (value < 0)
+  {
+    *buffer++ = '-';
+    return msf_digits (buffer, 0u - (uint32_t)value);
+  }
+
+  return msf_digits (buffer, (uint32_t)value);
+} /* End of msf_int32() */
+
+
+/***************************************************************************
+ * msf_product:
+ *
+ * Determine the rounding error of the product of two doubles, such
+ * that a * b == product + error exactly, by splitting the factors into
+ * halves whose products are exact (Dekker).  The product must not be
+ * near overflow.  The split products are volatile so that they are
+ * rounded and not contracted into fused multiply-adds.
+ *
+ * Returns the rounding error of the product.
+ ***************************************************************************/
+static double
+msf_product (double a, double b, double product)
+{
+  volatile double split;
+  double ahi, alo;
+  double bhi, blo;
+
+  split = 134217729.0 * a;  /* 2^27 + 1 */
+  ahi = split - (split - a);
+  alo = a - ahi;
+
+  split = 134217729.0 * b;
+  bhi = split - (split - b);
+  blo = b - bhi;
+
+  return ((ahi * bhi - product) + ahi * blo + alo * bhi) + alo * blo;
+} /* End of msf_product() */
+
+
+/***************************************************************************
+ * msf_fixed:
+ *
+ * Write a value in fixed-point notation with the specified number of
+ * decimals, 0 to MSF_MAXDIGITS, to a buffer with room for at least
+ * MSF_MAXFIXED characters.  The string is not terminated.
+ *
+ * The integer and fractional parts of the value are separated, both
+ * exactly.  The fraction is scaled by 10^digits and rounded once, half
+ * away from zero, using the rounding error of the scaling to decide
+ * values that are within rounding of a half.  The integer part is
+ * written with integer arithmetic up to 2^63 and as printf() "%.0f",
+ * which is exact for integers, beyond that.  Values that round to zero
+ * are written without a sign, infinities and NaN as "%.10g".
+ *
+ * Returns a pointer to the end of the written value.
+ ***************************************************************************/
+char *
+msf_fixed (char *buffer, double value, int digits)
+{
+  static const double scales[MSF_MAXDIGITS + 1] =
+    {1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9};
+  double magnitude = (value < 0) ? -value : value;
+  double integer;
+  double fraction;
+  double scaled;
+  uint64_t rounded;
+
+  if (!(magnitude <= DBL_MAX))
+    return buffer + snprintf (buffer, MSF_MAXFIXED, "%.10g", value);
+
+  /* Exact integer part, all doubles of 2^52 or more are integers */
+  if (magnitude < 4503599627370496.0)
+    integer = (double)(int64_t)magnitude;
+  else
+    integer = magnitude;
+
+  fraction = magnitude - integer;
+  scaled = fraction * scales[digits];
+
+  /* The scaled fraction is less than 2^30, its fraction is exact and a
+   * half is only crossed by the rounding error when exactly a half */
+  rounded = (uint64_t)(int64_t)scaled;
+  if (scaled - (double)rounded > 0.5 ||
+      (scaled - (double)rounded == 0.5 &&
+       msf_product (fraction, scales[digits], scaled) >= 0.0))
+    rounded++;
+
+  /* Carry into the integer part, exact as the fraction was not zero */
+  if (rounded >= (uint64_t)scales[digits])
+  {
+    rounded -= (uint64_t)scales[digits];
+    integer += 1.0;
+  }
+
+  if (value < 0 && (integer > 0.0 || rounded))
+    *buffer++ = '-';
+
+  if (integer < 9223372036854775808.0)
+    buffer = msf_digits64 (buffer, (uint64_t)(int64_t)integer);
+  else
+    buffer += snprintf (buffer, MSF_MAXFIXED, "%.0f", integer);
+
+  if (digits > 0)
+  {
+    *buffer++ = '.';
+    buffer = msf_fixeddigits (buffer, (uint32_t)rounded, digits);
+  }
+
+  return buffer;
+} /* End of msf_fixed() */
+
+
+/***************************************************************************
+ * msf_time:
+ *
+ * Write the time of the next sample of the state as an ISO time string
+ * with microseconds, as ms_hptime2isotimestr().  The date and time to
+ * the second are kept in the state and only formatted again when the
+ * second changes.
+ *
+ * Returns a pointer to the end of the written time.
+ ***************************************************************************/
+static char *
+msf_time (char *buffer, MSFormatState *state)
+{
+  hptime_t hptime = state->starttime + (hptime_t)(state->sample * state->hpperiod);
+  int64_t isec = MS_HPTIME2EPOCH (hptime);
+  int ifract = (int)(hptime - (isec * HPTMODULUS));
+
+  /* Adjust for negative epoch times */
+  if (hptime < 0 && ifract != 0)
+  {
+    isec -= 1;
+    ifract = HPTMODULUS - (-ifract);
+  }
+
+  if (isec != state->second || state->secondlength == 0)
+  {
+    if (ms_hptime2isotimestr ((hptime_t)isec * HPTMODULUS, state->secondstr, 0))
+      state->secondlength = (int)strlen (state->secondstr);
+    else
+      state->secondlength = 0;
+
+    state->second = isec;
+  }
+
+  memcpy (buffer, state->secondstr, state->secondlength);
+  buffer += state->secondlength;
+
+  *buffer++ = '.';
+
+  return msf_fixeddigits (buffer, (uint32_t)ifract, 6);
+} /* End of msf_time() */
+
+
+/***************************************************************************
+ * msf_seconds:
+ *
+ * Write a high precision time, or time difference, as seconds with
+ * six decimals using integer arithmetic.
+ *
+ * Returns a pointer to the end of the written seconds.
+ ***************************************************************************/
+char *
+msf_seconds (char *buffer, hptime_t hptime)
+{
+  uint64_t ticks = (uint64_t)hptime;
+  uint64_t seconds;
+
+  if (hptime < 0)
+  {
+    *buffer++ = '-';
+    ticks = 0u - ticks;
+  }
+
+  seconds = ticks / HPTMODULUS;
+
+  buffer = msf_digits64 (buffer, seconds);
+  *buffer++ = '.';
+
+  return msf_fixeddigits (buffer, (uint32_t)(ticks - seconds * HPTMODULUS), 6);
+} /* End of msf_seconds() */
+
+
+/* Time formatters of the next sample of the state as epoch seconds and
+ * as seconds relative to the start time */
+
+static char *
+msf_epoch (char *buffer, MSFormatState *state)
+{
+  return msf_seconds (buffer, state->starttime + (hptime_t)(state->sample * state->hpperiod));
+}
+
+static char *
+msf_relative (char *buffer, MSFormatState *state)
+{
+  return msf_seconds (buffer, (hptime_t)(state->sample * state->hpperiod));
+}
+
+
+/* Sample formatters, unpadded for the last column and padded to 10
+ * characters plus a two space separator otherwise.  The number of
+ * decimals is only used by the fixed-point formatters, the others have
+ * the same signature for the kernel templates. */
+
+static char *
+msf_emit_i (char *buffer, int32_t value, int digits)
+{
+  (void) digits;
+
+  return msf_int32 (buffer, value);
+}
+
+static char *
+msf_emit_f (char *buffer, float value, int digits)
+{
+  (void) digits;
+
+  return buffer + snprintf (buffer, MSF_MAXSAMPLE, "%.8g", value);
+}
+
+static char *
+msf_emit_d (char *buffer, double value, int digits)
+{
+  (void) digits;
+
+  return buffer + snprintf (buffer, MSF_MAXSAMPLE, "%.10g", value);
+}
+
+static char *
+msf_emit_xf (char *buffer, float value, int digits)
+{
+  return msf_fixed (buffer, value, digits);
+}
+
+static char *
+msf_emit_xd (char *buffer, double value, int digits)
+{
+  return msf_fixed (buffer, value, digits);
+}
+
+static char *
+msf_pad (char *buffer, char *end)
+{
+  while (end - buffer < 10)
+    *end++ = ' ';
+
+  *end++ = ' ';
+  *end++ = ' ';
+
+  return end;
+}
+
+static char *
+msf_emitpad_i (char *buffer, int32_t value, int digits)
+{
+  (void) digits;
+
+  return msf_pad (buffer, msf_int32 (buffer, value));
+}
+
+static char *
+msf_emitpad_f (char *buffer, float value, int digits)
+{
+  (void) digits;
+
+  return buffer + snprintf (buffer, MSF_MAXSAMPLE, "%-10.8g  ", value);
+}
+
+static char *
+msf_emitpad_d (char *buffer, double value, int digits)
+{
+  (void) digits;
+
+  return buffer + snprintf (buffer, MSF_MAXSAMPLE, "%-10.10g  ", value);
+}
+
+static char *
+msf_emitpad_xf (char *buffer, float value, int digits)
+{
+  return msf_pad (buffer, msf_fixed (buffer, value, digits));
+}
+
+static char *
+msf_emitpad_xd (char *buffer, double value, int digits)
+{
+  return msf_pad (buffer, msf_fixed (buffer, value, digits));
+}
+
+
+/***************************************************************************
+ * msf_field:
+ *
+ * Right-align the text from buffer to end in a field of width
+ * characters starting at buffer, or fill the field with '*' characters
+ * and count an overflow in the state if the text does not fit.
+ *
+ * Returns a pointer to the end of the field.
+ ***************************************************************************/
+static char *
+msf_field (char *buffer, char *end, int width, MSFormatState *state)
+{
+  int length = (int)(end - buffer);
+
+  if (length > width)
+  {
+    memset (buffer, '*', width);
+    state->overflows++;
+  }
+  else if (length < width)
+  {
+    memmove (buffer + (width - length), buffer, length);
+    memset (buffer, ' ', width - length);
+  }
+
+  return buffer + width;
+} /* End of msf_field() */
+
+
+/* Generate a time-sample pair kernel with a time formatter and the
+ * separator following the time */
+#define MSF_TSKERNEL(NAME, T, TYPE, TIME, SEPARATOR)                           \
+  static size_t                                                                \
+  NAME (char *buffer, const void *samples, int64_t count,                      \
+        MSFormatState *state)                                                  \
+  {                                                                            \
+    const TYPE *sample = (const TYPE *)samples;                                \
+    char *bp = buffer;                                                         \
+    int64_t idx;                                                               \
+                                                                               \
+    for (idx = 0; idx < count; idx++, state->sample++)                         \
+    {                                                                          \
+      bp = TIME (bp, state);                                                   \
+      memcpy (bp, SEPARATOR, sizeof (SEPARATOR) - 1);                          \
+      bp += sizeof (SEPARATOR) - 1;                                            \
+      bp = msf_emit_##T (bp, sample[idx], state->digits);                      \
+      *bp++ = '\n';                                                            \
+    }                                                                          \
+                                                                               \
+    return (size_t)(bp - buffer);                                              \
+  }
+
+/* Generate the kernels of a sample type for all output layouts */
+#define MSF_KERNELS(T, TYPE)                                                   \
+  static size_t                                                                \
+  msf_slist_##T (char *buffer, const void *samples, int64_t count,             \
+                 MSFormatState *state)                                         \
+  {                                                                            \
+    const TYPE *sample = (const TYPE *)samples;                                \
+    char *bp = buffer;                                                         \
+    int64_t idx;                                                               \
+                                                                               \
+    for (idx = 0; idx < count; idx++)                                          \
+    {                                                                          \
+      bp = msf_emit_##T (bp, sample[idx], state->digits);                      \
+      *bp++ = '\n';                                                            \
+    }                                                                          \
+                                                                               \
+    state->sample += count;                                                    \
+                                                                               \
+    return (size_t)(bp - buffer);                                              \
+  }                                                                            \
+                                                                               \
+  static size_t                                                                \
+  msf_slistcols_##T (char *buffer, const void *samples, int64_t count,         \
+                     MSFormatState *state)                                     \
+  {                                                                            \
+    const TYPE *sample = (const TYPE *)samples;                                \
+    char *bp = buffer;                                                         \
+    int64_t idx = 0;                                                           \
+    int64_t end;                                                               \
+                                                                               \
+    while (idx < count)                                                        \
+    {                                                                          \
+      /* Padded columns up to the last column of the line */                   \
+      end = idx + (state->columns - 1 - state->column);                        \
+      if (end > count)                                                         \
+        end = count;                                                           \
+                                                                               \
+      state->column += (int)(end - idx);                                       \
+                                                                               \
+      for (; idx < end; idx++)                                                 \
+        bp = msf_emitpad_##T (bp, sample[idx], state->digits);                 \
+                                                                               \
+      if (idx < count)                                                         \
+      {                                                                        \
+        bp = msf_emit_##T (bp, sample[idx++], state->digits);                  \
+        *bp++ = '\n';                                                          \
+        state->column = 0;                                                     \
+      }                                                                        \
+    }                                                                          \
+                                                                               \
+    state->sample += count;                                                    \
+                                                                               \
+    return (size_t)(bp - buffer);                                              \
+  }                                                                            \
+                                                                               \
+  MSF_TSKERNEL (msf_tspair_##T, T, TYPE, msf_time, "  ")                       \
+  MSF_TSKERNEL (msf_tspaircsv_##T, T, TYPE, msf_time, "Z, ")                   \
+  MSF_TSKERNEL (msf_tsepoch_##T, T, TYPE, msf_epoch, "  ")                     \
+  MSF_TSKERNEL (msf_tsepochcsv_##T, T, TYPE, msf_epoch, ", ")                  \
+  MSF_TSKERNEL (msf_tsrelative_##T, T, TYPE, msf_relative, "  ")               \
+  MSF_TSKERNEL (msf_tsrelativecsv_##T, T, TYPE, msf_relative, ", ")
+
+/* Generate a fixed-width time-sample pair kernel */
+#define MSF_FIXEDTSKERNEL(NAME, T, TYPE, TIME, SEPARATOR)                      \
+  static size_t                                                                \
+  NAME (char *buffer, const void *samples, int64_t count,                      \
+        MSFormatState *state)                                                  \
+  {                                                                            \
+    const TYPE *sample = (const TYPE *)samples;                                \
+    char *bp = buffer;                                                         \
+    int64_t idx;                                                               \
+                                                                               \
+    for (idx = 0; idx < count; idx++, state->sample++)                         \
+    {                                                                          \
+      bp = msf_field (bp, TIME (bp, state), state->timewidth, state);          \
+      memcpy (bp, SEPARATOR, sizeof (SEPARATOR) - 1);                          \
+      bp += sizeof (SEPARATOR) - 1;                                            \
+      bp = msf_field (bp, msf_emit_##T (bp, sample[idx], state->digits),       \
+                      state->width, state);                                    \
+      *bp++ = '\n';                                                            \
+    }                                                                          \
+                                                                               \
+    return (size_t)(bp - buffer);                                              \
+  }
+
+/* Generate the fixed-width kernels of a sample type, a sample list
+ * kernel for any number of columns and time-sample pair kernels */
+#define MSF_FIXEDKERNELS(T, TYPE)                                              \
+  static size_t                                                                \
+  msf_slistfixed_##T (char *buffer, const void *samples, int64_t count,        \
+                      MSFormatState *state)                                    \
+  {                                                                            \
+    const TYPE *sample = (const TYPE *)samples;                                \
+    char *bp = buffer;                                                         \
+    int64_t idx;                                                               \
+                                                                               \
+    for (idx = 0; idx < count; idx++)                                          \
+    {                                                                          \
+      bp = msf_field (bp, msf_emit_##T (bp, sample[idx], state->digits),       \
+                      state->width, state);                                    \
+                                                                               \
+      if (++state->column < state->columns)                                    \
+      {                                                                        \
+        *bp++ = ' ';                                                           \
+      }                                                                        \
+      else                                                                     \
+      {                                                                        \
+        *bp++ = '\n';                                                          \
+        state->column = 0;                                                     \
+      }                                                                        \
+    }                                                                          \
+                                                                               \
+    state->sample += count;                                                    \
+                                                                               \
+    return (size_t)(bp - buffer);                                              \
+  }                                                                            \
+                                                                               \
+  MSF_FIXEDTSKERNEL (msf_tspairfixed_##T, T, TYPE, msf_time, "  ")             \
+  MSF_FIXEDTSKERNEL (msf_tspaircsvfixed_##T, T, TYPE, msf_time, "Z, ")         \
+  MSF_FIXEDTSKERNEL (msf_tsepochfixed_##T, T, TYPE, msf_epoch, "  ")           \
+  MSF_FIXEDTSKERNEL (msf_tsepochcsvfixed_##T, T, TYPE, msf_epoch, ", ")        \
+  MSF_FIXEDTSKERNEL (msf_tsrelativefixed_##T, T, TYPE, msf_relative, "  ")     \
+  MSF_FIXEDTSKERNEL (msf_tsrelativecsvfixed_##T, T, TYPE, msf_relative, ", ")
+
+MSF_KERNELS (i, int32_t)
+MSF_KERNELS (f, float)
+MSF_KERNELS (d, double)
+MSF_KERNELS (xf, float)
+MSF_KERNELS (xd, double)
+
+MSF_FIXEDKERNELS (i, int32_t)
+MSF_FIXEDKERNELS (f, float)
+MSF_FIXEDKERNELS (d, double)
+MSF_FIXEDKERNELS (xf, float)
+MSF_FIXEDKERNELS (xd, double)
+
+/* Kernels by sample type, with float types in fixed-point notation
+ * last, and layout, followed by the fixed-width kernels by layout */
+#define MSF_LAYOUTS(T)                                                         \
+  {msf_slist_##T, msf_slistcols_##T, msf_tspair_##T, msf_tspaircsv_##T,        \
+   msf_tsepoch_##T, msf_tsepochcsv_##T, msf_tsrelative_##T,                    \
+   msf_tsrelativecsv_##T, msf_slistfixed_##T, msf_slistfixed_##T,              \
+   msf_tspairfixed_##T, msf_tspaircsvfixed_##T, msf_tsepochfixed_##T,          \
+   msf_tsepochcsvfixed_##T, msf_tsrelativefixed_##T,                           \
+   msf_tsrelativecsvfixed_##T}
+
+static const MSFormatKernel kernels[5][(MSF_TSRELATIVECSV + 1) * 2] = {
+  MSF_LAYOUTS (i),
+  MSF_LAYOUTS (f),
+  MSF_LAYOUTS (d),
+  MSF_LAYOUTS (xf),
+  MSF_LAYOUTS (xd),
+};
+
+
+/***************************************************************************
+ * msf_init:
+ *
+ * Initialize the formatting state for a trace written with the
+ * specified number of sample list columns, start time and sample rate.
+ * Float samples are written with the specified number of decimals in
+ * fixed-point notation, or with %g formats if digits is negative.
+ *
+ * If width is not negative values are written in fixed-width fields
+ * of width characters, 0 selecting the widest text of the sample type,
+ * and msf_fixedwidth() must be called before formatting samples.
+ ***************************************************************************/
+void
+msf_init (MSFormatState *state, int columns, int digits, int width,
+          hptime_t starttime, double samprate)
+{
+  state->columns = (columns > 0) ? columns : 1;
+  state->digits = (digits > MSF_MAXDIGITS) ? MSF_MAXDIGITS : digits;
+  state->column = 0;
+  state->starttime = starttime;
+  state->hpperiod = (samprate) ? (HPTMODULUS / samprate) : 0;
+  state->sample = 0;
+  state->second = 0;
+  state->secondlength = 0;
+  state->width = (width > MSF_MAXWIDTH) ? MSF_MAXWIDTH : width;
+  state->timewidth = 0;
+  state->overflows = 0;
+} /* End of msf_init() */
+
+
+/***************************************************************************
+ * msf_kernel:
+ *
+ * Select the formatting kernel for a sample type, 'i', 'f' or 'd', and
+ * an output layout with the number of decimals and field width of the
+ * state.  A sample list with a single column must use the MSF_SLIST
+ * layout, unless fixed-width.
+ *
+ * Returns the kernel or NULL if the sample type or layout is not
+ * supported.
+ ***************************************************************************/
+MSFormatKernel
+msf_kernel (MSFormatState *state, char sampletype, int layout)
+{
+  int type;
+
+  if (layout < MSF_SLIST || layout > MSF_TSRELATIVECSV)
+    return NULL;
+
+  switch (sampletype)
+  {
+  case 'i':
+    type = 0;
+    break;
+  case 'f':
+    type = 1;
+    break;
+  case 'd':
+    type = 2;
+    break;
+  default:
+    return NULL;
+  }
+
+  if (type > 0 && state->digits >= 0)
+    type += 2;
+
+  if (state->width >= 0)
+    layout += MSF_TSRELATIVECSV + 1;
+
+  return kernels[type][layout];
+} /* End of msf_kernel() */
+
+
+
+/***************************************************************************
+ * msf_fixedwidth:
+ *
+ * Set the field widths of the fixed-width output of count samples of a
+ * sample type in a layout, starting at the next sample of the state: a
+ * value width of 0 to the widest text of the sample type and the time
+ * width to the longest time of the first and last samples.
+ *
+ * Returns the length of the text of each sample, or -1 if the state is
+ * not fixed-width or the sample type or layout is not supported.
+ ***************************************************************************/
+int
+msf_fixedwidth (MSFormatState *state, char sampletype, int layout, int64_t count)
+{
+  static const int separators[MSF_TSRELATIVECSV + 1] = {0, 0, 2, 3, 2, 2, 2, 2};
+  MSFormatState times = *state;
+  char *(*timer) (char *, MSFormatState *);
+  char buffer[MSF_MAXSAMPLE];
+  int length;
+
+  if (state->width < 0 || layout < MSF_SLIST || layout > MSF_TSRELATIVECSV)
+    return -1;
+
+  /* Widest text: "%d" of INT32_MIN, "%.8g" and "%.10g" of negative
+   * values with three digit exponents, fixed-point of the negative
+   * maximum values with 39 and 309 integer digits */
+  if (state->width == 0)
+  {
+    switch (sampletype)
+    {
+    case 'i':
+      state->width = 11;
+      break;
+    case 'f':
+      state->width = (state->digits >= 0) ? 41 + state->digits : 14;
+      break;
+    case 'd':
+      state->width = (state->digits >= 0) ? 311 + state->digits : 17;
+      break;
+    default:
+      return -1;
+    }
+  }
+
+  if (layout <= MSF_SLISTCOLS)
+    return state->width + 1;
+
+  if (layout <= MSF_TSPAIRCSV)
+    timer = msf_time;
+  else if (layout <= MSF_TSEPOCHCSV)
+    timer = msf_epoch;
+  else
+    timer = msf_relative;
+
+  state->timewidth = (int)(timer (buffer, &times) - buffer);
+
+  if (count > 1)
+  {
+    times.sample = state->sample + count - 1;
+    times.secondlength = 0;
+
+    length = (int)(timer (buffer, &times) - buffer);
+
+    if (length > state->timewidth)
+      state->timewidth = length;
+  }
+
+  return state->timewidth + separators[layout] + state->width + 1;
+} /* End of msf_fixedwidth() */
+
+
+/***************************************************************************
+ * msf_writefixed:
+ *
+ * Write the text of count samples, formatted with a fixed-width kernel
+ * and linelength bytes per sample, to a file at offset.  The samples
+ * are split into up to the specified number of ranges of at least
+ * MSF_THREADSIZE bytes of text, each formatted and written at its own
+ * offset by a separate thread.  The state is advanced past the samples
+ * as by a single kernel call.
+ *
+ * Returns 0 on success and -1 on error.
+ ***************************************************************************/
+int
+msf_writefixed (int fd, int64_t offset, MSFormatKernel kernel,
+                MSFormatState *state, const void *samples, int64_t count,
+                int samplesize, int linelength, int threads)
+{
+#if defined(LMP_WIN32)
+  fprintf (stderr, "Parallel fixed-width output is not supported on this platform\n");
+  return -1;
+#else
+  MSFormatRange *ranges;
+  MSFormatRange *range;
+  int64_t start = 0;
+  int retval = 0;
+  int idx;
+
+  if (threads > count * linelength / MSF_THREADSIZE)
+    threads = (int)(count * linelength / MSF_THREADSIZE);
+
+  if (threads < 1)
+    threads = 1;
+
+  if ((ranges = (MSFormatRange *)calloc (threads, sizeof (MSFormatRange))) == NULL)
+  {
+    fprintf (stderr, "Cannot allocate memory for output ranges\n");
+    return -1;
+  }
+
+  for (idx = 0; idx < threads; idx++)
+  {
+    range = &ranges[idx];
+
+    range->kernel = kernel;
+    range->state = *state;
+    range->state.sample = state->sample + start;
+    range->state.column = (int)((state->column + start) % state->columns);
+    range->state.secondlength = 0;
+    range->state.overflows = 0;
+    range->samples = (const char *)samples + start * samplesize;
+    range->count = count / threads + ((idx < count % threads) ? 1 : 0);
+    range->samplesize = samplesize;
+    range->linelength = linelength;
+    range->fd = fd;
+    range->offset = offset + start * linelength;
+
+    start += range->count;
+  }
+
+  /* The first range is written by the calling thread, as are any
+   * ranges for which a thread cannot be started */
+  for (idx = 1; idx < threads; idx++)
+    ranges[idx].started = (pthread_create (&ranges[idx].thread, NULL,
+                                           msf_writerange, &ranges[idx]) == 0);
+
+  msf_writerange (&ranges[0]);
+
+  for (idx = 0; idx < threads; idx++)
+  {
+    range = &ranges[idx];
+
+    if (idx > 0)
+    {
+      if (range->started)
+        pthread_join (range->thread, NULL);
+      else
+        msf_writerange (range);
+    }
+
+    if (range->retval)
+      retval = -1;
+
+    state->overflows += range->state.overflows;
+  }
+
+  state->sample += count;
+  state->column = (int)((state->column + count) % state->columns);
+
+  free (ranges);
+
+  return retval;
+#endif
+} /* End of msf_writefixed() */
+
+
+#if !defined(LMP_WIN32)
+/***************************************************************************
+ * msf_writerange:
+ *
+ * Format the samples of a range in runs and write the text of each run
+ * at its offset, the thread routine of msf_writefixed().
+ *
+ * Returns NULL, the result is set in the range.
+ ***************************************************************************/
+static void *
+msf_writerange (void *arg)
+{
+  MSFormatRange *range = (MSFormatRange *)arg;
+  int64_t run = MSF_WRITESIZE / MSF_MAXSAMPLE;
+  int64_t done;
+  size_t length;
+  char *buffer;
+
+  if ((buffer = (char *)malloc (MSF_WRITESIZE)) == NULL)
+  {
+    fprintf (stderr, "Cannot allocate output buffer\n");
+    range->retval = -1;
+    return NULL;
+  }
+
+  for (done = 0; done < range->count; done += run)
+  {
+    if (run > range->count - done)
+      run = range->count - done;
+
+    length = range->kernel (buffer, range->samples + done * range->samplesize,
+                            run, &range->state);
+
+    if (msf_pwrite (range->fd, buffer, length, range->offset + done * range->linelength))
+    {
+      range->retval = -1;
+      break;
+    }
+  }
+
+  free (buffer);
+
+  return NULL;
+} /* End of msf_writerange() */
+
+
+/***************************************************************************
+ * msf_pwrite:
+ *
+ * Write a buffer to a file at offset, retrying partial writes.
+ *
+ * Returns 0 on success and -1 on error.
+ ***************************************************************************/
+static int
+msf_pwrite (int fd, const void *buffer, size_t size, int64_t offset)
+{
+  ssize_t written;
+
+  while (size > 0)
+  {
+    if ((written = pwrite (fd, buffer, size, (off_t)offset)) < 0)
+    {
+      if (errno == EINTR)
+        continue;
+
+      fprintf (stderr, "Error writing output file: %s\n", strerror (errno));
+      return -1;
+    }
+
+    buffer = (const char *)buffer + written;
+    size -= (size_t)written;
+    offset += written;
+  }
+
+  return 0;
+} /* End of msf_pwrite() */
+#endif
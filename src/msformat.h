@@ -0,0 +1,91 @@
+/***************************************************************************
+ * msformat.h
+ *
+ * Interface declarations for the sample text formatting routines in
+ * msformat.c
+ *
+ * A formatting kernel writes the text of a run of samples of one type
+ * in one output layout to a buffer.  Kernels are selected once per
+ * trace with msf_kernel() and called for successive runs of samples
+ * with a state initialized by msf_init().  The caller makes sure the
+ * buffer has room for MSF_MAXSAMPLE bytes per sample.
+ *
+ * With a field width set in the state the fixed-width kernels are
+ * selected, which write every sample as text of the same length,
+ * returned by msf_fixedwidth().  The text of a sample then starts at a
+ * known offset and msf_writefixed() can write runs of samples to a
+ * file in parallel.
+ ***************************************************************************/
+
+#ifndef MSFORMAT_H
+#define MSFORMAT_H 1
+
+#include <libmseed.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Maximum length of a value in fixed-point notation: sign, the 309
+ * integer digits of the largest double, point and MSF_MAXDIGITS */
+#define MSF_MAXFIXED 320
+
+/* Maximum length of the text of a sample in any layout */
+#define MSF_MAXSAMPLE 384
+
+/* Maximum number of decimals in fixed-point notation */
+#define MSF_MAXDIGITS 9
+
+/* Maximum width of a fixed-width value field */
+#define MSF_MAXWIDTH 26
+
+/* Minimum text written by each thread of msf_writefixed() */
+#define MSF_THREADSIZE 4194304
+
+/* Output layouts */
+#define MSF_SLIST      0    /* Sample list, one sample per line */
+#define MSF_SLISTCOLS  1    /* Sample list, multiple columns per line */
+#define MSF_TSPAIR     2    /* Time-sample pairs, simple ASCII header */
+#define MSF_TSPAIRCSV  3    /* Time-sample pairs, GeoCSV */
+#define MSF_TSEPOCH    4    /* Epoch second time-sample pairs, simple ASCII header */
+#define MSF_TSEPOCHCSV 5    /* Epoch second time-sample pairs, GeoCSV */
+#define MSF_TSRELATIVE 6    /* Relative second time-sample pairs, simple ASCII header */
+#define MSF_TSRELATIVECSV 7 /* Relative second time-sample pairs, GeoCSV */
+
+/* Position in the output of a trace, carried from run to run */
+typedef struct MSFormatState_s
+{
+  int      columns;         /* Number of sample list columns */
+  int      column;          /* Column of the next sample, starting at 0 */
+  int      digits;          /* Decimals of float samples, -1 for %g formats */
+  hptime_t starttime;       /* Time of the first sample */
+  double   hpperiod;        /* Sample period in high precision time ticks */
+  int64_t  sample;          /* Index of the next sample in the trace */
+  int64_t  second;          /* Epoch second of the time in secondstr */
+  char     secondstr[32];   /* Time string of the second, without fraction */
+  int      secondlength;    /* Length of secondstr, 0 if not set */
+  int      width;           /* Width of fixed-width value fields, -1 if not fixed */
+  int      timewidth;       /* Width of fixed-width time fields */
+  int64_t  overflows;       /* Number of values too long for the field width */
+} MSFormatState;
+
+typedef size_t (*MSFormatKernel) (char *buffer, const void *samples, int64_t count,
+                                  MSFormatState *state);
+
+extern void msf_init (MSFormatState *state, int columns, int digits, int width,
+                      hptime_t starttime, double samprate);
+extern MSFormatKernel msf_kernel (MSFormatState *state, char sampletype, int layout);
+extern int msf_fixedwidth (MSFormatState *state, char sampletype, int layout,
+                           int64_t count);
+extern int msf_writefixed (int fd, int64_t offset, MSFormatKernel kernel,
+                           MSFormatState *state, const void *samples, int64_t count,
+                           int samplesize, int linelength, int threads);
+extern char *msf_int32 (char *buffer, int32_t value);
+extern char *msf_fixed (char *buffer, double value, int digits);
+extern char *msf_seconds (char *buffer, hptime_t hptime);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* MSFORMAT_H */
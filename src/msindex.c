@@ -0,0 +1,605 @@
+/***************************************************************************
+ * msindex.c
+ *
+ * Routines to build, store and use miniSEED record indexes.
+ *
+ * An index allows repeated processing of the same (immutable) files
+ * without rescanning and re-detecting record boundaries.  Selections
+ * are answered from the index and only the needed byte ranges are
+ * read from the data file.
+ *
+ * Index file layout, all values in host byte order:
+ *
+ *   char[8]   signature, "MSINDEX" + version
+ *   uint32_t  byte order check value, 0x01020304
+ *   uint32_t  size of each entry in bytes
+ *   int64_t   size of indexed file in bytes
+ *   int64_t   modification time of indexed file in nanoseconds
+ *   int64_t   number of entries
+ *   MSIndexEntry[entries]
+ *
+ * An index with a different signature, byte order, entry size, file
+ * size or modification time is treated as stale and not used.
+ ***************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#include "msindex.h"
+
+#define MSINDEX_SIGNATURE "MSINDEX1"
+#define MSINDEX_BOCHECK   0x01020304
+
+/* Maximum number of bytes to read in a single coalesced range */
+#define MSINDEX_MAXREAD   4194304
+
+static int msi_filestat (const char *msfile, int64_t *size, int64_t *mtime);
+static uint64_t msi_pathhash (const char *path);
+
+
+/***************************************************************************
+ * msi_indexpath:
+ *
+ * Determine the index file name for a miniSEED file.  If indexdir is
+ * NULL the index is a sidecar file with MSINDEX_SUFFIX appended to
+ * the data file name.  Otherwise the index is placed in indexdir with
+ * a name composed of the base name of the data file and a hash of its
+ * full path, so that identically named files in different
+ * directories do not collide.
+ *
+ * Returns a pointer to path on success and NULL on error.
+ ***************************************************************************/
+char *
+msi_indexpath (const char *msfile, const char *indexdir,
+               char *path, size_t pathsize)
+{
+  char fullpath[4096];
+  const char *basename;
+  int printed;
+
+  if (!msfile || !path)
+    return NULL;
+
+  if (!indexdir)
+  {
+    printed = snprintf (path, pathsize, "%s%s", msfile, MSINDEX_SUFFIX);
+  }
+  else
+  {
+#if defined(LMP_WIN32)
+    if (!_fullpath (fullpath, msfile, sizeof (fullpath)))
+#else
+    if (!realpath (msfile, fullpath))
+#endif
+    {
+      fprintf (stderr, "Cannot determine full path of %s: %s\n",
+               msfile, strerror (errno));
+      return NULL;
+    }
+
+    if ((basename = strrchr (fullpath, '/')) || (basename = strrchr (fullpath, '\\')))
+      basename++;
+    else
+      basename = fullpath;
+
+    printed = snprintf (path, pathsize, "%s/%s.%016llx%s", indexdir, basename,
+                        (unsigned long long int)msi_pathhash (fullpath),
+                        MSINDEX_SUFFIX);
+  }
+
+  if (printed < 0 || (size_t)printed >= pathsize)
+  {
+    fprintf (stderr, "Index file name too long for %s\n", msfile);
+    return NULL;
+  }
+
+  return path;
+} /* End of msi_indexpath() */
+
+
+/***************************************************************************
+ * msi_build:
+ *
+ * Scan a miniSEED file and build an index of all data records.
+ * Sample data are not decoded.  Reading from stdin is not supported
+ * as the index would be useless.
+ *
+ * Returns a new MSIndex on success and NULL on error.
+ ***************************************************************************/
+MSIndex *
+msi_build (const char *msfile, int reclen, int verbose)
+{
+  MSFileParam *msfp = NULL;
+  MSRecord *msr = NULL;
+  MSIndex *index = NULL;
+  MSIndexEntry *entry;
+  int64_t maxentries = 0;
+  int64_t size, mtime;
+  off_t fpos;
+  int retcode;
+
+  if (!msfile)
+    return NULL;
+
+  if (!strcmp (msfile, "-"))
+  {
+    fprintf (stderr, "Cannot index standard input\n");
+    return NULL;
+  }
+
+  if (msi_filestat (msfile, &size, &mtime))
+    return NULL;
+
+  if ((index = (MSIndex *)calloc (1, sizeof (MSIndex))) == NULL ||
+      (index->filename = strdup (msfile)) == NULL)
+  {
+    fprintf (stderr, "Cannot allocate memory for index\n");
+    msi_free (&index);
+    return NULL;
+  }
+
+  index->filesize = size;
+  index->filemtime = mtime;
+
+  while ((retcode = ms_readmsr_r (&msfp, &msr, (char *)msfile, reclen, &fpos,
+                                  NULL, 1, 0, verbose - 1)) == MS_NOERROR)
+  {
+    /* Offsets in decompressed input cannot be used to read the file */
+    if (msfp->filter)
+    {
+      fprintf (stderr, "Cannot index compressed file: %s\n", msfile);
+      retcode = MS_GENERROR;
+      break;
+    }
+
+    if (index->entrycount >= maxentries)
+    {
+      maxentries = (maxentries) ? maxentries * 2 : 1024;
+
+      entry = (MSIndexEntry *)realloc (index->entries, (size_t)maxentries * sizeof (MSIndexEntry));
+
+      if (!entry)
+      {
+        fprintf (stderr, "Cannot allocate memory for index entries\n");
+        retcode = MS_GENERROR;
+        break;
+      }
+
+      index->entries = entry;
+    }
+
+    entry = &index->entries[index->entrycount];
+    memset (entry, 0, sizeof (MSIndexEntry));
+
+    entry->offset = fpos;
+    entry->starttime = msr->starttime;
+    entry->endtime = msr_endtime (msr);
+    entry->samprate = msr->samprate;
+    entry->reclen = msr->reclen;
+    entry->samplecnt = (int32_t)msr->samplecnt;
+    memcpy (entry->network, msr->network, sizeof (entry->network));
+    memcpy (entry->station, msr->station, sizeof (entry->station));
+    memcpy (entry->location, msr->location, sizeof (entry->location));
+    memcpy (entry->channel, msr->channel, sizeof (entry->channel));
+    entry->dataquality = msr->dataquality;
+    entry->encoding = msr->encoding;
+    entry->byteorder = msr->byteorder;
+
+    index->entrycount++;
+  }
+
+  /* Make sure everything is cleaned up */
+  ms_readmsr_r (&msfp, &msr, NULL, 0, NULL, NULL, 0, 0, 0);
+
+  if (retcode != MS_ENDOFFILE)
+  {
+    fprintf (stderr, "Error indexing %s: %s\n", msfile, ms_errorstr (retcode));
+    msi_free (&index);
+    return NULL;
+  }
+
+  /* Make sure the file did not change while it was being scanned */
+  if (msi_filestat (msfile, &size, &mtime) ||
+      size != index->filesize || mtime != index->filemtime)
+  {
+    fprintf (stderr, "File changed while being indexed: %s\n", msfile);
+    msi_free (&index);
+    return NULL;
+  }
+
+  if (verbose)
+    fprintf (stderr, "Indexed %lld records in %s\n",
+             (long long int)index->entrycount, msfile);
+
+  return index;
+} /* End of msi_build() */
+
+
+/***************************************************************************
+ * msi_write:
+ *
+ * Write an index to a file.  The index is first written to a
+ * temporary file which is then renamed to the final name so that
+ * concurrent readers never see a partial index.
+ *
+ * Returns 0 on success and -1 on error.
+ ***************************************************************************/
+int
+msi_write (MSIndex *index, const char *indexfile, int verbose)
+{
+  FILE *ifp;
+  char tmpfile[4096];
+  uint32_t bocheck = MSINDEX_BOCHECK;
+  uint32_t entrysize = sizeof (MSIndexEntry);
+  int failed = 0;
+
+  if (!index || !indexfile)
+    return -1;
+
+  snprintf (tmpfile, sizeof (tmpfile), "%s.tmp", indexfile);
+
+  if ((ifp = fopen (tmpfile, "wb")) == NULL)
+  {
+    fprintf (stderr, "Cannot open index file: %s (%s)\n",
+             tmpfile, strerror (errno));
+    return -1;
+  }
+
+  if (fwrite (MSINDEX_SIGNATURE, 8, 1, ifp) != 1 ||
+      fwrite (&bocheck, sizeof (bocheck), 1, ifp) != 1 ||
+      fwrite (&entrysize, sizeof (entrysize), 1, ifp) != 1 ||
+      fwrite (&index->filesize, sizeof (index->filesize), 1, ifp) != 1 ||
+      fwrite (&index->filemtime, sizeof (index->filemtime), 1, ifp) != 1 ||
+      fwrite (&index->entrycount, sizeof (index->entrycount), 1, ifp) != 1)
+    failed = 1;
+
+  if (!failed && index->entrycount > 0 &&
+      fwrite (index->entries, sizeof (MSIndexEntry), (size_t)index->entrycount, ifp) != (size_t)index->entrycount)
+    failed = 1;
+
+  if (fclose (ifp))
+    failed = 1;
+
+  if (failed)
+  {
+    fprintf (stderr, "Error writing index file: %s (%s)\n",
+             tmpfile, strerror (errno));
+    remove (tmpfile);
+    return -1;
+  }
+
+#if defined(LMP_WIN32)
+  remove (indexfile);
+#endif
+
+  if (rename (tmpfile, indexfile))
+  {
+    fprintf (stderr, "Cannot rename %s to %s (%s)\n",
+             tmpfile, indexfile, strerror (errno));
+    remove (tmpfile);
+    return -1;
+  }
+
+  if (verbose)
+    fprintf (stderr, "Wrote index file %s\n", indexfile);
+
+  return 0;
+} /* End of msi_write() */
+
+
+/***************************************************************************
+ * msi_read:
+ *
+ * Read the index for a miniSEED file from indexfile.  The index is
+ * only returned if it is current, i.e. the size and modification time
+ * recorded in the index match the data file.
+ *
+ * Returns a new MSIndex on success and NULL if the index does not
+ * exist, is stale or cannot be read.
+ ***************************************************************************/
+MSIndex *
+msi_read (const char *msfile, const char *indexfile, int verbose)
+{
+  FILE *ifp;
+  MSIndex *index = NULL;
+  char signature[8];
+  uint32_t bocheck = 0;
+  uint32_t entrysize = 0;
+  int64_t size, mtime;
+
+  if (!msfile || !indexfile)
+    return NULL;
+
+  if (msi_filestat (msfile, &size, &mtime))
+    return NULL;
+
+  if ((ifp = fopen (indexfile, "rb")) == NULL)
+  {
+    if (verbose > 1)
+      fprintf (stderr, "No index file %s\n", indexfile);
+    return NULL;
+  }
+
+  if ((index = (MSIndex *)calloc (1, sizeof (MSIndex))) == NULL ||
+      (index->filename = strdup (msfile)) == NULL)
+  {
+    fprintf (stderr, "Cannot allocate memory for index\n");
+    fclose (ifp);
+    msi_free (&index);
+    return NULL;
+  }
+
+  if (fread (signature, 8, 1, ifp) != 1 ||
+      fread (&bocheck, sizeof (bocheck), 1, ifp) != 1 ||
+      fread (&entrysize, sizeof (entrysize), 1, ifp) != 1 ||
+      fread (&index->filesize, sizeof (index->filesize), 1, ifp) != 1 ||
+      fread (&index->filemtime, sizeof (index->filemtime), 1, ifp) != 1 ||
+      fread (&index->entrycount, sizeof (index->entrycount), 1, ifp) != 1 ||
+      memcmp (signature, MSINDEX_SIGNATURE, 8) ||
+      bocheck != MSINDEX_BOCHECK ||
+      entrysize != sizeof (MSIndexEntry) ||
+      index->entrycount < 0)
+  {
+    if (verbose)
+      fprintf (stderr, "Ignoring unrecognized index file %s\n", indexfile);
+    fclose (ifp);
+    msi_free (&index);
+    return NULL;
+  }
+
+  if (index->filesize != size || index->filemtime != mtime)
+  {
+    if (verbose)
+      fprintf (stderr, "Ignoring stale index file %s\n", indexfile);
+    fclose (ifp);
+    msi_free (&index);
+    return NULL;
+  }
+
+  if (index->entrycount > 0)
+  {
+    if ((index->entries = (MSIndexEntry *)malloc ((size_t)index->entrycount * sizeof (MSIndexEntry))) == NULL)
+    {
+      fprintf (stderr, "Cannot allocate memory for index entries\n");
+      fclose (ifp);
+      msi_free (&index);
+      return NULL;
+    }
+
+    if (fread (index->entries, sizeof (MSIndexEntry), (size_t)index->entrycount, ifp) != (size_t)index->entrycount)
+    {
+      fprintf (stderr, "Short read of index file %s\n", indexfile);
+      fclose (ifp);
+      msi_free (&index);
+      return NULL;
+    }
+  }
+
+  fclose (ifp);
+
+  if (verbose)
+    fprintf (stderr, "Read index of %lld records from %s\n",
+             (long long int)index->entrycount, indexfile);
+
+  return index;
+} /* End of msi_read() */
+
+
+/***************************************************************************
+ * msi_readrecords:
+ *
+ * Read records described by an index that match the specified
+ * selections, or all records if selections is NULL.  Adjacent
+ * matching records are read from the data file with a single read,
+ * non-matching records are never read.  Each record is parsed, data
+ * samples are decoded if dataflag is true, and passed to
+ * record_handler() along with handlerdata.
+ *
+ * Returns the number of records read on success and -1 on error.
+ ***************************************************************************/
+int64_t
+msi_readrecords (MSIndex *index, Selections *selections,
+                 void (*record_handler) (MSRecord *, void *),
+                 void *handlerdata, flag dataflag, int verbose)
+{
+  FILE *fp;
+  MSRecord *msr = NULL;
+  MSIndexEntry *entry;
+  char srcname[50];
+  char *buffer = NULL;
+  size_t buffersize = 0;
+  size_t rangesize;
+  size_t bufferoffset;
+  int64_t idx, first, last;
+  int64_t count = 0;
+  int retcode;
+
+  if (!index || !record_handler)
+    return -1;
+
+  if ((fp = fopen (index->filename, "rb")) == NULL)
+  {
+    fprintf (stderr, "Cannot open file: %s (%s)\n",
+             index->filename, strerror (errno));
+    return -1;
+  }
+
+  for (idx = 0; idx < index->entrycount; idx++)
+  {
+    entry = &index->entries[idx];
+
+    if (selections)
+    {
+      snprintf (srcname, sizeof (srcname), "%s_%s_%s_%s_%c",
+                entry->network, entry->station, entry->location,
+                entry->channel, entry->dataquality);
+
+      if (!ms_matchselect (selections, srcname, entry->starttime,
+                           entry->endtime, NULL))
+        continue;
+    }
+
+    /* Coalesce following matching records that are contiguous in the file */
+    first = last = idx;
+    rangesize = entry->reclen;
+    while ((last + 1) < index->entrycount)
+    {
+      entry = &index->entries[last + 1];
+
+      if (entry->offset != (index->entries[last].offset + index->entries[last].reclen) ||
+          (rangesize + entry->reclen) > MSINDEX_MAXREAD)
+        break;
+
+      if (selections)
+      {
+        snprintf (srcname, sizeof (srcname), "%s_%s_%s_%s_%c",
+                  entry->network, entry->station, entry->location,
+                  entry->channel, entry->dataquality);
+
+        if (!ms_matchselect (selections, srcname, entry->starttime,
+                             entry->endtime, NULL))
+          break;
+      }
+
+      rangesize += entry->reclen;
+      last++;
+    }
+
+    if (rangesize > buffersize)
+    {
+      free (buffer);
+      if ((buffer = (char *)malloc (rangesize)) == NULL)
+      {
+        fprintf (stderr, "Cannot allocate read buffer of %lld bytes\n",
+                 (long long int)rangesize);
+        fclose (fp);
+        return -1;
+      }
+      buffersize = rangesize;
+    }
+
+    if (lmp_fseeko (fp, (off_t)index->entries[first].offset, SEEK_SET) ||
+        fread (buffer, rangesize, 1, fp) != 1)
+    {
+      fprintf (stderr, "Error reading %lld bytes at offset %lld of %s\n",
+               (long long int)rangesize, (long long int)index->entries[first].offset,
+               index->filename);
+      count = -1;
+      break;
+    }
+
+    if (verbose > 1)
+      fprintf (stderr, "Read %lld bytes (%lld records) at offset %lld\n",
+               (long long int)rangesize, (long long int)(last - first + 1),
+               (long long int)index->entries[first].offset);
+
+    for (bufferoffset = 0; first <= last; first++)
+    {
+      entry = &index->entries[first];
+
+      retcode = msr_parse (buffer + bufferoffset, entry->reclen, &msr,
+                           entry->reclen, dataflag, verbose - 1);
+
+      if (retcode != MS_NOERROR)
+      {
+        fprintf (stderr, "Error parsing record at offset %lld of %s: %s\n",
+                 (long long int)entry->offset, index->filename, ms_errorstr (retcode));
+        count = -1;
+        break;
+      }
+
+      record_handler (msr, handlerdata);
+      bufferoffset += entry->reclen;
+      count++;
+    }
+
+    if (count < 0)
+      break;
+
+    idx = last;
+  }
+
+  msr_free (&msr);
+  free (buffer);
+  fclose (fp);
+
+  return count;
+} /* End of msi_readrecords() */
+
+
+/***************************************************************************
+ * msi_free:
+ *
+ * Free all memory associated with an index and set the pointer to NULL.
+ ***************************************************************************/
+void
+msi_free (MSIndex **ppindex)
+{
+  if (!ppindex || !*ppindex)
+    return;
+
+  free ((*ppindex)->filename);
+  free ((*ppindex)->entries);
+  free (*ppindex);
+
+  *ppindex = NULL;
+} /* End of msi_free() */
+
+
+/***************************************************************************
+ * msi_filestat:
+ *
+ * Determine the size and modification time of a file.
+ *
+ * Returns 0 on success and -1 on error.
+ ***************************************************************************/
+static int
+msi_filestat (const char *msfile, int64_t *size, int64_t *mtime)
+{
+  struct stat sb;
+
+  if (stat (msfile, &sb))
+  {
+    fprintf (stderr, "Cannot stat %s: %s\n", msfile, strerror (errno));
+    return -1;
+  }
+
+  *size = (int64_t)sb.st_size;
+
+  /* Modification time in nanoseconds where the platform provides it */
+#if defined(LMP_GLIBC2)
+  *mtime = (int64_t)sb.st_mtim.tv_sec * 1000000000 + sb.st_mtim.tv_nsec;
+#elif defined(__APPLE__)
+  *mtime = (int64_t)sb.st_mtimespec.tv_sec * 1000000000 + sb.st_mtimespec.tv_nsec;
+#else
+  *mtime = (int64_t)sb.st_mtime * 1000000000;
+#endif
+
+  return 0;
+} /* End of msi_filestat() */
+
+
+/***************************************************************************
+ * msi_pathhash:
+ *
+ * Calculate a 64-bit FNV-1a hash of a path string.
+ *
+ * Returns hash value.
+ ***************************************************************************/
+static uint64_t
+msi_pathhash (const char *path)
+{
+  uint64_t hash = 14695981039346656037ULL;
+
+  while (*path)
+  {
+    hash ^= (uint8_t)*path++;
+    hash *= 1099511628211ULL;
+  }
+
+  return hash;
+} /* End of msi_pathhash() */
@@ -0,0 +1,69 @@
+/***************************************************************************
+ * msindex.h
+ *
+ * Interface declarations for the miniSEED record index routines in
+ * msindex.c
+ *
+ * A record index is a binary file describing each record in a
+ * miniSEED file: byte offset, record length, source name, time range,
+ * sample count, sample rate and encoding.  An index is tied to the
+ * size and modification time of the file it describes and is
+ * considered stale when either changes.
+ ***************************************************************************/
+
+#ifndef MSINDEX_H
+#define MSINDEX_H 1
+
+#include <libmseed.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Default suffix for sidecar index files */
+#define MSINDEX_SUFFIX ".msidx"
+
+/* Index entry for a single record, layout is written directly to index files */
+typedef struct MSIndexEntry_s
+{
+  int64_t  offset;          /* Byte offset of record in file */
+  hptime_t starttime;       /* Time of first sample */
+  hptime_t endtime;         /* Time of last sample */
+  double   samprate;        /* Nominal sample rate (Hz) */
+  int32_t  reclen;          /* Record length in bytes */
+  int32_t  samplecnt;       /* Number of samples in record */
+  char     network[11];     /* Network designation, NULL terminated */
+  char     station[11];     /* Station designation, NULL terminated */
+  char     location[11];    /* Location designation, NULL terminated */
+  char     channel[11];     /* Channel designation, NULL terminated */
+  char     dataquality;     /* Data quality indicator */
+  int8_t   encoding;        /* Data encoding format */
+  int8_t   byteorder;       /* Original/Final byte order of record */
+  char     reserved;
+} MSIndexEntry;
+
+/* Record index for a single file */
+typedef struct MSIndex_s
+{
+  char    *filename;        /* Name of the indexed file */
+  int64_t  filesize;        /* Size of the indexed file in bytes */
+  int64_t  filemtime;       /* Modification time of the indexed file, nanoseconds */
+  int64_t  entrycount;      /* Number of entries */
+  MSIndexEntry *entries;    /* Array of entries in file order */
+} MSIndex;
+
+extern char    *msi_indexpath (const char *msfile, const char *indexdir,
+                               char *path, size_t pathsize);
+extern MSIndex *msi_build (const char *msfile, int reclen, int verbose);
+extern int      msi_write (MSIndex *index, const char *indexfile, int verbose);
+extern MSIndex *msi_read (const char *msfile, const char *indexfile, int verbose);
+extern int64_t  msi_readrecords (MSIndex *index, Selections *selections,
+                                 void (*record_handler) (MSRecord *, void *),
+                                 void *handlerdata, flag dataflag, int verbose);
+extern void     msi_free (MSIndex **ppindex);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* MSINDEX_H */
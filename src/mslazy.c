@@ -0,0 +1,361 @@
+/***************************************************************************
+ * mslazy.c
+ *
+ * Routines to hold the raw records of trace segments and decode them
+ * while writing.
+ *
+ * Records read without decoding their data samples are added to a
+ * MSTraceList as usual, tracking the coverage of each segment, and a
+ * copy of each record is kept with the segment it was added to.
+ * Records are appended or, when added to the beginning of a segment,
+ * prepended so that they are always in time order.  The record buffer
+ * has room at both ends to make either operation cheap.
+ *
+ * The header and record buffer of a segment are a single allocation
+ * so that the MSTraceList can free them with the segment.
+ ***************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "mslazy.h"
+
+/* Size of an entry for a record of the specified length */
+#define MSLAZY_ENTRYSIZE(reclen) (8 + (((int64_t)(reclen) + 7) & ~(int64_t)7))
+
+/* Start of the record buffer following the header */
+#define MSLAZY_BUFFER(lazy) ((char *)(lazy) + sizeof (MSLazySeg))
+
+static MSLazySeg *msl_reserve (MSTraceSeg *seg, int64_t need, int front);
+
+
+/***************************************************************************
+ * msl_sampletype:
+ *
+ * Determine the type of samples decoded from a data encoding, as
+ * msr_unpack() sets it when decoding.
+ *
+ * Returns the sample type or 0 if the encoding cannot be decoded.
+ ***************************************************************************/
+char
+msl_sampletype (int8_t encoding)
+{
+  switch (encoding)
+  {
+  case DE_ASCII:
+    return 'a';
+  case DE_INT16:
+  case DE_INT32:
+  case DE_STEIM1:
+  case DE_STEIM2:
+  case DE_CDSN:
+  case DE_SRO:
+  case DE_DWWSSN:
+    return 'i';
+  case DE_FLOAT32:
+  case DE_GEOSCOPE24:
+  case DE_GEOSCOPE163:
+  case DE_GEOSCOPE164:
+    return 'f';
+  case DE_FLOAT64:
+    return 'd';
+  }
+
+  return 0;
+} /* End of msl_sampletype() */
+
+
+/***************************************************************************
+ * msl_addrecord:
+ *
+ * Keep a copy of a record that was added to a trace segment with
+ * mstl_addmsr().  A record that starts at the start time of a segment
+ * already holding records was added to the beginning and is prepended,
+ * otherwise it is appended.
+ *
+ * Returns 0 on success and -1 on error.
+ ***************************************************************************/
+int
+msl_addrecord (MSTraceSeg *seg, MSRecord *msr)
+{
+  MSLazySeg *lazy;
+  int64_t entrysize;
+  int32_t header[2];
+  char *entry;
+  int front;
+
+  if (!seg || !msr || !msr->record || msr->reclen <= 0)
+    return -1;
+
+  lazy = (MSLazySeg *)seg->prvtptr;
+  front = (lazy && lazy->count > 0 && msr->starttime == seg->starttime);
+
+  entrysize = MSLAZY_ENTRYSIZE (msr->reclen);
+
+  if ((lazy = msl_reserve (seg, entrysize, front)) == NULL)
+  {
+    fprintf (stderr, "Cannot allocate memory for raw records\n");
+    return -1;
+  }
+
+  if (front)
+  {
+    lazy->head -= entrysize;
+    entry = MSLAZY_BUFFER (lazy) + lazy->head;
+  }
+  else
+  {
+    entry = MSLAZY_BUFFER (lazy) + lazy->tail;
+    lazy->tail += entrysize;
+  }
+
+  header[0] = msr->reclen;
+  header[1] = (int32_t)msr->samplecnt;
+  memcpy (entry, header, sizeof (header));
+  memcpy (entry + 8, msr->record, (size_t)msr->reclen);
+
+  lazy->count++;
+
+  return 0;
+} /* End of msl_addrecord() */
+
+
+/***************************************************************************
+ * msl_nextblock:
+ *
+ * Decode the next block of samples of a segment.  Position is an
+ * offset into the record buffer, starting at 0 for a new segment, and
+ * is advanced past each record as it is parsed.
+ *
+ * A block is the samples of one data frame for Steim records, decoded
+ * into the reader block, and the samples of a whole record otherwise,
+ * decoded into the reader MSRecord.  The samples and their type are
+ * valid until the next call.
+ *
+ * The samples of a record that cannot be decoded, or that are not of
+ * the segment sample type, are replaced by zero samples (spaces for
+ * ASCII) returned in blocks with the reader gap flag set, so that the
+ * following samples keep their position in the segment.
+ *
+ * Returns the number of samples in the block, 0 when all records have
+ * been decoded and -1 on error.
+ ***************************************************************************/
+int64_t
+msl_nextblock (MSTraceSeg *seg, int64_t *position, MSLazyReader *reader,
+               void **samples, char *sampletype, int verbose)
+{
+  MSLazySeg *lazy;
+  int32_t header[2];
+  int32_t reclen;
+  int64_t samplecnt;
+  char *entry;
+  int samplesize;
+  int retcode;
+  int count;
+
+  if (!seg || !position || !reader || !samples || !sampletype)
+    return -1;
+
+  if (*position == 0)
+  {
+    reader->framing = 0;
+    reader->fill = 0;
+  }
+
+  reader->gap = 0;
+
+  for (;;)
+  {
+    /* Fill for the samples of a failed record */
+    if (reader->fill > 0)
+    {
+      samplesize = ms_samplesize (seg->sampletype);
+      count = (int)sizeof (reader->block) / samplesize;
+
+      if (count > reader->fill)
+        count = (int)reader->fill;
+
+      memset (reader->block, (seg->sampletype == 'a') ? ' ' : 0, (size_t)count * samplesize);
+      reader->fill -= count;
+      reader->gap = 1;
+
+      *samples = reader->block;
+      *sampletype = seg->sampletype;
+      return count;
+    }
+
+    /* Next frame of the current Steim record */
+    if (reader->framing)
+    {
+      if ((count = msr_decode_steimframe (&reader->steim, reader->block)) > 0)
+      {
+        *samples = reader->block;
+        *sampletype = 'i';
+        return count;
+      }
+
+      reader->framing = 0;
+
+      if (count < 0)
+      {
+        reader->fill = reader->steim.samplecount;
+        fprintf (stderr, "Error decoding record, filling %lld samples\n",
+                 (long long int)reader->fill);
+      }
+
+      continue;
+    }
+
+    if ((lazy = (MSLazySeg *)seg->prvtptr) == NULL ||
+        *position >= lazy->tail - lazy->head)
+      return 0;
+
+    entry = MSLAZY_BUFFER (lazy) + lazy->head + *position;
+    memcpy (header, entry, sizeof (header));
+    reclen = header[0];
+    samplecnt = header[1];
+
+    *position += MSLAZY_ENTRYSIZE (reclen);
+
+    if ((retcode = msr_parse (entry + 8, reclen, &reader->msr, reclen, 0, verbose)) != MS_NOERROR)
+    {
+      reader->fill = samplecnt;
+      fprintf (stderr, "Error decoding record: %s, filling %lld samples\n",
+               ms_errorstr (retcode), (long long int)reader->fill);
+      continue;
+    }
+
+    if (msl_sampletype (reader->msr->encoding) != seg->sampletype)
+    {
+      reader->fill = samplecnt;
+      fprintf (stderr, "Record with sample type '%c' in trace of type '%c', filling %lld samples\n",
+               msl_sampletype (reader->msr->encoding), seg->sampletype,
+               (long long int)reader->fill);
+      continue;
+    }
+
+    if (reader->msr->encoding == DE_STEIM1 || reader->msr->encoding == DE_STEIM2)
+    {
+      if ((retcode = msr_steimframes (reader->msr, &reader->steim)) != MS_NOERROR)
+      {
+        reader->fill = samplecnt;
+        fprintf (stderr, "Error decoding record: %s, filling %lld samples\n",
+                 ms_errorstr (retcode), (long long int)reader->fill);
+        continue;
+      }
+
+      reader->framing = 1;
+      continue;
+    }
+
+    /* Other encodings are decoded a record at a time */
+    if ((retcode = msr_parse (entry + 8, reclen, &reader->msr, reclen, 1, verbose)) != MS_NOERROR)
+    {
+      reader->fill = samplecnt;
+      fprintf (stderr, "Error decoding record: %s, filling %lld samples\n",
+               ms_errorstr (retcode), (long long int)reader->fill);
+      continue;
+    }
+
+    *samples = reader->msr->datasamples;
+    *sampletype = reader->msr->sampletype;
+
+    return reader->msr->numsamples;
+  }
+} /* End of msl_nextblock() */
+
+
+/***************************************************************************
+ * msl_freereader:
+ *
+ * Free the record held by a reader.
+ ***************************************************************************/
+void
+msl_freereader (MSLazyReader *reader)
+{
+  if (reader && reader->msr)
+    msr_free (&reader->msr);
+
+  if (reader)
+  {
+    reader->framing = 0;
+    reader->fill = 0;
+    reader->gap = 0;
+  }
+} /* End of msl_freereader() */
+
+
+/***************************************************************************
+ * msl_reserve:
+ *
+ * Make room for need bytes at the front or end of the record buffer
+ * of a segment, allocating the header and buffer if needed.  If there
+ * is enough room at the other end the entries are centered, otherwise
+ * the buffer is doubled and the entries are placed to leave the new
+ * room where it is needed.  The segment prvtptr is updated.
+ *
+ * Returns the header of the segment records on success and NULL on
+ * error.
+ ***************************************************************************/
+static MSLazySeg *
+msl_reserve (MSTraceSeg *seg, int64_t need, int front)
+{
+  MSLazySeg *lazy = (MSLazySeg *)seg->prvtptr;
+  int64_t used;
+  int64_t size;
+  int64_t head;
+
+  if (lazy)
+  {
+    if ((front && lazy->head >= need) ||
+        (!front && lazy->size - lazy->tail >= need))
+      return lazy;
+
+    used = lazy->tail - lazy->head;
+    size = lazy->size;
+  }
+  else
+  {
+    used = 0;
+    size = 0;
+  }
+
+  /* Center entries in the existing buffer, leaving room where needed */
+  if (lazy && size - used >= need)
+  {
+    head = (size - used - need) / 2;
+    head -= head % 8;
+
+    if (front)
+      head += need;
+  }
+  else
+  {
+    size = (size * 2 > used + need) ? size * 2 : used + need;
+
+    if ((lazy = (MSLazySeg *)realloc (lazy, sizeof (MSLazySeg) + (size_t)size)) == NULL)
+      return NULL;
+
+    if (!seg->prvtptr)
+    {
+      lazy->head = 0;
+      lazy->tail = 0;
+      lazy->count = 0;
+    }
+
+    lazy->size = size;
+    seg->prvtptr = lazy;
+
+    head = (front) ? size - used : 0;
+  }
+
+  if (head != lazy->head)
+  {
+    memmove (MSLAZY_BUFFER (lazy) + head, MSLAZY_BUFFER (lazy) + lazy->head, (size_t)used);
+    lazy->tail = head + used;
+    lazy->head = head;
+  }
+
+  return lazy;
+} /* End of msl_reserve() */
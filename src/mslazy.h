@@ -0,0 +1,55 @@
+/***************************************************************************
+ * mslazy.h
+ *
+ * Interface declarations for the lazy decoding routines in mslazy.c
+ *
+ * Instead of decoded samples, trace segments hold copies of the raw
+ * records added to them, in time order.  The records are decoded one
+ * at a time while the segment is written, so only the compressed data
+ * and a single record of samples are held in memory.
+ ***************************************************************************/
+
+#ifndef MSLAZY_H
+#define MSLAZY_H 1
+
+#include <libmseed.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Raw records of a trace segment, stored at the MSTraceSeg prvtptr.
+ * The record buffer follows this header in the same allocation, each
+ * entry is the record length and the number of samples, as 32-bit
+ * integers, followed by the record padded to 8 bytes. */
+typedef struct MSLazySeg_s
+{
+  int64_t  head;            /* Offset of first entry in record buffer */
+  int64_t  tail;            /* Offset after last entry in record buffer */
+  int64_t  size;            /* Size of record buffer in bytes */
+  int64_t  count;           /* Number of records */
+} MSLazySeg;
+
+/* State for decoding the records of a trace segment block by block */
+typedef struct MSLazyReader_s
+{
+  MSRecord      *msr;       /* Record being decoded */
+  MSSteimFrames  steim;     /* Frame decoding state of a Steim record */
+  int            framing;   /* Decoding the Steim frames of msr */
+  int64_t        fill;      /* Samples of a failed record still to fill */
+  int            gap;       /* Last block is fill, not decoded samples */
+  int32_t        block[MS_STEIMFRAMESAMPLES]; /* Samples of one frame */
+} MSLazyReader;
+
+extern char     msl_sampletype (int8_t encoding);
+extern int      msl_addrecord (MSTraceSeg *seg, MSRecord *msr);
+extern int64_t  msl_nextblock (MSTraceSeg *seg, int64_t *position,
+                               MSLazyReader *reader, void **samples,
+                               char *sampletype, int verbose);
+extern void     msl_freereader (MSLazyReader *reader);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* MSLAZY_H */
@@ -0,0 +1,1068 @@
+/***************************************************************************
+ * mssort.c
+ *
+ * Routines to read miniSEED records in source name and time order
+ * regardless of the order of the records in the input files.
+ *
+ * Input files are first scanned without decoding the data and a
+ * compact key is collected for each record.  Keys are sorted in runs
+ * of a size limited by a memory budget, full runs are spilled to
+ * temporary files.  Finally the runs are merged and the records are
+ * read from the input files in sorted order.
+ *
+ * Records from standard input and compressed files, for which file
+ * offsets cannot be used to read a record again, are copied to a
+ * temporary spool file while scanning.
+ *
+ * Temporary files are removed from the file system as soon as they
+ * are created and disappear when closed.
+ ***************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+#include "mssort.h"
+
+#if !defined(LMP_WIN32)
+#include <unistd.h>
+#endif
+
+/* Number of keys read at a time from each run while merging */
+#define MSSORT_RUNBUFFER 2048
+
+/* Maximum number of input files kept open while reading records */
+#define MSSORT_MAXOPEN 64
+
+/* Initial number of source name hash buckets, must be a power of 2 */
+#define MSSORT_HASHSIZE 256
+
+/* Merge cursor for a run of sorted keys */
+typedef struct MSSortCursor_s
+{
+  FILE      *fp;            /* Run file */
+  int64_t    remaining;     /* Keys remaining in run file */
+  MSSortKey *keys;          /* Buffer of keys read from run */
+  int        count;         /* Number of keys in buffer */
+  int        next;          /* Next key in buffer */
+} MSSortCursor;
+
+/* Open input file for reading records */
+typedef struct MSSortInput_s
+{
+  int32_t fileid;           /* File ID, -1 if unused */
+  FILE   *fp;               /* Open file */
+  int64_t filepos;          /* Current position of the file */
+} MSSortInput;
+
+/* Source name and ID pair for ranking source names */
+typedef struct MSSortName_s
+{
+  char   *srcname;
+  int32_t srcid;
+} MSSortName;
+
+static int32_t mss_srcid (MSSort *sort, const char *srcname);
+static int32_t mss_fileid (MSSort *sort, const char *filename);
+static int mss_addkey (MSSort *sort, int32_t srcid, int32_t fileid,
+                       hptime_t starttime, int64_t offset, int32_t reclen);
+static int mss_spill (MSSort *sort);
+static int mss_rank (MSSort *sort);
+static FILE *mss_tmpfile (MSSort *sort);
+static int mss_namecmp (const void *a, const void *b);
+static int mss_keycmp (const void *a, const void *b);
+static int mss_cursorfill (MSSortCursor *cursor);
+static int mss_cursorcmp (MSSort *sort, MSSortCursor *a, MSSortCursor *b);
+static void mss_siftdown (MSSort *sort, MSSortCursor **heap, int count, int idx);
+static int mss_readrecord (MSSort *sort, MSSortKey *key, MSSortInput *inputs,
+                           int *evict, char *buffer, flag dataflag,
+                           MSRecord **ppmsr);
+static uint32_t mss_hash (const char *srcname);
+
+
+/***************************************************************************
+ * mss_init:
+ *
+ * Initialize external sort state.  Temporary files are created in
+ * tmpdir, or the system default location if tmpdir is NULL.  The
+ * memory budget limits the keys held in memory before a sorted run is
+ * spilled to a temporary file.
+ *
+ * Returns a new MSSort on success and NULL on error.
+ ***************************************************************************/
+MSSort *
+mss_init (const char *tmpdir, int64_t memory, int verbose)
+{
+  MSSort *sort;
+
+  if ((sort = (MSSort *)calloc (1, sizeof (MSSort))) == NULL)
+  {
+    fprintf (stderr, "Cannot allocate memory for sort\n");
+    return NULL;
+  }
+
+  if (tmpdir && (sort->tmpdir = strdup (tmpdir)) == NULL)
+  {
+    fprintf (stderr, "Cannot allocate memory for sort\n");
+    free (sort);
+    return NULL;
+  }
+
+  sort->keymax = memory / (int64_t)sizeof (MSSortKey);
+  if (sort->keymax < MSSORT_RUNBUFFER)
+    sort->keymax = MSSORT_RUNBUFFER;
+
+  sort->spoolid = -1;
+  sort->verbose = verbose;
+
+  return sort;
+} /* End of mss_init() */
+
+
+/***************************************************************************
+ * mss_addfile:
+ *
+ * Scan a miniSEED file and add a sort key for each data record
+ * matching the selections, or all data records if selections is NULL.
+ * Sample data are not decoded.  Records from standard input ("-") or
+ * read through an input filter are copied to the spool file.
+ *
+ * Returns 0 on success and -1 on error.
+ ***************************************************************************/
+int
+mss_addfile (MSSort *sort, const char *msfile, int reclen, Selections *selections)
+{
+  MSFileParam *msfp = NULL;
+  MSRecord *msr = NULL;
+  char srcname[50];
+  off_t fpos = 0;
+  int64_t offset;
+  int32_t fileid = -1;
+  int32_t srcid;
+  int retcode;
+  int spool;
+
+  if (!sort || !msfile)
+    return -1;
+
+  spool = (strcmp (msfile, "-") == 0);
+
+  while ((retcode = ms_readmsr_main (&msfp, &msr, msfile, reclen, &fpos, NULL,
+                                     1, 0, selections, sort->verbose - 1)) == MS_NOERROR)
+  {
+    if (selections && !msr_matchselect (selections, msr, NULL))
+      continue;
+
+    /* Offsets in decompressed input cannot be used to read the file */
+    if (msfp->filter)
+      spool = 1;
+
+    if (spool)
+    {
+      if (!sort->spool)
+      {
+        if ((sort->spool = mss_tmpfile (sort)) == NULL ||
+            (sort->spoolid = mss_fileid (sort, "spool")) < 0)
+        {
+          retcode = MS_GENERROR;
+          break;
+        }
+      }
+
+      if (fwrite (msr->record, msr->reclen, 1, sort->spool) != 1)
+      {
+        fprintf (stderr, "Error writing to spool file: %s\n", strerror (errno));
+        retcode = MS_GENERROR;
+        break;
+      }
+
+      fileid = sort->spoolid;
+      offset = sort->spoolsize;
+      sort->spoolsize += msr->reclen;
+    }
+    else
+    {
+      if (fileid < 0 && (fileid = mss_fileid (sort, msfile)) < 0)
+      {
+        retcode = MS_GENERROR;
+        break;
+      }
+
+      offset = (int64_t)fpos;
+    }
+
+    msr_srcname (msr, srcname, 1);
+
+    if ((srcid = mss_srcid (sort, srcname)) < 0 ||
+        mss_addkey (sort, srcid, fileid, msr->starttime, offset, msr->reclen))
+    {
+      retcode = MS_GENERROR;
+      break;
+    }
+  }
+
+  /* Make sure everything is cleaned up */
+  ms_readmsr_main (&msfp, &msr, NULL, 0, NULL, NULL, 0, 0, NULL, 0);
+
+  if (retcode != MS_ENDOFFILE)
+  {
+    fprintf (stderr, "Error reading %s: %s\n", msfile, ms_errorstr (retcode));
+    return -1;
+  }
+
+  return 0;
+} /* End of mss_addfile() */
+
+
+/***************************************************************************
+ * mss_addindex:
+ *
+ * Add a sort key for each record described by an index that matches
+ * the selections, or all records if selections is NULL.  The data
+ * file is not read.
+ *
+ * Returns 0 on success and -1 on error.
+ ***************************************************************************/
+int
+mss_addindex (MSSort *sort, MSIndex *index, Selections *selections)
+{
+  MSIndexEntry *entry;
+  char srcname[50];
+  int64_t idx;
+  int32_t fileid;
+  int32_t srcid;
+
+  if (!sort || !index)
+    return -1;
+
+  if ((fileid = mss_fileid (sort, index->filename)) < 0)
+    return -1;
+
+  for (idx = 0; idx < index->entrycount; idx++)
+  {
+    entry = &index->entries[idx];
+
+    snprintf (srcname, sizeof (srcname), "%s_%s_%s_%s_%c",
+              entry->network, entry->station, entry->location,
+              entry->channel, entry->dataquality);
+
+    if (selections &&
+        !ms_matchselect (selections, srcname, entry->starttime,
+                         entry->endtime, NULL))
+      continue;
+
+    if ((srcid = mss_srcid (sort, srcname)) < 0 ||
+        mss_addkey (sort, srcid, fileid, entry->starttime,
+                    entry->offset, entry->reclen))
+      return -1;
+  }
+
+  return 0;
+} /* End of mss_addindex() */
+
+
+/***************************************************************************
+ * mss_readrecords:
+ *
+ * Read all records with a sort key in source name and time order.
+ * Each record is parsed, data samples are decoded if dataflag is true,
+ * and passed to record_handler() along with handlerdata.  Records that
+ * cannot be parsed are reported and skipped.  The keys are consumed,
+ * further keys may be added and read afterwards.
+ *
+ * Returns the number of records read on success and -1 on error.
+ ***************************************************************************/
+int64_t
+mss_readrecords (MSSort *sort,
+                 void (*record_handler) (MSRecord *, void *),
+                 void *handlerdata, flag dataflag)
+{
+  MSSortInput inputs[MSSORT_MAXOPEN];
+  MSSortCursor *cursors = NULL;
+  MSSortCursor **heap = NULL;
+  MSRecord *msr = NULL;
+  MSSortKey *key;
+  char *buffer = NULL;
+  int64_t count = 0;
+  int64_t idx;
+  int heapcount = 0;
+  int evict = 0;
+  int retcode;
+  int run;
+
+  if (!sort || !record_handler)
+    return -1;
+
+  for (idx = 0; idx < MSSORT_MAXOPEN; idx++)
+  {
+    inputs[idx].fileid = -1;
+    inputs[idx].fp = NULL;
+  }
+
+  if (sort->spool && fflush (sort->spool))
+  {
+    fprintf (stderr, "Error writing to spool file: %s\n", strerror (errno));
+    return -1;
+  }
+
+  if ((buffer = (char *)malloc (MAXRECLEN)) == NULL)
+  {
+    fprintf (stderr, "Cannot allocate memory for record buffer\n");
+    return -1;
+  }
+
+  /* Merge runs if any were spilled, including the keys in memory */
+  if (sort->runcount > 0)
+  {
+    if ((sort->keycount > 0 && mss_spill (sort)) || mss_rank (sort))
+    {
+      count = -1;
+      goto cleanup;
+    }
+
+    if (sort->verbose)
+      fprintf (stderr, "Merging %d sorted runs of %lld records\n",
+               sort->runcount, (long long int)sort->totalkeys);
+
+    cursors = (MSSortCursor *)calloc (sort->runcount, sizeof (MSSortCursor));
+    heap = (MSSortCursor **)calloc (sort->runcount, sizeof (MSSortCursor *));
+
+    if (!cursors || !heap)
+    {
+      fprintf (stderr, "Cannot allocate memory for merging\n");
+      count = -1;
+      goto cleanup;
+    }
+
+    for (run = 0; run < sort->runcount; run++)
+    {
+      cursors[run].fp = sort->runs[run];
+      cursors[run].remaining = sort->runcounts[run];
+
+      if ((cursors[run].keys = (MSSortKey *)malloc (MSSORT_RUNBUFFER * sizeof (MSSortKey))) == NULL)
+      {
+        fprintf (stderr, "Cannot allocate memory for merging\n");
+        count = -1;
+        goto cleanup;
+      }
+
+      rewind (cursors[run].fp);
+
+      if (mss_cursorfill (&cursors[run]))
+      {
+        count = -1;
+        goto cleanup;
+      }
+
+      if (cursors[run].count > 0)
+        heap[heapcount++] = &cursors[run];
+    }
+
+    for (run = heapcount / 2 - 1; run >= 0; run--)
+      mss_siftdown (sort, heap, heapcount, run);
+
+    /* Repeatedly take the lowest key from the run at the top of the heap */
+    while (heapcount > 0)
+    {
+      key = &heap[0]->keys[heap[0]->next++];
+
+      if ((retcode = mss_readrecord (sort, key, inputs, &evict, buffer, dataflag, &msr)) < 0)
+      {
+        count = -1;
+        goto cleanup;
+      }
+
+      if (retcode == 0)
+      {
+        record_handler (msr, handlerdata);
+        count++;
+      }
+
+      if (heap[0]->next >= heap[0]->count)
+      {
+        if (mss_cursorfill (heap[0]))
+        {
+          count = -1;
+          goto cleanup;
+        }
+
+        if (heap[0]->count == 0)
+          heap[0] = heap[--heapcount];
+      }
+
+      mss_siftdown (sort, heap, heapcount, 0);
+    }
+  }
+  /* Otherwise sort the keys in memory */
+  else if (sort->keycount > 0)
+  {
+    if (mss_rank (sort))
+    {
+      count = -1;
+      goto cleanup;
+    }
+
+    for (idx = 0; idx < sort->keycount; idx++)
+      sort->keys[idx].srcrank = sort->srcrank[sort->keys[idx].srcid];
+
+    qsort (sort->keys, (size_t)sort->keycount, sizeof (MSSortKey), mss_keycmp);
+
+    for (idx = 0; idx < sort->keycount; idx++)
+    {
+      if ((retcode = mss_readrecord (sort, &sort->keys[idx], inputs, &evict, buffer, dataflag, &msr)) < 0)
+      {
+        count = -1;
+        goto cleanup;
+      }
+
+      if (retcode == 0)
+      {
+        record_handler (msr, handlerdata);
+        count++;
+      }
+    }
+  }
+
+cleanup:
+  for (idx = 0; idx < MSSORT_MAXOPEN; idx++)
+    if (inputs[idx].fp)
+      fclose (inputs[idx].fp);
+
+  if (cursors)
+  {
+    for (run = 0; run < sort->runcount; run++)
+      free (cursors[run].keys);
+    free (cursors);
+  }
+
+  free (heap);
+  free (buffer);
+  msr_free (&msr);
+
+  /* Keys are consumed */
+  for (run = 0; run < sort->runcount; run++)
+    fclose (sort->runs[run]);
+
+  sort->runcount = 0;
+  sort->keycount = 0;
+  sort->totalkeys = 0;
+
+  return count;
+} /* End of mss_readrecords() */
+
+
+/***************************************************************************
+ * mss_free:
+ *
+ * Free all memory associated with external sort state, close and
+ * remove temporary files and set the pointer to NULL.
+ ***************************************************************************/
+void
+mss_free (MSSort **ppsort)
+{
+  MSSort *sort;
+  int32_t idx;
+
+  if (!ppsort || !*ppsort)
+    return;
+
+  sort = *ppsort;
+
+  for (idx = 0; idx < sort->srccount; idx++)
+    free (sort->srcnames[idx]);
+
+  for (idx = 0; idx < sort->filecount; idx++)
+    free (sort->filenames[idx]);
+
+  for (idx = 0; idx < sort->runcount; idx++)
+    fclose (sort->runs[idx]);
+
+  if (sort->spool)
+    fclose (sort->spool);
+
+  free (sort->srcnames);
+  free (sort->srcrank);
+  free (sort->srcnext);
+  free (sort->srchash);
+  free (sort->filenames);
+  free (sort->keys);
+  free (sort->runs);
+  free (sort->runcounts);
+  free (sort->tmpdir);
+  free (sort);
+
+  *ppsort = NULL;
+} /* End of mss_free() */
+
+
+/***************************************************************************
+ * mss_srcid:
+ *
+ * Find the ID of a source name, adding the name if not yet known.
+ *
+ * Returns the source ID on success and -1 on error.
+ ***************************************************************************/
+static int32_t
+mss_srcid (MSSort *sort, const char *srcname)
+{
+  uint32_t hash = mss_hash (srcname);
+  int32_t srcid;
+  int32_t idx;
+  void *ptr;
+
+  if (sort->hashsize > 0)
+  {
+    for (srcid = sort->srchash[hash & (sort->hashsize - 1)]; srcid >= 0;
+         srcid = sort->srcnext[srcid])
+      if (!strcmp (sort->srcnames[srcid], srcname))
+        return srcid;
+  }
+
+  /* Grow source name tables */
+  if (sort->srccount >= sort->srcmax)
+  {
+    sort->srcmax = (sort->srcmax) ? sort->srcmax * 2 : MSSORT_HASHSIZE;
+
+    if ((ptr = realloc (sort->srcnames, sort->srcmax * sizeof (char *))) == NULL)
+      goto memerror;
+    sort->srcnames = (char **)ptr;
+
+    if ((ptr = realloc (sort->srcrank, sort->srcmax * sizeof (int32_t))) == NULL)
+      goto memerror;
+    sort->srcrank = (int32_t *)ptr;
+
+    if ((ptr = realloc (sort->srcnext, sort->srcmax * sizeof (int32_t))) == NULL)
+      goto memerror;
+    sort->srcnext = (int32_t *)ptr;
+  }
+
+  if ((sort->srcnames[sort->srccount] = strdup (srcname)) == NULL)
+    goto memerror;
+
+  srcid = sort->srccount++;
+
+  /* Rebuild hash table with as many buckets as source name slots */
+  if (sort->hashsize < sort->srcmax)
+  {
+    free (sort->srchash);
+
+    sort->hashsize = sort->srcmax;
+    if ((sort->srchash = (int32_t *)malloc (sort->hashsize * sizeof (int32_t))) == NULL)
+    {
+      sort->hashsize = 0;
+      goto memerror;
+    }
+
+    for (idx = 0; idx < sort->hashsize; idx++)
+      sort->srchash[idx] = -1;
+
+    for (idx = 0; idx < sort->srccount; idx++)
+    {
+      hash = mss_hash (sort->srcnames[idx]) & (sort->hashsize - 1);
+      sort->srcnext[idx] = sort->srchash[hash];
+      sort->srchash[hash] = idx;
+    }
+  }
+  else
+  {
+    hash &= (sort->hashsize - 1);
+    sort->srcnext[srcid] = sort->srchash[hash];
+    sort->srchash[hash] = srcid;
+  }
+
+  return srcid;
+
+memerror:
+  fprintf (stderr, "Cannot allocate memory for source names\n");
+  return -1;
+} /* End of mss_srcid() */
+
+
+/***************************************************************************
+ * mss_fileid:
+ *
+ * Add a file name to the file table.
+ *
+ * Returns the file ID on success and -1 on error.
+ ***************************************************************************/
+static int32_t
+mss_fileid (MSSort *sort, const char *filename)
+{
+  void *ptr;
+
+  if (sort->filecount >= sort->filemax)
+  {
+    sort->filemax = (sort->filemax) ? sort->filemax * 2 : 16;
+
+    if ((ptr = realloc (sort->filenames, sort->filemax * sizeof (char *))) == NULL)
+    {
+      fprintf (stderr, "Cannot allocate memory for file names\n");
+      return -1;
+    }
+
+    sort->filenames = (char **)ptr;
+  }
+
+  if ((sort->filenames[sort->filecount] = strdup (filename)) == NULL)
+  {
+    fprintf (stderr, "Cannot allocate memory for file names\n");
+    return -1;
+  }
+
+  return sort->filecount++;
+} /* End of mss_fileid() */
+
+
+/***************************************************************************
+ * mss_addkey:
+ *
+ * Add a sort key, spilling the keys in memory to a sorted run when
+ * the memory budget is reached.
+ *
+ * Returns 0 on success and -1 on error.
+ ***************************************************************************/
+static int
+mss_addkey (MSSort *sort, int32_t srcid, int32_t fileid,
+            hptime_t starttime, int64_t offset, int32_t reclen)
+{
+  MSSortKey *key;
+  int64_t keyalloc;
+  void *ptr;
+
+  if (sort->keycount >= sort->keyalloc)
+  {
+    /* Spill keys when the memory budget is reached */
+    if (sort->keyalloc >= sort->keymax)
+    {
+      if (mss_spill (sort))
+        return -1;
+    }
+    else
+    {
+      keyalloc = (sort->keyalloc) ? sort->keyalloc * 2 : MSSORT_RUNBUFFER;
+      if (keyalloc > sort->keymax)
+        keyalloc = sort->keymax;
+
+      if ((ptr = realloc (sort->keys, (size_t)keyalloc * sizeof (MSSortKey))) == NULL)
+      {
+        fprintf (stderr, "Cannot allocate memory for sort keys\n");
+        return -1;
+      }
+
+      sort->keys = (MSSortKey *)ptr;
+      sort->keyalloc = keyalloc;
+    }
+  }
+
+  key = &sort->keys[sort->keycount++];
+  key->starttime = starttime;
+  key->offset = offset;
+  key->srcid = srcid;
+  key->fileid = fileid;
+  key->reclen = reclen;
+  key->srcrank = 0;
+
+  sort->totalkeys++;
+
+  return 0;
+} /* End of mss_addkey() */
+
+
+/***************************************************************************
+ * mss_spill:
+ *
+ * Sort the keys in memory and write them as a run to a temporary file.
+ *
+ * Returns 0 on success and -1 on error.
+ ***************************************************************************/
+static int
+mss_spill (MSSort *sort)
+{
+  void *ptr;
+  int64_t idx;
+  FILE *fp;
+
+  if (mss_rank (sort))
+    return -1;
+
+  for (idx = 0; idx < sort->keycount; idx++)
+    sort->keys[idx].srcrank = sort->srcrank[sort->keys[idx].srcid];
+
+  qsort (sort->keys, (size_t)sort->keycount, sizeof (MSSortKey), mss_keycmp);
+
+  if ((fp = mss_tmpfile (sort)) == NULL)
+    return -1;
+
+  if (fwrite (sort->keys, sizeof (MSSortKey), (size_t)sort->keycount, fp) != (size_t)sort->keycount ||
+      fflush (fp))
+  {
+    fprintf (stderr, "Error writing sorted run: %s\n", strerror (errno));
+    fclose (fp);
+    return -1;
+  }
+
+  if ((ptr = realloc (sort->runs, (sort->runcount + 1) * sizeof (FILE *))) == NULL)
+  {
+    fprintf (stderr, "Cannot allocate memory for sorted runs\n");
+    fclose (fp);
+    return -1;
+  }
+  sort->runs = (FILE **)ptr;
+
+  if ((ptr = realloc (sort->runcounts, (sort->runcount + 1) * sizeof (int64_t))) == NULL)
+  {
+    fprintf (stderr, "Cannot allocate memory for sorted runs\n");
+    fclose (fp);
+    return -1;
+  }
+  sort->runcounts = (int64_t *)ptr;
+
+  sort->runs[sort->runcount] = fp;
+  sort->runcounts[sort->runcount] = sort->keycount;
+  sort->runcount++;
+
+  if (sort->verbose > 1)
+    fprintf (stderr, "Spilled sorted run of %lld records\n", (long long int)sort->keycount);
+
+  sort->keycount = 0;
+
+  return 0;
+} /* End of mss_spill() */
+
+
+/***************************************************************************
+ * mss_rank:
+ *
+ * Determine the rank of each source name in alphanumeric order.
+ *
+ * Returns 0 on success and -1 on error.
+ ***************************************************************************/
+static int
+mss_rank (MSSort *sort)
+{
+  MSSortName *names;
+  int32_t idx;
+
+  if (sort->srccount <= 0)
+    return 0;
+
+  if ((names = (MSSortName *)malloc (sort->srccount * sizeof (MSSortName))) == NULL)
+  {
+    fprintf (stderr, "Cannot allocate memory for source names\n");
+    return -1;
+  }
+
+  for (idx = 0; idx < sort->srccount; idx++)
+  {
+    names[idx].srcname = sort->srcnames[idx];
+    names[idx].srcid = idx;
+  }
+
+  qsort (names, sort->srccount, sizeof (MSSortName), mss_namecmp);
+
+  for (idx = 0; idx < sort->srccount; idx++)
+    sort->srcrank[names[idx].srcid] = idx;
+
+  free (names);
+
+  return 0;
+} /* End of mss_rank() */
+
+
+/***************************************************************************
+ * mss_tmpfile:
+ *
+ * Create a temporary file, in the temporary directory if specified.
+ * The file is removed from the file system immediately and is
+ * deleted when closed.
+ *
+ * Returns an open file on success and NULL on error.
+ ***************************************************************************/
+static FILE *
+mss_tmpfile (MSSort *sort)
+{
+  FILE *fp = NULL;
+#if !defined(LMP_WIN32)
+  char path[1024];
+  int fd;
+
+  if (sort->tmpdir)
+  {
+    snprintf (path, sizeof (path), "%s/mseed2ascii-XXXXXX", sort->tmpdir);
+
+    if ((fd = mkstemp (path)) < 0)
+    {
+      fprintf (stderr, "Cannot create temporary file in %s: %s\n",
+               sort->tmpdir, strerror (errno));
+      return NULL;
+    }
+
+    unlink (path);
+
+    if ((fp = fdopen (fd, "w+b")) == NULL)
+    {
+      fprintf (stderr, "Cannot open temporary file: %s\n", strerror (errno));
+      close (fd);
+    }
+
+    return fp;
+  }
+#endif
+
+  if ((fp = tmpfile ()) == NULL)
+    fprintf (stderr, "Cannot create temporary file: %s\n", strerror (errno));
+
+  return fp;
+} /* End of mss_tmpfile() */
+
+
+/***************************************************************************
+ * mss_namecmp:
+ *
+ * Compare two source names for qsort().
+ ***************************************************************************/
+static int
+mss_namecmp (const void *a, const void *b)
+{
+  return strcmp (((const MSSortName *)a)->srcname, ((const MSSortName *)b)->srcname);
+} /* End of mss_namecmp() */
+
+
+/***************************************************************************
+ * mss_keycmp:
+ *
+ * Compare two sort keys for qsort() on source name rank, start time,
+ * file and offset.  Records with the same start time are kept in the
+ * order they were read.
+ ***************************************************************************/
+static int
+mss_keycmp (const void *a, const void *b)
+{
+  const MSSortKey *ka = (const MSSortKey *)a;
+  const MSSortKey *kb = (const MSSortKey *)b;
+
+  if (ka->srcrank != kb->srcrank)
+    return (ka->srcrank < kb->srcrank) ? -1 : 1;
+
+  if (ka->starttime != kb->starttime)
+    return (ka->starttime < kb->starttime) ? -1 : 1;
+
+  if (ka->fileid != kb->fileid)
+    return (ka->fileid < kb->fileid) ? -1 : 1;
+
+  if (ka->offset != kb->offset)
+    return (ka->offset < kb->offset) ? -1 : 1;
+
+  return 0;
+} /* End of mss_keycmp() */
+
+
+/***************************************************************************
+ * mss_cursorfill:
+ *
+ * Read the next keys of a run into the cursor buffer.  The count is
+ * zero when the run is exhausted.
+ *
+ * Returns 0 on success and -1 on error.
+ ***************************************************************************/
+static int
+mss_cursorfill (MSSortCursor *cursor)
+{
+  size_t count;
+
+  count = (cursor->remaining < MSSORT_RUNBUFFER) ? (size_t)cursor->remaining : MSSORT_RUNBUFFER;
+
+  if (count > 0 && fread (cursor->keys, sizeof (MSSortKey), count, cursor->fp) != count)
+  {
+    fprintf (stderr, "Error reading sorted run: %s\n", strerror (errno));
+    return -1;
+  }
+
+  cursor->remaining -= count;
+  cursor->count = (int)count;
+  cursor->next = 0;
+
+  return 0;
+} /* End of mss_cursorfill() */
+
+
+/***************************************************************************
+ * mss_cursorcmp:
+ *
+ * Compare the next keys of two run cursors, source names are compared
+ * using the final ranks as ranks stored in runs may be out of date.
+ *
+ * Returns negative, zero or positive as for mss_keycmp().
+ ***************************************************************************/
+static int
+mss_cursorcmp (MSSort *sort, MSSortCursor *a, MSSortCursor *b)
+{
+  MSSortKey ka = a->keys[a->next];
+  MSSortKey kb = b->keys[b->next];
+
+  ka.srcrank = sort->srcrank[ka.srcid];
+  kb.srcrank = sort->srcrank[kb.srcid];
+
+  return mss_keycmp (&ka, &kb);
+} /* End of mss_cursorcmp() */
+
+
+/***************************************************************************
+ * mss_siftdown:
+ *
+ * Move a run cursor down a heap of cursors to restore the heap order.
+ ***************************************************************************/
+static void
+mss_siftdown (MSSort *sort, MSSortCursor **heap, int count, int idx)
+{
+  MSSortCursor *cursor;
+  int child;
+
+  while ((child = 2 * idx + 1) < count)
+  {
+    if (child + 1 < count && mss_cursorcmp (sort, heap[child + 1], heap[child]) < 0)
+      child++;
+
+    if (mss_cursorcmp (sort, heap[idx], heap[child]) <= 0)
+      break;
+
+    cursor = heap[idx];
+    heap[idx] = heap[child];
+    heap[child] = cursor;
+    idx = child;
+  }
+} /* End of mss_siftdown() */
+
+
+/***************************************************************************
+ * mss_readrecord:
+ *
+ * Read and parse the record described by a sort key, decoding data
+ * samples if dataflag is true.  Up to
+ * MSSORT_MAXOPEN input files are kept open, when more are needed they
+ * are closed in turn starting at the evict index.  A file is only
+ * positioned when the record does not follow the last one read.
+ *
+ * Returns 0 on success, 1 if the record cannot be parsed and should be
+ * skipped and -1 on error.
+ ***************************************************************************/
+static int
+mss_readrecord (MSSort *sort, MSSortKey *key, MSSortInput *inputs,
+                int *evict, char *buffer, flag dataflag,
+                MSRecord **ppmsr)
+{
+  MSSortInput *input = NULL;
+  MSSortInput spool;
+  int idx;
+  int retcode;
+
+  if (key->reclen <= 0 || key->reclen > MAXRECLEN)
+  {
+    fprintf (stderr, "Invalid record length %d in %s\n", key->reclen,
+             sort->filenames[key->fileid]);
+    return -1;
+  }
+
+  if (key->fileid == sort->spoolid)
+  {
+    spool.fileid = sort->spoolid;
+    spool.fp = sort->spool;
+    spool.filepos = -1;
+    input = &spool;
+  }
+  else
+  {
+    for (idx = 0; idx < MSSORT_MAXOPEN; idx++)
+    {
+      if (inputs[idx].fileid == key->fileid)
+      {
+        input = &inputs[idx];
+        break;
+      }
+    }
+  }
+
+  /* Open the file, closing another if too many are open */
+  if (!input)
+  {
+    for (idx = 0; idx < MSSORT_MAXOPEN; idx++)
+    {
+      if (inputs[idx].fileid < 0)
+        break;
+    }
+
+    if (idx >= MSSORT_MAXOPEN)
+    {
+      idx = *evict;
+      *evict = (*evict + 1) % MSSORT_MAXOPEN;
+
+      fclose (inputs[idx].fp);
+      inputs[idx].fp = NULL;
+      inputs[idx].fileid = -1;
+    }
+
+    input = &inputs[idx];
+
+    if ((input->fp = fopen (sort->filenames[key->fileid], "rb")) == NULL)
+    {
+      fprintf (stderr, "Cannot open file: %s (%s)\n",
+               sort->filenames[key->fileid], strerror (errno));
+      return -1;
+    }
+
+    input->fileid = key->fileid;
+    input->filepos = 0;
+  }
+
+  if (input->filepos != key->offset &&
+      lmp_fseeko (input->fp, (off_t)key->offset, SEEK_SET))
+  {
+    fprintf (stderr, "Error seeking to offset %lld of %s\n",
+             (long long int)key->offset, sort->filenames[key->fileid]);
+    return -1;
+  }
+
+  if (fread (buffer, key->reclen, 1, input->fp) != 1)
+  {
+    fprintf (stderr, "Error reading %d bytes at offset %lld of %s\n",
+             key->reclen, (long long int)key->offset, sort->filenames[key->fileid]);
+    return -1;
+  }
+
+  input->filepos = key->offset + key->reclen;
+
+  retcode = msr_parse (buffer, key->reclen, ppmsr, key->reclen, dataflag, sort->verbose - 1);
+
+  if (retcode != MS_NOERROR)
+  {
+    fprintf (stderr, "Error parsing record at offset %lld of %s: %s\n",
+             (long long int)key->offset, sort->filenames[key->fileid],
+             ms_errorstr (retcode));
+    return 1;
+  }
+
+  return 0;
+} /* End of mss_readrecord() */
+
+
+/***************************************************************************
+ * mss_hash:
+ *
+ * Calculate a 32-bit FNV-1a hash of a source name.
+ *
+ * Returns hash value.
+ ***************************************************************************/
+static uint32_t
+mss_hash (const char *srcname)
+{
+  uint32_t hash = 2166136261U;
+
+  while (*srcname)
+  {
+    hash ^= (uint8_t)*srcname++;
+    hash *= 16777619U;
+  }
+
+  return hash;
+} /* End of mss_hash() */
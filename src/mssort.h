@@ -0,0 +1,81 @@
+/***************************************************************************
+ * mssort.h
+ *
+ * Interface declarations for the external sort of miniSEED records in
+ * mssort.c
+ *
+ * Records from any number of input files are described by compact
+ * sort keys: source name, start time, file and byte offset.  The keys
+ * are sorted in runs limited by a memory budget, runs exceeding the
+ * budget are spilled to temporary files.  The runs are merged and the
+ * records read and delivered in source name and time order.
+ ***************************************************************************/
+
+#ifndef MSSORT_H
+#define MSSORT_H 1
+
+#include <stdio.h>
+#include <libmseed.h>
+
+#include "msindex.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Default memory budget for sort keys in bytes */
+#define MSSORT_DEFMEMORY 67108864
+
+/* Sort key for a single record, layout is written directly to run files */
+typedef struct MSSortKey_s
+{
+  hptime_t starttime;       /* Time of first sample */
+  int64_t  offset;          /* Byte offset of record in file */
+  int32_t  srcid;           /* Index into source name table */
+  int32_t  fileid;          /* Index into file table */
+  int32_t  reclen;          /* Record length in bytes */
+  int32_t  srcrank;         /* Rank of source name while sorting a run */
+} MSSortKey;
+
+/* External sort state */
+typedef struct MSSort_s
+{
+  char     **srcnames;      /* Source names by source ID */
+  int32_t   *srcrank;       /* Sort rank of each source ID */
+  int32_t   *srcnext;       /* Next source ID in hash bucket chain */
+  int32_t   *srchash;       /* Hash buckets of source IDs, -1 is empty */
+  int32_t    srccount;      /* Number of source names */
+  int32_t    srcmax;        /* Allocated source name slots */
+  int32_t    hashsize;      /* Number of hash buckets, power of 2 */
+  char     **filenames;     /* File names by file ID */
+  int32_t    filecount;     /* Number of files */
+  int32_t    filemax;       /* Allocated file name slots */
+  int32_t    spoolid;       /* File ID of the spool file, -1 if none */
+  FILE      *spool;         /* Spool for records without usable offsets */
+  int64_t    spoolsize;     /* Bytes written to spool */
+  MSSortKey *keys;          /* Keys held in memory */
+  int64_t    keycount;      /* Number of keys held in memory */
+  int64_t    keyalloc;      /* Allocated key slots */
+  int64_t    keymax;        /* Keys held in memory before spilling a run */
+  FILE     **runs;          /* Spilled runs of sorted keys */
+  int64_t   *runcounts;     /* Number of keys in each run */
+  int        runcount;      /* Number of spilled runs */
+  int64_t    totalkeys;     /* Total keys added */
+  char      *tmpdir;        /* Directory for temporary files, NULL for default */
+  int        verbose;       /* Verbosity level */
+} MSSort;
+
+extern MSSort  *mss_init (const char *tmpdir, int64_t memory, int verbose);
+extern int      mss_addfile (MSSort *sort, const char *msfile, int reclen,
+                             Selections *selections);
+extern int      mss_addindex (MSSort *sort, MSIndex *index, Selections *selections);
+extern int64_t  mss_readrecords (MSSort *sort,
+                                 void (*record_handler) (MSRecord *, void *),
+                                 void *handlerdata, flag dataflag);
+extern void     mss_free (MSSort **ppsort);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* MSSORT_H */
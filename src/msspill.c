@@ -0,0 +1,586 @@
+/***************************************************************************
+ * msspill.c
+ *
+ * Routines to hold the decoded samples of trace segments within a
+ * memory budget.
+ *
+ * The samples added to each segment are accounted for and the
+ * segments are ranked by when they were last extended.  When the
+ * samples in memory exceed the budget the samples of the least
+ * recently extended segments are appended to an extent of the
+ * segment in a temporary spill file and released from memory.
+ * Extents are grown by doubling, relocating within the spill file,
+ * so that the spilled samples of a segment are always contiguous.
+ * For writing, the remaining samples in memory are also spilled and
+ * the extent is memory-mapped as the sample buffer of the segment.
+ *
+ * The spill file is removed from the file system as soon as it is
+ * created and disappears when closed.  Not available on Windows.
+ ***************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+#include "msspill.h"
+
+#if !defined(LMP_WIN32)
+#include <unistd.h>
+#include <sys/mman.h>
+#endif
+
+/* Minimum size of a segment extent in the spill file */
+#define MSSPILL_MINEXTENT 65536
+
+/* Size of buffer for relocating extents */
+#define MSSPILL_COPYSIZE 1048576
+
+#if !defined(LMP_WIN32)
+static int msp_spillcold (MSSpill *spill, MSTraceList *mstl);
+static int msp_spillseg (MSSpill *spill, MSTraceSeg *seg);
+static int msp_unspill (MSSpill *spill, MSTraceSeg *seg, int64_t prepended);
+static int msp_opentmp (MSSpill *spill);
+static int msp_pwrite (int fd, const void *buffer, size_t size, int64_t offset);
+static int msp_pread (int fd, void *buffer, size_t size, int64_t offset);
+static int msp_usecmp (const void *a, const void *b);
+#endif
+
+
+/***************************************************************************
+ * msp_init:
+ *
+ * Initialize a sample memory budget of maxmemory bytes.  The spill
+ * file is created in tmpdir when first needed, or in the directory
+ * specified by the TMPDIR environment variable or /tmp if tmpdir is
+ * NULL.
+ *
+ * Returns a new MSSpill on success and NULL on error.
+ ***************************************************************************/
+MSSpill *
+msp_init (const char *tmpdir, int64_t maxmemory, int verbose)
+{
+#if defined(LMP_WIN32)
+  fprintf (stderr, "Sample memory budget is not supported on this platform\n");
+  return NULL;
+#else
+  MSSpill *spill;
+
+  if ((spill = (MSSpill *)calloc (1, sizeof (MSSpill))) == NULL)
+  {
+    fprintf (stderr, "Cannot allocate memory for spill state\n");
+    return NULL;
+  }
+
+  if (tmpdir && (spill->tmpdir = strdup (tmpdir)) == NULL)
+  {
+    fprintf (stderr, "Cannot allocate memory for spill state\n");
+    free (spill);
+    return NULL;
+  }
+
+  spill->fd = -1;
+  spill->maxmemory = maxmemory;
+  spill->verbose = verbose;
+
+  return spill;
+#endif
+} /* End of msp_init() */
+
+
+/***************************************************************************
+ * msp_addrecord:
+ *
+ * Account for the samples of a record added to a trace segment with
+ * mstl_addmsr() and spill the least recently extended segments of the
+ * MSTraceList if the memory budget is exceeded.
+ *
+ * Samples of a record that were added to the beginning of a segment
+ * with spilled samples precede the spilled samples, in this case the
+ * spilled samples are read back into memory.
+ *
+ * Returns 0 on success and -1 on error.
+ ***************************************************************************/
+int
+msp_addrecord (MSSpill *spill, MSTraceList *mstl, MSTraceSeg *seg, MSRecord *msr)
+{
+#if defined(LMP_WIN32)
+  return -1;
+#else
+  MSSpillSeg *sseg;
+
+  if (!spill || !mstl || !seg || !msr)
+    return -1;
+
+  if ((sseg = (MSSpillSeg *)seg->prvtptr) == NULL)
+  {
+    if ((sseg = (MSSpillSeg *)calloc (1, sizeof (MSSpillSeg))) == NULL)
+    {
+      fprintf (stderr, "Cannot allocate memory for spill state\n");
+      return -1;
+    }
+
+    sseg->offset = -1;
+    seg->prvtptr = sseg;
+  }
+
+  sseg->lastuse = ++spill->usecount;
+  spill->memory += msr->numsamples * ms_samplesize (msr->sampletype);
+
+  /* Record was added to the beginning of a segment with spilled samples */
+  if (sseg->spilled > 0 && seg->starttime != sseg->starttime)
+  {
+    if (msp_unspill (spill, seg, msr->numsamples))
+      return -1;
+  }
+
+  if (spill->memory > spill->maxmemory)
+    return msp_spillcold (spill, mstl);
+
+  return 0;
+#endif
+} /* End of msp_addrecord() */
+
+
+/***************************************************************************
+ * msp_map:
+ *
+ * Prepare a segment for writing.  If samples of the segment were
+ * spilled the samples still in memory are also spilled and the
+ * extent is mapped as the sample buffer of the segment.  The segment
+ * must be released with msp_release() after writing.
+ *
+ * Returns 0 on success and -1 on error.
+ ***************************************************************************/
+int
+msp_map (MSSpill *spill, MSTraceSeg *seg)
+{
+#if defined(LMP_WIN32)
+  return -1;
+#else
+  MSSpillSeg *sseg;
+  void *map;
+  size_t length;
+
+  if (!spill || !seg)
+    return -1;
+
+  if ((sseg = (MSSpillSeg *)seg->prvtptr) == NULL || sseg->spilled == 0)
+    return 0;
+
+  if (seg->numsamples > 0 && msp_spillseg (spill, seg))
+    return -1;
+
+  length = (size_t)(sseg->spilled * ms_samplesize (seg->sampletype));
+
+  /* A private mapping allows in-place modification, e.g. scaling */
+  map = mmap (NULL, length, PROT_READ | PROT_WRITE, MAP_PRIVATE, spill->fd, (off_t)sseg->offset);
+
+  if (map == MAP_FAILED)
+  {
+    fprintf (stderr, "Cannot map %lld bytes of spill file: %s\n",
+             (long long int)length, strerror (errno));
+    return -1;
+  }
+
+#if defined(MADV_SEQUENTIAL)
+  madvise (map, length, MADV_SEQUENTIAL);
+#endif
+
+  sseg->map = map;
+  sseg->maplength = length;
+
+  seg->datasamples = map;
+  seg->numsamples = sseg->spilled;
+
+  return 0;
+#endif
+} /* End of msp_map() */
+
+
+/***************************************************************************
+ * msp_release:
+ *
+ * Release the samples of a segment after it has been written, either
+ * unmapping the extent or freeing the samples in memory.
+ ***************************************************************************/
+void
+msp_release (MSSpill *spill, MSTraceSeg *seg)
+{
+#if !defined(LMP_WIN32)
+  MSSpillSeg *sseg;
+
+  if (!spill || !seg)
+    return;
+
+  sseg = (MSSpillSeg *)seg->prvtptr;
+
+  if (sseg && sseg->map)
+  {
+    munmap (sseg->map, sseg->maplength);
+    sseg->map = NULL;
+    sseg->maplength = 0;
+  }
+  else if (seg->datasamples)
+  {
+    spill->memory -= seg->numsamples * ms_samplesize (seg->sampletype);
+    free (seg->datasamples);
+  }
+
+  seg->datasamples = NULL;
+  seg->numsamples = 0;
+#endif
+} /* End of msp_release() */
+
+
+/***************************************************************************
+ * msp_free:
+ *
+ * Close the spill file, free all memory associated with a MSSpill
+ * and set the pointer to NULL.
+ ***************************************************************************/
+void
+msp_free (MSSpill **ppspill)
+{
+  if (!ppspill || !*ppspill)
+    return;
+
+#if !defined(LMP_WIN32)
+  if ((*ppspill)->verbose && (*ppspill)->spillcount > 0)
+    fprintf (stderr, "Spilled samples %lld times, %lld bytes\n",
+             (long long int)(*ppspill)->spillcount,
+             (long long int)(*ppspill)->spillbytes);
+
+  if ((*ppspill)->fd >= 0)
+    close ((*ppspill)->fd);
+#endif
+
+  free ((*ppspill)->tmpdir);
+  free (*ppspill);
+
+  *ppspill = NULL;
+} /* End of msp_free() */
+
+
+#if !defined(LMP_WIN32)
+/***************************************************************************
+ * msp_spillcold:
+ *
+ * Spill the samples of the least recently extended segments until the
+ * samples in memory are below three quarters of the budget, leaving
+ * room to grow before spilling again.
+ *
+ * Returns 0 on success and -1 on error.
+ ***************************************************************************/
+static int
+msp_spillcold (MSSpill *spill, MSTraceList *mstl)
+{
+  MSTraceID *id;
+  MSTraceSeg *seg;
+  MSTraceSeg **segs;
+  int64_t count = 0;
+  int64_t idx;
+  int64_t target;
+
+  for (id = mstl->traces; id; id = id->next)
+    for (seg = id->first; seg; seg = seg->next)
+      if (seg->numsamples > 0 && seg->prvtptr)
+        count++;
+
+  if (count == 0)
+    return 0;
+
+  if ((segs = (MSTraceSeg **)malloc ((size_t)count * sizeof (MSTraceSeg *))) == NULL)
+  {
+    fprintf (stderr, "Cannot allocate memory for spilling\n");
+    return -1;
+  }
+
+  count = 0;
+  for (id = mstl->traces; id; id = id->next)
+    for (seg = id->first; seg; seg = seg->next)
+      if (seg->numsamples > 0 && seg->prvtptr)
+        segs[count++] = seg;
+
+  qsort (segs, (size_t)count, sizeof (MSTraceSeg *), msp_usecmp);
+
+  target = spill->maxmemory - spill->maxmemory / 4;
+
+  for (idx = 0; idx < count && spill->memory > target; idx++)
+  {
+    if (msp_spillseg (spill, segs[idx]))
+    {
+      free (segs);
+      return -1;
+    }
+  }
+
+  if (spill->verbose > 1)
+    fprintf (stderr, "Spilled %lld segment(s), %lld bytes of samples in memory\n",
+             (long long int)idx, (long long int)spill->memory);
+
+  free (segs);
+
+  return 0;
+} /* End of msp_spillcold() */
+
+
+/***************************************************************************
+ * msp_spillseg:
+ *
+ * Append the samples of a segment in memory to its extent in the
+ * spill file and free them.  An extent that is too small is
+ * relocated to the end of the spill file with double the size.
+ *
+ * Returns 0 on success and -1 on error.
+ ***************************************************************************/
+static int
+msp_spillseg (MSSpill *spill, MSTraceSeg *seg)
+{
+  MSSpillSeg *sseg = (MSSpillSeg *)seg->prvtptr;
+  char *buffer;
+  int64_t samplesize;
+  int64_t used;
+  int64_t size;
+  int64_t capacity;
+  int64_t offset;
+  int64_t copied;
+  int64_t pagesize;
+  size_t chunk;
+
+  if (!sseg || seg->numsamples <= 0 || !seg->datasamples)
+    return 0;
+
+  if (spill->fd < 0 && msp_opentmp (spill))
+    return -1;
+
+  samplesize = ms_samplesize (seg->sampletype);
+  used = sseg->spilled * samplesize;
+  size = seg->numsamples * samplesize;
+
+  /* Relocate extent to the end of the file if too small */
+  if (sseg->offset < 0 || used + size > sseg->capacity)
+  {
+    pagesize = (int64_t)sysconf (_SC_PAGESIZE);
+
+    capacity = (sseg->capacity > MSSPILL_MINEXTENT / 2) ? sseg->capacity * 2 : MSSPILL_MINEXTENT;
+    if (capacity < used + size)
+      capacity = used + size;
+
+    /* Extents are page aligned for mapping */
+    capacity = (capacity + pagesize - 1) / pagesize * pagesize;
+    offset = spill->filesize;
+
+    if (used > 0)
+    {
+      if ((buffer = (char *)malloc (MSSPILL_COPYSIZE)) == NULL)
+      {
+        fprintf (stderr, "Cannot allocate memory for spilling\n");
+        return -1;
+      }
+
+      for (copied = 0; copied < used; copied += chunk)
+      {
+        chunk = (used - copied < MSSPILL_COPYSIZE) ? (size_t)(used - copied) : MSSPILL_COPYSIZE;
+
+        if (msp_pread (spill->fd, buffer, chunk, sseg->offset + copied) ||
+            msp_pwrite (spill->fd, buffer, chunk, offset + copied))
+        {
+          free (buffer);
+          return -1;
+        }
+      }
+
+      free (buffer);
+    }
+
+    spill->filesize += capacity;
+    sseg->offset = offset;
+    sseg->capacity = capacity;
+  }
+
+  if (msp_pwrite (spill->fd, seg->datasamples, (size_t)size, sseg->offset + used))
+    return -1;
+
+  sseg->spilled += seg->numsamples;
+  sseg->starttime = seg->starttime;
+
+  spill->memory -= size;
+  spill->spillcount++;
+  spill->spillbytes += size;
+
+  free (seg->datasamples);
+  seg->datasamples = NULL;
+  seg->numsamples = 0;
+
+  return 0;
+} /* End of msp_spillseg() */
+
+
+/***************************************************************************
+ * msp_unspill:
+ *
+ * Read the spilled samples of a segment back into memory after the
+ * specified number of samples were added to the beginning of the
+ * segment.  The samples in memory are then the prepended samples
+ * followed by the samples that were added after spilling.
+ *
+ * Returns 0 on success and -1 on error.
+ ***************************************************************************/
+static int
+msp_unspill (MSSpill *spill, MSTraceSeg *seg, int64_t prepended)
+{
+  MSSpillSeg *sseg = (MSSpillSeg *)seg->prvtptr;
+  char *samples;
+  int64_t samplesize;
+  int64_t total;
+
+  samplesize = ms_samplesize (seg->sampletype);
+  total = seg->numsamples + sseg->spilled;
+
+  if ((samples = (char *)malloc ((size_t)(total * samplesize))) == NULL)
+  {
+    fprintf (stderr, "Cannot allocate memory for spilled samples\n");
+    return -1;
+  }
+
+  memcpy (samples, seg->datasamples, (size_t)(prepended * samplesize));
+
+  if (msp_pread (spill->fd, samples + prepended * samplesize,
+                 (size_t)(sseg->spilled * samplesize), sseg->offset))
+  {
+    free (samples);
+    return -1;
+  }
+
+  memcpy (samples + (prepended + sseg->spilled) * samplesize,
+          (char *)seg->datasamples + prepended * samplesize,
+          (size_t)((seg->numsamples - prepended) * samplesize));
+
+  free (seg->datasamples);
+  seg->datasamples = samples;
+  seg->numsamples = total;
+
+  spill->memory += sseg->spilled * samplesize;
+
+  /* The extent is abandoned */
+  sseg->spilled = 0;
+  sseg->offset = -1;
+  sseg->capacity = 0;
+
+  return 0;
+} /* End of msp_unspill() */
+
+
+/***************************************************************************
+ * msp_opentmp:
+ *
+ * Create the spill file and remove it from the file system.
+ *
+ * Returns 0 on success and -1 on error.
+ ***************************************************************************/
+static int
+msp_opentmp (MSSpill *spill)
+{
+  char path[1024];
+  const char *dir = spill->tmpdir;
+
+  if (!dir && (dir = getenv ("TMPDIR")) == NULL)
+    dir = "/tmp";
+
+  snprintf (path, sizeof (path), "%s/mseed2ascii-XXXXXX", dir);
+
+  if ((spill->fd = mkstemp (path)) < 0)
+  {
+    fprintf (stderr, "Cannot create spill file in %s: %s\n", dir, strerror (errno));
+    return -1;
+  }
+
+  unlink (path);
+
+  if (spill->verbose)
+    fprintf (stderr, "Spilling samples to temporary file in %s\n", dir);
+
+  return 0;
+} /* End of msp_opentmp() */
+
+
+/***************************************************************************
+ * msp_pwrite:
+ *
+ * Write a buffer to the spill file at offset, retrying partial writes.
+ *
+ * Returns 0 on success and -1 on error.
+ ***************************************************************************/
+static int
+msp_pwrite (int fd, const void *buffer, size_t size, int64_t offset)
+{
+  ssize_t written;
+
+  while (size > 0)
+  {
+    if ((written = pwrite (fd, buffer, size, (off_t)offset)) < 0)
+    {
+      if (errno == EINTR)
+        continue;
+
+      fprintf (stderr, "Error writing spill file: %s\n", strerror (errno));
+      return -1;
+    }
+
+    buffer = (const char *)buffer + written;
+    size -= (size_t)written;
+    offset += written;
+  }
+
+  return 0;
+} /* End of msp_pwrite() */
+
+
+/***************************************************************************
+ * msp_pread:
+ *
+ * Read a buffer from the spill file at offset, retrying partial reads.
+ *
+ * Returns 0 on success and -1 on error.
+ ***************************************************************************/
+static int
+msp_pread (int fd, void *buffer, size_t size, int64_t offset)
+{
+  ssize_t nread;
+
+  while (size > 0)
+  {
+    if ((nread = pread (fd, buffer, size, (off_t)offset)) <= 0)
+    {
+      if (nread < 0 && errno == EINTR)
+        continue;
+
+      fprintf (stderr, "Error reading spill file: %s\n",
+               (nread < 0) ? strerror (errno) : "unexpected end of file");
+      return -1;
+    }
+
+    buffer = (char *)buffer + nread;
+    size -= (size_t)nread;
+    offset += nread;
+  }
+
+  return 0;
+} /* End of msp_pread() */
+
+
+/***************************************************************************
+ * msp_usecmp:
+ *
+ * Compare the last use of two segments for qsort(), least recent first.
+ ***************************************************************************/
+static int
+msp_usecmp (const void *a, const void *b)
+{
+  int64_t usea = ((MSSpillSeg *)(*(MSTraceSeg *const *)a)->prvtptr)->lastuse;
+  int64_t useb = ((MSSpillSeg *)(*(MSTraceSeg *const *)b)->prvtptr)->lastuse;
+
+  return (usea < useb) ? -1 : (usea > useb);
+} /* End of msp_usecmp() */
+#endif /* !LMP_WIN32 */
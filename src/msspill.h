@@ -0,0 +1,59 @@
+/***************************************************************************
+ * msspill.h
+ *
+ * Interface declarations for the sample memory budget routines in
+ * msspill.c
+ *
+ * Decoded samples of trace segments are accounted against a memory
+ * budget.  When the budget is exceeded the samples of the least
+ * recently extended segments are moved to a temporary spill file and
+ * mapped back into memory when the segment is written.
+ ***************************************************************************/
+
+#ifndef MSSPILL_H
+#define MSSPILL_H 1
+
+#include <libmseed.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Spill state of a trace segment, stored at the MSTraceSeg prvtptr */
+typedef struct MSSpillSeg_s
+{
+  int64_t  lastuse;         /* Use count when samples were last added */
+  int64_t  offset;          /* Offset of extent in spill file, -1 if none */
+  int64_t  capacity;        /* Size of extent in bytes */
+  int64_t  spilled;         /* Number of samples in extent */
+  hptime_t starttime;       /* Start time of segment when samples were spilled */
+  void    *map;             /* Mapping of extent while writing */
+  size_t   maplength;       /* Length of mapping */
+} MSSpillSeg;
+
+/* Sample memory budget state */
+typedef struct MSSpill_s
+{
+  int      fd;              /* Spill file descriptor, -1 until needed */
+  int64_t  filesize;        /* Size of spill file in bytes */
+  int64_t  memory;          /* Bytes of samples held in memory */
+  int64_t  maxmemory;       /* Memory budget for samples in bytes */
+  int64_t  usecount;        /* Count of samples additions */
+  int64_t  spillcount;      /* Number of segment spills */
+  int64_t  spillbytes;      /* Bytes of samples written to spill file */
+  char    *tmpdir;          /* Directory for spill file, NULL for default */
+  int      verbose;         /* Verbosity level */
+} MSSpill;
+
+extern MSSpill *msp_init (const char *tmpdir, int64_t maxmemory, int verbose);
+extern int      msp_addrecord (MSSpill *spill, MSTraceList *mstl,
+                               MSTraceSeg *seg, MSRecord *msr);
+extern int      msp_map (MSSpill *spill, MSTraceSeg *seg);
+extern void     msp_release (MSSpill *spill, MSTraceSeg *seg);
+extern void     msp_free (MSSpill **ppspill);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* MSSPILL_H */
@@ -0,0 +1,132 @@
+/***************************************************************************
+ * sacformat.h
+ *
+ * Definitions for the SAC binary file format, version 6.
+ *
+ * A SAC binary file is a fixed length header followed by the samples
+ * as 32-bit floats.  The header is 70 floats, 40 integers and 24
+ * strings of 8 characters, except the 16 character event name, all in
+ * the byte order of the samples.  Strings are padded with spaces and
+ * not terminated.  Header values that are not set hold the undefined
+ * value of their type.
+ ***************************************************************************/
+
+#ifndef SACFORMAT_H
+#define SACFORMAT_H 1
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define SACHEADERLEN   632     /* SAC header length in bytes */
+#define SACNUMFLOATS   70      /* Number of float header values */
+#define SACNUMINTS     40      /* Number of integer header values */
+#define SACNUMSTRS     24      /* Number of 8 character string slots */
+#define SACVERSION     6       /* Header version, nvhdr */
+
+/* Undefined header values */
+#define SUNDEF         -12345
+#define SFUNDEF        -12345.0
+#define SSUNDEF        "-12345  "
+
+/* Enumerated header values */
+#define ITIME          1       /* iftype: Time series file */
+#define IUNKN          5       /* idep: Unknown dependent variable */
+#define IB             9       /* iztype: Reference time is begin time */
+
+/* SAC binary header */
+struct SACHeader
+{
+  float    delta;           /* Sample period in seconds */
+  float    depmin;          /* Minimum value of samples */
+  float    depmax;          /* Maximum value of samples */
+  float    scale;           /* Multiplying scale factor of samples */
+  float    odelta;          /* Observed sample period */
+  float    b;               /* Begin time relative to reference time */
+  float    e;               /* End time relative to reference time */
+  float    o;               /* Event origin time */
+  float    a;               /* First arrival time */
+  float    fmt;             /* Internal */
+  float    t[10];           /* User defined time picks */
+  float    f;               /* Fini or end of event time */
+  float    resp[10];        /* Instrument response parameters */
+  float    stla;            /* Station latitude, degrees */
+  float    stlo;            /* Station longitude, degrees */
+  float    stel;            /* Station elevation, meters */
+  float    stdp;            /* Station depth, meters */
+  float    evla;            /* Event latitude */
+  float    evlo;            /* Event longitude */
+  float    evel;            /* Event elevation */
+  float    evdp;            /* Event depth */
+  float    mag;             /* Event magnitude */
+  float    user[10];        /* User defined values */
+  float    dist;            /* Station to event distance, km */
+  float    az;              /* Event to station azimuth */
+  float    baz;             /* Station to event azimuth */
+  float    gcarc;           /* Station to event great circle arc */
+  float    sb;              /* Internal */
+  float    sdelta;          /* Internal */
+  float    depmen;          /* Mean value of samples */
+  float    cmpaz;           /* Component azimuth, degrees clockwise from north */
+  float    cmpinc;          /* Component incident angle, degrees from vertical */
+  float    xminimum;        /* Minimum value of X, spectral files */
+  float    xmaximum;        /* Maximum value of X, spectral files */
+  float    yminimum;        /* Minimum value of Y, spectral files */
+  float    ymaximum;        /* Maximum value of Y, spectral files */
+  float    unused1[7];      /* Unused */
+
+  int32_t  nzyear;          /* Reference time, year */
+  int32_t  nzjday;          /* Reference time, day of year */
+  int32_t  nzhour;          /* Reference time, hour */
+  int32_t  nzmin;           /* Reference time, minute */
+  int32_t  nzsec;           /* Reference time, second */
+  int32_t  nzmsec;          /* Reference time, millisecond */
+  int32_t  nvhdr;           /* Header version */
+  int32_t  norid;           /* Origin ID */
+  int32_t  nevid;           /* Event ID */
+  int32_t  npts;            /* Number of samples */
+  int32_t  nsnpts;          /* Internal */
+  int32_t  nwfid;           /* Waveform ID */
+  int32_t  nxsize;          /* Spectral length, spectral files */
+  int32_t  nysize;          /* Spectral width, spectral files */
+  int32_t  unused2;         /* Unused */
+  int32_t  iftype;          /* Type of file */
+  int32_t  idep;            /* Type of dependent variable */
+  int32_t  iztype;          /* Reference time equivalence */
+  int32_t  unused3;         /* Unused */
+  int32_t  iinst;           /* Type of recording instrument */
+  int32_t  istreg;          /* Station geographic region */
+  int32_t  ievreg;          /* Event geographic region */
+  int32_t  ievtyp;          /* Type of event */
+  int32_t  iqual;           /* Quality of data */
+  int32_t  isynth;          /* Synthetic data flag */
+  int32_t  imagtyp;         /* Magnitude type */
+  int32_t  imagsrc;         /* Source of magnitude information */
+  int32_t  unused4[8];      /* Unused */
+  int32_t  leven;           /* Evenly spaced samples flag */
+  int32_t  lpspol;          /* Positive polarity flag */
+  int32_t  lovrok;          /* Overwrite permission flag */
+  int32_t  lcalda;          /* Calculate distance and azimuths flag */
+  int32_t  unused5;         /* Unused */
+
+  char     kstnm[8];        /* Station name */
+  char     kevnm[16];       /* Event name */
+  char     khole[8];        /* Location code */
+  char     ko[8];           /* Event origin time identification */
+  char     ka[8];           /* First arrival time identification */
+  char     kt[10][8];       /* User defined time pick identifications */
+  char     kf[8];           /* Fini identification */
+  char     kuser[3][8];     /* User defined strings */
+  char     kcmpnm[8];       /* Channel name */
+  char     knetwk[8];       /* Network name */
+  char     kdatrd[8];       /* Date data was read */
+  char     kinst[8];        /* Instrument name */
+};
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* SACFORMAT_H */